@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../data_structures/conn_table.h"
+#include "../lib/uthash.h"
+
+// Compares the fd-indexed connection table against a uthash table keyed by fd, as the server used to keep its users,
+// at several table sizes: inserting every connection, looking up random connections by handle (what delivering a
+// message to a room does for each receiver) and removing every connection. Connections use fds 0 to n - 1, like the
+// dense fds the kernel hands out.
+
+#define NUM_KEYS (1 << 22) // Number of random fds looked up, cycled through for longer runs
+
+// A connection in the uthash table, laid out like the server's users were
+struct hashed_conn
+{
+    int fd;
+    UT_hash_handle hh;
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Runs every operation on a uthash table of n connections and prints the time each took.
+ *
+ * @return  A checksum of the lookups, so they cannot be optimized away.
+ */
+static uintptr_t bench_uthash(long n, const int *keys, long lookups)
+{
+    struct hashed_conn *conns = calloc(n, sizeof(struct hashed_conn));
+    if (conns == NULL)
+        exit(EXIT_FAILURE);
+    struct hashed_conn *table = NULL;
+
+    double start = now_ns();
+    for (long i = 0; i < n; i++)
+    {
+        conns[i].fd = i;
+        HASH_ADD_INT(table, fd, &conns[i]);
+    }
+    double insert = now_ns() - start;
+
+    uintptr_t sum = 0;
+    start = now_ns();
+    for (long i = 0; i < lookups; i++)
+    {
+        struct hashed_conn *conn;
+        int fd = keys[i & (NUM_KEYS - 1)];
+        HASH_FIND_INT(table, &fd, conn);
+        sum += (uintptr_t)conn;
+    }
+    double lookup = now_ns() - start;
+
+    start = now_ns();
+    for (long i = 0; i < n; i++)
+        HASH_DEL(table, &conns[i]);
+    double remove = now_ns() - start;
+
+    printf("%-12s %9ld %10.1f %10.1f %10.1f\n", "uthash", n, insert / n, lookup / lookups, remove / n);
+    free(conns);
+
+    return sum;
+}
+
+/**
+ * Runs every operation on a connection table of n connections and prints the time each took.
+ *
+ * @return  A checksum of the lookups, so they cannot be optimized away.
+ */
+static uintptr_t bench_conn_table(long n, const int *keys, long lookups)
+{
+    // Stand-ins for the connections' state, which the table never dereferences
+    char *conns = malloc(n);
+    struct conn_table table;
+    if (conns == NULL || conn_table_init(&table) != 0)
+        exit(EXIT_FAILURE);
+
+    double start = now_ns();
+    for (long i = 0; i < n; i++)
+        if (conn_table_insert(&table, conn_handle_make(i, 1), conns + i) != 0)
+            exit(EXIT_FAILURE);
+    double insert = now_ns() - start;
+
+    uintptr_t sum = 0;
+    start = now_ns();
+    for (long i = 0; i < lookups; i++)
+        sum += (uintptr_t)conn_table_get(&table, conn_handle_make(keys[i & (NUM_KEYS - 1)], 1));
+    double lookup = now_ns() - start;
+
+    start = now_ns();
+    for (long i = 0; i < n; i++)
+        conn_table_remove(&table, conn_handle_make(i, 1));
+    double remove = now_ns() - start;
+
+    printf("%-12s %9ld %10.1f %10.1f %10.1f\n", "conn_table", n, insert / n, lookup / lookups, remove / n);
+    conn_table_free(&table);
+    free(conns);
+
+    return sum;
+}
+
+int main(int argc, char *argv[])
+{
+    long sizes[] = {1000, 100000, 1000000};
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    long lookups = 10000000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            sizes[0] = atol(optarg);
+            num_sizes = 1;
+            break;
+        case 'l':
+            lookups = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n connections (default: 1000, 100000 and 1000000)] [-l lookups]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (sizes[0] < 1 || sizes[0] > INT32_MAX || lookups < 1)
+    {
+        fprintf(stderr, "usage: %s [-n connections (default: 1000, 100000 and 1000000)] [-l lookups]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int *keys = malloc(NUM_KEYS * sizeof(int));
+    if (keys == NULL)
+        exit(EXIT_FAILURE);
+
+    uintptr_t sum = 0;
+    printf("%-12s %9s %10s %10s %10s (ns/operation)\n", "table", "entries", "insert", "lookup", "remove");
+    for (int s = 0; s < num_sizes; s++)
+    {
+        srand(1);
+        for (long i = 0; i < NUM_KEYS; i++)
+            keys[i] = rand() % sizes[s];
+
+        sum += bench_uthash(sizes[s], keys, lookups);
+        sum += bench_conn_table(sizes[s], keys, lookups);
+    }
+    free(keys);
+
+    return sum == 0;
+}
@@ -0,0 +1,256 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../types/messages/message.h"
+#include "../types/messages/name_message.h"
+#include "../utils/net_utils.h"
+
+// Measures how long the server takes to admit a storm of clients connecting at once, like after a deploy. Every client
+// starts connecting before any is served, and a client counts as admitted once the server has answered the name
+// message it sends as soon as its connection is established.
+
+#define STORM_TIMEOUT_MS 30000
+
+// A client of the storm
+struct storm_client
+{
+    int fd;
+    bool connected; // Whether the connection is established and the name message sent
+    bool admitted;  // Whether the server has replied
+    double started; // Time the client started connecting
+    char buf[64];
+    size_t buf_len;
+};
+
+/**
+ * Gets the current time of a monotonic clock in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Starts a non-blocking connection to the server.
+ *
+ * @return  The socket on success.
+ *          -1 on error.
+ */
+static int start_connect(struct addrinfo *addr)
+{
+    int fd = socket(addr->ai_family, addr->ai_socktype | SOCK_NONBLOCK, addr->ai_protocol);
+    if (fd == -1)
+        return -1;
+
+    if (connect(fd, addr->ai_addr, addr->ai_addrlen) == -1 && errno != EINPROGRESS)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Sends a client's name message once its connection is established.
+ *
+ * @return  0 on success.
+ *          -1 if the connection failed.
+ */
+static int send_name(struct storm_client *client, int index)
+{
+    int error;
+    socklen_t len = sizeof(error);
+    if (getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1 || error != 0)
+        return -1;
+
+    struct name_message msg;
+    snprintf(msg.name, sizeof(msg.name), "storm%d", index);
+    char *buf;
+    size_t buf_len;
+    if (name_message_serialize(&msg, &buf, &buf_len) != 0)
+        return -1;
+
+    // The message is tiny, so it fits in the empty send buffer of a new connection
+    ssize_t sent = send(client->fd, buf, buf_len, 0);
+    free(buf);
+    if (sent != (ssize_t)buf_len)
+        return -1;
+
+    client->connected = true;
+    return 0;
+}
+
+/**
+ * Reads what the server sent a client, and checks whether a whole reply has arrived.
+ *
+ * @return  1 if the client has been admitted.
+ *          0 if the reply is incomplete.
+ *          -1 if the connection was closed or failed.
+ */
+static int receive_reply(struct storm_client *client)
+{
+    ssize_t n = recv(client->fd, client->buf + client->buf_len, sizeof(client->buf) - client->buf_len, 0);
+    if (n == 0)
+        return -1;
+    if (n == -1)
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    client->buf_len += n;
+
+    if (client->buf_len < sizeof(TOTAL_MSG_LEN))
+        return 0;
+    TOTAL_MSG_LEN len;
+    memcpy(&len, client->buf, sizeof(len));
+    return client->buf_len >= ntohl(len) ? 1 : 0;
+}
+
+static void print_usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-n clients] [-h host] [-p port]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int num_clients = 10000;
+    const char *host = "127.0.0.1";
+    const char *port = PORT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            num_clients = atoi(optarg);
+            break;
+        case 'h':
+            host = optarg;
+            break;
+        case 'p':
+            port = optarg;
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (num_clients < 1)
+    {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *addr;
+    if (getaddrinfo(host, port, &hints, &addr) != 0)
+    {
+        fprintf(stderr, "failed to resolve %s:%s\n", host, port);
+        exit(EXIT_FAILURE);
+    }
+
+    struct storm_client *clients = calloc(num_clients, sizeof(struct storm_client));
+    double *latencies = calloc(num_clients, sizeof(double));
+    int epfd = epoll_create1(0);
+    if (clients == NULL || latencies == NULL || epfd == -1)
+    {
+        fprintf(stderr, "failed to allocate space for %d clients\n", num_clients);
+        exit(EXIT_FAILURE);
+    }
+
+    double start = now();
+    for (int i = 0; i < num_clients; i++)
+    {
+        clients[i].started = now();
+        if ((clients[i].fd = start_connect(addr)) == -1)
+        {
+            fprintf(stderr, "failed to start connecting client %d: %s (is the fd limit high enough?)\n", i,
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT, .data.u32 = i};
+        epoll_ctl(epfd, EPOLL_CTL_ADD, clients[i].fd, &ev);
+    }
+    freeaddrinfo(addr);
+
+    int admitted = 0;
+    int failed = 0;
+    while (admitted + failed < num_clients)
+    {
+        struct epoll_event events[256];
+        int n = epoll_wait(epfd, events, 256, STORM_TIMEOUT_MS);
+        if (n <= 0)
+        {
+            fprintf(stderr, "timed out with %d of %d clients admitted\n", admitted, num_clients);
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            int index = events[i].data.u32;
+            struct storm_client *client = &clients[index];
+
+            int result = 0;
+            if (!client->connected && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+            {
+                if ((result = send_name(client, index)) == 0)
+                {
+                    struct epoll_event ev = {.events = EPOLLIN, .data.u32 = index};
+                    epoll_ctl(epfd, EPOLL_CTL_MOD, client->fd, &ev);
+                }
+            }
+            else if (client->connected)
+                result = receive_reply(client);
+
+            if (result == 1)
+            {
+                client->admitted = true;
+                latencies[admitted++] = now() - client->started;
+            }
+            else if (result == -1)
+                failed++;
+
+            if (result != 0)
+                epoll_ctl(epfd, EPOLL_CTL_DEL, client->fd, NULL);
+        }
+    }
+    double elapsed = now() - start;
+
+    qsort(latencies, admitted, sizeof(double), compare_doubles);
+    printf("clients=%d admitted=%d failed=%d time=%.3fs admitted/s=%.0f", num_clients, admitted, failed, elapsed,
+           admitted / elapsed);
+    if (admitted > 0)
+        printf(" p50=%.1fms p99=%.1fms max=%.1fms", latencies[admitted / 2] * 1000,
+               latencies[admitted * 99 / 100] * 1000, latencies[admitted - 1] * 1000);
+    printf("\n");
+
+    for (int i = 0; i < num_clients; i++)
+        close(clients[i].fd);
+    close(epfd);
+    free(clients);
+    free(latencies);
+
+    return failed == 0 ? 0 : 1;
+}
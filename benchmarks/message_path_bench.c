@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../data_structures/buffer_pool.h"
+#include "../data_structures/outbound_queue.h"
+#include "../data_structures/shared_buffer.h"
+#include "../types/messages/chat_message.h"
+#include "../types/messages/message.h"
+#include "../types/messages/reply_message.h"
+#include "../utils/frame_parser.h"
+#include "../utils/net_utils.h"
+
+// Runs the server's message path in one thread over socket pairs, and counts the heap allocations it makes once warmed
+// up: chat messages are received with a frame parser, read in place, serialized into a shared buffer queued for every
+// recipient, and written out, and every few messages a reply is serialized into the sender's outbound queue. The path
+// runs once with every buffer coming from the heap, then once with the buffer pool. Exits with status 1 if the pooled
+// path allocates anything, so it doubles as a check that the steady state message path stays off the heap.
+
+#define BATCH 32         // Number of messages the sender writes at a time
+#define REPLY_INTERVAL 8 // Number of chat messages handled per reply queued for the sender
+
+void *__libc_malloc(size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long allocations;
+
+void *malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The connections of the simulated reactor
+struct bench_path
+{
+    int sender[2];        // The sender writes to sender[0], the reactor receives on sender[1]
+    int (*recipients)[2]; // The reactor writes to recipients[i][0], which the benchmark drains from recipients[i][1]
+    struct outbound_queue *queues;
+    int num_recipients;
+    struct frame_parser parser;
+    struct outbound_queue sender_queue;
+    char batch[BATCH * MSG_SIZE_LIMIT]; // BATCH serialized chat messages, written by the sender at once
+    size_t batch_len;
+    char drain[64 * 1024];
+    long handled;
+};
+
+/**
+ * Reads and discards everything waiting on a non-blocking socket.
+ */
+static void drain_socket(struct bench_path *path, int fd)
+{
+    while (recv(fd, path->drain, sizeof(path->drain), 0) > 0)
+        ;
+}
+
+/**
+ * Writes out an outbound queue and drains its peer, like a client reading everything it is sent.
+ */
+static void flush_queue(struct bench_path *path, struct outbound_queue *queue, int fd, int peer)
+{
+    while (queue->bytes > 0)
+    {
+        if (outbound_queue_flush(queue, fd) == -1)
+        {
+            perror("writev");
+            exit(EXIT_FAILURE);
+        }
+        drain_socket(path, peer);
+    }
+}
+
+/**
+ * Handles one chat message the way the server does.
+ */
+static void handle_chat(struct bench_path *path, char *frame, size_t len)
+{
+    struct chat_message_view msg;
+    if (chat_message_parse(frame, len, &msg) != 0)
+    {
+        fprintf(stderr, "received an invalid chat message\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t size = chat_message_view_size(&msg);
+    struct shared_buffer *buf = shared_buffer_alloc(size);
+    if (buf == NULL || chat_message_view_serialize_to(&msg, buf->data, size, &buf->len) != 0)
+        exit(EXIT_FAILURE);
+    for (int i = 0; i < path->num_recipients; i++)
+        if (outbound_queue_push(&path->queues[i], buf) != 0)
+            exit(EXIT_FAILURE);
+    shared_buffer_unref(buf);
+
+    if (++path->handled % REPLY_INTERVAL == 0)
+    {
+        struct reply_message reply;
+        snprintf(reply.reply, sizeof(reply.reply), "%ld messages handled", path->handled);
+        size_t reply_size = reply_message_size(&reply);
+        char *dst = outbound_queue_reserve(&path->sender_queue, reply_size);
+        size_t reply_len;
+        if (dst == NULL || reply_message_serialize_to(&reply, dst, reply_size, &reply_len) != 0)
+            exit(EXIT_FAILURE);
+        outbound_queue_commit(&path->sender_queue, reply_len);
+    }
+}
+
+/**
+ * Sends a batch of messages and runs them through the path, up to writing them to every recipient.
+ */
+static void run_batch(struct bench_path *path)
+{
+    if (sendall(path->sender[0], path->batch, path->batch_len) != (ssize_t)path->batch_len)
+        exit(EXIT_FAILURE);
+
+    int received = 0;
+    while (received < BATCH)
+    {
+        char *frame;
+        size_t len;
+        enum frame_status status = frame_parser_recv(&path->parser, path->sender[1], &frame, &len);
+        if (status == FRAME_INCOMPLETE)
+            continue;
+        if (status != FRAME_COMPLETE)
+        {
+            fprintf(stderr, "failed to receive a message\n");
+            exit(EXIT_FAILURE);
+        }
+        handle_chat(path, frame, len);
+        received++;
+    }
+
+    for (int i = 0; i < path->num_recipients; i++)
+        flush_queue(path, &path->queues[i], path->recipients[i][0], path->recipients[i][1]);
+    flush_queue(path, &path->sender_queue, path->sender[1], path->sender[0]);
+}
+
+/**
+ * Opens the connections of the path.
+ */
+static void open_path(struct bench_path *path, int num_recipients, int text_size)
+{
+    path->num_recipients = num_recipients;
+    path->recipients = calloc(num_recipients, sizeof(*path->recipients));
+    path->queues = calloc(num_recipients, sizeof(*path->queues));
+    if (path->recipients == NULL || path->queues == NULL)
+        exit(EXIT_FAILURE);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, path->sender) == -1 || set_nonblocking(path->sender[0]) != 0 ||
+        set_nonblocking(path->sender[1]) != 0)
+    {
+        perror("socketpair");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < num_recipients; i++)
+    {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, path->recipients[i]) == -1 ||
+            set_nonblocking(path->recipients[i][0]) != 0 || set_nonblocking(path->recipients[i][1]) != 0)
+        {
+            perror("socketpair");
+            exit(EXIT_FAILURE);
+        }
+        outbound_queue_init(&path->queues[i]);
+    }
+    frame_parser_init(&path->parser);
+    outbound_queue_init(&path->sender_queue);
+    path->handled = 0;
+
+    struct chat_message msg;
+    memset(&msg, 0, sizeof(msg));
+    strcpy(msg.name, "benchmark");
+    memset(msg.text, 'x', text_size);
+    path->batch_len = 0;
+    for (int i = 0; i < BATCH; i++)
+    {
+        size_t len;
+        chat_message_serialize_to(&msg, path->batch + path->batch_len, sizeof(path->batch) - path->batch_len, &len);
+        path->batch_len += len;
+    }
+}
+
+/**
+ * Closes the connections of the path and releases everything it holds.
+ */
+static void close_path(struct bench_path *path)
+{
+    for (int i = 0; i < path->num_recipients; i++)
+    {
+        outbound_queue_clear(&path->queues[i]);
+        close(path->recipients[i][0]);
+        close(path->recipients[i][1]);
+    }
+    outbound_queue_clear(&path->sender_queue);
+    frame_parser_free(&path->parser);
+    close(path->sender[0]);
+    close(path->sender[1]);
+    free(path->recipients);
+    free(path->queues);
+}
+
+/**
+ * Runs count messages (rounded up to whole batches) through a new path.
+ *
+ * @return  Number of heap allocations made after warming up.
+ */
+static unsigned long run(const char *name, long count, int num_recipients, int text_size)
+{
+    static struct bench_path path;
+    open_path(&path, num_recipients, text_size);
+
+    long batches = (count + BATCH - 1) / BATCH;
+    for (long i = 0; i < batches / 10 + 1; i++) // Warm up caches and the allocator
+        run_batch(&path);
+
+    unsigned long allocations_before = allocations;
+    double start = now_ns();
+    for (long i = 0; i < batches; i++)
+        run_batch(&path);
+    double elapsed = now_ns() - start;
+    unsigned long allocated = allocations - allocations_before;
+    close_path(&path);
+
+    long messages = batches * BATCH;
+    printf("%-24s %8.1f ns/message %8.3f allocations/message (%lu in total)\n", name, elapsed / messages,
+           (double)allocated / messages, allocated);
+
+    return allocated;
+}
+
+int main(int argc, char *argv[])
+{
+    long count = 1000000;
+    int num_recipients = 8;
+    int text_size = 100;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = atol(optarg);
+            break;
+        case 'r':
+            num_recipients = atoi(optarg);
+            break;
+        case 's':
+            text_size = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n messages] [-r recipients] [-s chat text size]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (count < 1 || num_recipients < 1 || text_size < 0 || text_size >= TEXT_SIZE_LIMIT)
+    {
+        fprintf(stderr, "usage: %s [-n messages] [-r recipients] [-s chat text size]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    run("heap", count, num_recipients, text_size);
+
+    if (buffer_pool_init(false) != 0)
+    {
+        fprintf(stderr, "failed to initialize buffer pool\n");
+        exit(EXIT_FAILURE);
+    }
+    unsigned long pooled = run("buffer pool", count, num_recipients, text_size);
+
+    struct buffer_pool_stats stats;
+    buffer_pool_stats(&stats);
+    for (int i = 0; i < BUFFER_POOL_NUM_CLASSES; i++)
+        printf("  %5zu byte buffers: %10zu hits %6zu misses %4zu outstanding\n", stats.classes[i].size,
+               stats.classes[i].hits, stats.classes[i].misses, stats.classes[i].outstanding);
+
+    if (pooled != 0)
+    {
+        fprintf(stderr, "the pooled message path allocated from the heap %lu times\n", pooled);
+        return 1;
+    }
+
+    return 0;
+}
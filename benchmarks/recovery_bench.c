@@ -0,0 +1,234 @@
+#define _GNU_SOURCE // For nftw()
+
+#include <arpa/inet.h>
+#include <ftw.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../data_structures/buffer_pool.h"
+#include "../data_structures/room_directory.h"
+#include "../data_structures/shared_buffer.h"
+#include "../utils/room_log.h"
+#include "../utils/wal.h"
+
+// Measures how long the server takes to get ready after a crash with n messages in its store. A child process logs the
+// messages to r rooms the way a reactor does (numbered in the rooms' histories, appended to a WAL committed every
+// iteration and queued for the rooms' logs) and is killed once the last iteration is committed. The log is then opened
+// again, which recovers the rooms, and the time it takes is printed along with what it read back.
+// This is done first without snapshots, so recovery replays every message of the WAL, and then with a snapshot taken
+// every i messages, so it only replays the messages logged since the last one.
+
+#define HISTORY_LIMIT (64 * 1024) // Most bytes of history a room keeps, as in the server
+#define ITERATION 64              // Messages accepted per event loop iteration
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+/**
+ * Deletes a directory and everything in it, if it exists.
+ */
+static void remove_dir(const char *dir)
+{
+    if (access(dir, F_OK) == 0)
+        nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/**
+ * Joins a room in the directory, waiting for the log to look up the room if it has to, which a reactor does not.
+ */
+static struct room_entry *join_room(struct room_directory *directory, struct room_log *log, ROOM_ID id)
+{
+    struct room_log_lookup lookup = {.room = id};
+    struct room_entry *entry;
+    int status;
+    while ((status = room_directory_join(directory, id, 0, &lookup, &entry)) == 1)
+    {
+        room_log_lookup(log, &lookup);
+        while (atomic_load(&lookup.next_seq) == 0)
+            sched_yield();
+    }
+
+    return status == 0 ? entry : NULL;
+}
+
+/**
+ * Logs n messages of a given size to a number of rooms, taking a snapshot every interval messages (never if 0), then
+ * kills the calling process. Runs in the child.
+ */
+static void fill(const char *dir, long n, int rooms, size_t size, long interval)
+{
+    static struct room_directory directory;
+    struct history_budget history;
+    history_budget_init(&history, HISTORY_LIMIT, (size_t)rooms * HISTORY_LIMIT);
+    struct room_log *log = room_log_init(dir, 1, HISTORY_LIMIT);
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, "%s/wal/0", dir);
+    struct wal *wal = log != NULL ? wal_open(path, WAL_SYNC_NEVER) : NULL;
+    struct room_entry **entries = malloc(rooms * sizeof(struct room_entry *));
+    if (wal == NULL || entries == NULL || room_directory_init(&directory, &history, log, NULL) != 0)
+        exit(EXIT_FAILURE);
+    for (int i = 0; i < rooms; i++)
+        if ((entries[i] = join_room(&directory, log, i + 1)) == NULL)
+            exit(EXIT_FAILURE);
+
+    for (long i = 0; i < n; i++)
+    {
+        // A chat message frame as the server would log it
+        struct room_entry *entry = entries[i % rooms];
+        struct shared_buffer *buf = shared_buffer_alloc(size);
+        if (buf == NULL)
+            exit(EXIT_FAILURE);
+        memset(buf->data, 'x', size);
+        uint32_t len = htonl((uint32_t)size);
+        memcpy(buf->data, &len, sizeof(len));
+        buf->data[sizeof(len)] = 0;
+        buf->len = size;
+
+        pthread_mutex_lock(&entry->history_lock);
+        uint64_t seq = history_ring_append(&entry->history, buf->data, buf->len);
+        uint64_t lsn = wal_append(wal, entry->id, seq, buf->data, buf->len);
+        if (lsn == 0)
+            exit(EXIT_FAILURE);
+        room_log_append(log, entry->id, seq, buf, 0, lsn);
+        pthread_mutex_unlock(&entry->history_lock);
+        shared_buffer_unref(buf);
+
+        if ((i + 1) % ITERATION == 0 || i + 1 == n)
+        {
+            if (wal_commit(wal) != 0)
+                exit(EXIT_FAILURE);
+            wal_release(wal, room_log_replay_lsn(log, 0));
+        }
+        if (interval > 0 && (i + 1) % interval == 0)
+        {
+            uint64_t lsns[1] = {atomic_load(&wal->written)};
+            if (room_directory_snapshot(&directory, lsns) != 0)
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    // Whatever the rooms' logs have not taken yet is left to recovery
+    kill(getpid(), SIGKILL);
+}
+
+/**
+ * Fills a store in a child process, then recovers it and prints the results.
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int run(const char *dir, long n, int rooms, size_t size, long interval)
+{
+    remove_dir(dir);
+
+    fflush(stdout);
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid == -1)
+        return -1;
+    if (pid == 0)
+        fill(dir, n, rooms, size, interval);
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFSIGNALED(status) || WTERMSIG(status) != SIGKILL)
+        return -1;
+    double filled = now_ms() - start;
+
+    start = now_ms();
+    struct room_log *log = room_log_init(dir, 1, HISTORY_LIMIT);
+    if (log == NULL)
+        return -1;
+    double ready = now_ms() - start;
+
+    if (interval > 0)
+        printf("every %-7ld", interval);
+    else
+        printf("%-13s", "none");
+    printf(" %10.0f %9" PRIu64 " %9" PRIu64 " %11.1f %9.1f\n", n / filled * 1e3, log->recovered_rooms,
+           log->replayed, log->recovery_ms, ready);
+
+    room_log_free(log);
+    remove_dir(dir);
+
+    return 0;
+}
+
+static void print_usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-n messages] [-r rooms] [-s message size] [-i messages between snapshots] [-d dir]\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    long n = 10000000;
+    int rooms = 100; // Fewer than ROOM_LOG_MAX_OPEN: the rooms' logs stay open while they are filled
+    long size = 128;
+    long interval = 500000;
+    const char *dir = "recovery_bench.tmp";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:s:i:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n = atol(optarg);
+            break;
+        case 'r':
+            rooms = atoi(optarg);
+            break;
+        case 's':
+            size = atol(optarg);
+            break;
+        case 'i':
+            interval = atol(optarg);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (n < 1 || rooms < 1 || size < 5 || size > 65536 || interval < 1)
+    {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (buffer_pool_init(false) != 0)
+        exit(EXIT_FAILURE);
+
+    printf("%ld messages of %ld bytes in %d rooms, in %s\n", n, size, rooms, dir);
+    printf("%-13s %10s %9s %9s %11s %9s\n", "snapshots", "logged/s", "rooms", "replayed", "recovery ms", "ready ms");
+    if (run(dir, n, rooms, size, 0) != 0 || run(dir, n, rooms, size, interval) != 0)
+    {
+        fprintf(stderr, "failed to fill and recover %s\n", dir);
+        exit(EXIT_FAILURE);
+    }
+    printf("(replayed: WAL records read past the snapshot; ready: the log opened, recovery included)\n");
+
+    return 0;
+}
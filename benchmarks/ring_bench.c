@@ -0,0 +1,408 @@
+#define _GNU_SOURCE
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../data_structures/mpsc_ring.h"
+#include "../data_structures/ring_wakeup.h"
+#include "../data_structures/spsc_ring.h"
+
+// Microbenchmarks for the lock-free rings: throughput of single and batched operations with one or more producers,
+// one-way latency between two cores for both rings, and the latency of waking a consumer sleeping on a ring_wakeup.
+// Every consumer checks that it receives each producer's elements exactly once and in order.
+
+#define RING_CAPACITY 4096
+#define SPINS_BEFORE_YIELD 1000
+
+// An element the size of the messages reactor threads pass to each other
+struct bench_elem
+{
+    uint64_t producer;
+    uint64_t seq;
+    uint64_t sent_ns; // Time the element was pushed, for latency measurements
+    uint64_t pad;
+};
+
+// Settings and shared state of one benchmark run
+struct bench_run
+{
+    struct mpsc_ring *mpsc;
+    struct spsc_ring *spsc;
+    struct mpsc_ring *mpsc_back; // Rings carrying elements back for ping-pong runs
+    struct spsc_ring *spsc_back;
+    struct ring_wakeup wakeup;
+    int producers;
+    long count; // Number of elements per producer
+    size_t batch;
+    atomic_int ready; // Number of threads ready to start
+};
+
+// A producer thread
+struct bench_producer
+{
+    pthread_t thread;
+    struct bench_run *run;
+    uint64_t id;
+};
+
+static int num_cpus;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Pins the calling thread to a CPU, if there are enough of them for every thread to get its own.
+ */
+static void pin_thread(int cpu)
+{
+    if (cpu >= num_cpus)
+        return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/**
+ * Waits a little when a ring is full or empty: spins first, then yields so the other side can run even when the
+ * threads share a CPU.
+ */
+static void backoff(int *spins)
+{
+    if (++*spins < SPINS_BEFORE_YIELD)
+        return;
+    *spins = 0;
+    sched_yield();
+}
+
+/**
+ * Waits until every thread of a run is ready, so they start together.
+ */
+static void start_together(struct bench_run *run, int threads)
+{
+    atomic_fetch_add(&run->ready, 1);
+    while (atomic_load(&run->ready) < threads)
+        sched_yield();
+}
+
+static void check_order(uint64_t *next_seq, struct bench_elem *elem)
+{
+    if (elem->seq != next_seq[elem->producer])
+    {
+        fprintf(stderr, "producer %lu: expected element %lu, got %lu\n", (unsigned long)elem->producer,
+                (unsigned long)next_seq[elem->producer], (unsigned long)elem->seq);
+        exit(EXIT_FAILURE);
+    }
+    next_seq[elem->producer]++;
+}
+
+static void *run_mpsc_producer(void *arg)
+{
+    struct bench_producer *producer = arg;
+    struct bench_run *run = producer->run;
+    pin_thread(1 + producer->id);
+    start_together(run, run->producers + 1);
+
+    struct bench_elem elems[64];
+    int spins = 0;
+    for (long seq = 0; seq < run->count;)
+    {
+        size_t n = run->batch;
+        if ((long)n > run->count - seq)
+            n = run->count - seq;
+        for (size_t i = 0; i < n; i++)
+            elems[i] = (struct bench_elem){producer->id, seq + i, 0, 0};
+
+        size_t pushed = n == 1 ? (mpsc_ring_push(run->mpsc, elems) == 0) : mpsc_ring_push_batch(run->mpsc, elems, n);
+        if (pushed == 0)
+            backoff(&spins);
+        seq += pushed;
+    }
+
+    return NULL;
+}
+
+static void *run_spsc_producer(void *arg)
+{
+    struct bench_producer *producer = arg;
+    struct bench_run *run = producer->run;
+    pin_thread(1);
+    start_together(run, 2);
+
+    struct bench_elem elems[64];
+    int spins = 0;
+    for (long seq = 0; seq < run->count;)
+    {
+        size_t n = run->batch;
+        if ((long)n > run->count - seq)
+            n = run->count - seq;
+        for (size_t i = 0; i < n; i++)
+            elems[i] = (struct bench_elem){0, seq + i, 0, 0};
+
+        size_t pushed = spsc_ring_push_batch(run->spsc, elems, n);
+        if (pushed == 0)
+            backoff(&spins);
+        seq += pushed;
+    }
+
+    return NULL;
+}
+
+/**
+ * Measures how many elements per second producers can pass to one consumer.
+ */
+static void bench_throughput(bool spsc, int producers, long count, size_t batch)
+{
+    struct bench_run run;
+    memset(&run, 0, sizeof(run));
+    run.producers = producers;
+    run.count = count;
+    run.batch = batch;
+    if (spsc)
+        run.spsc = spsc_ring_init(RING_CAPACITY, sizeof(struct bench_elem));
+    else
+        run.mpsc = mpsc_ring_init(RING_CAPACITY, sizeof(struct bench_elem));
+
+    struct bench_producer *threads = calloc(producers, sizeof(struct bench_producer));
+    for (int i = 0; i < producers; i++)
+    {
+        threads[i].run = &run;
+        threads[i].id = i;
+        pthread_create(&threads[i].thread, NULL, spsc ? run_spsc_producer : run_mpsc_producer, &threads[i]);
+    }
+
+    pin_thread(0);
+    start_together(&run, producers + 1);
+    uint64_t start = now_ns();
+
+    uint64_t *next_seq = calloc(producers, sizeof(uint64_t));
+    struct bench_elem elems[64];
+    long total = count * producers;
+    int spins = 0;
+    for (long received = 0; received < total;)
+    {
+        size_t n = spsc ? spsc_ring_pop_batch(run.spsc, elems, batch) : mpsc_ring_pop_batch(run.mpsc, elems, batch);
+        if (n == 0)
+            backoff(&spins);
+        for (size_t i = 0; i < n; i++)
+            check_order(next_seq, &elems[i]);
+        received += n;
+    }
+
+    double elapsed = (now_ns() - start) / 1e9;
+    printf("%s throughput: %d producer(s), batch %zu: %.1f M elements/s\n", spsc ? "spsc" : "mpsc", producers, batch,
+           total / elapsed / 1e6);
+
+    for (int i = 0; i < producers; i++)
+        pthread_join(threads[i].thread, NULL);
+    if (spsc)
+        spsc_ring_free(run.spsc);
+    else
+        mpsc_ring_free(run.mpsc);
+    free(next_seq);
+    free(threads);
+}
+
+static int ring_push(struct bench_run *run, bool spsc, bool back, struct bench_elem *elem)
+{
+    if (spsc)
+        return spsc_ring_push(back ? run->spsc_back : run->spsc, elem);
+    return mpsc_ring_push(back ? run->mpsc_back : run->mpsc, elem);
+}
+
+static int ring_pop(struct bench_run *run, bool spsc, bool back, struct bench_elem *elem)
+{
+    if (spsc)
+        return spsc_ring_pop(back ? run->spsc_back : run->spsc, elem);
+    return mpsc_ring_pop(back ? run->mpsc_back : run->mpsc, elem);
+}
+
+struct echo_args
+{
+    struct bench_run *run;
+    bool spsc;
+};
+
+static void *run_echo(void *arg)
+{
+    struct echo_args *args = arg;
+    pin_thread(1);
+    start_together(args->run, 2);
+
+    struct bench_elem elem;
+    int spins = 0;
+    for (long i = 0; i < args->run->count; i++)
+    {
+        while (ring_pop(args->run, args->spsc, false, &elem) != 0)
+            backoff(&spins);
+        while (ring_push(args->run, args->spsc, true, &elem) != 0)
+            backoff(&spins);
+    }
+
+    return NULL;
+}
+
+/**
+ * Measures the one-way latency between two cores as half the round trip of an element sent to a thread which sends it
+ * straight back.
+ */
+static void bench_latency(bool spsc, long count)
+{
+    struct bench_run run;
+    memset(&run, 0, sizeof(run));
+    run.count = count;
+    if (spsc)
+    {
+        run.spsc = spsc_ring_init(RING_CAPACITY, sizeof(struct bench_elem));
+        run.spsc_back = spsc_ring_init(RING_CAPACITY, sizeof(struct bench_elem));
+    }
+    else
+    {
+        run.mpsc = mpsc_ring_init(RING_CAPACITY, sizeof(struct bench_elem));
+        run.mpsc_back = mpsc_ring_init(RING_CAPACITY, sizeof(struct bench_elem));
+    }
+
+    struct echo_args args = {&run, spsc};
+    pthread_t thread;
+    pthread_create(&thread, NULL, run_echo, &args);
+    pin_thread(0);
+    start_together(&run, 2);
+
+    uint64_t start = now_ns();
+    int spins = 0;
+    for (long i = 0; i < count; i++)
+    {
+        struct bench_elem elem = {0, i, 0, 0};
+        while (ring_push(&run, spsc, false, &elem) != 0)
+            backoff(&spins);
+        while (ring_pop(&run, spsc, true, &elem) != 0)
+            backoff(&spins);
+        if (elem.seq != (uint64_t)i)
+        {
+            fprintf(stderr, "expected element %ld back, got %lu\n", i, (unsigned long)elem.seq);
+            exit(EXIT_FAILURE);
+        }
+    }
+    double elapsed = now_ns() - start;
+    printf("%s latency: %.0f ns one way\n", spsc ? "spsc" : "mpsc", elapsed / count / 2);
+
+    pthread_join(thread, NULL);
+    if (spsc)
+    {
+        spsc_ring_free(run.spsc);
+        spsc_ring_free(run.spsc_back);
+    }
+    else
+    {
+        mpsc_ring_free(run.mpsc);
+        mpsc_ring_free(run.mpsc_back);
+    }
+}
+
+static void *run_sleeping_consumer(void *arg)
+{
+    struct bench_run *run = arg;
+    pin_thread(1);
+    start_together(run, 2);
+
+    uint64_t total_ns = 0;
+    uint64_t next_seq = 0;
+    while ((long)next_seq < run->count)
+    {
+        struct pollfd pfd = {run->wakeup.fd, POLLIN, 0};
+        poll(&pfd, 1, -1);
+        ring_wakeup_clear(&run->wakeup);
+
+        struct bench_elem elem;
+        while (mpsc_ring_pop(run->mpsc, &elem) == 0)
+        {
+            check_order(&next_seq, &elem);
+            total_ns += now_ns() - elem.sent_ns;
+        }
+    }
+    printf("wakeup latency: %.0f ns from push to pop by a sleeping consumer\n", (double)total_ns / run->count);
+
+    return NULL;
+}
+
+/**
+ * Measures how long a consumer sleeping on a ring_wakeup takes to see an element. Elements are pushed far enough apart
+ * for the consumer to be asleep each time.
+ */
+static void bench_wakeup(long count)
+{
+    struct bench_run run;
+    memset(&run, 0, sizeof(run));
+    run.count = count;
+    run.mpsc = mpsc_ring_init(RING_CAPACITY, sizeof(struct bench_elem));
+    ring_wakeup_init(&run.wakeup);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, run_sleeping_consumer, &run);
+    pin_thread(0);
+    start_together(&run, 2);
+
+    for (long i = 0; i < count; i++)
+    {
+        usleep(100);
+        struct bench_elem elem = {0, i, now_ns(), 0};
+        mpsc_ring_push(run.mpsc, &elem);
+        ring_wakeup_signal(&run.wakeup);
+    }
+
+    pthread_join(thread, NULL);
+    ring_wakeup_free(&run.wakeup);
+    mpsc_ring_free(run.mpsc);
+}
+
+int main(int argc, char *argv[])
+{
+    long count = 10000000;
+    int max_producers = 4;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = atol(optarg);
+            break;
+        case 'p':
+            max_producers = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n elements per producer] [-p maximum producers]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus < 2)
+        printf("only %d CPU online: threads share it, so numbers include context switches\n", num_cpus);
+
+    for (size_t batch = 1; batch <= 32; batch *= 32)
+    {
+        bench_throughput(true, 1, count, batch);
+        for (int producers = 1; producers <= max_producers; producers *= 2)
+            bench_throughput(false, producers, count / producers, batch);
+    }
+
+    bench_latency(true, count / 10);
+    bench_latency(false, count / 10);
+    bench_wakeup(10000);
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../data_structures/buffer_pool.h"
+#include "../data_structures/room_directory.h"
+#include "../data_structures/room_registry.h"
+#include "../data_structures/slab.h"
+
+// Churns rooms through a room registry and the room directory the way a reactor does: a room is opened (and joined in
+// the directory) when its first user arrives and closed (and left) when its last user goes. First n rooms are opened,
+// looked up at random and closed again, then n rooms are churned through a window of w open rooms, each new room
+// replacing the oldest. After each phase the slots of the registry's map and the room records still live are printed,
+// showing memory follows the number of open rooms rather than the number of rooms ever used.
+
+#define NUM_KEYS (1 << 20) // Number of random rooms looked up, cycled through for longer runs
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Gets the id of the i-th room used. Ids are scattered over the whole id space, like ids picked by clients.
+ */
+static ROOM_ID room_id(long i)
+{
+    return (ROOM_ID)((uint64_t)(i + 1) * 2654435761u % 4294967291u) + 1;
+}
+
+/**
+ * Opens a room and joins it in the directory, as the first user joining it does.
+ */
+static void open_room(struct room_registry *registry, struct room_directory *dir, ROOM_ID id)
+{
+    bool created;
+    struct room *room = room_registry_open(registry, id, &created);
+    if (room == NULL || !created || room_directory_join(dir, id, 0, NULL, &room->entry) != 0)
+    {
+        fprintf(stderr, "failed to open room %u\n", id);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Leaves a room in the directory and closes it, as the last user leaving it does.
+ */
+static void close_room(struct room_registry *registry, struct room_directory *dir, ROOM_ID id)
+{
+    struct room *room = room_registry_find(registry, id);
+    if (room == NULL)
+    {
+        fprintf(stderr, "room %u is not open\n", id);
+        exit(EXIT_FAILURE);
+    }
+    room_directory_leave(dir, room->entry, 0);
+    room_registry_close(registry, room);
+}
+
+static void print_memory(const char *phase, struct room_registry *registry, struct slab_pool *pool)
+{
+    struct slab_stats stats;
+    slab_pool_stats(pool, &stats);
+    printf("%-8s %9zu open rooms, %9zu map slots, %9zu room records live, %9zu free\n", phase,
+           room_registry_count(registry), registry->rooms.cap, stats.live, stats.free);
+}
+
+int main(int argc, char *argv[])
+{
+    long n = 1000000;
+    long window = 1000;
+    long lookups = 10000000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:l:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n = atol(optarg);
+            break;
+        case 'w':
+            window = atol(optarg);
+            break;
+        case 'l':
+            lookups = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n rooms] [-w rooms open at once while churning] [-l lookups]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (n < 1 || n > INT32_MAX || window < 1 || window > n || lookups < 1)
+    {
+        fprintf(stderr, "usage: %s [-n rooms] [-w rooms open at once while churning] [-l lookups]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    static struct room_directory dir;
+    struct history_budget history; // Rooms keep no history: no chat message is sent
+    history_budget_init(&history, 0, 0);
+    struct room_registry registry;
+    struct slab_pool *pool = slab_pool_init(sizeof(struct room), false);
+    ROOM_ID *keys = malloc(NUM_KEYS * sizeof(ROOM_ID));
+    if (buffer_pool_init(false) != 0 || pool == NULL || keys == NULL ||
+        room_directory_init(&dir, &history, NULL, NULL) != 0 || room_registry_init(&registry, pool) != 0)
+        exit(EXIT_FAILURE);
+
+    srand(1);
+    for (long i = 0; i < NUM_KEYS; i++)
+        keys[i] = room_id(rand() % n);
+
+    double start = now_ns();
+    for (long i = 0; i < n; i++)
+        open_room(&registry, &dir, room_id(i));
+    double open = now_ns() - start;
+    print_memory("opened", &registry, pool);
+
+    uintptr_t sum = 0;
+    start = now_ns();
+    for (long i = 0; i < lookups; i++)
+        sum += (uintptr_t)room_registry_find(&registry, keys[i & (NUM_KEYS - 1)]);
+    double lookup = now_ns() - start;
+
+    start = now_ns();
+    for (long i = 0; i < n; i++)
+        close_room(&registry, &dir, room_id(i));
+    double close = now_ns() - start;
+    print_memory("closed", &registry, pool);
+
+    // Room ids n and up were never used above, so the churn only ever opens new rooms
+    for (long i = 0; i < window; i++)
+        open_room(&registry, &dir, room_id(n + i));
+    start = now_ns();
+    for (long i = window; i < n + window; i++)
+    {
+        open_room(&registry, &dir, room_id(n + i));
+        close_room(&registry, &dir, room_id(n + i - window));
+    }
+    double churn = now_ns() - start;
+    print_memory("churned", &registry, pool);
+
+    printf("%-8s %9s %10s %10s %10s %10s (ns/operation)\n", "rooms", "window", "open", "lookup", "close", "churn");
+    printf("%-8ld %9ld %10.1f %10.1f %10.1f %10.1f\n", n, window, open / n, lookup / lookups, close / n, churn / n);
+
+    room_registry_free(&registry);
+    room_directory_free(&dir);
+    slab_pool_free(pool);
+    free(keys);
+
+    return sum == 0;
+}
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Measures how chat throughput scales with the number of reactor threads, with one room and with five rooms of 25 users
+# each.
+# Usage: benchmarks/scaling.sh [backend] [messages per user]
+# Run from the repository root after `make server bench`.
+
+BACKEND=${1:-epoll}
+MESSAGES=${2:-2000}
+MAX_THREADS=$(nproc)
+
+threads=1
+while [ "$threads" -le "$MAX_THREADS" ]; do
+    ./server -e "$BACKEND" -t "$threads" &
+    pid=$!
+    sleep 0.5
+
+    for rooms in 1 5; do
+        printf "threads=%d " "$threads"
+        ./benchmarks/throughput -r "$rooms" -u 25 -m "$MESSAGES" -j "$threads"
+    done
+
+    kill "$pid"
+    wait "$pid" 2>/dev/null
+    threads=$((threads * 2))
+done
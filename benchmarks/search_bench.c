@@ -0,0 +1,310 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../data_structures/text_index.h"
+
+// Measures the full-text index of a room: how fast messages are added to it, the memory it takes, and how long
+// queries take once it holds n messages. Messages are made of 3 to 15 words drawn from a vocabulary of v words with a
+// Zipf distribution, as in natural language, so the most common words appear in most messages and the rarest in a
+// handful. Every message can be made again from its sequence number, which phrase queries are taken from, so each
+// of them is known to match and the benchmark checks that it does. Each kind of query is run q times, asking for the
+// newest 20 matches as the client does with the budget the server gives each query, or the one given with -b (0 for
+// none), and the median and 99th percentile of its latency are printed.
+
+#define RESULTS 20    // Matches asked for by each query, as by the client
+#define MIN_WORDS 3   // Fewest words in a message
+#define MAX_WORDS 15  // Most words in a message
+#define WORD_MAX 12   // Longest word of the vocabulary, with its null character
+
+// A kind of query: how many words it has, and the ranks in the vocabulary each one is drawn from
+struct query_kind
+{
+    const char *name;
+    int terms;
+    long from[4];
+    long to[4];
+    int phrase; // Whether the words are a phrase taken from a message instead
+};
+
+static char (*vocabulary)[WORD_MAX];
+static double *cdf; // Probability of drawing each word or a more common one
+static long num_words;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Makes a vocabulary of distinct lowercase words, the most common first, and their Zipf distribution.
+ */
+static int make_vocabulary(long v)
+{
+    vocabulary = malloc(v * sizeof(*vocabulary));
+    cdf = malloc(v * sizeof(double));
+    if (vocabulary == NULL || cdf == NULL)
+        return -1;
+    num_words = v;
+
+    double sum = 0;
+    for (long r = 0; r < v; r++)
+    {
+        // Base 26 digits of the rank make the words distinct, random letters in front make their lengths vary
+        uint64_t h = mix(r);
+        int len = 0;
+        for (int i = h % 6; i > 0; i--)
+            vocabulary[r][len++] = 'a' + (h >> (8 * i)) % 26;
+        long x = r;
+        do
+        {
+            vocabulary[r][len++] = 'a' + x % 26;
+            x /= 26;
+        } while (x > 0);
+        vocabulary[r][len] = '\0';
+
+        sum += 1.0 / (r + 1);
+        cdf[r] = sum;
+    }
+    for (long r = 0; r < v; r++)
+        cdf[r] /= sum;
+
+    return 0;
+}
+
+/**
+ * Draws a word from the Zipf distribution with a random number.
+ */
+static long draw_word(uint64_t random)
+{
+    double u = (random >> 11) * 0x1.0p-53;
+    long lo = 0;
+    long hi = num_words - 1;
+    while (lo < hi)
+    {
+        long mid = (lo + hi) / 2;
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Makes the words of the message with a given sequence number, the same each time.
+ *
+ * @return  Number of words.
+ */
+static int make_message(uint64_t seq, long *words)
+{
+    uint64_t h = mix(seq);
+    int n = MIN_WORDS + h % (MAX_WORDS - MIN_WORDS + 1);
+    for (int i = 0; i < n; i++)
+        words[i] = draw_word(mix(h + i + 1));
+    return n;
+}
+
+/**
+ * Writes words into a buffer, separated by spaces and quoted as a phrase if asked.
+ *
+ * @return  Length of the text.
+ */
+static size_t write_text(char *buf, const long *words, int n, int quoted)
+{
+    size_t len = 0;
+    if (quoted)
+        buf[len++] = '"';
+    for (int i = 0; i < n; i++)
+        len += sprintf(buf + len, i == 0 ? "%s" : " %s", vocabulary[words[i]]);
+    if (quoted)
+        buf[len++] = '"';
+    buf[len] = '\0';
+    return len;
+}
+
+/**
+ * Runs one kind of query q times and prints its latencies and the matches found. Words are drawn from the ranks of the
+ * vocabulary given for each of them, or, for phrases, taken from random messages, which must then be found.
+ *
+ * @return  Number of phrase queries which did not find their message.
+ */
+static long run_queries(const struct text_index *index, const struct query_kind *kind, long q, size_t budget)
+{
+    double *times = malloc(q * sizeof(double));
+    if (times == NULL)
+        exit(EXIT_FAILURE);
+
+    long failures = 0;
+    long found = 0;
+    long more = 0;
+    for (long i = 0; i < q; i++)
+    {
+        uint64_t h = mix(~(uint64_t)i ^ (uint64_t)kind->name);
+        long words[MAX_WORDS];
+        uint64_t seq = 0;
+        int n = kind->terms;
+        if (kind->phrase)
+        {
+            // The first words of a random message, which is indexed
+            seq = 1 + h % index->last_seq;
+            n = make_message(seq, words);
+            n = n < kind->terms ? n : kind->terms;
+        }
+        else
+            for (int j = 0; j < n; j++)
+                words[j] = kind->from[j] + mix(h + j) % (kind->to[j] - kind->from[j]);
+
+        char query[256];
+        size_t len = write_text(query, words, n, kind->phrase);
+        uint64_t seqs[RESULTS];
+        size_t count;
+        bool older;
+        double start = now();
+        if (text_index_search(index, query, len, seqs, RESULTS, budget, &count, &older) != 0)
+            exit(EXIT_FAILURE);
+        times[i] = (now() - start) * 1e6;
+        found += count;
+        more += older;
+
+        // The message the phrase was taken from is found unless RESULTS newer ones match as well, or the search ran
+        // out of budget before it got to the message
+        if (kind->phrase)
+        {
+            bool listed = false;
+            for (size_t j = 0; j < count; j++)
+                listed = listed || seqs[j] == seq;
+            if (!listed && ((count < RESULTS && !older) || (count > 0 && seqs[count - 1] < seq)))
+                failures++;
+        }
+    }
+
+    qsort(times, q, sizeof(double), compare_doubles);
+    printf("%-26s %10.1f %10.1f %10.1f %10.1f %9.0f%%\n", kind->name, times[q / 2], times[q * 99 / 100], times[q - 1],
+           (double)found / q, 100.0 * more / q);
+    free(times);
+
+    return failures;
+}
+
+static void print_usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-n messages] [-v vocabulary size] [-q queries per kind] [-b postings per query]\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    long n = 10000000;
+    long v = 50000;
+    long q = 1000;
+
+    int opt;
+    long b = TEXT_INDEX_BUDGET;
+    while ((opt = getopt(argc, argv, "n:v:q:b:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n = atol(optarg);
+            break;
+        case 'v':
+            v = atol(optarg);
+            break;
+        case 'q':
+            q = atol(optarg);
+            break;
+        case 'b':
+            b = atol(optarg);
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (n < 1 || v < 10000 || v > 10000000 || q < 1 || b < 0)
+    {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (make_vocabulary(v) != 0)
+        exit(EXIT_FAILURE);
+
+    struct text_index index;
+    text_index_init(&index);
+    char text[MAX_WORDS * WORD_MAX];
+    long words[MAX_WORDS];
+    double indexing = 0;
+    long total_words = 0;
+    for (uint64_t seq = 1; seq <= (uint64_t)n; seq++)
+    {
+        int count = make_message(seq, words);
+        size_t len = write_text(text, words, count, 0);
+        total_words += count;
+
+        double start = now();
+        if (text_index_add(&index, seq, text, len) != 0)
+        {
+            fprintf(stderr, "failed to index message %" PRIu64 "\n", seq);
+            exit(EXIT_FAILURE);
+        }
+        indexing += now() - start;
+    }
+
+    printf("%ld messages, %ld words from a vocabulary of %ld\n", n, total_words, v);
+    printf("indexed in %.2f s: %.0f messages/s, %.2f us per message\n", indexing, n / indexing, indexing / n * 1e6);
+    printf("index: %zu terms, %.1f MiB, %.1f bytes per message\n", index.num_terms, index.bytes / 1048576.0,
+           (double)index.bytes / n);
+    printf("%-26s %10s %10s %10s %10s %10s\n", "query (newest 20)", "p50 us", "p99 us", "max us", "matches", "more");
+
+    // Common words are the 10 most frequent, rare ones are past the first tenth of the vocabulary
+    struct query_kind kinds[] = {
+        {"1 common word", 1, {0}, {10}, 0},
+        {"1 rare word", 1, {v / 10}, {v}, 0},
+        {"2 common words", 2, {0, 0}, {10, 10}, 0},
+        {"common and rare word", 2, {0, v / 10}, {10, v}, 0},
+        {"3 middling words", 3, {10, 10, 10}, {1000, 1000, 1000}, 0},
+        {"2 rare words", 2, {v / 10, v / 10}, {v, v}, 0},
+        {"2-word phrase", 2, {0}, {0}, 1},
+        {"4-word phrase", 4, {0}, {0}, 1},
+    };
+    long failures = 0;
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++)
+        failures += run_queries(&index, &kinds[i], q, b == 0 ? SIZE_MAX : (size_t)b);
+    printf("(matches: average found, at most %d; more: queries with older matches left, or stopped by the budget)\n",
+           RESULTS);
+
+    text_index_free(&index);
+    free(vocabulary);
+    free(cdf);
+
+    if (failures > 0)
+    {
+        fprintf(stderr, "%ld phrase queries did not find the message they were taken from\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
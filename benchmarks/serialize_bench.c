@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../data_structures/outbound_queue.h"
+#include "../data_structures/shared_buffer.h"
+#include "../types/messages/chat_message.h"
+#include "../types/messages/join_message.h"
+#include "../types/messages/message.h"
+#include "../types/messages/name_message.h"
+#include "../types/messages/reply_message.h"
+
+// Compares the cost of serializing messages with the allocating API (*_message_serialize(), whose buffer the caller
+// frees) against serializing into a caller-provided buffer (*_message_serialize_to()), into a shared buffer sized with
+// *_message_size() as the server does for chat messages, and into an outbound queue's tail as it does for replies.
+// Allocations are counted by interposing malloc().
+
+#define FLUSH_INTERVAL 32 // Number of replies queued between two simulated writes of the outbound queue
+
+void *__libc_malloc(size_t size);
+
+static unsigned long allocations;
+
+void *malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// State shared by the benchmarked operations
+struct bench_msgs
+{
+    struct chat_message chat;
+    struct name_message name;
+    struct join_message join;
+    struct reply_message reply;
+    struct outbound_queue queue;
+    char buf[MSG_SIZE_LIMIT];
+    size_t sink; // Sum of serialized lengths, so the work cannot be optimized away
+};
+
+typedef void (*bench_op)(struct bench_msgs *msgs, long i);
+
+static void chat_malloc(struct bench_msgs *msgs, long i)
+{
+    (void)i;
+    char *buf;
+    size_t len;
+    chat_message_serialize(&msgs->chat, &buf, &len);
+    msgs->sink += len;
+    free(buf);
+}
+
+static void chat_into(struct bench_msgs *msgs, long i)
+{
+    (void)i;
+    size_t len;
+    chat_message_serialize_to(&msgs->chat, msgs->buf, sizeof(msgs->buf), &len);
+    msgs->sink += len;
+}
+
+static void chat_shared_wrap(struct bench_msgs *msgs, long i)
+{
+    (void)i;
+    char *data;
+    size_t len;
+    chat_message_serialize(&msgs->chat, &data, &len);
+    struct shared_buffer *buf = shared_buffer_wrap(data, len);
+    msgs->sink += buf->len;
+    shared_buffer_unref(buf);
+}
+
+static void chat_shared_sized(struct bench_msgs *msgs, long i)
+{
+    (void)i;
+    size_t size = chat_message_size(&msgs->chat);
+    struct shared_buffer *buf = shared_buffer_alloc(size);
+    chat_message_serialize_to(&msgs->chat, buf->data, size, &buf->len);
+    msgs->sink += buf->len;
+    shared_buffer_unref(buf);
+}
+
+static void name_malloc(struct bench_msgs *msgs, long i)
+{
+    (void)i;
+    char *buf;
+    size_t len;
+    name_message_serialize(&msgs->name, &buf, &len);
+    msgs->sink += len;
+    free(buf);
+}
+
+static void name_into(struct bench_msgs *msgs, long i)
+{
+    (void)i;
+    size_t len;
+    name_message_serialize_to(&msgs->name, msgs->buf, sizeof(msgs->buf), &len);
+    msgs->sink += len;
+}
+
+static void join_malloc(struct bench_msgs *msgs, long i)
+{
+    (void)i;
+    char *buf;
+    size_t len;
+    join_message_serialize(&msgs->join, &buf, &len);
+    msgs->sink += len;
+    free(buf);
+}
+
+static void join_into(struct bench_msgs *msgs, long i)
+{
+    (void)i;
+    size_t len;
+    join_message_serialize_to(&msgs->join, msgs->buf, sizeof(msgs->buf), &len);
+    msgs->sink += len;
+}
+
+static void reply_malloc(struct bench_msgs *msgs, long i)
+{
+    (void)i;
+    char *buf;
+    size_t len;
+    reply_message_serialize(&msgs->reply, &buf, &len);
+    msgs->sink += len;
+    free(buf);
+}
+
+static void reply_into(struct bench_msgs *msgs, long i)
+{
+    (void)i;
+    size_t len;
+    reply_message_serialize_to(&msgs->reply, msgs->buf, sizeof(msgs->buf), &len);
+    msgs->sink += len;
+}
+
+/**
+ * Queues a reply the way the server did before replies could be serialized into the queue: in its own shared buffer.
+ */
+static void reply_queue_push(struct bench_msgs *msgs, long i)
+{
+    char *data;
+    size_t len;
+    reply_message_serialize(&msgs->reply, &data, &len);
+    struct shared_buffer *buf = shared_buffer_wrap(data, len);
+    outbound_queue_push(&msgs->queue, buf);
+    shared_buffer_unref(buf);
+
+    if (i % FLUSH_INTERVAL == FLUSH_INTERVAL - 1)
+        outbound_queue_consume(&msgs->queue, msgs->queue.bytes);
+}
+
+static void reply_queue_tail(struct bench_msgs *msgs, long i)
+{
+    size_t size = reply_message_size(&msgs->reply);
+    char *dst = outbound_queue_reserve(&msgs->queue, size);
+    size_t len;
+    reply_message_serialize_to(&msgs->reply, dst, size, &len);
+    outbound_queue_commit(&msgs->queue, len);
+
+    if (i % FLUSH_INTERVAL == FLUSH_INTERVAL - 1)
+        outbound_queue_consume(&msgs->queue, msgs->queue.bytes);
+}
+
+static void run(const char *name, bench_op op, struct bench_msgs *msgs, long count)
+{
+    outbound_queue_init(&msgs->queue);
+    for (long i = 0; i < count / 10; i++) // Warm up caches and the allocator
+        op(msgs, i);
+    outbound_queue_clear(&msgs->queue);
+
+    unsigned long allocations_before = allocations;
+    double start = now_ns();
+    for (long i = 0; i < count; i++)
+        op(msgs, i);
+    double elapsed = now_ns() - start;
+    unsigned long allocated = allocations - allocations_before;
+    outbound_queue_clear(&msgs->queue);
+
+    printf("%-32s %8.1f ns/message %8.3f allocations/message\n", name, elapsed / count, (double)allocated / count);
+}
+
+int main(int argc, char *argv[])
+{
+    long count = 5000000;
+    int text_size = 100;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = atol(optarg);
+            break;
+        case 's':
+            text_size = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n messages] [-s chat text size]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (count < 1 || text_size < 0 || text_size >= TEXT_SIZE_LIMIT)
+    {
+        fprintf(stderr, "usage: %s [-n messages] [-s chat text size]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    struct bench_msgs msgs;
+    memset(&msgs, 0, sizeof(msgs));
+    msgs.chat.room_id = 1;
+    strcpy(msgs.chat.name, "benchmark");
+    memset(msgs.chat.text, 'x', text_size);
+    strcpy(msgs.name.name, "benchmark");
+    msgs.join.room_id = 1;
+    strcpy(msgs.reply.reply, "you have joined room 1");
+
+    run("chat: serialize (malloc)", chat_malloc, &msgs, count);
+    run("chat: serialize_to", chat_into, &msgs, count);
+    run("chat: shared buffer (wrap)", chat_shared_wrap, &msgs, count);
+    run("chat: shared buffer (sized)", chat_shared_sized, &msgs, count);
+    run("name: serialize (malloc)", name_malloc, &msgs, count);
+    run("name: serialize_to", name_into, &msgs, count);
+    run("join: serialize (malloc)", join_malloc, &msgs, count);
+    run("join: serialize_to", join_into, &msgs, count);
+    run("reply: serialize (malloc)", reply_malloc, &msgs, count);
+    run("reply: serialize_to", reply_into, &msgs, count);
+    run("reply: queue (push)", reply_queue_push, &msgs, count);
+    run("reply: queue (tail)", reply_queue_tail, &msgs, count);
+
+    return msgs.sink == 0;
+}
@@ -0,0 +1,408 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../lib/log.h"
+#include "../types/messages/chat_message.h"
+#include "../types/messages/join_message.h"
+#include "../types/messages/message.h"
+#include "../types/messages/name_message.h"
+#include "../utils/net_utils.h"
+
+// Measures how many chat messages per second the server delivers. Every client joins a room, then sends messages
+// while reading everything broadcast to its room, keeping at most a window of its own messages unacknowledged (a
+// message is acknowledged when the server echoes it back), so the server is never pushed into its slow consumer policy.
+// Each worker thread drives whole rooms, so the receivers in a room keep up with its senders.
+
+#define RECV_BUF_SIZE (64 * 1024)
+#define SEND_BATCH_MAX 64
+
+// A benchmark client
+struct bench_client
+{
+    int fd;
+    char name[NAME_SIZE_LIMIT];
+    ROOM_ID room;  // The room the client sends to
+    long sent;     // Number of messages sent
+    long echoed;   // Number of own messages received back
+    long received; // Number of chat messages received
+    long expected; // Number of chat messages the client should receive
+    char buf[RECV_BUF_SIZE];
+    size_t buf_len;
+};
+
+// Settings shared by every worker
+struct bench_config
+{
+    int rooms;
+    int users_per_room;
+    long messages;
+    long window;
+    int text_size;
+    int batch; // Number of messages written with each send(), like a client pasting or scripting messages
+};
+
+// A worker thread driving a slice of the clients
+struct bench_worker
+{
+    pthread_t thread;
+    struct bench_client *clients;
+    int num_clients;
+    struct bench_config *config;
+};
+
+/**
+ * Gets the current time of a monotonic clock in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Connects to the server on host and port.
+ *
+ * @return  The socket on success.
+ *          -1 on error.
+ */
+static int connect_to_server(const char *host, const char *port)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *res;
+    if (getaddrinfo(host, port, &hints, &res) != 0)
+        return -1;
+
+    int fd = -1;
+    for (struct addrinfo *p = res; p != NULL; p = p->ai_next)
+    {
+        if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1)
+            continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    return fd;
+}
+
+/**
+ * Sends a serialized message on a blocking socket.
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int send_frame(int fd, char *buf, size_t len)
+{
+    ssize_t sent = sendall(fd, buf, len);
+    free(buf);
+    return sent == (ssize_t)len ? 0 : -1;
+}
+
+/**
+ * Handles every complete message in a client's receive buffer: counts chat messages, and acknowledges the client's
+ * own messages.
+ *
+ * @return  Number of messages handled.
+ */
+static int handle_frames(struct bench_client *client)
+{
+    int handled = 0;
+    size_t offset = 0;
+    while (client->buf_len - offset >= MSG_HEADER_SIZE)
+    {
+        TOTAL_MSG_LEN len;
+        memcpy(&len, client->buf + offset, sizeof(len));
+        len = ntohl(len);
+        if (client->buf_len - offset < len)
+            break;
+
+        char *frame = client->buf + offset;
+        if (get_message_type(frame) == CHAT_MESSAGE)
+        {
+            client->received++;
+            char *name = frame + MSG_HEADER_SIZE + sizeof(ROOM_ID) + sizeof(TIMESTAMP) + sizeof(NAME_LEN);
+            if (strcmp(name, client->name) == 0)
+                client->echoed++;
+        }
+        offset += len;
+        handled++;
+    }
+
+    client->buf_len -= offset;
+    memmove(client->buf, client->buf + offset, client->buf_len);
+
+    return handled;
+}
+
+/**
+ * Receives whatever the server has sent to a client without blocking.
+ *
+ * @return  0 on success.
+ *          -1 if the connection was closed or failed.
+ */
+static int receive(struct bench_client *client)
+{
+    while (1)
+    {
+        ssize_t n = recv(client->fd, client->buf + client->buf_len, RECV_BUF_SIZE - client->buf_len, MSG_DONTWAIT);
+        if (n == 0)
+            return -1;
+        if (n == -1)
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+        client->buf_len += n;
+        handle_frames(client);
+    }
+}
+
+/**
+ * Sends a client's next messages until its window is full or it has sent them all, up to config->batch at a time.
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int send_messages(struct bench_client *client, struct bench_config *config, struct chat_message *msg)
+{
+    char batch[SEND_BATCH_MAX * MSG_SIZE_LIMIT];
+    msg->room_id = client->room;
+    while (client->sent < config->messages && client->sent - client->echoed < config->window)
+    {
+        size_t batch_len = 0;
+        for (int i = 0; i < config->batch && client->sent < config->messages &&
+                        client->sent - client->echoed < config->window;
+             i++)
+        {
+            char *buf;
+            size_t len;
+            if (chat_message_serialize(msg, &buf, &len) != 0)
+                return -1;
+            memcpy(batch + batch_len, buf, len);
+            batch_len += len;
+            free(buf);
+            client->sent++;
+        }
+
+        if (sendall(client->fd, batch, batch_len) != (ssize_t)batch_len)
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Drives a worker's clients until each has received every message sent to its room.
+ */
+static void *run_worker(void *arg)
+{
+    struct bench_worker *worker = arg;
+    struct bench_config *config = worker->config;
+
+    struct chat_message msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(msg.text, 'x', config->text_size);
+
+    int epfd = epoll_create1(0);
+    for (int i = 0; i < worker->num_clients; i++)
+    {
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &worker->clients[i]};
+        epoll_ctl(epfd, EPOLL_CTL_ADD, worker->clients[i].fd, &ev);
+        if (send_messages(&worker->clients[i], config, &msg) != 0)
+        {
+            fprintf(stderr, "failed to send to the server\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int remaining = worker->num_clients;
+    while (remaining > 0)
+    {
+        struct epoll_event events[64];
+        int n = epoll_wait(epfd, events, 64, 10000);
+        if (n <= 0)
+        {
+            fprintf(stderr, "timed out waiting for the server\n");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            struct bench_client *client = events[i].data.ptr;
+            bool done = client->received >= client->expected;
+            if (receive(client) != 0 || send_messages(client, config, &msg) != 0)
+            {
+                fprintf(stderr, "connection to the server failed\n");
+                exit(EXIT_FAILURE);
+            }
+            if (!done && client->received >= client->expected)
+                remaining--;
+        }
+    }
+
+    close(epfd);
+    return NULL;
+}
+
+/**
+ * Connects a client, names it and makes it join a room, waiting for both replies.
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int setup_client(struct bench_client *client, const char *host, const char *port, int index, ROOM_ID room)
+{
+    if ((client->fd = connect_to_server(host, port)) == -1)
+        return -1;
+
+    struct name_message name;
+    snprintf(name.name, sizeof(name.name), "bench%d", index);
+    strcpy(client->name, name.name);
+    client->room = room;
+    struct join_message join = {room};
+
+    char *buf;
+    size_t len;
+    if (name_message_serialize(&name, &buf, &len) != 0 || send_frame(client->fd, buf, len) != 0)
+        return -1;
+    if (join_message_serialize(&join, &buf, &len) != 0 || send_frame(client->fd, buf, len) != 0)
+        return -1;
+
+    // Wait for the two replies
+    int replies = 0;
+    while (replies < 2)
+    {
+        ssize_t n = recv(client->fd, client->buf + client->buf_len, RECV_BUF_SIZE - client->buf_len, 0);
+        if (n <= 0)
+            return -1;
+        client->buf_len += n;
+        replies += handle_frames(client);
+    }
+
+    return 0;
+}
+
+static void print_usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-r rooms] [-u users per room] [-m messages per user] [-w window] [-s text size] "
+                    "[-b messages per send (at most %d)] [-j threads (at most one per room)] [-h host] [-p port]\n",
+            prog, SEND_BATCH_MAX);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_config config = {
+        .rooms = 5, .users_per_room = 25, .messages = 1000, .window = 32, .text_size = 100, .batch = 1};
+    int num_workers = 1;
+    const char *host = "127.0.0.1";
+    const char *port = PORT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:u:m:w:s:b:j:h:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            config.rooms = atoi(optarg);
+            break;
+        case 'u':
+            config.users_per_room = atoi(optarg);
+            break;
+        case 'm':
+            config.messages = atol(optarg);
+            break;
+        case 'w':
+            config.window = atol(optarg);
+            break;
+        case 's':
+            config.text_size = atoi(optarg);
+            break;
+        case 'b':
+            config.batch = atoi(optarg);
+            break;
+        case 'j':
+            num_workers = atoi(optarg);
+            break;
+        case 'h':
+            host = optarg;
+            break;
+        case 'p':
+            port = optarg;
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int num_clients = config.rooms * config.users_per_room;
+    if (config.rooms < 1 || config.users_per_room < 1 || config.messages < 1 || config.window < 1 ||
+        config.text_size < 0 || config.text_size >= TEXT_SIZE_LIMIT || config.batch < 1 ||
+        config.batch > SEND_BATCH_MAX || num_workers < 1)
+    {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (num_workers > config.rooms)
+        num_workers = config.rooms;
+
+    struct bench_client *clients = calloc(num_clients, sizeof(struct bench_client));
+    struct bench_worker *workers = calloc(num_workers, sizeof(struct bench_worker));
+    if (clients == NULL || workers == NULL)
+    {
+        fprintf(stderr, "failed to allocate space for %d clients\n", num_clients);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < num_clients; i++)
+    {
+        clients[i].expected = config.users_per_room * config.messages;
+        if (setup_client(&clients[i], host, port, i, i / config.users_per_room + 1) != 0)
+        {
+            fprintf(stderr, "failed to set up client %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double start = now();
+    for (int i = 0; i < num_workers; i++)
+    {
+        int first_room = i * config.rooms / num_workers;
+        int last_room = (i + 1) * config.rooms / num_workers;
+        workers[i].clients = &clients[first_room * config.users_per_room];
+        workers[i].num_clients = (last_room - first_room) * config.users_per_room;
+        workers[i].config = &config;
+        pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]);
+    }
+    for (int i = 0; i < num_workers; i++)
+        pthread_join(workers[i].thread, NULL);
+    double elapsed = now() - start;
+
+    long sent = num_clients * config.messages;
+    long delivered = sent * config.users_per_room;
+    printf("rooms=%d users/room=%d messages=%ld deliveries=%ld time=%.3fs sent/s=%.0f delivered/s=%.0f\n",
+           config.rooms, config.users_per_room, sent, delivered, elapsed, sent / elapsed, delivered / elapsed);
+
+    for (int i = 0; i < num_clients; i++)
+        close(clients[i].fd);
+    free(clients);
+    free(workers);
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../utils/wal.h"
+
+// Measures what each WAL sync policy costs a reactor. Messages are appended in iterations of b, as a reactor accepts
+// them during an event loop iteration, and the WAL is committed at the end of each iteration, or after every message
+// with "always". For each policy it prints the messages made durable per second, the syncs they took, the latency a
+// message gains before it may be delivered, and the time it takes to reach the disk. With "interval" and "never",
+// messages are delivered before they are durable, and with "never" the kernel syncs them whenever it likes, so how
+// long that takes is not known.
+
+static const char *policy_names[] = {"always", "batch", "interval", "never"};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Sorts the latencies of n messages, turning them from times into durations, and prints their median and 99th
+ * percentile in microseconds.
+ */
+static void print_latencies(double *times, const double *appended, long n)
+{
+    if (n == 0)
+    {
+        printf(" %12s %12s", "-", "-");
+        return;
+    }
+
+    for (long i = 0; i < n; i++)
+        times[i] -= appended[i];
+    qsort(times, n, sizeof(double), compare_doubles);
+    printf(" %12.1f %12.1f", times[n / 2] * 1e6, times[n * 99 / 100] * 1e6);
+}
+
+/**
+ * Marks the messages the WAL is synced past as durable now.
+ *
+ * @return  Number of messages durable from the first one on.
+ */
+static long mark_durable(struct wal *wal, const uint64_t *lsns, double *durable, long synced, long count)
+{
+    uint64_t synced_lsn = atomic_load(&wal->synced);
+    double t = now();
+    for (; synced < count && lsns[synced] <= synced_lsn; synced++)
+        durable[synced] = t;
+
+    return synced;
+}
+
+/**
+ * Appends and commits up to n messages of a given size with one policy, for at most max_seconds, and prints the
+ * results.
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int run_policy(enum wal_sync_policy policy, const char *dir, long n, int batch, size_t size,
+                      unsigned interval_ms, double max_seconds)
+{
+    wal_remove(dir);
+    struct wal *wal = wal_open(dir, policy);
+    char *msg = malloc(size);
+    double *appended = malloc(n * sizeof(double));
+    double *delivered = malloc(n * sizeof(double));
+    double *durable = malloc(n * sizeof(double));
+    uint64_t *lsns = malloc(n * sizeof(uint64_t));
+    if (wal == NULL || msg == NULL || appended == NULL || delivered == NULL || durable == NULL || lsns == NULL)
+        return -1;
+
+    // A chat message frame as the server would log it
+    memset(msg, 'x', size);
+    uint32_t len = htonl((uint32_t)size);
+    memcpy(msg, &len, sizeof(len));
+    msg[sizeof(len)] = 0;
+
+    struct wal_syncer syncer;
+    if (policy == WAL_SYNC_INTERVAL && wal_syncer_start(&syncer, &wal, 1, interval_ms) != 0)
+        return -1;
+
+    long count = 0;
+    long synced = 0;
+    double start = now();
+    while (count < n && now() - start < max_seconds)
+    {
+        long first = count;
+        for (int i = 0; i < batch && count < n; i++)
+        {
+            appended[count] = now();
+            if ((lsns[count] = wal_append(wal, 1, count + 1, msg, size)) == 0)
+                return -1;
+            count++;
+
+            if (policy == WAL_SYNC_ALWAYS)
+            {
+                if (wal_commit(wal) != 0)
+                    return -1;
+                delivered[count - 1] = now();
+                synced = mark_durable(wal, lsns, durable, synced, count);
+            }
+        }
+
+        if (policy != WAL_SYNC_ALWAYS)
+        {
+            if (wal_commit(wal) != 0)
+                return -1;
+            double t = now();
+            for (long i = first; i < count; i++)
+                delivered[i] = t;
+            synced = mark_durable(wal, lsns, durable, synced, count);
+        }
+    }
+
+    // The syncing thread syncs once more as it stops
+    if (policy == WAL_SYNC_INTERVAL)
+    {
+        wal_syncer_stop(&syncer);
+        double t = now();
+        for (; synced < count; synced++)
+            durable[synced] = t;
+    }
+    double elapsed = (synced > 0 ? durable[synced - 1] : now()) - start;
+
+    uint64_t syncs = atomic_load(&wal->syncs);
+    printf("%-8s %9ld", policy_names[policy], count);
+    if (synced > 0)
+        printf(" %10.0f %9" PRIu64 " %9.1f", synced / elapsed, syncs, (double)synced / syncs);
+    else
+        printf(" %10s %9" PRIu64 " %9s", "-", syncs, "-");
+    print_latencies(delivered, appended, count);
+    print_latencies(durable, appended, synced);
+    printf("\n");
+
+    wal_close(wal);
+    wal_remove(dir);
+    free(msg);
+    free(appended);
+    free(delivered);
+    free(durable);
+    free(lsns);
+
+    return 0;
+}
+
+static void print_usage(char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-n messages] [-b messages per iteration] [-s message size] [-i sync interval ms] "
+            "[-t seconds per policy] [-d dir]\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    long n = 200000;
+    int batch = 64;
+    long size = 128;
+    int interval_ms = 100;
+    double max_seconds = 5;
+    const char *dir = "wal_bench.tmp";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:b:s:i:t:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n = atol(optarg);
+            break;
+        case 'b':
+            batch = atoi(optarg);
+            break;
+        case 's':
+            size = atol(optarg);
+            break;
+        case 'i':
+            interval_ms = atoi(optarg);
+            break;
+        case 't':
+            max_seconds = atof(optarg);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (n < 1 || batch < 1 || size < 5 || size > 65536 || interval_ms < 1 || max_seconds <= 0)
+    {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%ld byte messages, %d per iteration, syncs every %d ms with interval, in %s\n", size, batch, interval_ms,
+           dir);
+    printf("%-8s %9s %10s %9s %9s %12s %12s %12s %12s\n", "policy", "messages", "durable/s", "syncs", "msgs/sync",
+           "deliver p50", "deliver p99", "durable p50", "durable p99");
+    for (int policy = WAL_SYNC_ALWAYS; policy <= WAL_SYNC_NEVER; policy++)
+        if (run_policy(policy, dir, n, batch, size, interval_ms, max_seconds) != 0)
+        {
+            fprintf(stderr, "failed to run the %s policy\n", policy_names[policy]);
+            exit(EXIT_FAILURE);
+        }
+    printf("(latencies in us, added from when a message is appended)\n");
+
+    return 0;
+}
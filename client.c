@@ -1,5 +1,6 @@
 #include <arpa/inet.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <netdb.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,14 +14,20 @@
 #include "data_structures/pollfd_array.h"
 #include "lib/log.h"
 #include "types/messages/chat_message.h"
+#include "types/messages/history_batch_message.h"
+#include "types/messages/history_message.h"
 #include "types/messages/join_message.h"
+#include "types/messages/leave_message.h"
 #include "types/messages/name_message.h"
 #include "types/messages/message.h"
 #include "types/messages/reply_message.h"
+#include "types/messages/search_message.h"
+#include "types/messages/search_result_message.h"
 #include "utils/net_utils.h"
 #include "utils/sockaddr_utils.h"
 
-#define COMMAND_SIZE_LIMIT 5
+#define COMMAND_SIZE_LIMIT 8 // Longest command name (7 characters) and its null character
+#define SEARCH_RESULTS 20    // Most messages a search names
 
 /**
  * Gets the address info of the server for the given port and stores it in res. The server runs on the same host as the
@@ -107,9 +114,9 @@ int send_name_message(int server, char *name)
     struct name_message msg;
     strcpy(msg.name, name);
 
-    char *send_buf;
+    char send_buf[MSG_SIZE_LIMIT];
     size_t len;
-    if (name_message_serialize(&msg, &send_buf, &len) != 0)
+    if (name_message_serialize_to(&msg, send_buf, sizeof(send_buf), &len) != 0)
     {
         LOG_ERROR("failed to serialize the name message");
         return -1;
@@ -118,10 +125,8 @@ int send_name_message(int server, char *name)
     if (sendall(server, send_buf, len) == -1)
     {
         LOG_ERROR("failed to send the name message");
-        free(send_buf);
         return -1;
     }
-    free(send_buf);
 
     LOG_INFO("sent name message to server");
 
@@ -142,9 +147,9 @@ int send_join_message(int server, ROOM_ID room_id)
     struct join_message msg;
     msg.room_id = room_id;
 
-    char *send_buf;
+    char send_buf[MSG_SIZE_LIMIT];
     size_t len;
-    if (join_message_serialize(&msg, &send_buf, &len) != 0)
+    if (join_message_serialize_to(&msg, send_buf, sizeof(send_buf), &len) != 0)
     {
         LOG_ERROR("failed to serialize the join message");
         return -1;
@@ -153,30 +158,139 @@ int send_join_message(int server, ROOM_ID room_id)
     if (sendall(server, send_buf, len) == -1)
     {
         LOG_ERROR("failed to send the join message");
-        free(send_buf);
         return -1;
     }
-    free(send_buf);
 
     LOG_INFO("sent join message to server");
 
     return 0;
 }
 
+/**
+ * Sends the id of a room the user wants to leave to the server. The server will remove the user from the chat room.
+ *
+ * @param server    The server socket.
+ * @param room_id   The id of the room the user wants to leave.
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int send_leave_message(int server, ROOM_ID room_id)
+{
+    struct leave_message msg;
+    msg.room_id = room_id;
+
+    char send_buf[MSG_SIZE_LIMIT];
+    size_t len;
+    if (leave_message_serialize_to(&msg, send_buf, sizeof(send_buf), &len) != 0)
+    {
+        LOG_ERROR("failed to serialize the leave message");
+        return -1;
+    }
+
+    if (sendall(server, send_buf, len) == -1)
+    {
+        LOG_ERROR("failed to send the leave message");
+        return -1;
+    }
+
+    LOG_INFO("sent leave message to server");
+
+    return 0;
+}
+
+/**
+ * Asks the server for the messages of a room from a sequence number on. The server will send them back in batches.
+ *
+ * @param server    The server socket.
+ * @param room_id   The id of the room whose messages the user wants.
+ * @param from_seq  The sequence number of the first message wanted.
+ * @param count     The most messages wanted.
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int send_history_message(int server, ROOM_ID room_id, MSG_SEQ from_seq, MSG_COUNT count)
+{
+    struct history_message msg;
+    msg.room_id = room_id;
+    msg.from_seq = from_seq;
+    msg.count = count;
+
+    char send_buf[MSG_SIZE_LIMIT];
+    size_t len;
+    if (history_message_serialize_to(&msg, send_buf, sizeof(send_buf), &len) != 0)
+    {
+        LOG_ERROR("failed to serialize the history message");
+        return -1;
+    }
+
+    if (sendall(server, send_buf, len) == -1)
+    {
+        LOG_ERROR("failed to send the history message");
+        return -1;
+    }
+
+    LOG_INFO("sent history message to server");
+
+    return 0;
+}
+
+/**
+ * Asks the server for the newest messages of a room matching a query. The server will send back their numbers.
+ *
+ * @param server    The server socket.
+ * @param room_id   The id of the room to search.
+ * @param query     Pointer to a char buffer containing the query.
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int send_search_message(int server, ROOM_ID room_id, char *query)
+{
+    struct search_message msg;
+    msg.room_id = room_id;
+    msg.count = SEARCH_RESULTS;
+    strcpy(msg.query, query);
+
+    char send_buf[MSG_SIZE_LIMIT];
+    size_t len;
+    if (search_message_serialize_to(&msg, send_buf, sizeof(send_buf), &len) != 0)
+    {
+        LOG_ERROR("failed to serialize the search message");
+        return -1;
+    }
+
+    if (sendall(server, send_buf, len) == -1)
+    {
+        LOG_ERROR("failed to send the search message");
+        return -1;
+    }
+
+    LOG_INFO("sent search message to server");
+
+    return 0;
+}
+
 /**
  * Executes the command in str if it is a valid command.
  *
  * Commands:
  * - /name [name] - Sets the user's name to [name]
+ * - /join [room] - Joins room [room], or switches to it if already in it: text typed afterwards is sent to it
+ * - /leave [room] - Leaves room [room]
+ * - /history [room] [seq] [count] - Shows up to [count] messages of room [room] from message number [seq] on
+ * - /search [room] [query] - Shows the numbers of the newest messages of room [room] holding every word of [query]
  * - /exit - Exits the application
  *
  * @param str       The command
  * @param server    The server socket
+ * @param room_id   Pointer to the id of the room text is sent to, 0 if none
  */
-void execute_command(char *str, int server)
+void execute_command(char *str, int server, ROOM_ID *room_id)
 {
     char command[COMMAND_SIZE_LIMIT];
-    if (sscanf(str, "/%5s", command) != 1)
+    if (sscanf(str, "/%7s", command) != 1)
     {
         LOG_ERROR("not a valid command");
         return;
@@ -185,7 +299,7 @@ void execute_command(char *str, int server)
     if (strcmp(command, "name") == 0)
     {
         char new_name[NAME_SIZE_LIMIT];
-        if (sscanf(str, "/%5s %100s", command, new_name) != 2)
+        if (sscanf(str, "/%7s %100s", command, new_name) != 2)
         {
             LOG_ERROR("name not provided");
             return;
@@ -198,17 +312,72 @@ void execute_command(char *str, int server)
     }
     else if (strcmp(command, "join") == 0)
     {
-        ROOM_ID room_id;
-        if (sscanf(str, "/%5s %hhd", command, &room_id) != 2)
+        ROOM_ID join_id;
+        if (sscanf(str, "/%7s %" SCNu32, command, &join_id) != 2)
         {
             LOG_ERROR("room id not provided");
             return;
         }
-        if (send_join_message(server, room_id) != 0)
+        if (send_join_message(server, join_id) != 0)
         {
             LOG_ERROR("failed to join room");
             return;
         }
+        *room_id = join_id;
+    }
+    else if (strcmp(command, "leave") == 0)
+    {
+        ROOM_ID leave_id;
+        if (sscanf(str, "/%7s %" SCNu32, command, &leave_id) != 2)
+        {
+            LOG_ERROR("room id not provided");
+            return;
+        }
+        if (send_leave_message(server, leave_id) != 0)
+        {
+            LOG_ERROR("failed to leave room");
+            return;
+        }
+        if (*room_id == leave_id)
+            *room_id = 0;
+    }
+    else if (strcmp(command, "history") == 0)
+    {
+        ROOM_ID history_id;
+        MSG_SEQ from_seq;
+        MSG_COUNT count;
+        if (sscanf(str, "/%7s %" SCNu32 " %" SCNu64 " %" SCNu32, command, &history_id, &from_seq, &count) != 4)
+        {
+            LOG_ERROR("room id, message number or count not provided");
+            return;
+        }
+        if (send_history_message(server, history_id, from_seq, count) != 0)
+        {
+            LOG_ERROR("failed to ask for history");
+            return;
+        }
+    }
+    else if (strcmp(command, "search") == 0)
+    {
+        ROOM_ID search_id;
+        int query_start;
+        if (sscanf(str, "/%7s %" SCNu32 " %n", command, &search_id, &query_start) != 2 || str[query_start] == '\0')
+        {
+            LOG_ERROR("room id or query not provided");
+            return;
+        }
+        char *query = str + query_start;
+        query[strcspn(query, "\n")] = '\0';
+        if (strlen(query) >= QUERY_SIZE_LIMIT)
+        {
+            LOG_ERROR("query longer than %d characters", QUERY_SIZE_LIMIT - 1);
+            return;
+        }
+        if (send_search_message(server, search_id, query) != 0)
+        {
+            LOG_ERROR("failed to search");
+            return;
+        }
     }
     else if (strcmp(command, "exit") == 0)
         exit(EXIT_SUCCESS);
@@ -217,25 +386,27 @@ void execute_command(char *str, int server)
 }
 
 /**
- * Sends text entered by the user to the server. The text will be sent to all other users in the same room as the client.
+ * Sends text entered by the user to the server. The text will be sent to all other users in the room.
  *
  * @param server    The server socket.
+ * @param room_id   The id of the room to send the text to.
  * @param text      Pointer to a char buffer containing the user's input.
  *
  * @return  0 on success.
  *          -1 on error.
  */
-int send_chat_message(int server, char *text)
+int send_chat_message(int server, ROOM_ID room_id, char *text)
 {
-    // Only the text field of the chat_message gets set by the client so initialize struct with 0s to avoid
+    // Only the room and text fields of the chat_message get set by the client so initialize struct with 0s to avoid
     // uninitialized value error for other fields when serializing
     struct chat_message msg;
     memset(&msg, 0, sizeof(msg));
+    msg.room_id = room_id;
     strcpy(msg.text, text);
 
-    char *send_buf;
+    char send_buf[MSG_SIZE_LIMIT];
     size_t len;
-    if (chat_message_serialize(&msg, &send_buf, &len) != 0)
+    if (chat_message_serialize_to(&msg, send_buf, sizeof(send_buf), &len) != 0)
     {
         LOG_ERROR("failed to serialize the chat message");
         return -1;
@@ -244,10 +415,8 @@ int send_chat_message(int server, char *text)
     if (sendall(server, send_buf, len) == -1)
     {
         LOG_ERROR("failed to send the chat message");
-        free(send_buf);
         return -1;
     }
-    free(send_buf);
 
     LOG_INFO("sent chat message to server");
 
@@ -257,14 +426,16 @@ int send_chat_message(int server, char *text)
 /**
  * Handles input from the user.
  *
- * If input is a command, executes the command. Otherwise, input is a message so sends it to the server.
+ * If input is a command, executes the command. Otherwise, input is a message so sends it to the server, for the room
+ * the user joined last.
  *
- * @param server  The server socket
+ * @param server    The server socket
+ * @param room_id   Pointer to the id of the room text is sent to, 0 if none
  *
  * @return  0 on success.
  *          -1 on error.
  */
-int handle_input(int server)
+int handle_input(int server, ROOM_ID *room_id)
 {
     char buf[TEXT_SIZE_LIMIT];
     if (fgets(buf, sizeof(buf), stdin) == NULL)
@@ -276,11 +447,17 @@ int handle_input(int server)
 
     if (strncmp(buf, "/", 1) == 0)
     {
-        execute_command(buf, server);
+        execute_command(buf, server, room_id);
+        return 0;
+    }
+
+    if (*room_id == 0)
+    {
+        printf("** you are not in a chat room: type '/join [room number]' to join a room **\n");
         return 0;
     }
 
-    if (send_chat_message(server, buf) != 0)
+    if (send_chat_message(server, *room_id, buf) != 0)
     {
         LOG_ERROR("failed to send chat message");
         return -1;
@@ -292,8 +469,8 @@ int handle_input(int server)
 /**
  * Handles a chat message from the server.
  *
- * The server sends this kind of message when someone has sent a message to the chat room the client is in. As a result,
- * this function will print message to the terminal.
+ * The server sends this kind of message when someone has sent a message to one of the chat rooms the client is in. As
+ * a result, this function will print message to the terminal.
  *
  * @param buf   Pointer to a char buffer containing the message
  */
@@ -316,6 +493,49 @@ void handle_reply_message(char *buf)
     printf("** %s **\n", msg.reply);
 }
 
+/**
+ * Handles a history batch message from the server.
+ *
+ * The server sends this kind of message in answer to a history message, each one followed by the chat messages it
+ * counts, which are handled as any other. As a result, this function will print which messages follow.
+ *
+ * @param buf   Pointer to a char buffer containing the message
+ */
+void handle_history_batch_message(char *buf)
+{
+    struct history_batch_message msg;
+    history_batch_message_deserialize(buf, &msg);
+    if (msg.count > 0)
+        printf("** %" PRIu32 " messages of room %" PRIu32 " from message %" PRIu64 " **\n", msg.count, msg.room_id,
+               msg.first_seq);
+    else if (!msg.more)
+        printf("** no more messages of room %" PRIu32 " from message %" PRIu64 " **\n", msg.room_id, msg.first_seq);
+}
+
+/**
+ * Handles a search result message from the server.
+ *
+ * The server sends this kind of message in answer to a search message. As a result, this function will print the
+ * numbers of the messages found, newest first.
+ *
+ * @param buf   Pointer to a char buffer containing the message
+ */
+void handle_search_result_message(char *buf)
+{
+    struct search_result_message msg;
+    search_result_message_deserialize(buf, &msg);
+    if (msg.count == 0)
+    {
+        printf("** no messages of room %" PRIu32 " match **\n", msg.room_id);
+        return;
+    }
+
+    printf("** messages of room %" PRIu32 " matching:", msg.room_id);
+    for (MSG_COUNT i = 0; i < msg.count; i++)
+        printf(" %" PRIu64, msg.seqs[i]);
+    printf("%s **\n", msg.more ? " and maybe older ones" : "");
+}
+
 /**
  * Handles a message from the server.
  *
@@ -329,8 +549,8 @@ void handle_reply_message(char *buf)
  */
 int handle_server_message(int server)
 {
-    char *recv_buf;
-    ssize_t recvd = recvall(server, &recv_buf);
+    char recv_buf[MSG_SIZE_LIMIT];
+    ssize_t recvd = recvall(server, recv_buf, sizeof(recv_buf));
     if (recvd == -1)
     {
         LOG_ERROR("failed to receive server message");
@@ -352,12 +572,18 @@ int handle_server_message(int server)
         LOG_INFO("received reply message from server");
         handle_reply_message(recv_buf);
         break;
+    case HISTORY_BATCH_MESSAGE:
+        LOG_INFO("received history batch message from server");
+        handle_history_batch_message(recv_buf);
+        break;
+    case SEARCH_RESULT_MESSAGE:
+        LOG_INFO("received search result message from server");
+        handle_search_result_message(recv_buf);
+        break;
     default:
         LOG_ERROR("invalid message type");
-        free(recv_buf);
         return -1;
     }
-    free(recv_buf);
 
     return 0;
 }
@@ -365,6 +591,7 @@ int handle_server_message(int server)
 int main()
 {
     int server;
+    ROOM_ID room_id = 0; // Room typed text is sent to: the room joined last, 0 if none
     struct pollfd_array *pollfds = pollfd_array_init();
 
     int status;
@@ -420,7 +647,7 @@ int main()
             {
                 if (fd == STDIN_FILENO)
                 {
-                    if (handle_input(server) != 0)
+                    if (handle_input(server, &room_id) != 0)
                     {
                         LOG_ERROR("failed to handle user input");
                         exit(EXIT_FAILURE);
@@ -0,0 +1,142 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "buffer_pool.h"
+#include "slab.h"
+#include "../lib/log.h"
+
+static const size_t class_sizes[BUFFER_POOL_NUM_CLASSES] = {64, 256, 1024, 4096, BUFFER_POOL_MAX_SIZE};
+
+// A size class of the pool
+struct buffer_class
+{
+    struct slab_pool *pool; // Buffers of the class, NULL until buffer_pool_init() is called
+    atomic_size_t hits;
+    atomic_size_t misses;
+};
+
+static struct buffer_class classes[BUFFER_POOL_NUM_CLASSES];
+static atomic_size_t heap_allocs;
+static atomic_size_t heap_outstanding;
+
+// The calling thread's free list of each class, set up on the thread's first use of the class
+static _Thread_local struct slab_cache caches[BUFFER_POOL_NUM_CLASSES];
+
+/**
+ * Finds the smallest class holding size bytes.
+ *
+ * @return  Index of the class, or -1 if the buffer has to come from the heap.
+ */
+static int find_class(size_t size)
+{
+    if (classes[0].pool == NULL)
+        return -1;
+
+    for (int i = 0; i < BUFFER_POOL_NUM_CLASSES; i++)
+        if (size <= class_sizes[i])
+            return i;
+
+    return -1;
+}
+
+int buffer_pool_init(bool hugepages)
+{
+    for (int i = 0; i < BUFFER_POOL_NUM_CLASSES; i++)
+    {
+        if ((classes[i].pool = slab_pool_init(class_sizes[i], hugepages)) == NULL)
+        {
+            LOG_ERROR("failed to initialize pool of %zu byte buffers", class_sizes[i]);
+            for (int j = 0; j <= i; j++)
+            {
+                if (classes[j].pool != NULL)
+                    slab_pool_free(classes[j].pool);
+                classes[j].pool = NULL;
+            }
+            return -1;
+        }
+        atomic_init(&classes[i].hits, 0);
+        atomic_init(&classes[i].misses, 0);
+    }
+
+    return 0;
+}
+
+void *buffer_pool_alloc(size_t size)
+{
+    int i = find_class(size);
+    if (i == -1)
+    {
+        void *buf = malloc(size);
+        if (buf == NULL)
+        {
+            LOG_ERROR("failed to allocate space for %zu byte buffer", size);
+            return NULL;
+        }
+        atomic_fetch_add_explicit(&heap_allocs, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&heap_outstanding, 1, memory_order_relaxed);
+        return buf;
+    }
+
+    struct slab_cache *cache = &caches[i];
+    if (cache->pool == NULL)
+        slab_cache_init(cache, classes[i].pool);
+
+    // Only the counts need to be right, so relaxed ordering is enough
+    atomic_fetch_add_explicit(cache->free_list != NULL ? &classes[i].hits : &classes[i].misses, 1,
+                              memory_order_relaxed);
+
+    void *buf = slab_alloc(cache);
+    if (buf == NULL)
+        LOG_ERROR("failed to allocate space for %zu byte buffer", size);
+
+    return buf;
+}
+
+size_t buffer_pool_size(size_t size)
+{
+    int i = find_class(size);
+    return i == -1 ? size : class_sizes[i];
+}
+
+void buffer_pool_release(void *buf, size_t size)
+{
+    if (buf == NULL)
+        return;
+
+    int i = find_class(size);
+    if (i == -1)
+    {
+        free(buf);
+        atomic_fetch_sub_explicit(&heap_outstanding, 1, memory_order_relaxed);
+        return;
+    }
+
+    struct slab_cache *cache = &caches[i];
+    if (cache->pool == NULL)
+        slab_cache_init(cache, classes[i].pool);
+    slab_release(cache, buf);
+}
+
+void buffer_pool_stats(struct buffer_pool_stats *stats)
+{
+    for (int i = 0; i < BUFFER_POOL_NUM_CLASSES; i++)
+    {
+        struct buffer_class_stats *s = &stats->classes[i];
+        s->size = class_sizes[i];
+        s->hits = atomic_load_explicit(&classes[i].hits, memory_order_relaxed);
+        s->misses = atomic_load_explicit(&classes[i].misses, memory_order_relaxed);
+        s->outstanding = 0;
+        if (classes[i].pool != NULL)
+        {
+            struct slab_stats slab;
+            slab_pool_stats(classes[i].pool, &slab);
+            s->outstanding = slab.live;
+        }
+    }
+
+    stats->heap.size = 0;
+    stats->heap.hits = 0;
+    stats->heap.misses = atomic_load_explicit(&heap_allocs, memory_order_relaxed);
+    stats->heap.outstanding = atomic_load_explicit(&heap_outstanding, memory_order_relaxed);
+}
@@ -0,0 +1,74 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BUFFER_POOL_NUM_CLASSES 5 // Number of buffer sizes the pool keeps (64 B, 256 B, 1 KiB, 4 KiB and 8 KiB)
+#define BUFFER_POOL_MAX_SIZE 8192 // Size of the largest class, larger buffers come from the heap
+
+// Counts of the buffers of one size class
+struct buffer_class_stats
+{
+    size_t size;        // Size of the class's buffers in bytes, 0 for buffers served by the heap
+    size_t hits;        // Allocations served by the calling thread's free list
+    size_t misses;      // Allocations which had to refill the thread's free list from the shared pool, or use the heap
+    size_t outstanding; // Buffers allocated and not released
+};
+
+// Counts of every size class of the buffer pool
+struct buffer_pool_stats
+{
+    struct buffer_class_stats classes[BUFFER_POOL_NUM_CLASSES];
+    struct buffer_class_stats heap; // Buffers larger than BUFFER_POOL_MAX_SIZE, or allocated without a pool
+};
+
+/**
+ * Sets up the process wide pool of buffers. Each size class is a slab pool (see slab.h), and each thread allocates
+ * through its own free lists, so released buffers are reused without going through the heap or taking a lock.
+ *
+ * Must be called before any buffer is allocated. Without a pool, every buffer comes from the heap.
+ *
+ * @param hugepages Whether to back the buffers with hugepages
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int buffer_pool_init(bool hugepages);
+
+/**
+ * Allocates a buffer of at least size bytes from the smallest class it fits in. The buffer's contents are undefined.
+ *
+ * @param size  Number of bytes needed
+ *
+ * @return  Pointer to the buffer on success.
+ *          NULL on error.
+ */
+void *buffer_pool_alloc(size_t size);
+
+/**
+ * Gets the number of bytes usable in a buffer allocated with buffer_pool_alloc(size), so callers can make use of the
+ * whole size class.
+ *
+ * @param size  Number of bytes the buffer was (or will be) allocated for
+ *
+ * @return  Size of the buffer in bytes, at least size.
+ */
+size_t buffer_pool_size(size_t size);
+
+/**
+ * Releases a buffer into the calling thread's free list. The buffer may have been allocated by another thread.
+ *
+ * @param buf   Pointer to the buffer, or NULL
+ * @param size  Number of bytes the buffer was allocated for (or its buffer_pool_size())
+ */
+void buffer_pool_release(void *buf, size_t size);
+
+/**
+ * Gets the counts of every size class. Safe to call from any thread.
+ *
+ * @param stats Pointer to a struct which will store the counts
+ */
+void buffer_pool_stats(struct buffer_pool_stats *stats);
+
+#endif
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "conn_table.h"
+#include "../lib/log.h"
+
+#define INITIAL_CAPACITY 1024
+
+/**
+ * Grows a connection table so fd fits, at least doubling its size so repeated growth stays amortized O(1).
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int grow(struct conn_table *table, int fd)
+{
+    size_t cap = table->cap;
+    while (cap <= (size_t)fd)
+        cap *= 2;
+
+    struct conn_slot *slots = reallocarray(table->slots, cap, sizeof(struct conn_slot));
+    if (slots == NULL)
+    {
+        LOG_ERROR("failed to allocate space for %zu connection slots", cap);
+        return -1;
+    }
+    memset(slots + table->cap, 0, (cap - table->cap) * sizeof(struct conn_slot));
+    table->slots = slots;
+    table->cap = cap;
+
+    LOG_INFO("resized connection table to %zu", cap);
+
+    return 0;
+}
+
+CONN_HANDLE conn_handle_make(int fd, uint32_t generation)
+{
+    return (CONN_HANDLE)generation << 32 | (uint32_t)fd;
+}
+
+int conn_handle_fd(CONN_HANDLE handle)
+{
+    return (int)(uint32_t)handle;
+}
+
+int conn_table_init(struct conn_table *table)
+{
+    table->slots = calloc(INITIAL_CAPACITY, sizeof(struct conn_slot));
+    if (table->slots == NULL)
+    {
+        LOG_ERROR("failed to allocate space for %d connection slots", INITIAL_CAPACITY);
+        return -1;
+    }
+    table->cap = INITIAL_CAPACITY;
+    table->count = 0;
+
+    return 0;
+}
+
+void conn_table_free(struct conn_table *table)
+{
+    free(table->slots);
+    table->slots = NULL;
+    table->cap = 0;
+    table->count = 0;
+}
+
+int conn_table_insert(struct conn_table *table, CONN_HANDLE handle, void *conn)
+{
+    int fd = conn_handle_fd(handle);
+    if (fd < 0)
+    {
+        LOG_ERROR("invalid connection fd %d", fd);
+        return -1;
+    }
+
+    if ((size_t)fd >= table->cap && grow(table, fd) != 0)
+        return -1;
+
+    struct conn_slot *slot = &table->slots[fd];
+    if (slot->conn != NULL)
+    {
+        LOG_ERROR("connection %d already exists in table", fd);
+        return -1;
+    }
+    slot->conn = conn;
+    slot->generation = handle >> 32;
+    table->count++;
+
+    return 0;
+}
+
+void *conn_table_remove(struct conn_table *table, CONN_HANDLE handle)
+{
+    void *conn = conn_table_get(table, handle);
+    if (conn == NULL)
+    {
+        LOG_ERROR("connection %d does not exist in table", conn_handle_fd(handle));
+        return NULL;
+    }
+
+    table->slots[conn_handle_fd(handle)].conn = NULL;
+    table->count--;
+
+    return conn;
+}
+
+void *conn_table_get(const struct conn_table *table, CONN_HANDLE handle)
+{
+    int fd = conn_handle_fd(handle);
+    if (fd < 0 || (size_t)fd >= table->cap)
+        return NULL;
+
+    const struct conn_slot *slot = &table->slots[fd];
+    return slot->generation == handle >> 32 ? slot->conn : NULL;
+}
@@ -0,0 +1,103 @@
+#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Identifies a connection: its socket fd (the index of its slot) in the low 32 bits and a generation in the high 32
+// bits. The kernel reuses the fd of a closed connection, but the new connection gets a new generation, so a handle kept
+// by deferred work never reaches the wrong connection.
+typedef uint64_t CONN_HANDLE;
+
+#define INVALID_CONN_HANDLE 0 // A handle no connection has, generation 0 is never handed out
+
+// A slot of a connection table
+struct conn_slot
+{
+    void *conn;          // The connection using the fd, NULL if the slot is free
+    uint32_t generation; // Generation of the connection using the fd (or of the last one)
+};
+
+// A table of connections indexed directly by socket fd. The kernel hands out the lowest free fd, so fds are small and
+// dense, and a lookup is a single array access with no hashing. A lookup by handle also checks the generation, so a
+// handle outliving its connection finds nothing. The array grows to fit the largest fd inserted.
+struct conn_table
+{
+    struct conn_slot *slots;
+    size_t cap;   // Number of slots, one more than the largest fd which fits
+    size_t count; // Number of connections in the table
+};
+
+/**
+ * Builds the handle of a connection.
+ *
+ * @param fd            The socket fd of the connection
+ * @param generation    The generation of the connection, not 0
+ *
+ * @return  The handle
+ */
+CONN_HANDLE conn_handle_make(int fd, uint32_t generation);
+
+/**
+ * Gets the socket fd of a connection from its handle.
+ *
+ * @param handle    The handle of the connection
+ *
+ * @return  The socket fd
+ */
+int conn_handle_fd(CONN_HANDLE handle);
+
+/**
+ * Initializes an empty connection table.
+ *
+ * The table should be freed with conn_table_free() when no longer needed.
+ *
+ * @param table Pointer to the table
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int conn_table_init(struct conn_table *table);
+
+/**
+ * Frees the slots of a connection table. The connections themselves are left to the caller.
+ *
+ * @param table Pointer to the table
+ */
+void conn_table_free(struct conn_table *table);
+
+/**
+ * Adds a connection to a table in the slot of its socket fd, growing the table if the fd does not fit.
+ *
+ * @param table     Pointer to the table
+ * @param handle    The handle of the connection
+ * @param conn      Pointer to the connection's state
+ *
+ * @return  0 on success.
+ *          -1 if the fd is already in use in the table or the table cannot grow.
+ */
+int conn_table_insert(struct conn_table *table, CONN_HANDLE handle, void *conn);
+
+/**
+ * Removes a connection from a table.
+ *
+ * @param table     Pointer to the table
+ * @param handle    The handle of the connection
+ *
+ * @return  Pointer to the connection's state on success.
+ *          NULL if the connection is not in the table.
+ */
+void *conn_table_remove(struct conn_table *table, CONN_HANDLE handle);
+
+/**
+ * Finds a connection by handle in O(1): the slot of its fd is used only if it holds the handle's generation.
+ *
+ * @param table     Pointer to the table
+ * @param handle    The handle of the connection
+ *
+ * @return  Pointer to the connection's state.
+ *          NULL if the connection is not in the table (it was closed, even if its fd has been reused since).
+ */
+void *conn_table_get(const struct conn_table *table, CONN_HANDLE handle);
+
+#endif
@@ -0,0 +1,433 @@
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer_pool.h"
+#include "history_ring.h"
+#include "../lib/log.h"
+
+/**
+ * Copies bytes into a ring buffer at the position of their stream offset, wrapping around its end.
+ *
+ * @param data      Pointer to the buffer
+ * @param cap       Size of the buffer, a power of 2
+ * @param offset    Stream offset of the first byte
+ * @param src       Pointer to the bytes
+ * @param len       Number of bytes, at most cap
+ */
+static void ring_write(char *data, size_t cap, uint64_t offset, const char *src, size_t len)
+{
+    size_t pos = offset & (cap - 1);
+    size_t first = len < cap - pos ? len : cap - pos;
+    memcpy(data + pos, src, first);
+    memcpy(data, src + first, len - first);
+}
+
+/**
+ * Copies bytes out of a ring buffer from the position of their stream offset, wrapping around its end.
+ *
+ * @param data      Pointer to the buffer
+ * @param cap       Size of the buffer, a power of 2
+ * @param offset    Stream offset of the first byte
+ * @param dst       Pointer to a buffer which will store the bytes
+ * @param len       Number of bytes, at most cap
+ */
+static void ring_read(const char *data, size_t cap, uint64_t offset, char *dst, size_t len)
+{
+    size_t pos = offset & (cap - 1);
+    size_t first = len < cap - pos ? len : cap - pos;
+    memcpy(dst, data + pos, first);
+    memcpy(dst + first, data, len - first);
+}
+
+/**
+ * Gets the length of the frame at a stream offset of a history ring.
+ *
+ * @param ring      Pointer to the ring
+ * @param offset    Stream offset of the frame
+ *
+ * @return  Length of the frame in bytes.
+ */
+static uint32_t frame_len(const struct history_ring *ring, uint64_t offset)
+{
+    uint32_t len;
+    ring_read(ring->data, ring->cap, offset, (char *)&len, sizeof(len));
+
+    return ntohl(len);
+}
+
+/**
+ * Doubles the buffer of a history ring, or allocates its first one, if the ring's budget allows it. Frames keep their
+ * stream offsets, so they move to where those map in the larger buffer.
+ *
+ * @param ring  Pointer to the ring
+ *
+ * @return  true if the ring grew.
+ *          false if it is as large as the budget allows, or on error.
+ */
+static bool grow(struct history_ring *ring)
+{
+    struct history_budget *budget = ring->budget;
+    size_t cap = ring->cap == 0 ? HISTORY_RING_MIN_SIZE : 2 * ring->cap;
+    if (cap > budget->ring_limit)
+        return false;
+
+    size_t added = cap - ring->cap;
+    if (atomic_fetch_add(&budget->used, added) + added > budget->limit)
+    {
+        atomic_fetch_sub(&budget->used, added);
+        return false;
+    }
+
+    char *data = buffer_pool_alloc(cap);
+    if (data == NULL)
+    {
+        LOG_ERROR("failed to allocate space for history");
+        atomic_fetch_sub(&budget->used, added);
+        return false;
+    }
+
+    for (uint64_t offset = ring->head; offset < ring->tail;)
+    {
+        size_t pos = offset & (ring->cap - 1);
+        size_t len = ring->tail - offset < ring->cap - pos ? ring->tail - offset : ring->cap - pos;
+        ring_write(data, cap, offset, ring->data + pos, len);
+        offset += len;
+    }
+    buffer_pool_release(ring->data, ring->cap);
+    ring->data = data;
+    ring->cap = cap;
+
+    return true;
+}
+
+/**
+ * Gets the mark of a frame of a history ring.
+ *
+ * @param ring  Pointer to the ring
+ * @param i     Position of the frame in the ring, 0 for the oldest
+ *
+ * @return  Pointer to the mark.
+ */
+static struct history_mark *mark(const struct history_ring *ring, size_t i)
+{
+    return &ring->marks[(ring->first_mark + i) & (ring->marks_cap - 1)];
+}
+
+/**
+ * Gets the stream offset at which a frame of a history ring starts.
+ *
+ * @param ring  Pointer to the ring
+ * @param i     Position of the frame in the ring, 0 for the oldest, or ring->count for the end of the newest
+ *
+ * @return  The stream offset.
+ */
+static uint64_t frame_offset(const struct history_ring *ring, size_t i)
+{
+    return i < ring->count ? mark(ring, i)->offset : ring->tail;
+}
+
+/**
+ * Doubles the index of a history ring, or allocates its first one, if the ring's budget allows it. Marks keep their
+ * indexes, so they move to where those map in the larger index.
+ *
+ * @param ring  Pointer to the ring
+ *
+ * @return  true if the index grew.
+ *          false if the budget does not allow it, or on error.
+ */
+static bool grow_marks(struct history_ring *ring)
+{
+    struct history_budget *budget = ring->budget;
+    size_t cap = ring->marks_cap == 0 ? HISTORY_RING_MIN_MARKS : 2 * ring->marks_cap;
+    size_t added = (cap - ring->marks_cap) * sizeof(struct history_mark);
+    if (atomic_fetch_add(&budget->used, added) + added > budget->limit)
+    {
+        atomic_fetch_sub(&budget->used, added);
+        return false;
+    }
+
+    struct history_mark *marks = buffer_pool_alloc(cap * sizeof(struct history_mark));
+    if (marks == NULL)
+    {
+        LOG_ERROR("failed to allocate space for the history index");
+        atomic_fetch_sub(&budget->used, added);
+        return false;
+    }
+
+    for (uint64_t i = ring->first_mark; i < ring->first_mark + ring->count; i++)
+        marks[i & (cap - 1)] = ring->marks[i & (ring->marks_cap - 1)];
+    buffer_pool_release(ring->marks, ring->marks_cap * sizeof(struct history_mark));
+    ring->marks = marks;
+    ring->marks_cap = cap;
+
+    return true;
+}
+
+/**
+ * Finds a frame of a history ring by its sequence number, with a binary search of its index. Frames are numbered in
+ * the order they were appended, though not always one after the other.
+ *
+ * @param ring  Pointer to the ring
+ * @param seq   Sequence number of the frame
+ *
+ * @return  Index of the oldest frame numbered seq or later, ring->count if there is none.
+ */
+static size_t find_frame(const struct history_ring *ring, uint64_t seq)
+{
+    size_t lo = 0;
+    size_t hi = ring->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mark(ring, mid)->seq < seq)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * Counts the oldest frames of a history ring up to the first one held back.
+ *
+ * @param ring  Pointer to the ring
+ *
+ * @return  Number of frames.
+ */
+static size_t count_committed(const struct history_ring *ring)
+{
+    return ring->first_held < ring->num_held ? find_frame(ring, ring->held[ring->first_held]) : ring->count;
+}
+
+/**
+ * Drops the oldest frame of a history ring.
+ *
+ * @param ring  Pointer to the ring, which holds frames
+ */
+static void drop_oldest(struct history_ring *ring)
+{
+    ring->head += frame_len(ring, ring->head);
+    ring->first_mark++;
+    ring->count--;
+}
+
+void history_budget_init(struct history_budget *budget, size_t ring_limit, size_t limit)
+{
+    budget->ring_limit = ring_limit;
+    budget->limit = limit;
+    atomic_init(&budget->used, 0);
+}
+
+void history_ring_init(struct history_ring *ring, struct history_budget *budget)
+{
+    ring->data = NULL;
+    ring->cap = 0;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->count = 0;
+    ring->next_seq = 1;
+    ring->next_stamp = 1;
+    ring->marks = NULL;
+    ring->marks_cap = 0;
+    ring->first_mark = 0;
+    ring->budget = budget;
+    ring->held = NULL;
+    ring->first_held = 0;
+    ring->num_held = 0;
+    ring->held_cap = 0;
+}
+
+void history_ring_free(struct history_ring *ring)
+{
+    if (ring->data != NULL)
+    {
+        buffer_pool_release(ring->data, ring->cap);
+        atomic_fetch_sub(&ring->budget->used, ring->cap);
+    }
+    if (ring->marks != NULL)
+    {
+        buffer_pool_release(ring->marks, ring->marks_cap * sizeof(struct history_mark));
+        atomic_fetch_sub(&ring->budget->used, ring->marks_cap * sizeof(struct history_mark));
+    }
+    ring->data = NULL;
+    ring->cap = 0;
+    ring->head = ring->tail;
+    ring->count = 0;
+    ring->marks = NULL;
+    ring->marks_cap = 0;
+    ring->first_mark = 0;
+    free(ring->held);
+    ring->held = NULL;
+    ring->first_held = 0;
+    ring->num_held = 0;
+    ring->held_cap = 0;
+}
+
+uint64_t history_ring_append(struct history_ring *ring, const char *frame, size_t len)
+{
+    uint64_t seq = ring->next_seq++;
+    ring->next_stamp++;
+
+    // Grow while the budget allows it, then drop the oldest frames until the new one fits
+    while (ring->tail - ring->head + len > ring->cap && grow(ring))
+        ;
+    if (len > ring->cap)
+        return seq;
+    while (ring->tail - ring->head + len > ring->cap)
+        drop_oldest(ring);
+
+    // The index grows the same way, and without room in it the new frame is not stored either
+    while (ring->count == ring->marks_cap && !grow_marks(ring))
+    {
+        if (ring->count == 0)
+            return seq;
+        drop_oldest(ring);
+    }
+
+    ring_write(ring->data, ring->cap, ring->tail, frame, len);
+    *mark(ring, ring->count) = (struct history_mark){seq, ring->tail};
+    ring->tail += len;
+    ring->count++;
+
+    return seq;
+}
+
+int history_ring_hold(struct history_ring *ring, uint64_t seq)
+{
+    if (ring->num_held == ring->held_cap)
+    {
+        // Entries committed already make room first
+        if (ring->first_held > 0)
+        {
+            memmove(ring->held, ring->held + ring->first_held, (ring->num_held - ring->first_held) * sizeof(uint64_t));
+            ring->num_held -= ring->first_held;
+            ring->first_held = 0;
+        }
+        else
+        {
+            size_t cap = ring->held_cap == 0 ? HISTORY_RING_MIN_HELD : 2 * ring->held_cap;
+            uint64_t *held = realloc(ring->held, cap * sizeof(uint64_t));
+            if (held == NULL)
+            {
+                LOG_ERROR("failed to allocate space to hold back history message %" PRIu64, seq);
+                return -1;
+            }
+            ring->held = held;
+            ring->held_cap = cap;
+        }
+    }
+    ring->held[ring->num_held++] = seq;
+
+    return 0;
+}
+
+uint64_t history_ring_commit(struct history_ring *ring, uint64_t seq)
+{
+    // Frames are mostly committed in the order they were held back, so the frame is looked for from the oldest
+    for (size_t i = ring->first_held; i < ring->num_held; i++)
+        if (ring->held[i] == seq)
+        {
+            ring->held[i] = 0;
+            break;
+        }
+
+    while (ring->first_held < ring->num_held && ring->held[ring->first_held] == 0)
+        ring->first_held++;
+    if (ring->first_held == ring->num_held)
+    {
+        ring->first_held = 0;
+        ring->num_held = 0;
+    }
+
+    return ring->next_stamp++;
+}
+
+uint64_t history_ring_committed_seq(const struct history_ring *ring)
+{
+    return ring->first_held < ring->num_held ? ring->held[ring->first_held] : ring->next_seq;
+}
+
+void history_ring_find_newest(const struct history_ring *ring, size_t n, struct history_range *range)
+{
+    size_t first = n >= ring->count ? 0 : ring->count - n;
+    range->first_seq = first < ring->count ? mark(ring, first)->seq : ring->next_seq;
+    range->next_seq = ring->next_seq;
+    range->count = ring->count - first;
+    range->offset = frame_offset(ring, first);
+    range->len = ring->tail - range->offset;
+}
+
+size_t history_ring_read_committed(const struct history_ring *ring, const struct history_range *range, char *dst)
+{
+    // The frames between two held back are copied in one piece
+    size_t len = 0;
+    uint64_t offset = range->offset;
+    uint64_t end = range->offset + range->len;
+    for (size_t i = ring->first_held; i < ring->num_held && offset < end; i++)
+    {
+        uint64_t seq = ring->held[i];
+        if (seq == 0 || seq < range->first_seq)
+            continue;
+
+        size_t held = find_frame(ring, seq);
+        if (held == ring->count || mark(ring, held)->seq != seq)
+            continue;
+        uint64_t held_offset = frame_offset(ring, held);
+        if (held_offset >= end)
+            break;
+        ring_read(ring->data, ring->cap, offset, dst + len, held_offset - offset);
+        len += held_offset - offset;
+        offset = frame_offset(ring, held + 1);
+    }
+    if (offset < end)
+    {
+        ring_read(ring->data, ring->cap, offset, dst + len, end - offset);
+        len += end - offset;
+    }
+
+    return len;
+}
+
+void history_ring_range(const struct history_ring *ring, uint64_t seq, size_t max_count, size_t max_len,
+                        struct history_range *range)
+{
+    size_t shown = count_committed(ring);
+    size_t lo = find_frame(ring, seq);
+    if (lo > shown)
+        lo = shown;
+    if (lo == shown || max_count == 0)
+    {
+        uint64_t first_seq = lo < shown ? mark(ring, lo)->seq : history_ring_committed_seq(ring);
+        *range = (struct history_range){first_seq, first_seq, 0, frame_offset(ring, lo), 0};
+        return;
+    }
+
+    // The range ends at the last frame which fits, found with a binary search of the offsets
+    uint64_t offset = frame_offset(ring, lo);
+    size_t end = shown - lo > max_count ? lo + max_count : shown;
+    size_t first = lo + 1;
+    while (first < end)
+    {
+        size_t mid = first + (end - first + 1) / 2;
+        if (frame_offset(ring, mid) - offset <= max_len)
+            first = mid;
+        else
+            end = mid - 1;
+    }
+
+    range->first_seq = mark(ring, lo)->seq;
+    range->next_seq = first < shown ? mark(ring, first)->seq : history_ring_committed_seq(ring);
+    range->count = first - lo;
+    range->offset = offset;
+    range->len = frame_offset(ring, first) - offset;
+}
+
+void history_ring_read(const struct history_ring *ring, uint64_t offset, char *dst, size_t len)
+{
+    ring_read(ring->data, ring->cap, offset, dst, len);
+}
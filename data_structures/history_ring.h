@@ -0,0 +1,178 @@
+#ifndef HISTORY_RING_H
+#define HISTORY_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTORY_RING_MIN_SIZE 4096 // Size of a ring's first buffer, which holds any frame (see MSG_SIZE_LIMIT)
+#define HISTORY_RING_MIN_MARKS 64  // Number of frames a ring's first index has room for
+#define HISTORY_RING_MIN_HELD 16   // Number of held back frames a ring first has room for
+
+// Limits on the memory held by the history rings charged to it, which may be appended to by any thread
+struct history_budget
+{
+    size_t ring_limit;  // Most bytes one ring may hold
+    size_t limit;       // Most bytes all rings together may hold
+    atomic_size_t used; // Bytes held by all rings
+};
+
+// Where a frame of a history ring starts
+struct history_mark
+{
+    uint64_t seq;    // Sequence number of the frame
+    uint64_t offset; // Stream offset of the frame
+};
+
+// The frames of a history ring in a range of sequence numbers, which lie back to back from offset
+struct history_range
+{
+    uint64_t first_seq; // Sequence number of the first frame
+    uint64_t next_seq;  // Sequence number after the last frame
+    size_t count;       // Number of frames
+    uint64_t offset;    // Stream offset of the first frame
+    size_t len;         // Length of the frames in bytes
+};
+
+// The most recent frames sent to a room, stored back to back exactly as they were sent, so any number of the newest
+// ones, or those from any sequence number on, can be copied out in one piece. Bytes are addressed by their offset in
+// the stream of every byte ever appended, which maps to the buffer by its low bits. The buffer doubles while it is
+// full, up to the budget's limits, and after that the oldest frames are dropped to make room for new ones.
+// An index holds the sequence number and stream offset of every frame in the ring, in the order they were appended,
+// so a frame is found by its number with a binary search and the newest frames are found without walking them. The
+// index is a ring of its own, addressed by the count of frames ever appended, which doubles as the buffer does.
+// A frame may be held back from readers until it is committed. Frames are stamped in the order readers may see them,
+// when they are appended and, if they were held back, again when they are committed, so the frames a reader copies
+// are stamped below the ring's next stamp at that moment and those committed later from it on. Ranges by sequence
+// number stop at the oldest frame held back.
+struct history_ring
+{
+    char *data;                    // NULL until the first frame is appended
+    size_t cap;                    // Size of data, a power of 2
+    uint64_t head;                 // Stream offset of the oldest frame
+    uint64_t tail;                 // Stream offset just past the newest frame
+    size_t count;                  // Number of frames in the ring
+    uint64_t next_seq;             // Sequence number the next frame appended gets, starting at 1
+    uint64_t next_stamp;           // Stamp the next frame appended or committed gets, starting at 1
+    struct history_mark *marks;    // Index of the frames, NULL until the first frame is appended
+    size_t marks_cap;              // Number of marks there is room for, a power of 2
+    uint64_t first_mark;           // Index of the oldest frame's mark, which maps to marks by its low bits
+    struct history_budget *budget; // Budget the ring's buffer and index are charged to
+    uint64_t *held;                // Numbers of the frames held back, in order, 0 once committed, NULL if none ever was
+    size_t first_held;             // Index in held of the oldest frame still held back
+    size_t num_held;               // Number of entries in held, committed or not
+    size_t held_cap;               // Number of entries there is room for in held
+};
+
+/**
+ * Initializes a history budget with nothing charged to it.
+ *
+ * @param budget        Pointer to the budget
+ * @param ring_limit    Most bytes one ring may hold, 0 to keep no history
+ * @param limit         Most bytes all rings together may hold
+ */
+void history_budget_init(struct history_budget *budget, size_t ring_limit, size_t limit);
+
+/**
+ * Initializes an empty history ring. Its buffer is allocated when the first frame is appended.
+ *
+ * @param ring      Pointer to the ring
+ * @param budget    Pointer to the budget the ring is charged to
+ */
+void history_ring_init(struct history_ring *ring, struct history_budget *budget);
+
+/**
+ * Frees the buffer of a history ring and returns its size to the budget.
+ *
+ * @param ring  Pointer to the ring
+ */
+void history_ring_free(struct history_ring *ring);
+
+/**
+ * Appends a frame to a history ring and gives it the ring's next sequence number. The ring grows if the budget allows
+ * it, and drops its oldest frames otherwise. A frame the ring has no room for at all is numbered but not stored.
+ *
+ * @param ring  Pointer to the ring
+ * @param frame Pointer to the frame, starting with its length (see message.h)
+ * @param len   Length of the frame in bytes
+ *
+ * @return  Sequence number of the frame.
+ */
+uint64_t history_ring_append(struct history_ring *ring, const char *frame, size_t len);
+
+/**
+ * Holds back the newest frame of a history ring from readers until it is committed with history_ring_commit().
+ *
+ * @param ring  Pointer to the ring
+ * @param seq   Sequence number of the frame
+ *
+ * @return  0 on success.
+ *          -1 on error, in which case the frame is not held back.
+ */
+int history_ring_hold(struct history_ring *ring, uint64_t seq);
+
+/**
+ * Commits a frame held back by history_ring_hold() and stamps it.
+ *
+ * @param ring  Pointer to the ring
+ * @param seq   Sequence number of the frame
+ *
+ * @return  Stamp of the frame.
+ */
+uint64_t history_ring_commit(struct history_ring *ring, uint64_t seq);
+
+/**
+ * Gets the sequence number of the oldest frame held back in a history ring: every frame numbered below it is committed.
+ *
+ * @param ring  Pointer to the ring
+ *
+ * @return  The sequence number, ring->next_seq if no frame is held back.
+ */
+uint64_t history_ring_committed_seq(const struct history_ring *ring);
+
+/**
+ * Finds the newest frames of a history ring, committed or not.
+ *
+ * @param ring  Pointer to the ring
+ * @param n     Number of frames wanted, more than the ring holds means all of them
+ * @param range Pointer to the range, which is empty if n is 0 or the ring holds no frame
+ */
+void history_ring_find_newest(const struct history_ring *ring, size_t n, struct history_range *range);
+
+/**
+ * Copies the committed frames of a range of a history ring back to back, leaving out those held back.
+ *
+ * @param ring  Pointer to the ring
+ * @param range Pointer to the range, found by history_ring_find_newest()
+ * @param dst   Pointer to a buffer which will store the frames, range->len bytes long
+ *
+ * @return  Number of bytes copied.
+ */
+size_t history_ring_read_committed(const struct history_ring *ring, const struct history_range *range, char *dst);
+
+/**
+ * Finds the frames of a history ring from a sequence number on, up to the oldest one held back, with a binary search
+ * of its index.
+ * The range holds at most max_count frames and, unless its first frame alone is longer, max_len bytes.
+ *
+ * @param ring      Pointer to the ring
+ * @param seq       Sequence number of the first frame wanted, an older one than the ring holds means its oldest
+ * @param max_count Most frames in the range
+ * @param max_len   Most bytes in the range
+ * @param range     Pointer to the range. If max_count is 0 or the ring shows no frame from seq on, it is empty and starts
+ *                  where it would have, at the ring's committed sequence number in the latter case
+ */
+void history_ring_range(const struct history_ring *ring, uint64_t seq, size_t max_count, size_t max_len,
+                        struct history_range *range);
+
+/**
+ * Copies bytes out of a history ring.
+ *
+ * @param ring      Pointer to the ring
+ * @param offset    Stream offset of the first byte, at least ring->head
+ * @param dst       Pointer to a buffer which will store the bytes
+ * @param len       Number of bytes to copy, at most ring->tail - offset
+ */
+void history_ring_read(const struct history_ring *ring, uint64_t offset, char *dst, size_t len);
+
+#endif
@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpsc_ring.h"
+#include "../lib/log.h"
+
+// Every slot starts with a sequence number telling whose turn it is: pos when free for the push claiming position pos,
+// pos + 1 once that push has written its element, and pos + capacity once the element has been popped
+#define SLOT_SEQ(ring, pos) ((atomic_size_t *)((ring)->slots + ((pos) & ((ring)->capacity - 1)) * (ring)->slot_size))
+#define SLOT_ELEM(seq) ((char *)(seq) + sizeof(atomic_size_t))
+
+struct mpsc_ring *mpsc_ring_init(size_t capacity, size_t elem_size)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+    {
+        LOG_ERROR("ring capacity %zu is not a power of 2", capacity);
+        return NULL;
+    }
+
+    struct mpsc_ring *ring;
+    if (posix_memalign((void **)&ring, CACHE_LINE_SIZE, sizeof(struct mpsc_ring)) != 0)
+    {
+        LOG_ERROR("failed to allocate space for ring");
+        return NULL;
+    }
+
+    // Keep elements aligned for any type they may contain
+    size_t align = alignof(max_align_t);
+    ring->slot_size = (sizeof(atomic_size_t) + elem_size + align - 1) / align * align;
+    ring->capacity = capacity;
+    ring->elem_size = elem_size;
+
+    if (posix_memalign((void **)&ring->slots, CACHE_LINE_SIZE, capacity * ring->slot_size) != 0)
+    {
+        LOG_ERROR("failed to allocate space for %zu ring slots", capacity);
+        free(ring);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < capacity; i++)
+        atomic_init(SLOT_SEQ(ring, i), i);
+    atomic_init(&ring->tail, 0);
+    ring->head = 0;
+
+    return ring;
+}
+
+void mpsc_ring_free(struct mpsc_ring *ring)
+{
+    free(ring->slots);
+    free(ring);
+}
+
+int mpsc_ring_push(struct mpsc_ring *ring, const void *elem)
+{
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while (1)
+    {
+        atomic_size_t *seq = SLOT_SEQ(ring, pos);
+        intptr_t diff = (intptr_t)atomic_load_explicit(seq, memory_order_acquire) - (intptr_t)pos;
+        if (diff == 0)
+        {
+            // The slot is free: claim it, unless another producer got it first (pos is then reloaded)
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                memcpy(SLOT_ELEM(seq), elem, ring->elem_size);
+                atomic_store_explicit(seq, pos + 1, memory_order_release);
+                return 0;
+            }
+        }
+        else if (diff < 0)
+            return -1; // The slot still holds the element pushed one lap ago
+        else
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    }
+}
+
+size_t mpsc_ring_push_batch(struct mpsc_ring *ring, const void *elems, size_t n)
+{
+    if (n > ring->capacity)
+        n = ring->capacity;
+
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while (n > 0)
+    {
+        // The consumer frees slots in order, so the run is free if its last slot is
+        intptr_t diff = (intptr_t)atomic_load_explicit(SLOT_SEQ(ring, pos + n - 1), memory_order_acquire) -
+                        (intptr_t)(pos + n - 1);
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + n, memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                for (size_t i = 0; i < n; i++)
+                {
+                    atomic_size_t *seq = SLOT_SEQ(ring, pos + i);
+                    memcpy(SLOT_ELEM(seq), (const char *)elems + i * ring->elem_size, ring->elem_size);
+                    atomic_store_explicit(seq, pos + i + 1, memory_order_release);
+                }
+                return n;
+            }
+        }
+        else if (diff < 0)
+            n /= 2; // Not enough free slots, try a shorter run
+        else
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    }
+
+    return 0;
+}
+
+int mpsc_ring_pop(struct mpsc_ring *ring, void *elem)
+{
+    atomic_size_t *seq = SLOT_SEQ(ring, ring->head);
+    if (atomic_load_explicit(seq, memory_order_acquire) != ring->head + 1)
+        return -1; // Empty, or the producer which claimed the slot has not written it yet
+
+    memcpy(elem, SLOT_ELEM(seq), ring->elem_size);
+    atomic_store_explicit(seq, ring->head + ring->capacity, memory_order_release);
+    ring->head++;
+
+    return 0;
+}
+
+size_t mpsc_ring_pop_batch(struct mpsc_ring *ring, void *elems, size_t max)
+{
+    size_t n = 0;
+    while (n < max && mpsc_ring_pop(ring, (char *)elems + n * ring->elem_size) == 0)
+        n++;
+
+    return n;
+}
@@ -0,0 +1,90 @@
+#ifndef MPSC_RING_H
+#define MPSC_RING_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define CACHE_LINE_SIZE 64
+
+// A bounded lock-free queue of fixed size elements which any number of threads may push to and one thread pops from.
+// Pushes never block each other for longer than a compare-and-swap: a producer claims slots by advancing tail, then
+// publishes each slot through its sequence number.
+struct mpsc_ring
+{
+    alignas(CACHE_LINE_SIZE) atomic_size_t tail; // Position the next push claims, shared by producers
+    alignas(CACHE_LINE_SIZE) size_t head;        // Position the next pop reads, only touched by the consumer
+
+    alignas(CACHE_LINE_SIZE) char *slots; // Each slot holds a sequence number followed by an element
+    size_t capacity;                      // Number of slots, a power of 2
+    size_t elem_size;                     // Size of an element in bytes
+    size_t slot_size;                     // Size of a slot in bytes
+};
+
+/**
+ * Initializes a ring with room for capacity elements of elem_size bytes each.
+ *
+ * The returned struct should be freed with mpsc_ring_free() when no longer needed.
+ *
+ * @param capacity  Number of elements the ring can hold, must be a power of 2
+ * @param elem_size Size of an element in bytes
+ *
+ * @return  Pointer to the ring on success.
+ *          NULL if initialization fails.
+ */
+struct mpsc_ring *mpsc_ring_init(size_t capacity, size_t elem_size);
+
+/**
+ * Frees a ring. Elements still in it are discarded.
+ *
+ * @param ring  Pointer to the ring
+ */
+void mpsc_ring_free(struct mpsc_ring *ring);
+
+/**
+ * Copies an element to the back of the ring. Safe to call from any thread.
+ *
+ * @param ring  Pointer to the ring
+ * @param elem  Pointer to the element
+ *
+ * @return  0 on success.
+ *          -1 if the ring is full.
+ */
+int mpsc_ring_push(struct mpsc_ring *ring, const void *elem);
+
+/**
+ * Copies up to n elements to the back of the ring, as one contiguous run which no other producer's elements are
+ * interleaved with. Safe to call from any thread.
+ *
+ * @param ring  Pointer to the ring
+ * @param elems Pointer to an array of n elements
+ * @param n     Number of elements to push
+ *
+ * @return  Number of elements pushed, from the front of elems (0 if the ring is full).
+ */
+size_t mpsc_ring_push_batch(struct mpsc_ring *ring, const void *elems, size_t n);
+
+/**
+ * Removes the element at the front of the ring and copies it to elem. Must only be called by the consumer thread.
+ *
+ * @param ring  Pointer to the ring
+ * @param elem  Pointer to a buffer of elem_size bytes which will store the element
+ *
+ * @return  0 on success.
+ *          -1 if the ring is empty.
+ */
+int mpsc_ring_pop(struct mpsc_ring *ring, void *elem);
+
+/**
+ * Removes up to max elements from the front of the ring and copies them to elems. Must only be called by the consumer
+ * thread.
+ *
+ * @param ring  Pointer to the ring
+ * @param elems Pointer to an array of max elements which will store the elements
+ * @param max   Number of elements elems can hold
+ *
+ * @return  Number of elements popped (0 if the ring is empty).
+ */
+size_t mpsc_ring_pop_batch(struct mpsc_ring *ring, void *elems, size_t max);
+
+#endif
@@ -0,0 +1,188 @@
+#include <errno.h>
+#include <stdio.h>
+#include <sys/uio.h>
+
+#include "buffer_pool.h"
+#include "outbound_queue.h"
+#include "../lib/log.h"
+
+void outbound_queue_init(struct outbound_queue *queue)
+{
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->head_offset = 0;
+    queue->bytes = 0;
+    queue->spare = NULL;
+    queue->reserved = NULL;
+}
+
+/**
+ * Frees a segment, releasing its reference to its message.
+ */
+static void free_segment(struct outbound_segment *segment)
+{
+    shared_buffer_unref(segment->buf);
+    buffer_pool_release(segment, sizeof(struct outbound_segment));
+}
+
+/**
+ * Adds a segment to the back of an outbound queue.
+ */
+static void append_segment(struct outbound_queue *queue, struct outbound_segment *segment)
+{
+    segment->next = NULL;
+    if (queue->tail == NULL)
+        queue->head = segment;
+    else
+        queue->tail->next = segment;
+    queue->tail = segment;
+}
+
+void outbound_queue_clear(struct outbound_queue *queue)
+{
+    struct outbound_segment *segment = queue->head;
+    while (segment != NULL)
+    {
+        struct outbound_segment *next = segment->next;
+        free_segment(segment);
+        segment = next;
+    }
+    if (queue->spare != NULL)
+        free_segment(queue->spare);
+    outbound_queue_init(queue);
+}
+
+int outbound_queue_push(struct outbound_queue *queue, struct shared_buffer *buf)
+{
+    struct outbound_segment *segment = buffer_pool_alloc(sizeof(struct outbound_segment));
+    if (segment == NULL)
+    {
+        LOG_ERROR("failed to allocate space for outbound segment");
+        return -1;
+    }
+    segment->buf = shared_buffer_ref(buf);
+    segment->cap = 0;
+    append_segment(queue, segment);
+    queue->bytes += buf->len;
+
+    return 0;
+}
+
+char *outbound_queue_reserve(struct outbound_queue *queue, size_t len)
+{
+    struct outbound_segment *tail = queue->tail;
+    // Only a buffer the queue allocated has room to write to: a pushed message is shared with other queues
+    if (tail != NULL && tail->cap != 0 && tail->cap - tail->buf->len >= len)
+    {
+        queue->reserved = tail;
+        return tail->buf->data + tail->buf->len;
+    }
+
+    // The room comes from a buffer which is only queued once the message is committed
+    if (queue->spare == NULL || queue->spare->cap < len)
+    {
+        // Sized so the whole buffer, header included, fills one size class of the buffer pool
+        size_t size = OUTBOUND_TAIL_SIZE - sizeof(struct shared_buffer);
+        struct outbound_segment *segment = buffer_pool_alloc(sizeof(struct outbound_segment));
+        if (segment == NULL || (segment->buf = shared_buffer_alloc(len > size ? len : size)) == NULL)
+        {
+            LOG_ERROR("failed to allocate space for outbound segment");
+            buffer_pool_release(segment, sizeof(struct outbound_segment));
+            return NULL;
+        }
+        segment->cap = segment->buf->cap;
+
+        if (queue->spare != NULL)
+            free_segment(queue->spare);
+        queue->spare = segment;
+    }
+
+    queue->reserved = queue->spare;
+    return queue->spare->buf->data;
+}
+
+void outbound_queue_commit(struct outbound_queue *queue, size_t len)
+{
+    struct outbound_segment *segment = queue->reserved;
+    if (segment == queue->spare)
+    {
+        queue->spare = NULL;
+        append_segment(queue, segment);
+    }
+    queue->reserved = NULL;
+
+    segment->buf->len += len;
+    queue->bytes += len;
+}
+
+ssize_t outbound_queue_flush(struct outbound_queue *queue, int sockfd)
+{
+    size_t total_written = 0;
+
+    while (queue->head != NULL)
+    {
+        struct iovec iov[OUTBOUND_IOV_MAX];
+        int iovcnt = outbound_queue_fill_iov(queue, iov, OUTBOUND_IOV_MAX);
+
+        ssize_t written = writev(sockfd, iov, iovcnt);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return -1;
+        }
+
+        outbound_queue_consume(queue, written);
+        total_written += written;
+    }
+
+    return total_written;
+}
+
+int outbound_queue_fill_iov(struct outbound_queue *queue, struct iovec *iov, int max)
+{
+    int iovcnt = 0;
+    size_t offset = queue->head_offset;
+    for (struct outbound_segment *s = queue->head; s != NULL && iovcnt < max; s = s->next)
+    {
+        iov[iovcnt].iov_base = s->buf->data + offset;
+        iov[iovcnt].iov_len = s->buf->len - offset;
+        iovcnt++;
+        offset = 0;
+    }
+
+    return iovcnt;
+}
+
+void outbound_queue_consume(struct outbound_queue *queue, size_t n)
+{
+    queue->bytes -= n;
+    while (n > 0)
+    {
+        struct outbound_segment *head = queue->head;
+        size_t remaining = head->buf->len - queue->head_offset;
+        if (n < remaining)
+        {
+            queue->head_offset += n;
+            return;
+        }
+
+        n -= remaining;
+        queue->head = head->next;
+        queue->head_offset = 0;
+
+        // A buffer the queue allocated is not shared with anyone, so it can be reused once written
+        if (head->cap > 0 && queue->spare == NULL)
+        {
+            head->buf->len = 0;
+            queue->spare = head;
+        }
+        else
+            free_segment(head);
+    }
+
+    if (queue->head == NULL)
+        queue->tail = NULL;
+}
@@ -0,0 +1,111 @@
+#ifndef OUTBOUND_QUEUE_H
+#define OUTBOUND_QUEUE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "shared_buffer.h"
+
+#define OUTBOUND_IOV_MAX 64    // Maximum number of segments written by one writev()
+#define OUTBOUND_TAIL_SIZE 4096 // Size of the buffers (header included) the queue allocates for its tail
+
+// A serialized message waiting in an outbound queue
+struct outbound_segment
+{
+    struct outbound_segment *next;
+    struct shared_buffer *buf; // Reference to the message, which may be queued for other sockets as well
+    size_t cap;                // Size of a buffer the queue allocated for its tail, 0 for a pushed message
+};
+
+// A FIFO of serialized messages waiting to be written to a socket
+struct outbound_queue
+{
+    struct outbound_segment *head;
+    struct outbound_segment *tail;
+    size_t head_offset; // Number of bytes of head which have already been written
+    size_t bytes;       // Number of bytes waiting to be written
+    struct outbound_segment *spare;    // Tail buffer kept for outbound_queue_reserve(), not queued
+    struct outbound_segment *reserved; // Segment holding the room returned by the last outbound_queue_reserve()
+};
+
+/**
+ * Initializes an empty outbound queue.
+ *
+ * @param queue Pointer to the outbound queue
+ */
+void outbound_queue_init(struct outbound_queue *queue);
+
+/**
+ * Releases every message in an outbound queue, leaving it empty.
+ *
+ * @param queue Pointer to the outbound queue
+ */
+void outbound_queue_clear(struct outbound_queue *queue);
+
+/**
+ * Adds a serialized message to the back of an outbound queue. The queue takes its own reference to the message instead
+ * of copying it, and releases it once the message has been written.
+ *
+ * @param queue Pointer to the outbound queue
+ * @param buf   Pointer to a shared buffer containing the message
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int outbound_queue_push(struct outbound_queue *queue, struct shared_buffer *buf);
+
+/**
+ * Makes room for len bytes at the back of an outbound queue, so a message can be serialized straight into the queue.
+ * Messages serialized into the tail share a buffer the queue owns, and a written buffer is reused, so in steady state
+ * nothing is allocated. The message is queued once outbound_queue_commit() is called.
+ *
+ * @param queue Pointer to the outbound queue
+ * @param len   Number of bytes to make room for
+ *
+ * @return  Pointer to the room on success, valid until the next call modifying the queue.
+ *          NULL on error.
+ */
+char *outbound_queue_reserve(struct outbound_queue *queue, size_t len);
+
+/**
+ * Queues the len bytes written to the room returned by the last outbound_queue_reserve().
+ *
+ * @param queue Pointer to the outbound queue
+ * @param len   Number of bytes written, at most the number reserved
+ */
+void outbound_queue_commit(struct outbound_queue *queue, size_t len);
+
+/**
+ * Writes as much of an outbound queue as a non-blocking socket accepts, gathering up to OUTBOUND_IOV_MAX messages
+ * into each writev() call. Written messages are removed from the queue.
+ *
+ * @param queue     Pointer to the outbound queue
+ * @param sockfd    The non-blocking socket to write to
+ *
+ * @return  Number of bytes written (stops early without error when the socket's send buffer is full).
+ *          -1 on error (errno is set appropriately).
+ */
+ssize_t outbound_queue_flush(struct outbound_queue *queue, int sockfd);
+
+/**
+ * Describes the bytes at the front of an outbound queue which have not been written yet, one iovec per message, so they
+ * can be written with a single gather write.
+ *
+ * @param queue Pointer to the outbound queue
+ * @param iov   Pointer to an array which will store the iovecs
+ * @param max   Number of elements in iov
+ *
+ * @return  Number of iovecs stored (0 if the queue is empty).
+ */
+int outbound_queue_fill_iov(struct outbound_queue *queue, struct iovec *iov, int max);
+
+/**
+ * Marks n bytes at the front of an outbound queue as written, removing the messages they complete.
+ *
+ * @param queue Pointer to the outbound queue
+ * @param n     Number of bytes written, at most queue->bytes
+ */
+void outbound_queue_consume(struct outbound_queue *queue, size_t n);
+
+#endif
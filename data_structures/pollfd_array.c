@@ -54,7 +54,6 @@ struct pollfd_array *pollfd_array_init()
 
 int pollfd_array_append(struct pollfd_array *pollfds, int fd, short events)
 {
-    struct pollfd *fds = pollfds->fds;
     uint32_t len = pollfds->len;
     uint32_t capacity = pollfds->capacity;
 
@@ -66,6 +65,7 @@ int pollfd_array_append(struct pollfd_array *pollfds, int fd, short events)
             return -1;
         }
 
+    struct pollfd *fds = pollfds->fds; // Read after resizing since resizing can move the array
     fds[len].fd = fd;
     fds[len].events = events;
     fds[len].revents = 0;
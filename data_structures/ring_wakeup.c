@@ -0,0 +1,50 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "ring_wakeup.h"
+#include "../lib/log.h"
+
+int ring_wakeup_init(struct ring_wakeup *wakeup)
+{
+    if ((wakeup->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+    {
+        LOG_ERROR("failed to create eventfd: %s", strerror(errno));
+        return -1;
+    }
+    atomic_init(&wakeup->pending, false);
+
+    return 0;
+}
+
+void ring_wakeup_free(struct ring_wakeup *wakeup)
+{
+    close(wakeup->fd);
+}
+
+int ring_wakeup_signal(struct ring_wakeup *wakeup)
+{
+    if (atomic_exchange(&wakeup->pending, true))
+        return 0;
+
+    uint64_t one = 1;
+    if (write(wakeup->fd, &one, sizeof(one)) == -1)
+    {
+        LOG_ERROR("failed to signal eventfd: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+void ring_wakeup_clear(struct ring_wakeup *wakeup)
+{
+    uint64_t count;
+    if (read(wakeup->fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+        LOG_ERROR("failed to read eventfd: %s", strerror(errno));
+
+    atomic_store(&wakeup->pending, false);
+}
@@ -0,0 +1,54 @@
+#ifndef RING_WAKEUP_H
+#define RING_WAKEUP_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Wakes up the consumer of a ring (see mpsc_ring.h and spsc_ring.h) which sleeps in poll(), epoll or io_uring while
+// the ring is empty. The eventfd is only written once between two drains, however many elements are pushed.
+//
+// Producers push, then call ring_wakeup_signal(). The consumer waits for fd to become readable, calls
+// ring_wakeup_clear(), then pops until the ring is empty. Clearing before draining guarantees that an element pushed
+// after the drain signals fd again.
+struct ring_wakeup
+{
+    int fd;              // eventfd the consumer waits on
+    atomic_bool pending; // Whether fd has been signalled since the consumer last cleared it
+};
+
+/**
+ * Initializes a wakeup hook with a new non-blocking eventfd.
+ *
+ * @param wakeup    Pointer to the wakeup hook
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int ring_wakeup_init(struct ring_wakeup *wakeup);
+
+/**
+ * Closes the eventfd of a wakeup hook.
+ *
+ * @param wakeup    Pointer to the wakeup hook
+ */
+void ring_wakeup_free(struct ring_wakeup *wakeup);
+
+/**
+ * Wakes up the consumer after elements have been pushed, unless it has already been signalled. Safe to call from any
+ * thread.
+ *
+ * @param wakeup    Pointer to the wakeup hook
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int ring_wakeup_signal(struct ring_wakeup *wakeup);
+
+/**
+ * Resets the eventfd once the consumer has woken up. Must be called by the consumer before it drains the ring.
+ *
+ * @param wakeup    Pointer to the wakeup hook
+ */
+void ring_wakeup_clear(struct ring_wakeup *wakeup);
+
+#endif
@@ -0,0 +1,259 @@
+#include <limits.h>
+#include <stdio.h>
+
+#include "buffer_pool.h"
+#include "room_directory.h"
+#include "../types/room.h"
+#include "../lib/log.h"
+
+/**
+ * Gets the shard holding a room. Sequential ids land in different shards. The low bits of the id are used rather than a
+ * hash, as the shard's room map hashes ids into slots by their top bits: the rooms of a shard must not share those.
+ */
+static struct room_directory_shard *shard_of(struct room_directory *dir, ROOM_ID id)
+{
+    return &dir->shards[id & (ROOM_DIRECTORY_SHARDS - 1)];
+}
+
+/**
+ * Frees an entry and the history of its room.
+ *
+ * @param entry Pointer to the entry
+ */
+static void release_entry(struct room_entry *entry)
+{
+    history_ring_free(&entry->history);
+    pthread_mutex_destroy(&entry->history_lock);
+    buffer_pool_release(entry, sizeof(struct room_entry));
+}
+
+/**
+ * Frees an entry and the history of its room, has the log remember where the room's numbering is and has the search
+ * drop the room's index.
+ *
+ * @param dir   Pointer to the directory
+ * @param entry Pointer to the entry
+ */
+static void free_entry(struct room_directory *dir, struct room_entry *entry)
+{
+    if (dir->log != NULL)
+        room_log_close_room(dir->log, entry->id, entry->history.next_seq);
+    if (dir->search != NULL)
+        text_search_close_room(dir->search, entry->id);
+    release_entry(entry);
+}
+
+int room_directory_init(struct room_directory *dir, struct history_budget *history, struct room_log *log,
+                        struct text_search *search)
+{
+    for (int i = 0; i < ROOM_DIRECTORY_SHARDS; i++)
+    {
+        struct room_directory_shard *shard = &dir->shards[i];
+        if (room_map_init(&shard->rooms) != 0)
+        {
+            LOG_ERROR("failed to initialize room directory shard %d", i);
+            while (--i >= 0)
+            {
+                room_map_free(&dir->shards[i].rooms);
+                pthread_mutex_destroy(&dir->shards[i].lock);
+            }
+            return -1;
+        }
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+    atomic_init(&dir->count, 0);
+    dir->history = history;
+    dir->log = log;
+    dir->search = search;
+
+    return 0;
+}
+
+void room_directory_free(struct room_directory *dir)
+{
+    for (int i = 0; i < ROOM_DIRECTORY_SHARDS; i++)
+    {
+        struct room_directory_shard *shard = &dir->shards[i];
+        for (size_t s = 0; s < shard->rooms.cap; s++)
+            if (shard->rooms.slots[s].id != INVALID_ROOM)
+                free_entry(dir, shard->rooms.slots[s].value);
+        room_map_free(&shard->rooms);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    atomic_store(&dir->count, 0);
+}
+
+int room_directory_join(struct room_directory *dir, ROOM_ID id, int reactor, const struct room_log_lookup *lookup,
+                        struct room_entry **joined)
+{
+    *joined = NULL;
+    struct room_directory_shard *shard = shard_of(dir, id);
+    pthread_mutex_lock(&shard->lock);
+
+    struct room_entry *entry = room_map_find(&shard->rooms, id);
+    if (entry == NULL)
+    {
+        if ((entry = buffer_pool_alloc(sizeof(struct room_entry))) == NULL)
+        {
+            LOG_ERROR("failed to allocate space for room %u", id);
+            pthread_mutex_unlock(&shard->lock);
+            return -1;
+        }
+        entry->id = id;
+        atomic_init(&entry->reactors, 0);
+        pthread_mutex_init(&entry->history_lock, NULL);
+        history_ring_init(&entry->history, dir->history);
+
+        // The room's numbering is on disk only, which the log's writer reads rather than this thread
+        if (dir->log != NULL && room_log_open_room(dir->log, id, &entry->history, lookup) != 0)
+        {
+            release_entry(entry);
+            pthread_mutex_unlock(&shard->lock);
+            return 1;
+        }
+
+        if (room_map_insert(&shard->rooms, id, entry) != 0)
+        {
+            LOG_ERROR("failed to add room %u to room directory", id);
+            free_entry(dir, entry);
+            pthread_mutex_unlock(&shard->lock);
+            return -1;
+        }
+        atomic_fetch_add(&dir->count, 1);
+
+        // Under the shard's lock, so the open is queued after the close of the room's last entry
+        if (dir->search != NULL)
+            text_search_open_room(dir->search, id);
+    }
+    atomic_fetch_or(&entry->reactors, (uint64_t)1 << reactor);
+
+    pthread_mutex_unlock(&shard->lock);
+    *joined = entry;
+
+    return 0;
+}
+
+void room_directory_leave(struct room_directory *dir, struct room_entry *entry, int reactor)
+{
+    // Once its bit is cleared the reactor may not touch the entry, which another reactor may free at any time
+    ROOM_ID id = entry->id;
+    if ((atomic_fetch_and(&entry->reactors, ~((uint64_t)1 << reactor)) & ~((uint64_t)1 << reactor)) != 0)
+        return;
+
+    // The room looked closed everywhere, but a reactor may have joined it again since, or another reactor leaving may
+    // have freed it first, so it is only freed if it is still in the directory and still closed everywhere
+    struct room_directory_shard *shard = shard_of(dir, id);
+    pthread_mutex_lock(&shard->lock);
+
+    entry = room_map_find(&shard->rooms, id);
+    if (entry != NULL && atomic_load(&entry->reactors) == 0)
+    {
+        room_map_remove(&shard->rooms, id);
+        free_entry(dir, entry);
+        atomic_fetch_sub(&dir->count, 1);
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+}
+
+uint64_t room_directory_commit(struct room_directory *dir, struct room_entry *entry, ROOM_ID id, uint64_t seq,
+                               uint64_t *stamp)
+{
+    // An entry the reactor does not hold open is only kept from being freed by the shard's lock
+    struct room_directory_shard *shard = NULL;
+    *stamp = 0;
+    if (entry == NULL)
+    {
+        shard = shard_of(dir, id);
+        pthread_mutex_lock(&shard->lock);
+        if ((entry = room_map_find(&shard->rooms, id)) == NULL)
+        {
+            pthread_mutex_unlock(&shard->lock);
+            return 0;
+        }
+    }
+
+    // A reactor sets its bit before it replays the history under the same lock, so it is seen here unless the replay
+    // came after the commit and showed the message
+    pthread_mutex_lock(&entry->history_lock);
+    *stamp = history_ring_commit(&entry->history, seq);
+    uint64_t reactors = atomic_load(&entry->reactors);
+    pthread_mutex_unlock(&entry->history_lock);
+
+    if (shard != NULL)
+        pthread_mutex_unlock(&shard->lock);
+
+    return reactors;
+}
+
+/**
+ * Adds the open rooms of a shard to a snapshot being written, each with its history as it is at that moment.
+ *
+ * @param shard     Pointer to the shard
+ * @param writer    Pointer to the snapshot's writer
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int snapshot_shard(struct room_directory_shard *shard, struct snapshot_writer *writer)
+{
+    int status = 0;
+    pthread_mutex_lock(&shard->lock);
+    for (size_t i = 0; i < shard->rooms.cap && status == 0; i++)
+    {
+        if (shard->rooms.slots[i].id == INVALID_ROOM)
+            continue;
+
+        struct room_entry *entry = shard->rooms.slots[i].value;
+        pthread_mutex_lock(&entry->history_lock);
+        struct history_ring *history = &entry->history;
+        size_t len = history->tail - history->head;
+        char *dst = snapshot_writer_add_room(writer, entry->id, history->next_seq, history->count, len);
+        if (dst == NULL)
+            status = -1;
+        else if (len > 0)
+            history_ring_read(history, history->head, dst, len);
+        pthread_mutex_unlock(&entry->history_lock);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return status;
+}
+
+int room_directory_snapshot(struct room_directory *dir, const uint64_t *wal_lsns)
+{
+    struct room_log *log = dir->log;
+
+    // The snapshot must not replay a WAL from past what the rooms' logs have synced
+    uint64_t lsns[ROOM_DIRECTORY_MAX_REACTORS];
+    for (int i = 0; i < log->num_sources; i++)
+    {
+        uint64_t checkpoint = room_log_checkpoint(log, i);
+        lsns[i] = wal_lsns[i] < checkpoint ? wal_lsns[i] : checkpoint;
+    }
+
+    char path[PATH_MAX];
+    struct snapshot_writer writer;
+    if (room_log_snapshot_dir(log, path) != 0 || snapshot_writer_begin(&writer, path, log->num_sources, lsns) != 0)
+        return -1;
+
+    // A room closed or opened again meanwhile may be taken twice, and recovery keeps its newest state, or be missed,
+    // and recovery finds its numbering from its log on disk and the WALs past the snapshot, only losing its history
+    for (int i = 0; i < ROOM_DIRECTORY_SHARDS; i++)
+        if (snapshot_shard(&dir->shards[i], &writer) != 0)
+        {
+            snapshot_writer_abort(&writer);
+            return -1;
+        }
+    if (room_log_snapshot_rooms(log, &writer) != 0)
+    {
+        snapshot_writer_abort(&writer);
+        return -1;
+    }
+
+    if (snapshot_writer_commit(&writer) != 0)
+        return -1;
+    room_log_snapshot_taken(log, lsns);
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+#ifndef ROOM_DIRECTORY_H
+#define ROOM_DIRECTORY_H
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "history_ring.h"
+#include "mpsc_ring.h"
+#include "room_map.h"
+#include "../types/messages/join_message.h"
+#include "../utils/room_log.h"
+#include "../utils/text_search.h"
+
+#define ROOM_DIRECTORY_SHARDS 64 // Number of independently locked parts of the directory, a power of 2
+#define ROOM_DIRECTORY_MAX_REACTORS 64 // Number of reactors an entry has a bit for
+
+// What every reactor knows about an open room
+struct room_entry
+{
+    ROOM_ID id;
+    _Atomic uint64_t reactors;    // Bit i is set while reactor i has the room open
+    pthread_mutex_t history_lock; // Protects history, which any reactor with the room open appends to and reads
+    struct history_ring history;  // The room's most recent chat messages
+};
+
+// A part of a room directory, holding the rooms whose ids hash to it
+struct room_directory_shard
+{
+    alignas(CACHE_LINE_SIZE) pthread_mutex_t lock; // Protects rooms, not the entries' reactor masks
+    struct room_map rooms;                         // Entries of the shard's open rooms, by id
+};
+
+// The rooms open on any reactor of a group. A reactor joins a room's entry when its first user enters the room and
+// leaves it when its last user goes; the entry is created by the first reactor to join and freed by the last to leave,
+// along with the room's history.
+// Joining and leaving lock only the shard of the room, and the reactor mask of an entry is read and updated without any
+// lock by the reactors which have joined it.
+struct room_directory
+{
+    struct room_directory_shard shards[ROOM_DIRECTORY_SHARDS];
+    atomic_size_t count;            // Number of open rooms
+    struct history_budget *history; // Budget the histories of the rooms are charged to
+    struct room_log *log;           // Log the sequence numbers of the rooms carry on from, NULL if there is none
+    struct text_search *search;     // Search indexing the messages of the rooms, NULL if there is none
+};
+
+/**
+ * Initializes an empty room directory.
+ *
+ * The directory should be freed with room_directory_free() when no longer needed.
+ *
+ * @param dir       Pointer to the directory
+ * @param history   Pointer to the budget the histories of the rooms are charged to
+ * @param log       Pointer to the log of the rooms' messages, NULL if they are not logged
+ * @param search    Pointer to the search of the rooms' messages, NULL if they are not indexed
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int room_directory_init(struct room_directory *dir, struct history_budget *history, struct room_log *log,
+                        struct text_search *search);
+
+/**
+ * Frees a room directory and every entry left in it.
+ *
+ * @param dir   Pointer to the directory
+ */
+void room_directory_free(struct room_directory *dir);
+
+/**
+ * Marks a room as open on a reactor, creating its entry if no reactor has it open yet. The entry stays valid until the
+ * reactor leaves it. A new entry gets the room's state from the log: its numbering carries on from where it was, and a
+ * room recovered after a restart gets its history back. If the log keeps nothing of the room, its numbering is looked
+ * up on disk by the log's writer thread first, so joining never waits for the disk (see room_log_open_room()). The
+ * search starts a new entry's index over (see text_search_open_room()).
+ *
+ * @param dir       Pointer to the directory
+ * @param id        Id of the room, not INVALID_ROOM
+ * @param reactor   Index of the reactor, below ROOM_DIRECTORY_MAX_REACTORS
+ * @param lookup    Pointer to an answered lookup of the room by the log, NULL if there is none
+ * @param joined    Double pointer which will store the room's entry, NULL unless it was joined
+ *
+ * @return  0 on success.
+ *          1 if the room must be looked up with room_log_lookup() before the call is made again with the lookup.
+ *          -1 on error.
+ */
+int room_directory_join(struct room_directory *dir, ROOM_ID id, int reactor, const struct room_log_lookup *lookup,
+                        struct room_entry **joined);
+
+/**
+ * Marks a room as closed on a reactor, freeing its entry if no reactor has it open anymore. The reactor must not use
+ * the entry afterwards.
+ *
+ * @param dir       Pointer to the directory
+ * @param entry     Pointer to the room's entry, joined by the reactor
+ * @param reactor   Index of the reactor
+ */
+void room_directory_leave(struct room_directory *dir, struct room_entry *entry, int reactor);
+
+/**
+ * Commits a chat message held back in the history of its room (see history_ring_hold()), and reads the reactors the
+ * room is open on once it is. A reactor joining the room after that replays the message, and one which joined before
+ * is among those read, so every reactor either shows the message in its replay or gets it delivered.
+ *
+ * @param dir       Pointer to the directory
+ * @param entry     Pointer to the room's entry if the calling reactor has the room open, NULL to find it by its id
+ * @param id        Id of the room
+ * @param seq       Sequence number of the message
+ * @param stamp     Pointer which will store the stamp the message gets, 0 if the room is not open anywhere
+ *
+ * @return  Bit set of the reactors the room is open on, 0 if it is not open anywhere.
+ */
+uint64_t room_directory_commit(struct room_directory *dir, struct room_entry *entry, ROOM_ID id, uint64_t seq,
+                               uint64_t *stamp);
+
+/**
+ * Saves the state of every room in a snapshot: the open rooms with their histories, and the closed rooms the log
+ * still keeps (see room_log_snapshot_rooms()). Safe to call from any thread, and only ever from one at a time. The
+ * directory must have a log.
+ *
+ * Each open room is locked while it is copied, so messages keep flowing to the others. The snapshot holds every message
+ * a WAL had taken before the call; the WAL is replayed on top of it from the given LSN, or from the log's checkpoint if
+ * that is earlier.
+ *
+ * @param dir       Pointer to the directory
+ * @param wal_lsns  Pointer to the LSN in each of the log's WALs up to which records were appended before the call
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int room_directory_snapshot(struct room_directory *dir, const uint64_t *wal_lsns);
+
+#endif
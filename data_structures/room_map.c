@@ -0,0 +1,139 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "room_map.h"
+#include "../lib/log.h"
+
+/**
+ * Finds the slot a room's probe run starts at. Clients pick ids in patterns (sequential, strided), so every bit of the
+ * id is mixed into the top bits of the hash with the MurmurHash3 finalizer, and the top bits pick the slot.
+ */
+static size_t home_slot(const struct room_map *map, ROOM_ID id)
+{
+    uint32_t h = id;
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+
+    return (size_t)((uint64_t)h << 32 >> map->shift);
+}
+
+/**
+ * Puts a room in the first free slot of its probe run. The room must not be in the map, and the map must have a free
+ * slot.
+ */
+static void place(struct room_map *map, ROOM_ID id, void *value)
+{
+    size_t mask = map->cap - 1;
+    size_t i = home_slot(map, id);
+    while (map->slots[i].id != 0)
+        i = (i + 1) & mask;
+    map->slots[i].id = id;
+    map->slots[i].value = value;
+}
+
+/**
+ * Moves every room to a new array of cap slots.
+ *
+ * @return  0 on success.
+ *          -1 on error (the map is left as it was).
+ */
+static int resize(struct room_map *map, size_t cap)
+{
+    struct room_map_slot *slots = calloc(cap, sizeof(struct room_map_slot));
+    if (slots == NULL)
+    {
+        LOG_ERROR("failed to allocate space for %zu room slots", cap);
+        return -1;
+    }
+
+    struct room_map_slot *old_slots = map->slots;
+    size_t old_cap = map->cap;
+    map->slots = slots;
+    map->cap = cap;
+    map->shift = 64;
+    for (size_t c = cap; c > 1; c >>= 1)
+        map->shift--;
+
+    for (size_t i = 0; i < old_cap; i++)
+        if (old_slots[i].id != 0)
+            place(map, old_slots[i].id, old_slots[i].value);
+    free(old_slots);
+
+    return 0;
+}
+
+int room_map_init(struct room_map *map)
+{
+    map->slots = NULL;
+    map->cap = 0;
+    map->count = 0;
+
+    return resize(map, ROOM_MAP_MIN_CAPACITY);
+}
+
+void room_map_free(struct room_map *map)
+{
+    free(map->slots);
+    map->slots = NULL;
+    map->cap = 0;
+    map->count = 0;
+}
+
+void *room_map_find(const struct room_map *map, ROOM_ID id)
+{
+    size_t mask = map->cap - 1;
+    for (size_t i = home_slot(map, id); map->slots[i].id != 0; i = (i + 1) & mask)
+        if (map->slots[i].id == id)
+            return map->slots[i].value;
+
+    return NULL;
+}
+
+int room_map_insert(struct room_map *map, ROOM_ID id, void *value)
+{
+    if ((map->count + 1) * 4 > map->cap * 3 && resize(map, map->cap * 2) != 0)
+        return -1;
+
+    place(map, id, value);
+    map->count++;
+
+    return 0;
+}
+
+void *room_map_remove(struct room_map *map, ROOM_ID id)
+{
+    size_t mask = map->cap - 1;
+    size_t i = home_slot(map, id);
+    while (map->slots[i].id != id)
+    {
+        if (map->slots[i].id == 0)
+            return NULL;
+        i = (i + 1) & mask;
+    }
+    void *value = map->slots[i].value;
+
+    // Shift later rooms of the probe run back into the hole, unless that would move one before its home slot
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask; map->slots[j].id != 0; j = (j + 1) & mask)
+    {
+        size_t home = home_slot(map, map->slots[j].id);
+        if (((j - home) & mask) >= ((j - hole) & mask))
+        {
+            map->slots[hole] = map->slots[j];
+            hole = j;
+        }
+    }
+    map->slots[hole].id = 0;
+    map->slots[hole].value = NULL;
+    map->count--;
+
+    // Failing to shrink only wastes memory, so the error is ignored
+    if (map->cap > ROOM_MAP_MIN_CAPACITY && map->count * 8 < map->cap)
+        resize(map, map->cap / 2);
+
+    return value;
+}
@@ -0,0 +1,82 @@
+#ifndef ROOM_MAP_H
+#define ROOM_MAP_H
+
+#include <stddef.h>
+
+#include "../types/messages/join_message.h"
+
+#define ROOM_MAP_MIN_CAPACITY 16 // The map never shrinks below this many slots
+
+// A slot of a room map
+struct room_map_slot
+{
+    ROOM_ID id;  // Id of the room in the slot, INVALID_ROOM (0) if the slot is free
+    void *value;
+};
+
+// A hash map from room ids to pointers, using open addressing with linear probing. Removed entries are filled by
+// shifting the rest of their probe run back, so there are no tombstones and lookups stay short however many rooms come
+// and go. The slot array doubles when it is 3/4 full and halves when it is 1/8 full, so its size follows the number of
+// rooms in the map.
+struct room_map
+{
+    struct room_map_slot *slots;
+    size_t cap;   // Number of slots, a power of 2
+    size_t count; // Number of rooms in the map
+    int shift;    // 64 - log2(cap), turns a hash in the top 32 bits of a 64 bit word into a slot index
+};
+
+/**
+ * Initializes an empty room map.
+ *
+ * The map should be freed with room_map_free() when no longer needed.
+ *
+ * @param map   Pointer to the map
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int room_map_init(struct room_map *map);
+
+/**
+ * Frees the slots of a room map. The values are left to the caller.
+ *
+ * @param map   Pointer to the map
+ */
+void room_map_free(struct room_map *map);
+
+/**
+ * Finds the value of a room.
+ *
+ * @param map   Pointer to the map
+ * @param id    Id of the room
+ *
+ * @return  The room's value.
+ *          NULL if the room is not in the map.
+ */
+void *room_map_find(const struct room_map *map, ROOM_ID id);
+
+/**
+ * Adds a room which is not in the map yet, growing the map if it is too full.
+ *
+ * @param map   Pointer to the map
+ * @param id    Id of the room, not INVALID_ROOM
+ * @param value The room's value, not NULL
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int room_map_insert(struct room_map *map, ROOM_ID id, void *value);
+
+/**
+ * Removes a room from the map, shrinking the map if it has become mostly empty.
+ *
+ * @param map   Pointer to the map
+ * @param id    Id of the room
+ *
+ * @return  The room's value.
+ *          NULL if the room is not in the map.
+ */
+void *room_map_remove(struct room_map *map, ROOM_ID id);
+
+#endif
@@ -0,0 +1,73 @@
+#include <stdio.h>
+
+#include "room_registry.h"
+#include "../lib/log.h"
+
+int room_registry_init(struct room_registry *registry, struct slab_pool *pool)
+{
+    if (room_map_init(&registry->rooms) != 0)
+    {
+        LOG_ERROR("failed to initialize room map");
+        return -1;
+    }
+    slab_cache_init(&registry->cache, pool);
+
+    return 0;
+}
+
+void room_registry_free(struct room_registry *registry)
+{
+    for (size_t i = 0; i < registry->rooms.cap; i++)
+        if (registry->rooms.slots[i].id != INVALID_ROOM)
+        {
+            room_free(registry->rooms.slots[i].value);
+            slab_release(&registry->cache, registry->rooms.slots[i].value);
+        }
+    room_map_free(&registry->rooms);
+    slab_cache_flush(&registry->cache);
+}
+
+struct room *room_registry_find(struct room_registry *registry, ROOM_ID id)
+{
+    return room_map_find(&registry->rooms, id);
+}
+
+struct room *room_registry_open(struct room_registry *registry, ROOM_ID id, bool *created)
+{
+    struct room *room = room_map_find(&registry->rooms, id);
+    *created = room == NULL;
+    if (room != NULL)
+        return room;
+
+    if ((room = slab_alloc(&registry->cache)) == NULL)
+    {
+        LOG_ERROR("failed to allocate space for room %u", id);
+        return NULL;
+    }
+    room_init(room, id);
+
+    if (room_map_insert(&registry->rooms, id, room) != 0)
+    {
+        LOG_ERROR("failed to add room %u to room registry", id);
+        slab_release(&registry->cache, room);
+        return NULL;
+    }
+
+    LOG_INFO("opened room %u", id);
+
+    return room;
+}
+
+void room_registry_close(struct room_registry *registry, struct room *room)
+{
+    LOG_INFO("closed room %u", room->id);
+
+    room_map_remove(&registry->rooms, room->id);
+    room_free(room);
+    slab_release(&registry->cache, room);
+}
+
+size_t room_registry_count(const struct room_registry *registry)
+{
+    return registry->rooms.count;
+}
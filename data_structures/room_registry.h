@@ -0,0 +1,80 @@
+#ifndef ROOM_REGISTRY_H
+#define ROOM_REGISTRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "room_map.h"
+#include "slab.h"
+#include "../types/room.h"
+
+// The rooms a reactor has users in, by id. A room is created when its first user joins and reclaimed when its last user
+// leaves, so the registry holds only active rooms however many ids clients use. Rooms are allocated from a slab pool,
+// and looked up in O(1) through a room map which shrinks as rooms are reclaimed.
+struct room_registry
+{
+    struct room_map rooms;   // The open rooms, by id
+    struct slab_cache cache; // Free list of room records
+};
+
+/**
+ * Initializes an empty room registry.
+ *
+ * The registry should be freed with room_registry_free() when no longer needed.
+ *
+ * @param registry  Pointer to the registry
+ * @param pool      Slab pool of struct room records to allocate rooms from
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int room_registry_init(struct room_registry *registry, struct slab_pool *pool);
+
+/**
+ * Frees a room registry and every room left in it.
+ *
+ * @param registry  Pointer to the registry
+ */
+void room_registry_free(struct room_registry *registry);
+
+/**
+ * Finds an open room.
+ *
+ * @param registry  Pointer to the registry
+ * @param id        Id of the room
+ *
+ * @return  Pointer to the room.
+ *          NULL if the room is not open.
+ */
+struct room *room_registry_find(struct room_registry *registry, ROOM_ID id);
+
+/**
+ * Finds an open room, or creates it empty if it is not open yet.
+ *
+ * @param registry  Pointer to the registry
+ * @param id        Id of the room, not INVALID_ROOM
+ * @param created   Set to whether the room was created
+ *
+ * @return  Pointer to the room on success.
+ *          NULL on error.
+ */
+struct room *room_registry_open(struct room_registry *registry, ROOM_ID id, bool *created);
+
+/**
+ * Reclaims an empty room. The room must not be used afterwards.
+ *
+ * @param registry  Pointer to the registry
+ * @param room      Pointer to the room, which has no users
+ */
+void room_registry_close(struct room_registry *registry, struct room *room);
+
+/**
+ * Gets the number of open rooms.
+ *
+ * @param registry  Pointer to the registry
+ *
+ * @return  The number of rooms
+ */
+size_t room_registry_count(const struct room_registry *registry);
+
+#endif
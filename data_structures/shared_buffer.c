@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "buffer_pool.h"
+#include "shared_buffer.h"
+#include "../lib/log.h"
+
+struct shared_buffer *shared_buffer_wrap(char *data, size_t len)
+{
+    struct shared_buffer *buf = buffer_pool_alloc(sizeof(struct shared_buffer));
+    if (buf == NULL)
+    {
+        LOG_ERROR("failed to allocate space for shared buffer");
+        return NULL;
+    }
+    atomic_init(&buf->refcount, 1);
+    buf->len = len;
+    buf->cap = 0;
+    buf->data = data;
+
+    return buf;
+}
+
+struct shared_buffer *shared_buffer_alloc(size_t size)
+{
+    size_t alloc_size = buffer_pool_size(sizeof(struct shared_buffer) + size);
+    struct shared_buffer *buf = buffer_pool_alloc(alloc_size);
+    if (buf == NULL)
+    {
+        LOG_ERROR("failed to allocate space for shared buffer");
+        return NULL;
+    }
+    atomic_init(&buf->refcount, 1);
+    buf->len = 0;
+    buf->cap = alloc_size - sizeof(struct shared_buffer);
+    buf->data = (char *)(buf + 1);
+
+    return buf;
+}
+
+struct shared_buffer *shared_buffer_ref(struct shared_buffer *buf)
+{
+    atomic_fetch_add_explicit(&buf->refcount, 1, memory_order_relaxed);
+    return buf;
+}
+
+void shared_buffer_unref(struct shared_buffer *buf)
+{
+    // The last holder must see every other holder's accesses to the buffer before freeing it
+    if (atomic_fetch_sub_explicit(&buf->refcount, 1, memory_order_acq_rel) > 1)
+        return;
+
+    if (buf->cap == 0)
+        free(buf->data);
+    buffer_pool_release(buf, sizeof(struct shared_buffer) + buf->cap);
+}
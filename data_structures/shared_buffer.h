@@ -0,0 +1,59 @@
+#ifndef SHARED_BUFFER_H
+#define SHARED_BUFFER_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// An immutable, reference counted buffer holding a serialized message, so one copy can be queued for many sockets. The
+// buffer may be shared between threads.
+struct shared_buffer
+{
+    _Atomic uint32_t refcount; // Number of holders of the buffer, which is freed when it drops to 0
+    size_t len;                // Length of data in bytes
+    size_t cap;                // Room for data allocated along with the buffer, 0 if data was wrapped
+    char *data;
+};
+
+/**
+ * Wraps a heap allocated buffer in a shared buffer holding one reference, which belongs to the caller. The shared buffer
+ * takes ownership of data, which must not be modified or freed afterwards.
+ *
+ * @param data  Pointer to a buffer allocated with malloc()
+ * @param len   Length of the buffer in bytes
+ *
+ * @return  Pointer to the shared buffer on success.
+ *          NULL on error (data is left to the caller).
+ */
+struct shared_buffer *shared_buffer_wrap(char *data, size_t len);
+
+/**
+ * Allocates a shared buffer with room for at least size bytes of data in the same allocation, holding one reference
+ * which belongs to the caller. The allocation comes from the buffer pool (see buffer_pool.h), and its whole size class
+ * is usable: cap is set to the room there is. Its length starts at 0: the caller writes the message to data and sets
+ * len before sharing it.
+ *
+ * @param size  Number of bytes of data to make room for
+ *
+ * @return  Pointer to the shared buffer on success.
+ *          NULL on error.
+ */
+struct shared_buffer *shared_buffer_alloc(size_t size);
+
+/**
+ * Takes another reference to a shared buffer.
+ *
+ * @param buf   Pointer to the shared buffer
+ *
+ * @return  buf
+ */
+struct shared_buffer *shared_buffer_ref(struct shared_buffer *buf);
+
+/**
+ * Releases a reference to a shared buffer, freeing it if it was the last one.
+ *
+ * @param buf   Pointer to the shared buffer
+ */
+void shared_buffer_unref(struct shared_buffer *buf);
+
+#endif
@@ -0,0 +1,236 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "slab.h"
+#include "../lib/log.h"
+
+// Header at the start of every chunk, padded so the objects after it are aligned
+struct slab_chunk
+{
+    struct slab_chunk *next;
+    size_t size;
+};
+
+#define CHUNK_HEADER_SIZE ((sizeof(struct slab_chunk) + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1))
+
+/**
+ * Gets the object a free object links to.
+ */
+static void *next_free(void *obj)
+{
+    void *next;
+    memcpy(&next, obj, sizeof(next));
+    return next;
+}
+
+/**
+ * Links a free object to the next one.
+ */
+static void set_next_free(void *obj, void *next)
+{
+    memcpy(obj, &next, sizeof(next));
+}
+
+/**
+ * Maps a new chunk and makes its objects the ones carved next. Called with the pool locked.
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int map_chunk(struct slab_pool *pool)
+{
+    void *mem = MAP_FAILED;
+    if (pool->hugepages)
+    {
+        mem = mmap(NULL, pool->chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem == MAP_FAILED)
+        {
+            LOG_WARN("no hugepages available for slab chunk, falling back to transparent hugepages");
+            pool->hugepages = false;
+        }
+    }
+
+    if (mem == MAP_FAILED)
+    {
+        mem = mmap(NULL, pool->chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+        {
+            LOG_ERROR("failed to map slab chunk");
+            return -1;
+        }
+        if (pool->chunk_size == SLAB_HUGE_CHUNK_SIZE)
+            madvise(mem, pool->chunk_size, MADV_HUGEPAGE); // Only a hint, so failure does not matter
+    }
+
+    struct slab_chunk *chunk = mem;
+    chunk->next = pool->chunks;
+    chunk->size = pool->chunk_size;
+    pool->chunks = chunk;
+
+    pool->carve_next = (char *)mem + CHUNK_HEADER_SIZE;
+    pool->carve_left = (pool->chunk_size - CHUNK_HEADER_SIZE) / pool->obj_size;
+    atomic_fetch_add_explicit(&pool->capacity, pool->carve_left, memory_order_relaxed);
+
+    return 0;
+}
+
+struct slab_pool *slab_pool_init(size_t obj_size, bool hugepages)
+{
+    struct slab_pool *pool = calloc(1, sizeof(struct slab_pool));
+    if (pool == NULL)
+    {
+        LOG_ERROR("failed to allocate space for slab pool");
+        return NULL;
+    }
+
+    if (obj_size < sizeof(void *))
+        obj_size = sizeof(void *);
+    pool->obj_size = (obj_size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+    pool->chunk_size = hugepages ? SLAB_HUGE_CHUNK_SIZE : SLAB_CHUNK_SIZE;
+    pool->hugepages = hugepages;
+
+    if (pool->obj_size > pool->chunk_size - CHUNK_HEADER_SIZE)
+    {
+        LOG_ERROR("slab objects of %zu bytes do not fit in a chunk", obj_size);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+
+    return pool;
+}
+
+void slab_pool_free(struct slab_pool *pool)
+{
+    struct slab_chunk *chunk = pool->chunks;
+    while (chunk != NULL)
+    {
+        struct slab_chunk *next = chunk->next;
+        munmap(chunk, chunk->size);
+        chunk = next;
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+void slab_pool_stats(struct slab_pool *pool, struct slab_stats *stats)
+{
+    stats->live = atomic_load_explicit(&pool->live, memory_order_relaxed);
+    stats->high_water = atomic_load_explicit(&pool->high_water, memory_order_relaxed);
+    size_t capacity = atomic_load_explicit(&pool->capacity, memory_order_relaxed);
+    stats->free = capacity > stats->live ? capacity - stats->live : 0;
+}
+
+void slab_cache_init(struct slab_cache *cache, struct slab_pool *pool)
+{
+    cache->pool = pool;
+    cache->free_list = NULL;
+    cache->free_count = 0;
+}
+
+/**
+ * Moves up to n objects from a free list to another.
+ *
+ * @return  Number of objects moved.
+ */
+static size_t move_objects(void **from, void **to, size_t n)
+{
+    size_t moved = 0;
+    while (moved < n && *from != NULL)
+    {
+        void *obj = *from;
+        *from = next_free(obj);
+        set_next_free(obj, *to);
+        *to = obj;
+        moved++;
+    }
+
+    return moved;
+}
+
+void slab_cache_flush(struct slab_cache *cache)
+{
+    struct slab_pool *pool = cache->pool;
+    pthread_mutex_lock(&pool->lock);
+    pool->free_count += move_objects(&cache->free_list, &pool->free_list, cache->free_count);
+    pthread_mutex_unlock(&pool->lock);
+    cache->free_count = 0;
+}
+
+/**
+ * Refills an empty thread cache with a batch of objects: ones given back to the pool first, then new ones carved from
+ * the newest chunk.
+ *
+ * @return  0 on success.
+ *          -1 if the pool cannot map another chunk.
+ */
+static int refill_cache(struct slab_cache *cache)
+{
+    struct slab_pool *pool = cache->pool;
+    pthread_mutex_lock(&pool->lock);
+
+    size_t moved = move_objects(&pool->free_list, &cache->free_list, SLAB_CACHE_BATCH);
+    pool->free_count -= moved;
+    cache->free_count += moved;
+
+    while (cache->free_count < SLAB_CACHE_BATCH)
+    {
+        if (pool->carve_left == 0 && (cache->free_count > 0 || map_chunk(pool) != 0))
+            break;
+
+        set_next_free(pool->carve_next, cache->free_list);
+        cache->free_list = pool->carve_next;
+        cache->free_count++;
+        pool->carve_next += pool->obj_size;
+        pool->carve_left--;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return cache->free_count > 0 ? 0 : -1;
+}
+
+void *slab_alloc(struct slab_cache *cache)
+{
+    if (cache->free_list == NULL && refill_cache(cache) != 0)
+        return NULL;
+
+    void *obj = cache->free_list;
+    cache->free_list = next_free(obj);
+    cache->free_count--;
+
+    // Only the counts need to be right, so relaxed ordering is enough
+    struct slab_pool *pool = cache->pool;
+    size_t live = atomic_fetch_add_explicit(&pool->live, 1, memory_order_relaxed) + 1;
+    size_t high_water = atomic_load_explicit(&pool->high_water, memory_order_relaxed);
+    while (live > high_water &&
+           !atomic_compare_exchange_weak_explicit(&pool->high_water, &high_water, live, memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+
+    return obj;
+}
+
+void slab_release(struct slab_cache *cache, void *obj)
+{
+    set_next_free(obj, cache->free_list);
+    cache->free_list = obj;
+    cache->free_count++;
+    atomic_fetch_sub_explicit(&cache->pool->live, 1, memory_order_relaxed);
+
+    // Objects freed by a thread which did not allocate them would otherwise pile up in its cache
+    if (cache->free_count >= 2 * SLAB_CACHE_BATCH)
+    {
+        struct slab_pool *pool = cache->pool;
+        pthread_mutex_lock(&pool->lock);
+        size_t moved = move_objects(&cache->free_list, &pool->free_list, SLAB_CACHE_BATCH);
+        pool->free_count += moved;
+        pthread_mutex_unlock(&pool->lock);
+        cache->free_count -= moved;
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SLAB_ALIGN 64 // Objects are cache line aligned, so objects used by different threads never share a line
+#define SLAB_CHUNK_SIZE (256 * 1024)           // Size of the chunks objects are carved from
+#define SLAB_HUGE_CHUNK_SIZE (2 * 1024 * 1024) // Size of the chunks objects are carved from when backed by hugepages
+#define SLAB_CACHE_BATCH 32 // Number of objects a thread's cache takes from or gives back to the pool at a time
+
+// A pool of fixed size objects carved from large chunks of memory mapped from the kernel. Chunks are kept until the
+// pool is freed, so freeing and allocating objects again never reaches the heap. Threads allocate through their own
+// slab_cache, and only touch the pool (under its lock) to move a batch of objects between their cache and the pool.
+struct slab_pool
+{
+    size_t obj_size;   // Size of an object, rounded up to SLAB_ALIGN
+    size_t chunk_size; // Size of a chunk in bytes
+    bool hugepages;    // Whether chunks are mapped from the kernel's hugepage pool
+
+    pthread_mutex_t lock;      // Protects the fields below, up to the counters
+    void *free_list;           // Objects given back by caches, linked through their first bytes
+    size_t free_count;         // Number of objects in free_list
+    struct slab_chunk *chunks; // Every chunk mapped
+    char *carve_next;          // Next object never handed out in the newest chunk
+    size_t carve_left;         // Number of objects never handed out in the newest chunk
+
+    atomic_size_t capacity;   // Number of objects in all chunks
+    atomic_size_t live;       // Number of objects allocated and not freed
+    atomic_size_t high_water; // Highest number of objects ever live at once
+};
+
+// A thread's free list of objects from a slab pool. Only the owning thread may use it.
+struct slab_cache
+{
+    struct slab_pool *pool;
+    void *free_list;   // Objects ready to be allocated, linked through their first bytes
+    size_t free_count; // Number of objects in free_list
+};
+
+// Object counts of a slab pool
+struct slab_stats
+{
+    size_t live;       // Objects allocated and not freed
+    size_t free;       // Objects ready to be allocated, in caches, in the pool or never handed out
+    size_t high_water; // Highest number of objects ever live at once
+};
+
+/**
+ * Initializes a pool of objects of obj_size bytes.
+ *
+ * The returned struct should be freed with slab_pool_free() when no longer needed.
+ *
+ * @param obj_size  Size of an object in bytes
+ * @param hugepages Whether to back the pool with hugepages. If the kernel has none to give, the pool falls back to
+ *                  regular pages and asks for transparent hugepages instead.
+ *
+ * @return  Pointer to the pool on success.
+ *          NULL on error.
+ */
+struct slab_pool *slab_pool_init(size_t obj_size, bool hugepages);
+
+/**
+ * Frees a pool and unmaps every chunk, including objects still allocated from it.
+ *
+ * @param pool  Pointer to the pool
+ */
+void slab_pool_free(struct slab_pool *pool);
+
+/**
+ * Gets the number of objects live and free in a pool. Safe to call from any thread.
+ *
+ * @param pool  Pointer to the pool
+ * @param stats Pointer to a struct which will store the counts
+ */
+void slab_pool_stats(struct slab_pool *pool, struct slab_stats *stats);
+
+/**
+ * Initializes an empty thread cache of objects from a pool.
+ *
+ * @param cache Pointer to the cache
+ * @param pool  Pointer to the pool
+ */
+void slab_cache_init(struct slab_cache *cache, struct slab_pool *pool);
+
+/**
+ * Gives every object in a thread cache back to its pool.
+ *
+ * @param cache Pointer to the cache
+ */
+void slab_cache_flush(struct slab_cache *cache);
+
+/**
+ * Allocates an object from a thread cache, refilling it from the pool when it is empty. The object's contents are
+ * undefined.
+ *
+ * @param cache Pointer to the calling thread's cache
+ *
+ * @return  Pointer to the object on success.
+ *          NULL if the pool cannot map another chunk.
+ */
+void *slab_alloc(struct slab_cache *cache);
+
+/**
+ * Frees an object into a thread cache, giving a batch back to the pool when the cache holds too many. The object may
+ * have been allocated by another thread's cache.
+ *
+ * @param cache Pointer to the calling thread's cache
+ * @param obj   Pointer to the object
+ */
+void slab_release(struct slab_cache *cache, void *obj);
+
+#endif
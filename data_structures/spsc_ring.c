@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spsc_ring.h"
+#include "../lib/log.h"
+
+#define ELEM(ring, pos) ((ring)->elems + ((pos) & ((ring)->capacity - 1)) * (ring)->elem_size)
+
+struct spsc_ring *spsc_ring_init(size_t capacity, size_t elem_size)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+    {
+        LOG_ERROR("ring capacity %zu is not a power of 2", capacity);
+        return NULL;
+    }
+
+    struct spsc_ring *ring;
+    if (posix_memalign((void **)&ring, CACHE_LINE_SIZE, sizeof(struct spsc_ring)) != 0)
+    {
+        LOG_ERROR("failed to allocate space for ring");
+        return NULL;
+    }
+
+    if (posix_memalign((void **)&ring->elems, CACHE_LINE_SIZE, capacity * elem_size) != 0)
+    {
+        LOG_ERROR("failed to allocate space for %zu ring elements", capacity);
+        free(ring);
+        return NULL;
+    }
+    ring->capacity = capacity;
+    ring->elem_size = elem_size;
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->head, 0);
+    ring->cached_head = 0;
+    ring->cached_tail = 0;
+
+    return ring;
+}
+
+void spsc_ring_free(struct spsc_ring *ring)
+{
+    free(ring->elems);
+    free(ring);
+}
+
+/**
+ * Gets the number of free slots the producer can write to, only reading head when the cached copy shows fewer than
+ * wanted.
+ */
+static size_t free_slots(struct spsc_ring *ring, size_t tail, size_t wanted)
+{
+    size_t available = ring->capacity - (tail - ring->cached_head);
+    if (available < wanted)
+    {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        available = ring->capacity - (tail - ring->cached_head);
+    }
+    return available;
+}
+
+/**
+ * Gets the number of elements the consumer can read, only reading tail when the cached copy shows fewer than wanted.
+ */
+static size_t used_slots(struct spsc_ring *ring, size_t head, size_t wanted)
+{
+    size_t used = ring->cached_tail - head;
+    if (used < wanted)
+    {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        used = ring->cached_tail - head;
+    }
+    return used;
+}
+
+int spsc_ring_push(struct spsc_ring *ring, const void *elem)
+{
+    return spsc_ring_push_batch(ring, elem, 1) == 1 ? 0 : -1;
+}
+
+size_t spsc_ring_push_batch(struct spsc_ring *ring, const void *elems, size_t n)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t available = free_slots(ring, tail, n);
+    if (n > available)
+        n = available;
+
+    for (size_t i = 0; i < n; i++)
+        memcpy(ELEM(ring, tail + i), (const char *)elems + i * ring->elem_size, ring->elem_size);
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+
+    return n;
+}
+
+int spsc_ring_pop(struct spsc_ring *ring, void *elem)
+{
+    return spsc_ring_pop_batch(ring, elem, 1) == 1 ? 0 : -1;
+}
+
+size_t spsc_ring_pop_batch(struct spsc_ring *ring, void *elems, size_t max)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t used = used_slots(ring, head, max);
+    if (max > used)
+        max = used;
+
+    for (size_t i = 0; i < max; i++)
+        memcpy((char *)elems + i * ring->elem_size, ELEM(ring, head + i), ring->elem_size);
+    atomic_store_explicit(&ring->head, head + max, memory_order_release);
+
+    return max;
+}
@@ -0,0 +1,92 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "mpsc_ring.h"
+
+// A bounded lock-free queue of fixed size elements between exactly one producer thread and one consumer thread. Each
+// side keeps its index and a cached copy of the other side's index on its own cache line, so it only reads the other
+// side's index (and takes a cache miss) when the cached copy says the ring is full or empty.
+struct spsc_ring
+{
+    alignas(CACHE_LINE_SIZE) atomic_size_t tail; // Position the next push writes, advanced by the producer
+    size_t cached_head;                          // Producer's copy of head
+
+    alignas(CACHE_LINE_SIZE) atomic_size_t head; // Position the next pop reads, advanced by the consumer
+    size_t cached_tail;                          // Consumer's copy of tail
+
+    alignas(CACHE_LINE_SIZE) char *elems;
+    size_t capacity;  // Number of elements, a power of 2
+    size_t elem_size; // Size of an element in bytes
+};
+
+/**
+ * Initializes a ring with room for capacity elements of elem_size bytes each.
+ *
+ * The returned struct should be freed with spsc_ring_free() when no longer needed.
+ *
+ * @param capacity  Number of elements the ring can hold, must be a power of 2
+ * @param elem_size Size of an element in bytes
+ *
+ * @return  Pointer to the ring on success.
+ *          NULL if initialization fails.
+ */
+struct spsc_ring *spsc_ring_init(size_t capacity, size_t elem_size);
+
+/**
+ * Frees a ring. Elements still in it are discarded.
+ *
+ * @param ring  Pointer to the ring
+ */
+void spsc_ring_free(struct spsc_ring *ring);
+
+/**
+ * Copies an element to the back of the ring. Must only be called by the producer thread.
+ *
+ * @param ring  Pointer to the ring
+ * @param elem  Pointer to the element
+ *
+ * @return  0 on success.
+ *          -1 if the ring is full.
+ */
+int spsc_ring_push(struct spsc_ring *ring, const void *elem);
+
+/**
+ * Copies up to n elements to the back of the ring, publishing them all at once. Must only be called by the producer
+ * thread.
+ *
+ * @param ring  Pointer to the ring
+ * @param elems Pointer to an array of n elements
+ * @param n     Number of elements to push
+ *
+ * @return  Number of elements pushed, from the front of elems (0 if the ring is full).
+ */
+size_t spsc_ring_push_batch(struct spsc_ring *ring, const void *elems, size_t n);
+
+/**
+ * Removes the element at the front of the ring and copies it to elem. Must only be called by the consumer thread.
+ *
+ * @param ring  Pointer to the ring
+ * @param elem  Pointer to a buffer of elem_size bytes which will store the element
+ *
+ * @return  0 on success.
+ *          -1 if the ring is empty.
+ */
+int spsc_ring_pop(struct spsc_ring *ring, void *elem);
+
+/**
+ * Removes up to max elements from the front of the ring and copies them to elems, freeing their slots all at once. Must
+ * only be called by the consumer thread.
+ *
+ * @param ring  Pointer to the ring
+ * @param elems Pointer to an array of max elements which will store the elements
+ * @param max   Number of elements elems can hold
+ *
+ * @return  Number of elements popped (0 if the ring is empty).
+ */
+size_t spsc_ring_pop_batch(struct spsc_ring *ring, void *elems, size_t max);
+
+#endif
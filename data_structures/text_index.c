@@ -0,0 +1,558 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "text_index.h"
+#include "../lib/log.h"
+
+#define VARINT_MAX 10 // Most bytes a varint of 64 bits takes
+
+/**
+ * Encodes a number as a varint: 7 bits per byte, lowest first, with the high bit set on every byte but the last.
+ *
+ * @param buf   Pointer to a buffer with room for VARINT_MAX bytes
+ * @param value The number
+ *
+ * @return  Number of bytes written.
+ */
+static size_t put_varint(uint8_t *buf, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        buf[n++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    buf[n++] = (uint8_t)value;
+
+    return n;
+}
+
+/**
+ * Decodes a varint written by put_varint().
+ *
+ * @param buf   Pointer to the varint
+ * @param value Pointer to a uint64_t which will store the number
+ *
+ * @return  Number of bytes read.
+ */
+static size_t get_varint(const uint8_t *buf, uint64_t *value)
+{
+    uint64_t v = 0;
+    size_t n = 0;
+    int shift = 0;
+    do
+    {
+        v |= (uint64_t)(buf[n] & 0x7f) << shift;
+        shift += 7;
+    } while (buf[n++] & 0x80);
+    *value = v;
+
+    return n;
+}
+
+/**
+ * Tells whether a byte belongs to a word: ASCII letters and digits, and every byte of a UTF-8 sequence, so words in
+ * other scripts are kept whole.
+ *
+ * @param c The byte
+ *
+ * @return  true if it belongs to a word.
+ *          false if it separates words.
+ */
+static bool is_word_byte(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+/**
+ * Finds the slot of a term in the table of a text index: the slot holding it, or the free slot it would go in.
+ *
+ * @param index Pointer to the index, whose table is allocated
+ * @param term  The term
+ * @param hash  Hash of the term
+ *
+ * @return  Pointer to the slot.
+ */
+static struct text_term *find_slot(const struct text_index *index, const char *term, uint32_t hash)
+{
+    size_t mask = index->cap - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        struct text_term *slot = &index->terms[i];
+        if (slot->term[0] == '\0' || (slot->hash == hash && strcmp(slot->term, term) == 0))
+            return slot;
+    }
+}
+
+/**
+ * Doubles the term table of a text index, or allocates its first one. Terms move to their slots in the new table,
+ * along with their posting lists.
+ *
+ * @param index Pointer to the index
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int grow_terms(struct text_index *index)
+{
+    struct text_term *old = index->terms;
+    size_t old_cap = index->cap;
+    size_t cap = old_cap == 0 ? TEXT_INDEX_MIN_TERMS : 2 * old_cap;
+
+    struct text_term *terms = calloc(cap, sizeof(struct text_term));
+    if (terms == NULL)
+    {
+        LOG_ERROR("failed to allocate space for the terms of the text index");
+        return -1;
+    }
+    index->terms = terms;
+    index->cap = cap;
+    for (size_t i = 0; i < old_cap; i++)
+        if (old[i].term[0] != '\0')
+            *find_slot(index, old[i].term, old[i].hash) = old[i];
+    free(old);
+    index->bytes += (cap - old_cap) * sizeof(struct text_term);
+
+    return 0;
+}
+
+/**
+ * Appends a posting to a posting list, with a skip entry in front of it if it starts a block.
+ *
+ * @param index     Pointer to the index holding the list, charged with the memory the list takes
+ * @param postings  Pointer to the list
+ * @param seq       Sequence number of the message, higher than the list's last
+ * @param positions Pointer to the positions of the term in the message, in increasing order
+ * @param n         Number of positions, at least 1
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int add_posting(struct text_index *index, struct text_postings *postings, uint64_t seq,
+                       const uint32_t *positions, size_t n)
+{
+    size_t need = postings->len + (n + 2) * VARINT_MAX;
+    if (need > postings->cap)
+    {
+        size_t cap = postings->cap == 0 ? 16 : 2 * postings->cap;
+        while (cap < need)
+            cap *= 2;
+        uint8_t *data = realloc(postings->data, cap);
+        if (data == NULL)
+        {
+            LOG_ERROR("failed to allocate space for a posting list");
+            return -1;
+        }
+        index->bytes += cap - postings->cap;
+        postings->data = data;
+        postings->cap = cap;
+    }
+
+    if (postings->count % TEXT_INDEX_BLOCK == 0)
+    {
+        if (postings->num_skips == postings->skips_cap)
+        {
+            size_t cap = postings->skips_cap == 0 ? 4 : 2 * postings->skips_cap;
+            struct text_skip *skips = realloc(postings->skips, cap * sizeof(struct text_skip));
+            if (skips == NULL)
+            {
+                LOG_ERROR("failed to allocate space for the skip entries of a posting list");
+                return -1;
+            }
+            index->bytes += (cap - postings->skips_cap) * sizeof(struct text_skip);
+            postings->skips = skips;
+            postings->skips_cap = cap;
+        }
+        postings->skips[postings->num_skips++] = (struct text_skip){postings->last_seq, postings->len};
+    }
+
+    uint8_t *b = postings->data + postings->len;
+    b += put_varint(b, seq - postings->last_seq);
+    b += put_varint(b, n);
+    uint32_t prev = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        b += put_varint(b, positions[i] - prev);
+        prev = positions[i];
+    }
+    postings->len = b - postings->data;
+    postings->last_seq = seq;
+    postings->count++;
+
+    return 0;
+}
+
+/**
+ * Orders the keys of the words of a message, each its term's slot above its position.
+ *
+ * @param a Pointer to the first key
+ * @param b Pointer to the second key
+ *
+ * @return  A negative, zero or positive number as the first key comes before, with or after the second.
+ */
+static int compare_keys(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Decodes the block of a posting list a cursor is to read, noting where each posting's positions are.
+ *
+ * @param cursor    Pointer to the cursor
+ * @param block     Index of the block
+ * @param work      Pointer to the number of postings the search has read, which the block's are added to
+ */
+static void load_block(struct text_cursor *cursor, size_t block, size_t *work)
+{
+    const struct text_postings *postings = cursor->postings;
+    uint64_t offset = postings->skips[block].offset;
+    uint64_t end = block + 1 < postings->num_skips ? postings->skips[block + 1].offset : postings->len;
+    uint64_t seq = postings->skips[block].base;
+    size_t n = 0;
+    while (offset < end)
+    {
+        uint64_t delta, count;
+        offset += get_varint(postings->data + offset, &delta);
+        seq += delta;
+        cursor->seqs[n] = seq;
+        cursor->offsets[n] = offset;
+        n++;
+
+        // Skip over the positions, whose varints each end with a byte without the high bit
+        offset += get_varint(postings->data + offset, &count);
+        while (count > 0)
+            if ((postings->data[offset++] & 0x80) == 0)
+                count--;
+    }
+    cursor->block = block;
+    cursor->count = n;
+    *work += n;
+}
+
+/**
+ * Finds the newest message at or before a sequence number in the posting list of a cursor. The block which may hold it
+ * is found with a binary search of the skip entries, unless it is the one decoded already, then decoded and searched.
+ *
+ * @param cursor    Pointer to the cursor
+ * @param seq       Sequence number of the message, at least 1
+ * @param at        Pointer to a size_t which will store the index of the posting found in the block decoded
+ * @param work      Pointer to the number of postings the search has read, which those decoded are added to
+ *
+ * @return  Sequence number of the message found.
+ *          0 if the term appears in no message up to seq.
+ */
+static uint64_t find_at_or_before(struct text_cursor *cursor, uint64_t seq, size_t *at, size_t *work)
+{
+    const struct text_postings *postings = cursor->postings;
+    size_t block = cursor->block;
+    if (block == SIZE_MAX || seq <= postings->skips[block].base ||
+        (block + 1 < postings->num_skips && seq > postings->skips[block + 1].base))
+    {
+        // The last block starting after a lower sequence number holds seq or the postings right before it
+        size_t lo = 0;
+        size_t hi = postings->num_skips;
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (postings->skips[mid].base < seq)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        load_block(cursor, lo - 1, work);
+    }
+
+    size_t lo = 0;
+    size_t hi = cursor->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cursor->seqs[mid] <= seq)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0)
+    {
+        *at = lo - 1;
+        return cursor->seqs[lo - 1];
+    }
+
+    // Every posting of the block comes after seq: the one before is the last of the previous block
+    if (cursor->block == 0)
+        return 0;
+    load_block(cursor, cursor->block - 1, work);
+    *at = cursor->count - 1;
+
+    return cursor->seqs[*at];
+}
+
+/**
+ * Decodes the positions of a posting of the block a cursor has decoded.
+ *
+ * @param cursor    Pointer to the cursor
+ * @param at        Index of the posting in the block
+ * @param positions Pointer to an array of TEXT_INDEX_MAX_TOKENS which will store the positions
+ *
+ * @return  Number of positions.
+ */
+static size_t read_positions(const struct text_cursor *cursor, size_t at, uint32_t *positions)
+{
+    const uint8_t *b = cursor->postings->data + cursor->offsets[at];
+    uint64_t n, delta;
+    b += get_varint(b, &n);
+    uint32_t pos = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        b += get_varint(b, &delta);
+        pos += delta;
+        positions[i] = pos;
+    }
+
+    return n;
+}
+
+/**
+ * Checks whether the words of a phrase of a query appear one after the other in a message they all appear in.
+ *
+ * @param tokens    Pointer to the words of the query
+ * @param cursors   Pointer to the cursor of each word, which has decoded the block holding the message
+ * @param at        Pointer to the index of the message's posting in the block of each cursor
+ * @param first     Index of the phrase's first word
+ * @param end       Index past the phrase's last word
+ *
+ * @return  true if the phrase appears in the message.
+ *          false if it does not.
+ */
+static bool phrase_matches(const struct text_token *tokens, const struct text_cursor *cursors, const size_t *at,
+                           size_t first, size_t end)
+{
+    uint32_t starts[TEXT_INDEX_MAX_TOKENS];
+    uint32_t positions[TEXT_INDEX_MAX_TOKENS];
+
+    // Keep the positions of the first word which each following word is at the right distance from
+    size_t n = read_positions(&cursors[first], at[first], starts);
+    for (size_t k = first + 1; k < end && n > 0; k++)
+    {
+        size_t m = read_positions(&cursors[k], at[k], positions);
+        uint32_t gap = tokens[k].pos - tokens[first].pos;
+        size_t kept = 0;
+        size_t j = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            while (j < m && positions[j] < starts[i] + gap)
+                j++;
+            if (j < m && positions[j] == starts[i] + gap)
+                starts[kept++] = starts[i];
+        }
+        n = kept;
+    }
+
+    return n > 0;
+}
+
+void text_index_init(struct text_index *index)
+{
+    index->terms = NULL;
+    index->cap = 0;
+    index->num_terms = 0;
+    index->first_seq = 0;
+    index->last_seq = 0;
+    index->messages = 0;
+    index->bytes = 0;
+}
+
+void text_index_free(struct text_index *index)
+{
+    for (size_t i = 0; i < index->cap; i++)
+    {
+        free(index->terms[i].postings.data);
+        free(index->terms[i].postings.skips);
+    }
+    free(index->terms);
+    text_index_init(index);
+}
+
+size_t text_index_tokenize(const char *text, size_t len, struct text_token *tokens, size_t max)
+{
+    size_t n = 0;
+    uint32_t clause = 0;
+    bool in_phrase = false;
+    bool phrase_started = false; // Whether the current phrase has a word yet
+
+    size_t i = 0;
+    while (i < len && n < max)
+    {
+        unsigned char c = text[i];
+        if (c == '"')
+        {
+            if (phrase_started)
+                clause++;
+            in_phrase = !in_phrase;
+            phrase_started = false;
+            i++;
+            continue;
+        }
+        if (!is_word_byte(c))
+        {
+            i++;
+            continue;
+        }
+
+        // Lowercase the word and hash it with FNV-1a as it is copied
+        struct text_token *token = &tokens[n];
+        uint32_t hash = 2166136261u;
+        size_t k = 0;
+        for (; i < len && is_word_byte(text[i]); i++)
+            if (k < TEXT_INDEX_TERM_MAX - 1)
+            {
+                char b = text[i] >= 'A' && text[i] <= 'Z' ? text[i] - 'A' + 'a' : text[i];
+                token->term[k++] = b;
+                hash = (hash ^ (unsigned char)b) * 16777619u;
+            }
+        token->term[k] = '\0';
+        token->hash = hash;
+        token->pos = n++;
+        token->clause = clause;
+        if (in_phrase)
+            phrase_started = true;
+        else
+            clause++;
+    }
+
+    return n;
+}
+
+int text_index_add(struct text_index *index, uint64_t seq, const char *text, size_t len)
+{
+    struct text_token tokens[TEXT_INDEX_MAX_TOKENS];
+    size_t n = text_index_tokenize(text, len, tokens, TEXT_INDEX_MAX_TOKENS);
+    if (index->first_seq == 0)
+        index->first_seq = seq;
+    index->last_seq = seq;
+    index->messages++;
+    if (n == 0)
+        return 0;
+
+    // Make room for every word to be a new term first, so slots do not move while the words are looked up
+    while ((index->num_terms + n) * 4 > index->cap * 3)
+        if (grow_terms(index) != 0)
+            return -1;
+
+    // Key every word by its term's slot, then by its position, so sorting the keys groups the positions of each term
+    uint64_t keys[TEXT_INDEX_MAX_TOKENS];
+    for (size_t i = 0; i < n; i++)
+    {
+        struct text_term *slot = find_slot(index, tokens[i].term, tokens[i].hash);
+        if (slot->term[0] == '\0')
+        {
+            memcpy(slot->term, tokens[i].term, TEXT_INDEX_TERM_MAX);
+            slot->hash = tokens[i].hash;
+            index->num_terms++;
+        }
+        keys[i] = (uint64_t)(slot - index->terms) << 32 | tokens[i].pos;
+    }
+    qsort(keys, n, sizeof(uint64_t), compare_keys);
+
+    uint32_t positions[TEXT_INDEX_MAX_TOKENS];
+    for (size_t i = 0; i < n;)
+    {
+        size_t slot = keys[i] >> 32;
+        size_t count = 0;
+        for (; i < n && keys[i] >> 32 == slot; i++)
+            positions[count++] = (uint32_t)keys[i];
+        if (add_posting(index, &index->terms[slot].postings, seq, positions, count) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+int text_index_search(const struct text_index *index, const char *query, size_t len, uint64_t *seqs, size_t max,
+                      size_t budget, size_t *count, bool *more)
+{
+    struct text_token tokens[TEXT_INDEX_QUERY_TERMS + 1];
+    size_t n = text_index_tokenize(query, len, tokens, TEXT_INDEX_QUERY_TERMS + 1);
+    if (n == 0 || n > TEXT_INDEX_QUERY_TERMS)
+        return -1;
+
+    *count = 0;
+    *more = false;
+    if (index->cap == 0)
+        return 0;
+
+    // Every word must be in the index, and the rarest leads the search
+    struct text_cursor cursors[TEXT_INDEX_QUERY_TERMS];
+    size_t lead = 0;
+    bool phrases = false;
+    for (size_t i = 0; i < n; i++)
+    {
+        struct text_term *slot = find_slot(index, tokens[i].term, tokens[i].hash);
+        if (slot->term[0] == '\0')
+            return 0;
+        cursors[i].postings = &slot->postings;
+        cursors[i].block = SIZE_MAX;
+        if (slot->postings.count < cursors[lead].postings->count)
+            lead = i;
+        if (i > 0 && tokens[i].clause == tokens[i - 1].clause)
+            phrases = true;
+    }
+
+    // Every word's list in turn moves the newest candidate back to the newest message it holds at or before it, until
+    // all of them agree on one, so stretches of a list holding messages the others lack are skipped without decoding.
+    // Each step, and each posting decoded or phrase position read, counts against the budget.
+    size_t at[TEXT_INDEX_QUERY_TERMS];
+    uint64_t target = cursors[lead].postings->last_seq;
+    size_t agreed = 0;
+    size_t work = 0;
+    for (size_t i = lead;; i = (i + 1) % n)
+    {
+        if (++work > budget)
+        {
+            *more = true;
+            break;
+        }
+        uint64_t seq = find_at_or_before(&cursors[i], target, &at[i], &work);
+        if (seq == 0)
+            break;
+        if (seq < target)
+        {
+            target = seq;
+            agreed = 0;
+        }
+        if (++agreed < n)
+            continue;
+
+        // Each run of words sharing a clause is a phrase to check
+        bool found = true;
+        for (size_t first = 0, end; found && phrases && first < n; first = end)
+        {
+            for (end = first + 1; end < n && tokens[end].clause == tokens[first].clause; end++)
+                ;
+            if (end - first > 1)
+            {
+                found = phrase_matches(tokens, cursors, at, first, end);
+                work += end - first;
+            }
+        }
+        if (found)
+        {
+            if (*count == max)
+            {
+                *more = true;
+                break;
+            }
+            seqs[(*count)++] = target;
+        }
+        if (target == 1)
+            break;
+        target--;
+        agreed = 0;
+    }
+
+    return 0;
+}
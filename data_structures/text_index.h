@@ -0,0 +1,151 @@
+#ifndef TEXT_INDEX_H
+#define TEXT_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TEXT_INDEX_TERM_MAX 32     // Longest term kept, in bytes with its null character: longer words are cut short
+#define TEXT_INDEX_MAX_TOKENS 512  // Most words of a message indexed, more than a chat message has room for
+#define TEXT_INDEX_BLOCK 128       // Number of postings between two skip entries of a posting list
+#define TEXT_INDEX_QUERY_TERMS 16  // Most words in a query
+#define TEXT_INDEX_MIN_TERMS 256   // Number of slots of an index's first term table, a power of 2
+#define TEXT_INDEX_BUDGET 65536    // Postings a search reads before it stops, unless it is given another budget
+
+// Where a block of TEXT_INDEX_BLOCK postings starts in a posting list, so a search can jump to it
+struct text_skip
+{
+    uint64_t base;   // Sequence number of the posting before the block, 0 for the first block
+    uint64_t offset; // Offset of the block's first posting in the list's data
+};
+
+// The messages a term appears in, in the order of their sequence numbers. Each posting is encoded as varints: the
+// difference between its sequence number and the previous posting's, the number of times the term appears in the
+// message, then its positions in the message, each as the difference from the previous one.
+struct text_postings
+{
+    uint8_t *data; // NULL until the first posting is added
+    size_t len;
+    size_t cap;
+    uint64_t count;    // Number of postings
+    uint64_t last_seq; // Sequence number of the newest posting
+    struct text_skip *skips;
+    size_t num_skips;
+    size_t skips_cap;
+};
+
+// A slot of the term table of an index
+struct text_term
+{
+    char term[TEXT_INDEX_TERM_MAX]; // Empty if the slot is free
+    uint32_t hash;
+    struct text_postings postings;
+};
+
+// A word of a message or query: its term and where it is
+struct text_token
+{
+    char term[TEXT_INDEX_TERM_MAX];
+    uint32_t hash;
+    uint32_t pos;    // Position of the word in the message, or in its phrase of a query
+    uint32_t clause; // Index of the phrase of the query the word belongs to
+};
+
+// A block of a posting list decoded by a search
+struct text_cursor
+{
+    const struct text_postings *postings;
+    size_t block;                        // Index of the block decoded, SIZE_MAX if none is
+    size_t count;                        // Number of postings in it
+    uint64_t seqs[TEXT_INDEX_BLOCK];     // Sequence number of each posting
+    uint64_t offsets[TEXT_INDEX_BLOCK];  // Offset in the list's data of each posting's count of positions
+};
+
+// An inverted index of the words of a room's chat messages, which maps every term to the list of messages it appears
+// in, by sequence number. Words are runs of letters and digits, ASCII letters lowercased, and bytes of UTF-8
+// sequences; anything else separates them. Messages are added in the order of their sequence numbers, so each
+// posting list only grows at its end and is compressed with delta and varint encoding. Every TEXT_INDEX_BLOCK
+// postings, a skip entry records where the list stands, so a search finds the block holding a message with a binary
+// search and decodes only that block.
+//
+// Terms are kept in an open-addressed hash table which doubles when it is 3/4 full.
+struct text_index
+{
+    struct text_term *terms; // NULL until the first message is added
+    size_t cap;              // Number of slots, a power of 2
+    size_t num_terms;
+    uint64_t first_seq; // Sequence number of the oldest message added, 0 if none has been
+    uint64_t last_seq;  // Sequence number of the newest message added, 0 if none has been
+    uint64_t messages; // Number of messages added
+    size_t bytes;      // Bytes of memory held by the table and the posting lists
+};
+
+/**
+ * Initializes an empty text index.
+ *
+ * The index should be freed with text_index_free() when no longer needed.
+ *
+ * @param index Pointer to the index
+ */
+void text_index_init(struct text_index *index);
+
+/**
+ * Frees the memory held by a text index, leaving it empty.
+ *
+ * @param index Pointer to the index
+ */
+void text_index_free(struct text_index *index);
+
+/**
+ * Splits text into words, the way both messages and queries are indexed. A double quote starts or ends a phrase: the
+ * words of a phrase share a clause and are numbered by their position in it, and every other word is a clause of its
+ * own. Messages are split the same way, but the clauses of their words are not used.
+ *
+ * @param text      Pointer to the text
+ * @param len       Length of the text in bytes
+ * @param tokens    Pointer to an array which will store the words
+ * @param max       Most words stored, the rest are left out
+ *
+ * @return  Number of words stored.
+ */
+size_t text_index_tokenize(const char *text, size_t len, struct text_token *tokens, size_t max);
+
+/**
+ * Adds a message to a text index. The message must have a higher sequence number than every message added before.
+ *
+ * @param index Pointer to the index
+ * @param seq   Sequence number of the message, higher than index->last_seq
+ * @param text  Pointer to the text of the message
+ * @param len   Length of the text in bytes
+ *
+ * @return  0 on success.
+ *          -1 on error, after which the message may be found by some of its words only.
+ */
+int text_index_add(struct text_index *index, uint64_t seq, const char *text, size_t len);
+
+/**
+ * Searches a text index for the messages matching a query, newest first. A message matches if it holds every word of
+ * the query, and the words of each phrase, in double quotes, one after the other. The words' posting lists are walked
+ * from their newest blocks back, starting with the rarest, each one moving the candidate back to the newest message it
+ * holds at or before it until all of them agree, so the search stops as soon as it has found one more message than
+ * asked for. A query of common words which rarely appear together may walk most of their lists, so the search also
+ * stops once it has read as many postings as its budget allows: the messages found by then are still the newest which
+ * match.
+ *
+ * @param index     Pointer to the index
+ * @param query     Pointer to the query
+ * @param len       Length of the query in bytes
+ * @param seqs      Pointer to an array which will store the sequence numbers of the messages found
+ * @param max       Most messages found
+ * @param budget    Most postings read, SIZE_MAX for no limit
+ * @param count     Pointer to a size_t which will store the number of messages found
+ * @param more      Pointer to a bool which will store whether older messages match as well, or may match if the
+ *                  search ran out of budget before it found max messages
+ *
+ * @return  0 on success.
+ *          -1 if the query has no word or more than TEXT_INDEX_QUERY_TERMS words.
+ */
+int text_index_search(const struct text_index *index, const char *query, size_t len, uint64_t *seqs, size_t max,
+                      size_t budget, size_t *count, bool *more);
+
+#endif
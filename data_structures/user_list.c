@@ -0,0 +1,43 @@
+#include "user_list.h"
+
+#define LINK(user, offset) ((struct user_link *)((char *)(user) + (offset)))
+
+void user_list_add(struct user **head, struct user *user, size_t offset)
+{
+    struct user_link *link = LINK(user, offset);
+    if (link->linked)
+        return;
+
+    link->linked = true;
+    link->prev = NULL;
+    link->next = *head;
+    if (*head != NULL)
+        LINK(*head, offset)->prev = user;
+    *head = user;
+}
+
+void user_list_remove(struct user **head, struct user *user, size_t offset)
+{
+    struct user_link *link = LINK(user, offset);
+    if (!link->linked)
+        return;
+
+    if (link->prev != NULL)
+        LINK(link->prev, offset)->next = link->next;
+    else
+        *head = link->next;
+    if (link->next != NULL)
+        LINK(link->next, offset)->prev = link->prev;
+
+    link->linked = false;
+    link->prev = NULL;
+    link->next = NULL;
+}
+
+struct user *user_list_pop(struct user **head, size_t offset)
+{
+    struct user *user = *head;
+    if (user != NULL)
+        user_list_remove(head, user, offset);
+    return user;
+}
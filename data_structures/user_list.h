@@ -0,0 +1,40 @@
+#ifndef USER_LIST_H
+#define USER_LIST_H
+
+#include <stddef.h>
+
+#include "../types/user.h"
+
+/**
+ * Adds a user to the front of an intrusive list of users. Does nothing if the user is already in the list.
+ *
+ * The list is threaded through the struct user_link at offset within struct user, so a user can be in several lists at
+ * once (one per link) and be removed from any of them in O(1).
+ *
+ * @param head      Double pointer to the first user in the list
+ * @param user      Pointer to the user to add
+ * @param offset    Offset of the list's struct user_link in struct user, i.e. offsetof(struct user, <link>)
+ */
+void user_list_add(struct user **head, struct user *user, size_t offset);
+
+/**
+ * Removes a user from an intrusive list of users. Does nothing if the user is not in the list.
+ *
+ * @param head      Double pointer to the first user in the list
+ * @param user      Pointer to the user to remove
+ * @param offset    Offset of the list's struct user_link in struct user
+ */
+void user_list_remove(struct user **head, struct user *user, size_t offset);
+
+/**
+ * Removes the first user from an intrusive list of users.
+ *
+ * @param head      Double pointer to the first user in the list
+ * @param offset    Offset of the list's struct user_link in struct user
+ *
+ * @return  Pointer to the removed user.
+ *          NULL if the list is empty.
+ */
+struct user *user_list_pop(struct user **head, size_t offset);
+
+#endif
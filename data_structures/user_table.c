@@ -1,57 +0,0 @@
-#include <stdio.h>
-
-#include "user_table.h"
-#include "../lib/log.h"
-#include "../lib/uthash.h"
-#include "../types/room.h"
-
-int user_table_add(struct user **user_table, int id)
-{
-    struct user *new_user;
-
-    if (user_table_find(user_table, id) != NULL)
-    {
-        LOG_ERROR("user %d already exists in table", id);
-        return -1;
-    }
-
-    new_user = malloc(sizeof(*new_user));
-    if (new_user == NULL)
-    {
-        LOG_ERROR("failed to allocate space for new user");
-        return -1;
-    }
-
-    new_user->id = id;
-    new_user->room = INVALID_ROOM;
-    strcpy(new_user->name, "anonymous");
-    HASH_ADD_INT(*user_table, id, new_user);
-
-    LOG_INFO("added user %d to user table", id);
-
-    return 0;
-}
-
-int user_table_delete(struct user **user_table, int id)
-{
-    struct user *user = user_table_find(user_table, id);
-    if (user == NULL)
-    {
-        LOG_ERROR("user %d does not exist in table", id);
-        return -1;
-    }
-
-    HASH_DEL(*user_table, user);
-    free(user);
-
-    LOG_INFO("deleted user %d from user table", id);
-
-    return 0;
-}
-
-struct user *user_table_find(struct user **user_table, int id)
-{
-    struct user *user;
-    HASH_FIND_INT(*user_table, &id, user);
-    return user;
-}
\ No newline at end of file
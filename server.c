@@ -1,7 +1,19 @@
+#define _GNU_SOURCE // For accept4()
+
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <netdb.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdalign.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,20 +22,174 @@
 #include <time.h>
 #include <unistd.h>
 
-#include "data_structures/pollfd_array.h"
-#include "data_structures/room_array.h"
-#include "data_structures/user_table.h"
+#include "data_structures/buffer_pool.h"
+#include "data_structures/conn_table.h"
+#include "data_structures/history_ring.h"
+#include "data_structures/mpsc_ring.h"
+#include "data_structures/outbound_queue.h"
+#include "data_structures/ring_wakeup.h"
+#include "data_structures/room_directory.h"
+#include "data_structures/room_registry.h"
+#include "data_structures/shared_buffer.h"
+#include "data_structures/slab.h"
+#include "data_structures/user_list.h"
 #include "lib/log.h"
 #include "types/messages/chat_message.h"
+#include "types/messages/history_batch_message.h"
+#include "types/messages/history_message.h"
 #include "types/messages/join_message.h"
+#include "types/messages/leave_message.h"
 #include "types/messages/name_message.h"
 #include "types/messages/message.h"
 #include "types/messages/reply_message.h"
+#include "types/messages/search_message.h"
+#include "types/messages/search_result_message.h"
+#include "utils/room_log.h"
+#include "utils/event_loop.h"
 #include "utils/net_utils.h"
 #include "utils/sockaddr_utils.h"
+#include "utils/text_search.h"
+#include "utils/uring_engine.h"
+#include "utils/wal.h"
+
+#define DEFAULT_BACKLOG SOMAXCONN // Connections the kernel queues on each listener until they are accepted
+#define MAX_EVENTS 64 // Maximum number of ready fds (or io_uring completions) handled per batch
+#define ACCEPT_BUDGET 256 // Maximum number of connections accepted per event loop iteration
+#define READ_BUDGET 16 // Maximum number of messages handled from one client before others get a turn
+#define URING_ENTRIES 1024
+#define URING_NUM_BUFS 512
+#define URING_BUF_SIZE 4096
+#define OUTBOUND_HIGH_WATERMARK (256 * 1024)              // Queued bytes at which a user is treated as a slow consumer
+#define OUTBOUND_LOW_WATERMARK (64 * 1024)                // Queued bytes at which a slow consumer has caught up again
+#define OUTBOUND_HARD_LIMIT (4 * OUTBOUND_HIGH_WATERMARK) // Queued bytes at which a paused user is disconnected
+#define RECV_BACKLOG_LIMIT (64 * 1024) // Unparsed bytes at which the io_uring engine stops receiving from a user
+#define MAX_THREADS ROOM_DIRECTORY_MAX_REACTORS // Every reactor has a bit in the room directory's entries
+#define INBOX_CAPACITY 4096 // Maximum number of messages waiting for a reactor thread
+#define INBOX_BATCH 32      // Number of messages taken from the inbox at a time
+#define HISTORY_ROOM_LIMIT (64 * 1024) // Most bytes of messages a room keeps in its history, below the low watermark
+#define HISTORY_BATCH_BYTES (16 * 1024) // Most bytes of chat messages in one batch of the answer to a history message
+#define DEFAULT_HISTORY_REPLAY 100     // Number of messages from its history a user joining a room is sent
+#define DEFAULT_HISTORY_LIMIT 64       // Most MiB of history all rooms together keep
+#define HELD_MESSAGES_MAX 4096 // Most chat messages a reactor holds until its WAL is synced, more commit the WAL early
+#define DEFAULT_WAL_INTERVAL_MS 100 // Milliseconds between syncs of the WALs with WAL_SYNC_INTERVAL
+#define DEFAULT_SEARCH_LIMIT 256    // Most MiB the search indexes of all rooms together hold
+#define SNAPSHOT_WAL_BYTES (64 * 1024 * 1024) // Bytes written to the WALs which trigger a snapshot, bounding recovery
+#define SNAPSHOT_INTERVAL_MS 30000            // Most milliseconds between snapshots while messages are logged
+#define SNAPSHOT_POLL_MS 100                  // Milliseconds between checks of whether a snapshot is due
+
+// What happens to a user whose outbound queue grows past the high watermark
+enum slow_consumer_policy
+{
+    SLOW_CONSUMER_DISCONNECT, // Shut down the connection
+    SLOW_CONSUMER_DROP,       // Drop new messages for the user until the queue drains to the low watermark
+    SLOW_CONSUMER_PAUSE,      // Stop reading from the user until the queue drains to the low watermark
+};
+
+// Kinds of messages reactor threads pass to each other
+enum reactor_msg_type
+{
+    REACTOR_MSG_BROADCAST, // Deliver a chat message to the receiving reactor's users in a room
+    REACTOR_MSG_MIGRATE,   // Take over a user joining a room the receiving reactor owns
+};
+
+// A message passed from one reactor thread to another through the receiver's inbox
+struct reactor_msg
+{
+    enum reactor_msg_type type;
+    ROOM_ID room;
+    struct shared_buffer *buf; // For REACTOR_MSG_BROADCAST, the serialized message, whose reference belongs to the receiver
+    struct user *user;         // For REACTOR_MSG_MIGRATE, the user, which belongs to the receiver from then on
+    uint64_t stamp;            // For REACTOR_MSG_BROADCAST, the message's stamp in the room's history
+};
+
+// A chat message accepted by a reactor, waiting for the reactor's WAL to be synced before it is delivered
+struct held_message
+{
+    ROOM_ID room;
+    struct shared_buffer *buf; // The serialized message, whose reference belongs to the reactor
+    uint64_t seq;              // The message's sequence number in the room
+};
+
+// A user's join of a room waiting for the room log to look up where the room's numbering is on disk
+struct pending_join
+{
+    struct room_log_lookup lookup; // Answered by the log's writer thread, which may do so after the user is gone
+    CONN_HANDLE user;
+    struct pending_join *next;
+};
+
+// A user's history message waiting for the room log to read the messages older than the room's history from disk
+struct pending_read
+{
+    struct room_log_read read; // Answered by the log's writer thread, which may do so after the user is gone
+    CONN_HANDLE user;
+    struct pending_read *next;
+};
+
+// Counters describing a reactor's cross-thread traffic. Only the reactor's thread updates them, but any thread may read
+// them to report them.
+struct reactor_metrics
+{
+    atomic_uint_fast64_t migrations_in;      // Users handed over to the reactor
+    atomic_uint_fast64_t migrations_out;     // Users the reactor handed over to others
+    atomic_uint_fast64_t broadcasts_posted;  // Chat messages posted to other reactors
+    atomic_uint_fast64_t broadcasts_handled; // Chat messages posted by other reactors
+    atomic_uint_fast64_t local_deliveries;   // Chat messages queued for the reactor's own users
+};
 
-#define BACKLOG_LIMIT 10
-#define NUM_ROOMS 5
+struct server_group;
+
+// State of one reactor thread, shared by its handlers. Each reactor accepts connections on its own listener and owns
+// the users it accepts: only the reactor's thread touches them.
+struct server
+{
+    alignas(CACHE_LINE_SIZE) int id; // Index of the reactor in its group
+    struct server_group *group;
+    pthread_t thread;
+    int listener;
+    int spare_fd;                 // Open on /dev/null, given up to turn connections away when out of fds, -1 if lost
+    struct event_loop *loop;      // Event loop watching all open sockets, NULL when the io_uring engine is used
+    struct uring_engine *uring;   // io_uring engine doing all socket I/O, NULL when an event loop is used
+    bool listener_polled;         // io_uring: whether the listener is polled, which it is once fds first ran out
+    bool accept_paused;           // io_uring: whether accepting waits for the listener to poll readable
+    struct room_registry rooms;   // The rooms the reactor has users in
+    struct conn_table users;      // The reactor's users, indexed by socket fd
+    struct slab_cache user_cache; // The reactor's free list of user records
+    struct user *ready_users;     // Users whose sockets may have unread data left after their read budget ran out
+    struct user *flush_users;     // Users with messages queued during the current event loop iteration
+    enum slow_consumer_policy slow_consumer_policy;
+
+    struct mpsc_ring *inbox;        // Messages posted by other reactors
+    struct ring_wakeup wakeup;      // Signalled when messages are posted to the inbox
+    struct user *migrating_users;   // Users to hand over to other reactors at the end of the event loop iteration
+    struct reactor_metrics metrics; // Counters of the reactor's cross-thread traffic
+    struct pending_join *joins;     // Joins waiting for the room log, which signals the wakeup fd once it answers
+    struct pending_read *reads;     // History reads waiting for the room log, which signals the wakeup fd likewise
+
+    struct wal *wal;           // Write-ahead log of the chat messages the reactor accepts, NULL if they are not logged
+    struct held_message *held; // Messages waiting for the WAL to be synced, NULL unless the sync policy has them wait
+    size_t num_held;
+};
+
+// State shared by every reactor thread. A room's users can be spread over several reactors, each tracking its own
+// users in its room registry, so chat messages are passed to every reactor the room directory lists for the room.
+struct server_group
+{
+    struct server *servers;
+    int num_servers;
+    struct room_directory rooms;      // The rooms open on any reactor, with the reactors they are open on
+    struct history_budget history;    // Limits on the memory the histories of the rooms hold
+    size_t history_replay;            // Number of messages a user joining a room is sent, 0 if rooms keep no history
+    struct room_log *log;             // Log of every room's messages on disk, NULL if messages are not logged
+    enum wal_sync_policy wal_policy;  // When the reactors' WALs are synced, if messages are logged
+    struct text_search *search;       // Full-text indexes of every room's messages, NULL if search is turned off
+    atomic_uint_fast64_t snapshots;   // Snapshots of the rooms' state taken since the server started
+    double ready_ms;                  // Milliseconds from the start until the listeners were up, recovery included
+    bool room_affinity;               // Whether every room is owned by one reactor, which all its users are handed to
+    struct slab_pool *room_pool;      // Room records of every reactor
+    struct slab_pool *user_pool;      // User records of every reactor, which may free users allocated by another
+    _Atomic uint32_t next_generation; // Generation of the next connection accepted by any reactor, see CONN_HANDLE
+};
 
 /**
  * Gets the address info of the server for the given port and stores it in res. The IP address will be the wildcard
@@ -50,7 +216,8 @@ int get_server_addr_info(char *port, struct addrinfo **res)
 }
 
 /**
- * Creates a socket for listening to incoming connections to the address provided in res
+ * Creates a socket for listening to incoming connections to the address provided in res. Other sockets can be bound to
+ * the same address with SO_REUSEPORT.
  *
  * @param res   Pointer to a linked list of addrinfos which contain the address used to create the socket
  *
@@ -76,6 +243,13 @@ int create_listener_socket(struct addrinfo *res)
             return -1;
         }
 
+        // Every reactor thread binds its own listener to the address, and the kernel spreads connections over them
+        if (setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == -1)
+        {
+            LOG_ERROR("failed to allow sockets to share a port: %s", strerror(errno));
+            return -1;
+        }
+
         if (bind(listener, p->ai_addr, p->ai_addrlen) == -1)
         {
             LOG_WARN("failed to bind listener socket to address, trying again...");
@@ -92,62 +266,130 @@ int create_listener_socket(struct addrinfo *res)
 }
 
 /**
- * Accepts an incoming connection on the given socket.
+ * Accepts an incoming connection on the given socket. The new socket is non-blocking and closed on exec.
  *
  * @param listener  The socket to accept the connection on
  *
- * @return  0 on success.
+ * @return  The socket of the accepted connection on success.
  *          -1 on error (errno is set appropriately).
  */
 int accept_connection(int listener)
 {
-    struct sockaddr client_addr;
+    struct sockaddr_storage client_addr;
+    struct sockaddr *addr = (struct sockaddr *)&client_addr;
     socklen_t client_addr_size = sizeof(client_addr);
     int sockfd;
-    if ((sockfd = accept(listener, &client_addr, &client_addr_size)) == -1)
+    if ((sockfd = accept4(listener, addr, &client_addr_size, SOCK_NONBLOCK | SOCK_CLOEXEC)) == -1)
         return -1;
 
     char ip[INET6_ADDRSTRLEN];
-    get_ip_address(&client_addr, ip, sizeof(ip));
-    LOG_INFO("new connection from: %s, port %d", ip, get_port(&client_addr));
+    get_ip_address(addr, ip, sizeof(ip));
+    LOG_INFO("new connection from: %s, port %d", ip, get_port(addr));
 
     return sockfd;
 }
 
+/**
+ * Allocates the user data for a new client and adds it to the reactor's table of users.
+ *
+ * @param server    Pointer to the server state
+ * @param sockfd    The socket of the client
+ *
+ * @return  Pointer to the user on success.
+ *          NULL on error.
+ */
+struct user *add_user(struct server *server, int sockfd)
+{
+    struct user *user = slab_alloc(&server->user_cache);
+    if (user == NULL)
+    {
+        LOG_ERROR("failed to allocate space for new user");
+        return NULL;
+    }
+
+    // Reactors hand users to each other, so generations come from one counter, and each connection's is unique until it
+    // wraps around. Generation 0 is skipped so no handle is INVALID_CONN_HANDLE.
+    uint32_t generation;
+    while ((generation = atomic_fetch_add_explicit(&server->group->next_generation, 1, memory_order_relaxed)) == 0)
+        ;
+    user_init(user, conn_handle_make(sockfd, generation));
+
+    if (conn_table_insert(&server->users, user->handle, user) != 0)
+    {
+        slab_release(&server->user_cache, user);
+        return NULL;
+    }
+
+    LOG_INFO("added user %d to user table", sockfd);
+
+    return user;
+}
+
+/**
+ * Removes a user from the reactor's table of users and frees the user data.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 if the user is not in the table.
+ */
+int delete_user(struct server *server, struct user *user)
+{
+    if (conn_table_remove(&server->users, user->handle) == NULL)
+        return -1;
+
+    LOG_INFO("deleted user %d from user table", user->id);
+    slab_release(&server->user_cache, user);
+
+    return 0;
+}
+
 /**
  * Handles a new client connection.
  *
- * - Accepts the connection on the given socket
- * - Adds the new socket file descriptor to an array containing all open sockets
- * - Creates a new user for the connection and adds it to a hash table containing all users
+ * - Creates a new user for the connection and adds it to the reactor's table of users
+ * - Starts watching the connection: adds its socket fd to the event loop with the user as its context, or submits a
+ *   multishot recv for it to the io_uring engine
  *
- * @param listener      The socket to accept the new connection on
- * @param pollfds       Pointer to an array containing all open socket fds
- * @param user_table    Double pointer to a hash table containing all users
+ * @param server    Pointer to the server state
+ * @param sockfd    The socket of the accepted connection
  *
  * @return  0 on success.
  *          -1 on error.
  */
-int handle_new_client(int listener, struct pollfd_array *pollfds, struct user **user_table)
+int handle_new_client(struct server *server, int sockfd)
 {
-    int sockfd;
-    if ((sockfd = accept_connection(listener)) == -1)
+    struct user *user = add_user(server, sockfd);
+    if (user == NULL)
     {
-        LOG_ERROR("failed to accept the connection");
+        LOG_ERROR("failed to add user %d to user table", sockfd);
+        close(sockfd);
         return -1;
     }
 
-    if (pollfd_array_append(pollfds, sockfd, POLLIN) != 0)
+    if (server->uring != NULL)
     {
-        LOG_ERROR("failed to add socket fd %d to pollfd array", sockfd);
-        close(sockfd);
-        return -1;
+        if (uring_engine_prep_recv(server->uring, sockfd, user) != 0)
+        {
+            LOG_ERROR("failed to submit recv for client %d", sockfd);
+            delete_user(server, user);
+            close(sockfd);
+            return -1;
+        }
+        user->recv_armed = true;
+        user->inflight_ops++;
     }
-
-    if (user_table_add(user_table, sockfd))
+    else
     {
-        LOG_ERROR("failed to add user %d to user table", sockfd);
-        return -1;
+        if (event_loop_add(server->loop, sockfd, EVENT_READ | EVENT_EDGE, user) != 0)
+        {
+            LOG_ERROR("failed to add socket fd %d to event loop", sockfd);
+            delete_user(server, user);
+            close(sockfd);
+            return -1;
+        }
+        user->events = EVENT_READ | EVENT_EDGE;
     }
 
     LOG_INFO("created new connection to client %d", sockfd);
@@ -156,370 +398,2718 @@ int handle_new_client(int listener, struct pollfd_array *pollfds, struct user **
 }
 
 /**
- * Sends a reply from the server to the client.
+ * Turns away a connection waiting on the reactor's listener when the process is out of fds. The reactor's spare fd is
+ * closed to make room to accept the connection, which is closed at once, then opened again. Leaving the connection
+ * queued instead would keep the listener readable, and the reactor would spin on it until an fd is freed.
  *
- * @param client    The client socket
- * @param reply     The reply which may contain format specifiers
- * @param ...       Value(s) for format specifier(s) (if any)
+ * @param server    Pointer to the server state
+ *
+ * @return  true if a connection was turned away.
+ *          false if none was waiting.
  */
-void send_reply_message(int client, char *reply, ...)
+bool turn_away_connection(struct server *server)
 {
-    // Fill in format specifiers with values
-    va_list args;
-    va_start(args, reply); // Initialize args with the variable arguments starting after "reply"
+    if (server->spare_fd != -1)
+        close(server->spare_fd);
 
-    char total_reply[REPLY_SIZE_LIMIT];
-    if (vsnprintf(total_reply, sizeof(total_reply), reply, args) >= (int)sizeof(total_reply))
-        LOG_WARN("reply message truncated: %s", total_reply);
+    int sockfd = accept(server->listener, NULL, NULL);
+    if (sockfd != -1)
+    {
+        close(sockfd);
+        LOG_WARN("out of fds: turned away a connection");
+    }
 
-    va_end(args);
+    // Another thread may take the fd first, in which case the next connection gets another try
+    if ((server->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC)) == -1)
+        LOG_ERROR("failed to reopen the spare fd: %s", strerror(errno));
 
-    struct reply_message msg;
-    strcpy(msg.reply, total_reply);
+    return sockfd != -1;
+}
 
-    char *send_buf;
-    size_t len;
-    if (reply_message_serialize(&msg, &send_buf, &len) != 0)
+/**
+ * Accepts the connections waiting on the reactor's listener until there are none left or ACCEPT_BUDGET have been
+ * accepted. The listener is watched level-triggered, so connections left over by the budget are reported again on the
+ * next iteration, after the clients already connected have had a turn.
+ *
+ * @param server    Pointer to the server state
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int accept_clients(struct server *server)
+{
+    for (int i = 0; i < ACCEPT_BUDGET; i++)
     {
-        LOG_ERROR("failed to serialize the reply message");
-        return;
+        int sockfd;
+        if ((sockfd = accept_connection(server->listener)) == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if (errno == EMFILE || errno == ENFILE)
+            {
+                turn_away_connection(server);
+                continue;
+            }
+
+            // The connection may have been reset while waiting. Either way, the clients already connected should
+            // still be served.
+            LOG_ERROR("failed to accept the connection: %s", strerror(errno));
+            return 0;
+        }
+
+        if (handle_new_client(server, sockfd) != 0)
+        {
+            LOG_ERROR("failed to create new connection");
+            return -1;
+        }
     }
 
-    if (sendall(client, send_buf, len) == -1)
+    return 0;
+}
+
+/**
+ * Makes the event loop watch a user's socket for exactly the events it currently needs: readability unless reads are
+ * paused, and writability while its outbound queue is not empty.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int update_user_events(struct server *server, struct user *user)
+{
+    uint32_t events = EVENT_EDGE;
+    if (!user->reads_paused)
+        events |= EVENT_READ;
+    if (user->outbound.bytes > 0)
+        events |= EVENT_WRITE;
+
+    if (events == user->events)
+        return 0;
+
+    if (event_loop_modify(server->loop, user->id, events, user) != 0)
     {
-        LOG_ERROR("failed to send the reply message");
-        free(send_buf);
-        return;
+        LOG_ERROR("failed to update events for client %d", user->id);
+        return -1;
     }
-    free(send_buf);
+    user->events = events;
 
-    LOG_INFO("sent reply message to client %d", client);
+    return 0;
 }
 
 /**
- * Handles a chat message from a client.
- *
- * A client sends this kind of message when it wants to send a message to the chat room they are in. As a result, this
- * function will take their message and send it to all other clients in the room.
+ * Submits a gather send of the front of the user's outbound queue to the io_uring engine, unless one is already in
+ * flight. Having one send in flight at a time keeps messages in order.
  *
- * @param buf           Pointer to a char buffer containing the message
- * @param user          Pointer to the user data for the client
- * @param rooms         Pointer to an array containing all open chat rooms
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
  *
  * @return  0 on success.
  *          -1 on error.
  */
-int handle_chat_message(char *buf, struct user *user, struct room_array *rooms)
+int start_uring_send(struct server *server, struct user *user)
 {
-    if (user->room == INVALID_ROOM)
-    {
-        LOG_INFO("did not send chat message: client %d is not in a room", user->room);
-        send_reply_message(user->id, "you are not in a chat room: type '/join [room number]' to join a room");
+    if (user->send_in_flight || user->closing || user->migrating)
         return 0;
-    }
 
-    struct chat_message msg;
-    chat_message_deserialize(buf, &msg);
-    time(&msg.timestamp);
-    strcpy(msg.name, user->name);
+    int iovcnt = outbound_queue_fill_iov(&user->outbound, user->send_iov, USER_SEND_IOV_MAX);
+    if (iovcnt == 0)
+        return 0;
 
-    char *send_buf;
-    size_t len;
-    if (chat_message_serialize(&msg, &send_buf, &len) != 0)
-    {
-        LOG_ERROR("failed to serialize the chat message");
+    memset(&user->send_msg, 0, sizeof(user->send_msg));
+    user->send_msg.msg_iov = user->send_iov;
+    user->send_msg.msg_iovlen = iovcnt;
+    if (uring_engine_prep_sendmsg(server->uring, user->id, &user->send_msg, user) != 0)
         return -1;
-    }
+    user->send_in_flight = true;
+    user->inflight_ops++;
 
-    struct room *room = room_array_get_room(rooms, user->room);
-    for (uint8_t i = 0; i < room->num_users; i++)
-    {
-        int receiver = room->users[i];
+    return 0;
+}
+
+/**
+ * Makes the io_uring engine receive from a user exactly when it should: while reads are not paused and the user's
+ * backlog of unparsed bytes is below RECV_BACKLOG_LIMIT. Stopping the multishot recv leaves further data in the socket,
+ * which pushes back on the client through TCP flow control.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int update_uring_recv(struct server *server, struct user *user)
+{
+    bool wanted = !user->closing && !user->migrating && !user->hung_up && !user->reads_paused &&
+                  user->backlog_len < RECV_BACKLOG_LIMIT;
 
-        if (sendall(receiver, send_buf, len) == -1)
+    if (wanted && !user->recv_armed)
+    {
+        if (uring_engine_prep_recv(server->uring, user->id, user) != 0)
         {
-            LOG_ERROR("failed to send chat message to client %d", receiver);
-            free(send_buf);
+            LOG_ERROR("failed to arm recv for client %d", user->id);
             return -1;
         }
+        user->recv_armed = true;
+        user->recv_cancelled = false;
+        user->inflight_ops++;
+    }
+    else if (!wanted && user->recv_armed && !user->recv_cancelled)
+    {
+        if (uring_engine_prep_cancel_recv(server->uring, user) != 0)
+        {
+            LOG_ERROR("failed to cancel recv for client %d", user->id);
+            return -1;
+        }
+        user->recv_cancelled = true;
     }
-    free(send_buf);
-
-    LOG_INFO("sent chat message from client %d to all clients in room %d", user->id, room->id);
 
     return 0;
 }
 
 /**
- * Handles a name message from a client.
+ * Stops reading from a user until their outbound queue drains.
  *
- * A client sends this kind of message when it wants to update their name. As a result, this function will update their
- * name then send a message back to inform them that the update was successful.
- *
- * @param buf   Pointer to a char buffer containing the message
- * @param user  Pointer to the user data for the client
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
  */
-void handle_name_message(char *buf, struct user *user)
+void pause_user_reads(struct server *server, struct user *user)
 {
-    struct name_message msg;
-    name_message_deserialize(buf, &msg);
-    strcpy(user->name, msg.name);
-    LOG_INFO("set name of user %d to %s", user->id, user->name);
+    if (user->reads_paused)
+        return;
+
+    LOG_WARN("pausing reads from client %d: outbound queue over high watermark", user->id);
+    user->reads_paused = true;
+    user_list_remove(&server->ready_users, user, offsetof(struct user, ready));
 
-    send_reply_message(user->id, "set name to %s", msg.name);
+    if (server->uring != NULL)
+        update_uring_recv(server, user);
+    else
+        update_user_events(server, user);
 }
 
 /**
- * Handles a join message from a client.
- *
- * A client sends this kind of message when it wants to join a room. As a result, this function will add them to the
- * room then send a message back to inform them that the join was successful.
+ * Resumes reading from a user whose reads were paused.
  *
- * @param buf   Pointer to a char buffer containing the message
- * @param rooms Pointer to an array containing all open chat rooms
- * @param user  Pointer to the user data for the client
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
  */
-void handle_join_message(char *buf, struct room_array *rooms, struct user *user)
+void resume_user_reads(struct server *server, struct user *user)
 {
-    struct join_message msg;
-    join_message_deserialize(buf, &msg);
+    user->reads_paused = false;
+    LOG_INFO("resuming reads from client %d", user->id);
 
-    struct room *new_room = room_array_get_room(rooms, msg.room_id);
-    if (new_room == NULL)
-    {
-        LOG_INFO("did not add user %d to room %d: room does not exist", user->id, msg.room_id);
-        send_reply_message(user->id, "room %d does not exist", msg.room_id);
-        return;
-    }
+    if (server->uring != NULL)
+        update_uring_recv(server, user);
+    else
+        update_user_events(server, user);
+    user_list_add(&server->ready_users, user, offsetof(struct user, ready)); // Data may have arrived while paused
+}
 
-    if (user->room == new_room->id)
-    {
-        LOG_INFO("did not add user %d to room %d: user already in room", user->id, new_room->id);
-        send_reply_message(user->id, "you are already in room %d", new_room->id);
+/**
+ * Shuts down the connection to a user which has fallen too far behind. The connection is then closed through the usual
+ * path once the hang up is reported, so it is safe to call while iterating over a room.
+ *
+ * @param user      Pointer to the user data for the client
+ */
+void shut_down_user(struct user *user)
+{
+    if (user->shut_down)
         return;
-    }
-    else if (user->room != INVALID_ROOM)
-    {
-        struct room *current_room = room_array_get_room(rooms, user->room);
-        room_remove_user(current_room, user);
-    }
 
-    if (room_add_user(new_room, user) != 0)
-    {
-        LOG_INFO("did not add user %d to room %d: room is full", user->id, new_room->id);
-        send_reply_message(user->id, "room %d is full", new_room->id);
+    LOG_WARN("disconnecting client %d: outbound queue over limit", user->id);
+    user->shut_down = true;
+    if (shutdown(user->id, SHUT_RDWR) == -1)
+        LOG_ERROR("failed to shut down socket %d: %s", user->id, strerror(errno));
+}
+
+/**
+ * Lifts the backpressure on a user once their outbound queue has drained to the low watermark.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ */
+void handle_outbound_drained(struct server *server, struct user *user)
+{
+    if (user->outbound.bytes > OUTBOUND_LOW_WATERMARK)
         return;
-    }
 
-    send_reply_message(user->id, "you have joined room %d", new_room->id);
+    user->dropping = false;
+    if (user->reads_paused && !user->shut_down)
+        resume_user_reads(server, user);
 }
 
 /**
- * Handles a message from a client.
+ * Writes as much of a user's outbound queue as their socket accepts, and watches the socket for writability if
+ * anything is left.
  *
- * - Receives message from the server
- * - Determines the type of message and handles it accordingly
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
  *
- * @param client        The client socket to receive the message from
- * @param user_table    Double pointer to a hash table containing all users
- * @param rooms         Pointer to an array containing all open chat rooms
- *
- * @return  1 on success.
- *          0 when the client closes the connection.
+ * @return  0 on success.
  *          -1 on error.
  */
-int handle_client_message(int client, struct user **user_table, struct room_array *rooms)
+int flush_user(struct server *server, struct user *user)
 {
-    char *recv_buf;
-    ssize_t recvd = recvall(client, &recv_buf);
-    if (recvd == -1)
+    if (outbound_queue_flush(&user->outbound, user->id) == -1)
     {
-        LOG_ERROR("failed to receive message from client %d: %s", client, strerror(errno));
+        if (errno == EPIPE || errno == ECONNRESET)
+            LOG_INFO("connection to client %d closed", user->id);
+        else
+            LOG_ERROR("failed to send data to client %d: %s", user->id, strerror(errno));
         return -1;
     }
-    else if (recvd == 0)
-    {
-        LOG_INFO("connection to client %d closed", client);
-        return 0;
-    }
 
-    struct user *user = user_table_find(user_table, client);
-    if (user == NULL)
-    {
-        LOG_ERROR("failed to find user %d", client);
-        return -1;
-    }
+    handle_outbound_drained(server, user);
+
+    return update_user_events(server, user);
+}
+
+/**
+ * Applies the slow consumer policy to a user before len more bytes are queued for them: if their queue would grow past
+ * OUTBOUND_HIGH_WATERMARK, the user is disconnected, has messages dropped or has their reads paused.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ * @param len       Length of the message to queue
+ *
+ * @return  true if the message should be queued.
+ *          false if it should be dropped.
+ */
+bool admit_message(struct server *server, struct user *user, size_t len)
+{
+    if (user->closing || user->shut_down || user->dropping)
+        return false;
 
-    switch (get_message_type(recv_buf))
+    if (user->outbound.bytes + len > OUTBOUND_HIGH_WATERMARK)
     {
-    case CHAT_MESSAGE:
-        LOG_INFO("received chat message from client %d", user->id);
-        if (handle_chat_message(recv_buf, user, rooms) != 0)
+        switch (server->slow_consumer_policy)
         {
-            LOG_ERROR("failed to handle chat message");
-            free(recv_buf);
-            return -1;
+        case SLOW_CONSUMER_DISCONNECT:
+            shut_down_user(user);
+            return false;
+        case SLOW_CONSUMER_DROP:
+            LOG_WARN("dropping messages for client %d: outbound queue over high watermark", user->id);
+            user->dropping = true;
+            return false;
+        case SLOW_CONSUMER_PAUSE:
+            if (user->outbound.bytes + len > OUTBOUND_HARD_LIMIT)
+            {
+                shut_down_user(user);
+                return false;
+            }
+            pause_user_reads(server, user);
+            break;
         }
-        break;
-    case JOIN_MESSAGE:
-        LOG_INFO("received join message from client %d", user->id);
-        handle_join_message(recv_buf, rooms, user);
-        break;
-    case NAME_MESSAGE:
-        LOG_INFO("received name message from client %d", user->id);
-        handle_name_message(recv_buf, user);
-        break;
-    default:
-        LOG_ERROR("invalid message type");
-        free(recv_buf);
-        return -1;
     }
-    free(recv_buf);
 
-    return 1;
+    return true;
 }
 
 /**
- * Handles terminiation of a client.
+ * Makes sure the messages just queued for a user get sent. Sending never blocks:
  *
- * - Removes the client's socket fd from the array of socket fds
- * - Removes the client from the room they were in (if they were in one)
- * - Removes the user data associated with the client from the hash table of users
- * - Closes the connection to the given client
+ * - With an event loop, every user with queued messages is flushed once at the end of the event loop iteration, so
+ *   messages queued in the same iteration are written with a single writev(). Whatever the socket does not accept is
+ *   written when it becomes writable.
+ * - With the io_uring engine, the front of the queue is submitted as a send, and every send prepared during an
+ *   iteration is submitted in one system call.
  *
- * @param client        The client socket to close
- * @param i             The index of the socket fd in pollfds
- * @param pollfds       Pointer to an array containing all open socket fds
- * @param rooms         Pointer to an array containing all open chat rooms
- * @param user_table    Double pointer to a hash table containing all users
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
  *
  * @return  0 on success.
  *          -1 on error.
  */
-int handle_client_termination(int client, uint32_t i, struct pollfd_array *pollfds, struct room_array *rooms, struct user **user_table)
+int schedule_send(struct server *server, struct user *user)
 {
-    if (pollfd_array_delete(pollfds, i) != 0)
-    {
-        LOG_ERROR("failed to delete fd %d from pollfd array", client);
-        return -1;
-    }
+    if (server->uring != NULL)
+        return start_uring_send(server, user);
 
-    struct user *user = user_table_find(user_table, client);
-    if (user == NULL)
-    {
-        LOG_ERROR("user %d not found", client);
-        return -1;
-    }
+    user_list_add(&server->flush_users, user, offsetof(struct user, flush));
 
-    struct room *room = room_array_get_room(rooms, user->room);
-    if (room != NULL)
-        if (room_remove_user(room, user) != 0)
-        {
-            LOG_ERROR("failed to remove user %d from room %d", user->id, room->id);
-            return -1;
-        }
+    return 0;
+}
 
-    if (user_table_delete(user_table, client) != 0)
-    {
-        LOG_ERROR("failed to delete user %d", client);
-        return -1;
-    }
+/**
+ * Queues a serialized message to be sent to the user, unless the slow consumer policy drops it. The queue takes a
+ * reference to the message rather than a copy, so a message queued for a whole room exists once.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ * @param buf       Pointer to a shared buffer containing the message
+ *
+ * @return  0 on success (including when the message is dropped).
+ *          -1 on error.
+ */
+int send_to_user(struct server *server, struct user *user, struct shared_buffer *buf)
+{
+    if (!admit_message(server, user, buf->len))
+        return 0;
 
-    close(client);
-    LOG_INFO("closed connection to client %d", client);
+    if (outbound_queue_push(&user->outbound, buf) != 0)
+        return -1;
 
-    return 0;
+    return schedule_send(server, user);
 }
 
-int main()
+/**
+ * Serializes a chat message into a shared buffer, so it can be queued for any number of users.
+ *
+ * @param msg   View of the message to serialize
+ *
+ * @return  Pointer to the shared buffer, holding one reference which belongs to the caller, on success.
+ *          NULL on error.
+ */
+struct shared_buffer *serialize_chat_message(struct chat_message_view *msg)
 {
-    int listener;
-    struct pollfd_array *pollfds = pollfd_array_init();
-    struct room_array *rooms = room_array_init(NUM_ROOMS);
-    struct user *user_table = NULL;
+    size_t size = chat_message_view_size(msg);
+    struct shared_buffer *buf = shared_buffer_alloc(size);
+    if (buf == NULL)
+        return NULL;
 
-    int status;
-    struct addrinfo *res;
-    if ((status = get_server_addr_info(PORT, &res)) != 0)
+    if (chat_message_view_serialize_to(msg, buf->data, size, &buf->len) != 0)
     {
-        LOG_ERROR("failed to get server's address info: %s", gai_strerror(status));
-        exit(EXIT_FAILURE);
+        shared_buffer_unref(buf);
+        return NULL;
     }
 
-    if ((listener = create_listener_socket(res)) == -1)
-    {
-        LOG_ERROR("failed to create listener socket");
-        exit(EXIT_FAILURE);
-    }
-    freeaddrinfo(res);
-    res = NULL;
+    return buf;
+}
+
+/**
+ * Sends a reply from the server to the client. The reply is serialized straight into the back of the client's
+ * outbound queue.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ * @param reply     The reply which may contain format specifiers
+ * @param ...       Value(s) for format specifier(s) (if any)
+ */
+void send_reply_message(struct server *server, struct user *user, char *reply, ...)
+{
+    struct reply_message msg;
+
+    // Fill in format specifiers with values
+    va_list args;
+    va_start(args, reply); // Initialize args with the variable arguments starting after "reply"
+
+    if (vsnprintf(msg.reply, sizeof(msg.reply), reply, args) >= (int)sizeof(msg.reply))
+        LOG_WARN("reply message truncated: %s", msg.reply);
+
+    va_end(args);
+
+    size_t size = reply_message_size(&msg);
+    if (!admit_message(server, user, size))
+        return;
+
+    char *dst = outbound_queue_reserve(&user->outbound, size);
+    size_t len;
+    if (dst == NULL || reply_message_serialize_to(&msg, dst, size, &len) != 0)
+    {
+        LOG_ERROR("failed to serialize the reply message");
+        return;
+    }
+    outbound_queue_commit(&user->outbound, len);
+
+    if (schedule_send(server, user) != 0)
+    {
+        LOG_ERROR("failed to send the reply message");
+        return;
+    }
+
+    LOG_INFO("sent reply message to client %d", user->id);
+}
+
+/**
+ * Reclaims a room this reactor has no users left in, and leaves its entry in the room directory.
+ *
+ * @param server    Pointer to the server state
+ * @param room      Pointer to the room, which has no users
+ */
+void close_room(struct server *server, struct room *room)
+{
+    if (room->entry != NULL)
+        room_directory_leave(&server->group->rooms, room->entry, server->id);
+    room_registry_close(&server->rooms, room);
+}
+
+/**
+ * Adds a user to a room, opening the room on this reactor if the user is its first user here.
+ *
+ * @param server    Pointer to the server state
+ * @param room_id   Id of the room, not INVALID_ROOM
+ * @param user      Pointer to the user data for the client
+ * @param lookup    Pointer to an answered lookup of the room by the room log, NULL if there is none
+ *
+ * @return  0 on success.
+ *          1 if the room log must look the room up first, see room_directory_join().
+ *          -1 on error.
+ */
+int add_user_to_room(struct server *server, ROOM_ID room_id, struct user *user, const struct room_log_lookup *lookup)
+{
+    bool created;
+    struct room *room = room_registry_open(&server->rooms, room_id, &created);
+    if (room == NULL)
+        return -1;
+
+    if (created)
+    {
+        int status = room_directory_join(&server->group->rooms, room_id, server->id, lookup, &room->entry);
+        if (status != 0)
+        {
+            close_room(server, room);
+            return status;
+        }
+    }
+
+    if (room_add_user(room, user) != 0)
+    {
+        if (room->num_users == 0)
+            close_room(server, room);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Removes a user from a room they are in. The room is reclaimed once this reactor has no users left in it.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ * @param sub       Pointer to the user's subscription to the room
+ */
+void remove_user_from_room(struct server *server, struct user *user, struct subscription *sub)
+{
+    struct room *room = sub->room;
+    room_remove_user(user, sub, &server->users);
+
+    if (room->num_users == 0)
+        close_room(server, room);
+}
+
+/**
+ * Removes a user from every room they are in.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ */
+void remove_user_from_rooms(struct server *server, struct user *user)
+{
+    while (user->num_subs > 0)
+        remove_user_from_room(server, user, &user->subs[user->num_subs - 1]);
+}
+
+/**
+ * Gets the reactor owning a room in room affinity mode.
+ *
+ * @param group     Pointer to the group of reactors
+ * @param room_id   Id of the room
+ *
+ * @return  Index of the reactor
+ */
+int room_owner(struct server_group *group, ROOM_ID room_id)
+{
+    return (room_id - 1) % group->num_servers;
+}
+
+/**
+ * Removes a user whose I/O has stopped from this reactor and queues them to be handed to the owner of the room they are
+ * joining at the end of the event loop iteration, once nothing up the call stack touches the user anymore.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ */
+void hand_over_user(struct server *server, struct user *user)
+{
+    conn_table_remove(&server->users, user->handle);
+    user_list_add(&server->migrating_users, user, offsetof(struct user, migrate));
+}
+
+/**
+ * Frees the user data associated with a client and closes its socket once the io_uring engine has no operations left in
+ * flight for it. A user being handed to another reactor is handed over at that point instead.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int release_uring_user(struct server *server, struct user *user)
+{
+    if (user->inflight_ops != 0)
+        return 0;
+
+    if (user->migrating && !user->closing)
+    {
+        hand_over_user(server, user);
+        return 0;
+    }
+
+    if (!user->closing)
+        return 0;
+
+    int client = user->id;
+    frame_parser_free(&user->parser);
+    outbound_queue_clear(&user->outbound);
+    buffer_pool_release(user->recv_backlog, user->backlog_cap);
+
+    if (delete_user(server, user) != 0)
+    {
+        LOG_ERROR("failed to delete user %d", client);
+        return -1;
+    }
+
+    close(client);
+    LOG_INFO("closed connection to client %d", client);
+
+    return 0;
+}
+
+/**
+ * Starts handing a user over to the reactor owning the room they are joining. The user stops being read from (data
+ * already received stays with the user) and written to (queued messages stay in their outbound queue), and is handed
+ * over once no I/O is in flight.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ * @param room_id   Id of the room the user is joining
+ */
+void start_migration(struct server *server, struct user *user, ROOM_ID room_id)
+{
+    user->migrating = true;
+    user->migrate_room = room_id;
+    user_list_remove(&server->ready_users, user, offsetof(struct user, ready));
+
+    if (server->uring != NULL)
+    {
+        // The multishot recv is cancelled, and the user is handed over once it and any send in flight have finished
+        if (update_uring_recv(server, user) != 0)
+            LOG_ERROR("failed to stop receiving from client %d", user->id);
+        release_uring_user(server, user);
+        return;
+    }
+
+    if (event_loop_delete(server->loop, user->id) != 0)
+        LOG_ERROR("failed to delete fd %d from event loop", user->id);
+    user->events = 0;
+    user_list_remove(&server->flush_users, user, offsetof(struct user, flush));
+    hand_over_user(server, user);
+}
+
+/**
+ * Sends a user who has just joined a room the room's most recent messages. They are copied out of the room's history
+ * in one piece, so they are queued as a single buffer and written with a single writev(). Messages held back until the
+ * WAL is synced are left out, and delivered once they are. Messages stamped before the copy may still be on their way
+ * from other reactors: the user's fence keeps those from being delivered twice.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ * @param sub       Pointer to the user's subscription to the room
+ */
+void replay_history(struct server *server, struct user *user, struct subscription *sub)
+{
+    if (server->group->history_replay == 0)
+        return;
+
+    struct room *room = sub->room;
+    struct room_entry *entry = room->entry;
+    struct shared_buffer *buf = NULL;
+    struct history_range range;
+    uint64_t fence = 0;
+
+    pthread_mutex_lock(&entry->history_lock);
+    history_ring_find_newest(&entry->history, server->group->history_replay, &range);
+    if (range.len > 0 && (buf = shared_buffer_alloc(range.len)) != NULL)
+    {
+        buf->len = history_ring_read_committed(&entry->history, &range, buf->data);
+        fence = entry->history.next_stamp;
+    }
+    pthread_mutex_unlock(&entry->history_lock);
+
+    if (buf == NULL)
+    {
+        if (range.len > 0)
+            LOG_ERROR("failed to replay the history of room %u to client %d", room->id, user->id);
+        return;
+    }
+
+    // Every message the room holds may be held back, and the fence is needed all the same
+    room->members[sub->member].fence = fence;
+    if (buf->len > 0 && send_to_user(server, user, buf) != 0)
+        LOG_ERROR("failed to replay the history of room %u to client %d", room->id, user->id);
+    else
+        LOG_INFO("replayed %zu bytes of the history of room %u to client %d", buf->len, room->id, user->id);
+    shared_buffer_unref(buf);
+}
+
+/**
+ * Has the room log look up where the numbering of a room a user is joining is on disk. The user's messages are not
+ * handled until finish_joins() takes the answer.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ * @param room_id   Id of the room
+ * @param join      Pointer to the join if it was looked up before, NULL otherwise
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int wait_for_lookup(struct server *server, struct user *user, ROOM_ID room_id, struct pending_join *join)
+{
+    if (join == NULL)
+    {
+        if ((join = malloc(sizeof(struct pending_join))) == NULL)
+        {
+            LOG_ERROR("failed to allocate space for the join of user %d to room %u", user->id, room_id);
+            return -1;
+        }
+        join->lookup.room = room_id;
+        join->lookup.wakeup = &server->wakeup;
+        join->user = user->handle;
+    }
+    join->next = server->joins;
+    server->joins = join;
+
+    user->waiting = true;
+    user_list_remove(&server->ready_users, user, offsetof(struct user, ready));
+    room_log_lookup(server->group->log, &join->lookup);
+
+    return 0;
+}
+
+/**
+ * Adds a user to a room on this reactor, tells them whether they joined it, and replays the room's history to them.
+ * If the room log must look the room up first, this is done once it has.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ * @param room_id   Id of the room
+ * @param join      Pointer to the join if the room was looked up for it, which is freed, NULL otherwise
+ */
+void join_room(struct server *server, struct user *user, ROOM_ID room_id, struct pending_join *join)
+{
+    int status = add_user_to_room(server, room_id, user, join != NULL ? &join->lookup : NULL);
+    if (status == 1 && wait_for_lookup(server, user, room_id, join) == 0)
+        return;
+    free(join);
+
+    if (status != 0)
+    {
+        LOG_ERROR("failed to add user %d to room %u", user->id, room_id);
+        send_reply_message(server, user, "could not join room %u", room_id);
+        return;
+    }
+
+    send_reply_message(server, user, "you have joined room %u", room_id);
+    replay_history(server, user, user_find_subscription(user, room_id));
+}
+
+/**
+ * Finishes the joins the room log has answered the lookup of, and resumes handling the messages of their users. The
+ * joins of users who have gone since are dropped.
+ *
+ * @param server    Pointer to the server state
+ */
+void finish_joins(struct server *server)
+{
+    // Joins looked up again are put back on the list, so take the answered ones off it first
+    struct pending_join *answered = NULL;
+    for (struct pending_join **link = &server->joins; *link != NULL;)
+    {
+        struct pending_join *join = *link;
+        if (atomic_load(&join->lookup.next_seq) == 0)
+        {
+            link = &join->next;
+            continue;
+        }
+        *link = join->next;
+        join->next = answered;
+        answered = join;
+    }
+
+    while (answered != NULL)
+    {
+        struct pending_join *join = answered;
+        answered = join->next;
+
+        struct user *user = conn_table_get(&server->users, join->user);
+        if (user == NULL || user->closing)
+        {
+            free(join);
+            continue;
+        }
+
+        user->waiting = false;
+        join_room(server, user, join->lookup.room, join);
+        if (!user->waiting)
+            user_list_add(&server->ready_users, user, offsetof(struct user, ready));
+    }
+}
+
+/**
+ * Takes over a user handed over by another reactor: starts watching their socket, joins them to the room they were
+ * joining, and resumes their I/O. If the socket cannot be watched, the connection is closed.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int adopt_user(struct server *server, struct user *user)
+{
+    user->migrating = false;
+    atomic_fetch_add_explicit(&server->metrics.migrations_in, 1, memory_order_relaxed);
+
+    int client = user->id;
+    if (conn_table_insert(&server->users, user->handle, user) != 0)
+    {
+        LOG_ERROR("failed to add user %d to user table", client);
+        frame_parser_free(&user->parser);
+        outbound_queue_clear(&user->outbound);
+        buffer_pool_release(user->recv_backlog, user->backlog_cap);
+        slab_release(&server->user_cache, user);
+        close(client);
+        return -1;
+    }
+
+    int watched;
+    if (server->uring != NULL)
+        watched = update_uring_recv(server, user);
+    else
+    {
+        user->events = EVENT_READ | EVENT_EDGE;
+        watched = event_loop_add(server->loop, client, user->events, user);
+    }
+
+    if (watched != 0)
+    {
+        LOG_ERROR("failed to watch socket of client %d", client);
+        frame_parser_free(&user->parser);
+        outbound_queue_clear(&user->outbound);
+        buffer_pool_release(user->recv_backlog, user->backlog_cap);
+        delete_user(server, user);
+        close(client);
+        return -1;
+    }
+
+    join_room(server, user, user->migrate_room, NULL);
+
+    // Flush messages queued before the hand over, and read data which arrived in the meantime
+    if (server->uring != NULL)
+    {
+        if (start_uring_send(server, user) != 0)
+            LOG_ERROR("failed to submit send for client %d", user->id);
+    }
+    else if (user->outbound.bytes > 0)
+        user_list_add(&server->flush_users, user, offsetof(struct user, flush));
+    user_list_add(&server->ready_users, user, offsetof(struct user, ready));
+
+    LOG_INFO("took over client %d", user->id);
+
+    return 0;
+}
+
+/**
+ * Queues a chat message for every user this reactor has in a room. Members with a stale handle are dropped (see
+ * room_drop_stale_member()), and the room is reclaimed if none is left.
+ *
+ * @param server    Pointer to the server state
+ * @param room      Pointer to the room
+ * @param buf       Pointer to a shared buffer containing the message
+ * @param stamp     Stamp of the message in the room's history, 0 if rooms keep no history
+ */
+void deliver_to_room(struct server *server, struct room *room, struct shared_buffer *buf, uint64_t stamp)
+{
+    uint64_t delivered = 0;
+    for (uint32_t i = 0; i < room->num_users; i++)
+    {
+        // A user who joined after the message was stamped was sent it, or newer ones, from the history
+        if (stamp < room->members[i].fence)
+            continue;
+
+        // A member with a stale handle is dropped, and the member moved into its place is looked at next
+        struct user *receiver = conn_table_get(&server->users, room->members[i].handle);
+        if (receiver == NULL)
+        {
+            room_drop_stale_member(room, i--, &server->users);
+            continue;
+        }
+
+        // A receiver which cannot be sent to does not stop the others from getting the message
+        if (send_to_user(server, receiver, buf) != 0)
+            LOG_ERROR("failed to send chat message to client %d", receiver->id);
+        else
+            delivered++;
+    }
+    atomic_fetch_add_explicit(&server->metrics.local_deliveries, delivered, memory_order_relaxed);
+
+    if (room->num_users == 0)
+        close_room(server, room);
+}
+
+/**
+ * Handles every message other reactors have posted to this reactor's inbox. Handling a message never posts one, so
+ * this can run while waiting for room in another reactor's inbox without deadlocking.
+ *
+ * @param server    Pointer to the server state
+ */
+void handle_inbox(struct server *server)
+{
+    struct reactor_msg msgs[INBOX_BATCH];
+    size_t n;
+    while ((n = mpsc_ring_pop_batch(server->inbox, msgs, INBOX_BATCH)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            struct reactor_msg *msg = &msgs[i];
+            switch (msg->type)
+            {
+            case REACTOR_MSG_BROADCAST:
+            {
+                atomic_fetch_add_explicit(&server->metrics.broadcasts_handled, 1, memory_order_relaxed);
+                // The room is closed if this reactor's users in it left after the message was posted
+                struct room *room = room_registry_find(&server->rooms, msg->room);
+                if (room != NULL)
+                    deliver_to_room(server, room, msg->buf, msg->stamp);
+                shared_buffer_unref(msg->buf);
+                break;
+            }
+            case REACTOR_MSG_MIGRATE:
+                if (adopt_user(server, msg->user) != 0)
+                    LOG_ERROR("failed to take over a client");
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Posts a message to another reactor's inbox and wakes it up. If the inbox is full, handles this reactor's own inbox
+ * while waiting, so two reactors posting to each other cannot deadlock.
+ *
+ * @param server    Pointer to the server state
+ * @param dest      Pointer to the state of the receiving reactor
+ * @param msg       Pointer to the message
+ */
+void post_to_server(struct server *server, struct server *dest, struct reactor_msg *msg)
+{
+    while (mpsc_ring_push(dest->inbox, msg) != 0)
+    {
+        handle_inbox(server);
+        sched_yield();
+    }
+
+    if (ring_wakeup_signal(&dest->wakeup) != 0)
+        LOG_ERROR("failed to wake up reactor %d", dest->id);
+}
+
+/**
+ * Hands every user queued by hand_over_user() to the reactor owning the room they are joining. From then on, the user
+ * belongs to that reactor and must not be touched by this one.
+ *
+ * @param server    Pointer to the server state
+ */
+void finish_migrations(struct server *server)
+{
+    struct user *user;
+    while ((user = user_list_pop(&server->migrating_users, offsetof(struct user, migrate))) != NULL)
+    {
+        struct server *owner = &server->group->servers[room_owner(server->group, user->migrate_room)];
+        LOG_INFO("handing client %d over to reactor %d", user->id, owner->id);
+        atomic_fetch_add_explicit(&server->metrics.migrations_out, 1, memory_order_relaxed);
+
+        struct reactor_msg migrate = {REACTOR_MSG_MIGRATE, user->migrate_room, NULL, user, 0};
+        post_to_server(server, owner, &migrate);
+    }
+}
+
+/**
+ * Sends a stamped chat message to a room: queues it for the room's users on this reactor, and posts it to every other
+ * reactor the room was open on once the message was stamped.
+ *
+ * @param server    Pointer to the server state
+ * @param room      Pointer to the room, NULL if the reactor has no users in it
+ * @param room_id   Id of the room
+ * @param reactors  Bit set of the reactors the room was open on
+ * @param buf       Pointer to a shared buffer containing the message
+ * @param stamp     Stamp of the message in the room's history, 0 if rooms keep no history and messages are not logged
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int broadcast_message(struct server *server, struct room *room, ROOM_ID room_id, uint64_t reactors,
+                      struct shared_buffer *buf, uint64_t stamp)
+{
+    if (room != NULL)
+        deliver_to_room(server, room, buf, stamp);
+
+    struct server_group *group = server->group;
+    reactors &= ~((uint64_t)1 << server->id);
+    while (reactors != 0)
+    {
+        int i = __builtin_ctzll(reactors);
+        reactors &= reactors - 1;
+
+        struct reactor_msg broadcast = {REACTOR_MSG_BROADCAST, room_id, shared_buffer_ref(buf), NULL, stamp};
+        post_to_server(server, &group->servers[i], &broadcast);
+        atomic_fetch_add_explicit(&server->metrics.broadcasts_posted, 1, memory_order_relaxed);
+    }
+
+    return 0;
+}
+
+/**
+ * Commits the reactor's WAL: writes the chat messages the reactor accepted since the last commit with one write(),
+ * syncs them if the sync policy says so, and then sends the messages held until they were synced. Segments of the WAL
+ * whose messages are all synced in the rooms' logs are deleted.
+ *
+ * @param server    Pointer to the server state
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int commit_wal(struct server *server)
+{
+    if (server->wal == NULL)
+        return 0;
+
+    if (wal_commit(server->wal) != 0)
+        return -1;
+
+    for (size_t i = 0; i < server->num_held; i++)
+    {
+        struct held_message *msg = &server->held[i];
+        // The room is closed if this reactor's users in it left while the message was held, and other reactors may
+        // still have it open
+        struct room *room = room_registry_find(&server->rooms, msg->room);
+        uint64_t stamp;
+        uint64_t reactors = room_directory_commit(&server->group->rooms, room != NULL ? room->entry : NULL,
+                                                  msg->room, msg->seq, &stamp);
+        if (broadcast_message(server, room, msg->room, reactors, msg->buf, stamp) != 0)
+            LOG_ERROR("failed to deliver chat message to room %u", msg->room);
+        shared_buffer_unref(msg->buf);
+    }
+    server->num_held = 0;
+
+    wal_release(server->wal, room_log_replay_lsn(server->group->log, server->id));
+
+    return 0;
+}
+
+/**
+ * Holds a chat message until the reactor's WAL is synced. The WAL is committed at once with WAL_SYNC_ALWAYS, and
+ * otherwise at the end of the event loop iteration, or as soon as the reactor holds HELD_MESSAGES_MAX messages. The
+ * message is held back in the room's history as well, so no user is shown it before it is on disk.
+ *
+ * @param server    Pointer to the server state
+ * @param room_id   Id of the message's room
+ * @param buf       Pointer to a shared buffer containing the message, which the reactor takes a reference to
+ * @param seq       Sequence number of the message in the room
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int hold_message(struct server *server, ROOM_ID room_id, struct shared_buffer *buf, uint64_t seq)
+{
+    if (server->num_held == HELD_MESSAGES_MAX && commit_wal(server) != 0)
+        return -1;
+
+    server->held[server->num_held++] = (struct held_message){room_id, shared_buffer_ref(buf), seq};
+    if (server->wal->policy == WAL_SYNC_ALWAYS)
+        return commit_wal(server);
+
+    return 0;
+}
+
+/**
+ * Adds a chat message to the history of its room, which numbers it, appends it to the reactor's WAL and queues it for
+ * the room's log. It is queued under the history's lock so that the log gets the messages of a room in the order of
+ * their numbers. The WAL record is appended first, so a message the WAL has no room for is rejected before it gets a
+ * number. If the sync policy holds messages until they are on disk, the message is held back in the history too.
+ *
+ * @param server    Pointer to the server state
+ * @param room      Pointer to the room
+ * @param buf       Pointer to a shared buffer containing the message
+ * @param seq       Pointer which will store the sequence number of the message in the room, 0 if rooms keep no
+ *                  history and messages are not logged
+ * @param stamp     Pointer which will store the stamp of the message in the room's history, 0 likewise
+ *
+ * @return  0 on success.
+ *          -1 if the message could not be appended to the WAL, in which case it is not recorded.
+ */
+int record_history(struct server *server, struct room *room, struct shared_buffer *buf, uint64_t *seq,
+                   uint64_t *stamp)
+{
+    struct server_group *group = server->group;
+    *seq = 0;
+    *stamp = 0;
+    if (group->history_replay == 0 && group->log == NULL && group->search == NULL)
+        return 0;
+
+    struct room_entry *entry = room->entry;
+    pthread_mutex_lock(&entry->history_lock);
+    uint64_t lsn = 0;
+    if (group->log != NULL &&
+        (lsn = wal_append(server->wal, room->id, entry->history.next_seq, buf->data, buf->len)) == 0)
+    {
+        pthread_mutex_unlock(&entry->history_lock);
+        return -1;
+    }
+    *seq = history_ring_append(&entry->history, buf->data, buf->len);
+    *stamp = entry->history.next_stamp - 1;
+    if (server->held != NULL && history_ring_hold(&entry->history, *seq) != 0)
+        LOG_ERROR("failed to hold back chat message %" PRIu64 " of room %u from its history", *seq, room->id);
+    if (group->log != NULL)
+        room_log_append(group->log, room->id, *seq, buf, server->id, lsn);
+    if (group->search != NULL)
+        text_search_append(group->search, room->id, *seq, buf);
+    pthread_mutex_unlock(&entry->history_lock);
+
+    return 0;
+}
+
+/**
+ * Handles a chat message from a client.
+ *
+ * A client sends this kind of message when it wants to send a message to one of the chat rooms they are in, named by
+ * the message. As a result, this function will take their message and send it to all other clients in the room: it
+ * adds the message to the room's history, queues it for the room's users on this reactor, and posts it to every other
+ * reactor with users in the room. If the WAL's sync policy makes messages wait until they are on disk, the message is
+ * held until the WAL is committed instead.
+ *
+ * The outbound message is built from slices: the sender's name and the text, read in place from the receive buffer,
+ * are each copied once, straight into the buffer shared by every receiver.
+ *
+ * @param server    Pointer to the server state
+ * @param buf       Pointer to a char buffer containing the message
+ * @param len       Length of the message in bytes
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 on error or if the message is malformed.
+ */
+int handle_chat_message(struct server *server, char *buf, size_t len, struct user *user)
+{
+    struct chat_message_view msg;
+    if (chat_message_parse(buf, len, &msg) != 0)
+    {
+        LOG_ERROR("malformed chat message from client %d", user->id);
+        return -1;
+    }
+
+    struct subscription *sub = user_find_subscription(user, msg.room_id);
+    if (sub == NULL)
+    {
+        LOG_INFO("did not send chat message: client %d is not in room %u", user->id, msg.room_id);
+        send_reply_message(server, user, "you are not in room %u: type '/join %u' to join it", msg.room_id,
+                           msg.room_id);
+        return 0;
+    }
+
+    msg.timestamp = time(NULL);
+    msg.name = user->name;
+    msg.name_len = strlen(user->name) + 1; // +1 for null character
+
+    // Serialize the message once: every receiver's outbound queue shares the same buffer
+    struct shared_buffer *send_buf = serialize_chat_message(&msg);
+    if (send_buf == NULL)
+    {
+        LOG_ERROR("failed to serialize the chat message");
+        return -1;
+    }
+
+    struct room *room = sub->room;
+    uint64_t seq;
+    uint64_t stamp;
+    if (record_history(server, room, send_buf, &seq, &stamp) != 0)
+    {
+        LOG_ERROR("failed to log chat message from client %d to room %u", user->id, room->id);
+        send_reply_message(server, user, "could not send your message to room %u: try again", room->id);
+        shared_buffer_unref(send_buf);
+        return 0;
+    }
+
+    // The message is stamped before the room's reactors are read, so a reactor joining the room after that replays it.
+    // A held message is stamped and its reactors are read once it is committed instead (see room_directory_commit()).
+    int status;
+    if (server->held != NULL)
+        status = hold_message(server, room->id, send_buf, seq);
+    else
+        status = broadcast_message(server, room, room->id,
+                                   atomic_load_explicit(&room->entry->reactors, memory_order_relaxed), send_buf, stamp);
+    shared_buffer_unref(send_buf);
+    if (status != 0)
+        return -1;
+
+    LOG_INFO("sent chat message from client %d to all clients in room %u", user->id, room->id);
+
+    return 0;
+}
+
+/**
+ * Handles a name message from a client.
+ *
+ * A client sends this kind of message when it wants to update their name. As a result, this function will update their
+ * name then send a message back to inform them that the update was successful.
+ *
+ * @param server    Pointer to the server state
+ * @param buf       Pointer to a char buffer containing the message
+ * @param len       Length of the message in bytes
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int handle_name_message(struct server *server, char *buf, size_t len, struct user *user)
+{
+    struct name_message_view msg;
+    if (name_message_parse(buf, len, &msg) != 0)
+    {
+        LOG_ERROR("malformed name message from client %d", user->id);
+        return -1;
+    }
+
+    memcpy(user->name, msg.name, msg.name_len);
+    LOG_INFO("set name of user %d to %s", user->id, user->name);
+
+    send_reply_message(server, user, "set name to %s", user->name);
+
+    return 0;
+}
+
+/**
+ * Handles a join message from a client.
+ *
+ * A client sends this kind of message when it wants to join a room, in addition to the rooms they are already in. As a
+ * result, this function will add them to the room, creating it if nobody is in it yet, then send a message back to
+ * inform them that the join was successful. In room affinity mode, a user joining their first room is handed over to
+ * the reactor owning it, which adds them to the room; a user already in rooms joins on the reactor they are on.
+ *
+ * @param server    Pointer to the server state
+ * @param buf       Pointer to a char buffer containing the message
+ * @param len       Length of the message in bytes
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int handle_join_message(struct server *server, char *buf, size_t len, struct user *user)
+{
+    struct join_message_view msg;
+    if (join_message_parse(buf, len, &msg) != 0)
+    {
+        LOG_ERROR("malformed join message from client %d", user->id);
+        return -1;
+    }
+
+    if (msg.room_id == INVALID_ROOM)
+    {
+        LOG_INFO("did not add user %d to room %u: room does not exist", user->id, msg.room_id);
+        send_reply_message(server, user, "room %u does not exist", msg.room_id);
+        return 0;
+    }
+
+    if (user_find_subscription(user, msg.room_id) != NULL)
+    {
+        LOG_INFO("did not add user %d to room %u: user already in room", user->id, msg.room_id);
+        send_reply_message(server, user, "you are already in room %u", msg.room_id);
+        return 0;
+    }
+
+    if (user->num_subs == USER_MAX_SUBSCRIPTIONS)
+    {
+        LOG_INFO("did not add user %d to room %u: user in too many rooms", user->id, msg.room_id);
+        send_reply_message(server, user, "you can not be in more than %d rooms", USER_MAX_SUBSCRIPTIONS);
+        return 0;
+    }
+
+    // In room affinity mode, a user in no room joins the room on the reactor owning it
+    if (server->group->room_affinity && user->num_subs == 0 && room_owner(server->group, msg.room_id) != server->id)
+    {
+        start_migration(server, user, msg.room_id);
+        return 0;
+    }
+
+    join_room(server, user, msg.room_id, NULL);
+
+    return 0;
+}
+
+/**
+ * Handles a leave message from a client.
+ *
+ * A client sends this kind of message when it wants to leave one of the rooms they are in. As a result, this function
+ * will remove them from the room then send a message back to inform them that they left it.
+ *
+ * @param server    Pointer to the server state
+ * @param buf       Pointer to a char buffer containing the message
+ * @param len       Length of the message in bytes
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int handle_leave_message(struct server *server, char *buf, size_t len, struct user *user)
+{
+    struct leave_message_view msg;
+    if (leave_message_parse(buf, len, &msg) != 0)
+    {
+        LOG_ERROR("malformed leave message from client %d", user->id);
+        return -1;
+    }
+
+    struct subscription *sub = user_find_subscription(user, msg.room_id);
+    if (sub == NULL)
+    {
+        LOG_INFO("did not remove user %d from room %u: user not in room", user->id, msg.room_id);
+        send_reply_message(server, user, "you are not in room %u", msg.room_id);
+        return 0;
+    }
+
+    remove_user_from_room(server, user, sub);
+    send_reply_message(server, user, "you have left room %u", msg.room_id);
+
+    return 0;
+}
+
+/**
+ * Has the room log read a user the messages of a room older than the room's history from disk, as the next batch of
+ * the answer to their history message. The user's messages are not handled until finish_reads() takes the answer.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ * @param room_id   Id of the room
+ * @param from_seq  Sequence number of the first message wanted
+ * @param end_seq   Sequence number of the oldest message in the room's history, or where it would start
+ * @param count     Most messages sent
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int read_history(struct server *server, struct user *user, ROOM_ID room_id, uint64_t from_seq, uint64_t end_seq,
+                 size_t count)
+{
+    struct pending_read *read = malloc(sizeof(struct pending_read));
+    if (read == NULL)
+    {
+        LOG_ERROR("failed to allocate space to read the log of room %u for client %d", room_id, user->id);
+        return -1;
+    }
+    struct history_batch_message batch = {.room_id = room_id};
+    read->read.room = room_id;
+    read->read.from_seq = from_seq;
+    read->read.end_seq = end_seq;
+    read->read.max_count = count;
+    read->read.max_len = HISTORY_BATCH_BYTES;
+    read->read.reserve = history_batch_message_size(&batch);
+    read->read.seqs = NULL;
+    read->read.wakeup = &server->wakeup;
+    read->user = user->handle;
+    read->next = server->reads;
+    server->reads = read;
+
+    user->waiting = true;
+    user_list_remove(&server->ready_users, user, offsetof(struct user, ready));
+    room_log_read(server->group->log, &read->read);
+
+    return 0;
+}
+
+/**
+ * Sends a user the chat messages of a room from a sequence number on, as history batch messages each followed by a
+ * range of the room's history. A range is found with a binary search of the history's index and copied out of it in
+ * one piece, behind its batch message, so each batch is queued as a single buffer and its chat messages are sent
+ * exactly as they were first serialized. Messages older than the history are read from the room's log on disk, if
+ * there is one, by the log's writer thread (see read_history()), and the answer goes on once they are sent. Each batch
+ * tells the user where its messages start, so they can tell the messages which were not kept from those not sent yet.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ * @param entry     Pointer to the room's entry in the room directory
+ * @param from_seq  Sequence number of the first message wanted
+ * @param count     Most messages sent
+ */
+void send_history(struct server *server, struct user *user, struct room_entry *entry, uint64_t from_seq, size_t count)
+{
+    struct history_batch_message batch = {.room_id = entry->id};
+    size_t header = history_batch_message_size(&batch);
+    do
+    {
+        struct history_range range;
+        struct shared_buffer *buf;
+        pthread_mutex_lock(&entry->history_lock);
+        history_ring_range(&entry->history, from_seq, count, HISTORY_BATCH_BYTES, &range);
+        if (server->group->log != NULL && count > 0 && from_seq < range.first_seq)
+        {
+            pthread_mutex_unlock(&entry->history_lock);
+            if (read_history(server, user, entry->id, from_seq, range.first_seq, count) != 0)
+                LOG_ERROR("failed to send the history of room %u to client %d", entry->id, user->id);
+            return;
+        }
+        batch.first_seq = range.first_seq;
+        batch.next_seq = range.next_seq;
+        batch.count = range.count;
+        batch.more = range.count < count && range.next_seq < history_ring_committed_seq(&entry->history);
+        if ((buf = shared_buffer_alloc(header + range.len)) != NULL)
+        {
+            history_batch_message_serialize_to(&batch, buf->data, header, &buf->len);
+            history_ring_read(&entry->history, range.offset, buf->data + header, range.len);
+            buf->len += range.len;
+        }
+        pthread_mutex_unlock(&entry->history_lock);
+
+        if (buf == NULL || send_to_user(server, user, buf) != 0)
+        {
+            LOG_ERROR("failed to send the history of room %u to client %d", entry->id, user->id);
+            if (buf != NULL)
+                shared_buffer_unref(buf);
+            return;
+        }
+        shared_buffer_unref(buf);
+
+        count -= range.count;
+        from_seq = range.next_seq;
+    } while (batch.more);
+
+    LOG_INFO("sent the history of room %u to client %d", entry->id, user->id);
+}
+
+/**
+ * Sends a user the messages the room log read for their history message as a batch of the answer, and goes on with
+ * the answer from the message after them.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ * @param read      Pointer to the answered read, whose buffer is released
+ */
+void send_history_read(struct server *server, struct user *user, struct room_log_read *read)
+{
+    struct subscription *sub = user_find_subscription(user, read->room);
+    size_t count = read->max_count - read->count;
+    if (read->count > 0)
+    {
+        struct history_batch_message batch = {read->room, read->first_seq, read->next_seq, read->count,
+                                              sub != NULL && count > 0};
+        size_t len;
+        history_batch_message_serialize_to(&batch, read->buf->data, read->reserve, &len);
+        if (send_to_user(server, user, read->buf) != 0)
+        {
+            LOG_ERROR("failed to send the history of room %u to client %d", read->room, user->id);
+            shared_buffer_unref(read->buf);
+            return;
+        }
+        shared_buffer_unref(read->buf);
+        if (count == 0)
+            return;
+    }
+
+    // The user's messages were not handled while the log was read, so they are still in the room
+    if (sub != NULL)
+        send_history(server, user, sub->room->entry, read->next_seq, count);
+}
+
+/**
+ * Finishes the history messages the room log has answered the read of, and resumes handling the messages of their
+ * users. The reads of users who have gone since are dropped.
+ *
+ * @param server    Pointer to the server state
+ */
+void finish_reads(struct server *server)
+{
+    // Reads made again are put back on the list, so take the answered ones off it first
+    struct pending_read *answered = NULL;
+    for (struct pending_read **link = &server->reads; *link != NULL;)
+    {
+        struct pending_read *read = *link;
+        if (!atomic_load(&read->read.done))
+        {
+            link = &read->next;
+            continue;
+        }
+        *link = read->next;
+        read->next = answered;
+        answered = read;
+    }
+
+    while (answered != NULL)
+    {
+        struct pending_read *read = answered;
+        answered = read->next;
+
+        struct user *user = conn_table_get(&server->users, read->user);
+        if (user == NULL || user->closing)
+        {
+            if (read->read.buf != NULL)
+                shared_buffer_unref(read->read.buf);
+            free(read);
+            continue;
+        }
+
+        user->waiting = false;
+        send_history_read(server, user, &read->read);
+        free(read);
+        if (!user->waiting)
+            user_list_add(&server->ready_users, user, offsetof(struct user, ready));
+    }
+}
+
+/**
+ * Handles the wakeup fd of a reactor becoming readable: resets it, handles the messages in the inbox, and finishes the
+ * joins and history messages the room log has answered.
+ *
+ * @param server    Pointer to the server state
+ */
+void handle_wakeup(struct server *server)
+{
+    ring_wakeup_clear(&server->wakeup);
+    handle_inbox(server);
+    finish_joins(server);
+    finish_reads(server);
+}
+
+/**
+ * Handles a history message from a client.
+ *
+ * A client sends this kind of message to catch up on the messages of a room they are in, from a sequence number on,
+ * for instance after reconnecting. As a result, this function will send them the messages of the room from that number
+ * on, up to the number asked for, in batches: from the room's log on disk for those older than the room's history, if
+ * messages are logged, and from the history for the others.
+ *
+ * @param server    Pointer to the server state
+ * @param buf       Pointer to a char buffer containing the message
+ * @param len       Length of the message in bytes
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int handle_history_message(struct server *server, char *buf, size_t len, struct user *user)
+{
+    struct history_message_view msg;
+    if (history_message_parse(buf, len, &msg) != 0)
+    {
+        LOG_ERROR("malformed history message from client %d", user->id);
+        return -1;
+    }
+
+    struct subscription *sub = user_find_subscription(user, msg.room_id);
+    if (sub == NULL)
+    {
+        LOG_INFO("did not send the history of room %u to user %d: user not in room", msg.room_id, user->id);
+        send_reply_message(server, user, "you are not in room %u", msg.room_id);
+        return 0;
+    }
+
+    send_history(server, user, sub->room->entry, msg.from_seq, msg.count);
+
+    return 0;
+}
+
+/**
+ * Handles a search message from a client.
+ *
+ * A client sends this kind of message to find the messages of a room they are in which match a query. As a result,
+ * this function will search the room's index and send them the sequence numbers of the newest messages found, which
+ * they can fetch with a history message. The search runs on this reactor, but only ever decodes the blocks of the
+ * posting lists which may hold a match, newest first, and stops once it has found enough or read TEXT_INDEX_BUDGET
+ * postings, so no query holds up the reactor for long. The client is told whether older messages may match, which they
+ * may when the search stopped early or the room's index does not reach back to its first message.
+ *
+ * @param server    Pointer to the server state
+ * @param buf       Pointer to a char buffer containing the message
+ * @param len       Length of the message in bytes
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int handle_search_message(struct server *server, char *buf, size_t len, struct user *user)
+{
+    struct search_message_view msg;
+    if (search_message_parse(buf, len, &msg) != 0)
+    {
+        LOG_ERROR("malformed search message from client %d", user->id);
+        return -1;
+    }
+
+    struct server_group *group = server->group;
+    if (group->search == NULL)
+    {
+        send_reply_message(server, user, "search is turned off");
+        return 0;
+    }
+    if (user_find_subscription(user, msg.room_id) == NULL)
+    {
+        LOG_INFO("did not search room %u for user %d: user not in room", msg.room_id, user->id);
+        send_reply_message(server, user, "you are not in room %u", msg.room_id);
+        return 0;
+    }
+
+    struct search_result_message result = {.room_id = msg.room_id};
+    size_t max = msg.count < SEARCH_RESULTS_LIMIT ? msg.count : SEARCH_RESULTS_LIMIT;
+    size_t count;
+    bool more;
+    if (text_search_query(group->search, msg.room_id, msg.query, msg.query_len - 1, result.seqs, max, &count,
+                          &more) != 0) // -1 to leave out the null character
+    {
+        send_reply_message(server, user, "a search takes 1 to %d words", TEXT_INDEX_QUERY_TERMS);
+        return 0;
+    }
+    result.count = count;
+    result.more = more;
+
+    size_t size = search_result_message_size(&result);
+    if (!admit_message(server, user, size))
+        return 0;
+
+    char *dst = outbound_queue_reserve(&user->outbound, size);
+    size_t result_len;
+    if (dst == NULL || search_result_message_serialize_to(&result, dst, size, &result_len) != 0)
+    {
+        LOG_ERROR("failed to serialize the search result message");
+        return 0;
+    }
+    outbound_queue_commit(&user->outbound, result_len);
+
+    if (schedule_send(server, user) != 0)
+        LOG_ERROR("failed to send the search result message");
+
+    LOG_INFO("sent %zu search results for room %u to client %d", count, msg.room_id, user->id);
+
+    return 0;
+}
+
+/**
+ * Handles a complete message from a client by determining its type and handling it accordingly.
+ *
+ * @param server    Pointer to the server state
+ * @param buf       Pointer to a char buffer containing the message
+ * @param len       Length of the message in bytes
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 on error or if the message is malformed.
+ */
+int handle_client_frame(struct server *server, char *buf, size_t len, struct user *user)
+{
+    switch (get_message_type(buf))
+    {
+    case CHAT_MESSAGE:
+        LOG_INFO("received chat message from client %d", user->id);
+        if (handle_chat_message(server, buf, len, user) != 0)
+        {
+            LOG_ERROR("failed to handle chat message");
+            return -1;
+        }
+        break;
+    case JOIN_MESSAGE:
+        LOG_INFO("received join message from client %d", user->id);
+        if (handle_join_message(server, buf, len, user) != 0)
+            return -1;
+        break;
+    case NAME_MESSAGE:
+        LOG_INFO("received name message from client %d", user->id);
+        if (handle_name_message(server, buf, len, user) != 0)
+            return -1;
+        break;
+    case LEAVE_MESSAGE:
+        LOG_INFO("received leave message from client %d", user->id);
+        if (handle_leave_message(server, buf, len, user) != 0)
+            return -1;
+        break;
+    case HISTORY_MESSAGE:
+        LOG_INFO("received history message from client %d", user->id);
+        if (handle_history_message(server, buf, len, user) != 0)
+            return -1;
+        break;
+    case SEARCH_MESSAGE:
+        LOG_INFO("received search message from client %d", user->id);
+        if (handle_search_message(server, buf, len, user) != 0)
+            return -1;
+        break;
+    default:
+        LOG_ERROR("invalid message type");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Handles messages from a client whose socket is readable.
+ *
+ * - Receives whatever data is available into the client's frame parser, a buffer at a time, without waiting for the
+ *   rest of a partially received message
+ * - Determines the type of each complete message and handles it accordingly
+ *
+ * At most READ_BUDGET messages are handled per call so one busy client cannot starve the others. If the budget runs
+ * out, the client is marked ready so the rest of its data is read on the next event loop iteration.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  1 on success.
+ *          0 when the client closes the connection.
+ *          -1 on error.
+ */
+int handle_client_message(struct server *server, struct user *user)
+{
+    // Read once the join or history the user waits for is finished, which makes the user ready
+    if (user->waiting)
+        return 1;
+
+    for (int i = 0; i < READ_BUDGET; i++)
+    {
+        char *recv_buf;
+        size_t len;
+        switch (frame_parser_recv(&user->parser, user->id, &recv_buf, &len))
+        {
+        case FRAME_COMPLETE:
+            break;
+        case FRAME_INCOMPLETE:
+            return 1; // Socket drained
+        case FRAME_CLOSED:
+            LOG_INFO("connection to client %d closed", user->id);
+            return 0;
+        case FRAME_ERROR:
+            LOG_ERROR("failed to receive message from client %d", user->id);
+            return -1;
+        }
+
+        if (handle_client_frame(server, recv_buf, len, user) != 0)
+            return -1;
+
+        // Anything after a join which hands the user to another reactor is read by that reactor, and anything after a
+        // join or history message waiting for the room log once it is finished
+        if (user->migrating || user->waiting)
+            return 1;
+    }
+
+    user_list_add(&server->ready_users, user, offsetof(struct user, ready));
+
+    return 1;
+}
+
+/**
+ * Handles the bytes a client has sent which the io_uring engine received but were not parsed yet. They are handed to
+ * the client's frame parser and every complete message is handled, while reads are not paused.
+ *
+ * At most READ_BUDGET messages are handled per call so one busy client cannot starve the others. If the budget runs
+ * out, the client is marked ready so the rest of its backlog is handled on the next iteration.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          1 when the client hung up and everything it sent has been handled.
+ *          -1 on error.
+ */
+int handle_client_backlog(struct server *server, struct user *user)
+{
+    size_t offset = 0;
+    int handled = 0;
+    bool drained = false;
+    while (!user->reads_paused && !user->migrating && !user->waiting)
+    {
+        if (handled == READ_BUDGET)
+        {
+            user_list_add(&server->ready_users, user, offsetof(struct user, ready));
+            break;
+        }
+
+        char *frame;
+        size_t frame_len;
+        size_t consumed;
+        enum frame_status status = frame_parser_feed(&user->parser, user->recv_backlog + offset,
+                                                     user->backlog_len - offset, &consumed, &frame, &frame_len);
+        offset += consumed;
+
+        if (status == FRAME_INCOMPLETE)
+        {
+            drained = true;
+            break;
+        }
+        else if (status == FRAME_ERROR)
+        {
+            LOG_ERROR("failed to parse message from client %d", user->id);
+            return -1;
+        }
+
+        if (handle_client_frame(server, frame, frame_len, user) != 0)
+            return -1;
+        handled++;
+    }
+
+    user->backlog_len -= offset;
+    memmove(user->recv_backlog, user->recv_backlog + offset, user->backlog_len);
+
+    // A client which hung up with messages left to handle is closed once everything it sent is handled
+    if (user->hung_up && drained)
+        return 1;
+
+    return update_uring_recv(server, user);
+}
+
+/**
+ * Handles data received from a client by the io_uring engine. The data is appended to the client's backlog of unparsed
+ * bytes, so the provided buffer holding it can be handed back to the kernel right away, and the backlog is handled.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ * @param data      Pointer to the received data
+ * @param len       Number of bytes received
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int handle_client_data(struct server *server, struct user *user, char *data, size_t len)
+{
+    if (user->backlog_len + len > user->backlog_cap)
+    {
+        size_t cap = user->backlog_cap > 0 ? user->backlog_cap : URING_BUF_SIZE;
+        while (cap < user->backlog_len + len)
+            cap *= 2;
+
+        char *backlog = buffer_pool_alloc(cap);
+        if (backlog == NULL)
+        {
+            LOG_ERROR("failed to allocate space for data from client %d", user->id);
+            return -1;
+        }
+        if (user->backlog_len > 0)
+            memcpy(backlog, user->recv_backlog, user->backlog_len);
+        buffer_pool_release(user->recv_backlog, user->backlog_cap);
+        user->recv_backlog = backlog;
+        user->backlog_cap = cap;
+    }
+
+    memcpy(user->recv_backlog + user->backlog_len, data, len);
+    user->backlog_len += len;
+
+    // A turn on the ready list is already scheduled to handle the backlog
+    if (user->ready.linked)
+        return update_uring_recv(server, user);
+
+    return handle_client_backlog(server, user);
+}
+
+/**
+ * Handles terminiation of a client.
+ *
+ * - Stops watching the client's socket: removes it from the event loop, or cancels its recv in the io_uring engine
+ * - Removes the client from the rooms they were in
+ * - Removes the user data associated with the client from the reactor's table of users
+ * - Closes the connection to the given client
+ *
+ * With the io_uring engine, the last two steps are deferred until the engine has no operations left in flight for the
+ * client.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int handle_client_termination(struct server *server, struct user *user)
+{
+    int client = user->id;
+
+    if (server->uring != NULL)
+    {
+        if (user->closing)
+            return 0;
+        user->closing = true;
+
+        user_list_remove(&server->ready_users, user, offsetof(struct user, ready));
+        if (update_uring_recv(server, user) != 0)
+            return -1;
+    }
+    else if (event_loop_delete(server->loop, client) != 0)
+    {
+        LOG_ERROR("failed to delete fd %d from event loop", client);
+        return -1;
+    }
+
+    remove_user_from_rooms(server, user);
+
+    if (server->uring != NULL)
+        return release_uring_user(server, user);
+
+    user_list_remove(&server->ready_users, user, offsetof(struct user, ready));
+    user_list_remove(&server->flush_users, user, offsetof(struct user, flush));
+    frame_parser_free(&user->parser);
+    outbound_queue_clear(&user->outbound);
+
+    if (delete_user(server, user) != 0)
+    {
+        LOG_ERROR("failed to delete user %d", client);
+        return -1;
+    }
+
+    close(client);
+    LOG_INFO("closed connection to client %d", client);
+
+    return 0;
+}
+
+/**
+ * Handles an operation completed by the io_uring engine.
+ *
+ * @param server    Pointer to the server state
+ * @param c         Pointer to the completion
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int handle_uring_completion(struct server *server, struct uring_completion *c)
+{
+    struct user *user = c->ctx;
+
+    switch (c->op)
+    {
+    case URING_OP_ACCEPT:
+        if (c->res == -EMFILE || c->res == -ENFILE)
+        {
+            // The kernel fails an accept when out of fds even if no connection is queued, so re-arming it at once
+            // would spin. The connections queued are turned away, and accepting waits for the listener to poll
+            // readable, which it does for each connection queued from then on.
+            while (turn_away_connection(server))
+                ;
+            if (!server->listener_polled && uring_engine_prep_poll(server->uring, server->listener, NULL) != 0)
+            {
+                LOG_ERROR("failed to submit poll on listener socket");
+                return -1;
+            }
+            server->listener_polled = true;
+            server->accept_paused = true;
+            break;
+        }
+        if (c->res < 0)
+            LOG_ERROR("failed to accept a connection: %s", strerror(-c->res));
+        else if (handle_new_client(server, c->res) != 0)
+        {
+            LOG_ERROR("failed to create new connection");
+            return -1;
+        }
+
+        // The kernel stops a multishot accept on errors, so it has to be re-armed
+        if (!c->more && uring_engine_prep_accept(server->uring, server->listener) != 0)
+        {
+            LOG_ERROR("failed to re-arm accept on listener socket");
+            return -1;
+        }
+        break;
+    case URING_OP_RECV:
+        if (c->buf != NULL)
+        {
+            int status = 0;
+            if (!user->closing)
+                status = handle_client_data(server, user, c->buf, c->res);
+            uring_engine_return_buffer(server->uring, c->buf_id);
+
+            if (status != 0)
+            {
+                LOG_ERROR("failed to handle data from client %d", user->id);
+                if (handle_client_termination(server, user) != 0)
+                    return -1;
+            }
+        }
+
+        if (c->more)
+            break;
+
+        // The multishot recv has finished: re-arm it if it only ran out of provided buffers or was cancelled, as long
+        // as the client should still be read from. A user being handed over is, and the reactor taking them over
+        // finds out about a hang-up once it has handled the messages received before.
+        user->recv_armed = false;
+        user->recv_cancelled = false;
+        user->inflight_ops--;
+        if (!user->closing && (c->res > 0 || c->res == -ENOBUFS || c->res == -ECANCELED || user->migrating))
+        {
+            if (update_uring_recv(server, user) != 0)
+                return handle_client_termination(server, user);
+            return release_uring_user(server, user);
+        }
+
+        // The messages received before the hang-up are handled first, once the join or history they wait for is done or
+        // on the turn the user has on the ready list
+        if (!user->closing && c->res == 0 && (user->waiting || user->ready.linked))
+        {
+            user->hung_up = true;
+            return release_uring_user(server, user);
+        }
+
+        if (!user->closing)
+        {
+            if (c->res < 0)
+                LOG_ERROR("failed to receive data from client %d: %s", user->id, strerror(-c->res));
+            LOG_INFO("connection to client %d closed", user->id);
+            return handle_client_termination(server, user);
+        }
+        return release_uring_user(server, user);
+    case URING_OP_SEND:
+        user->send_in_flight = false;
+        user->inflight_ops--;
+
+        if (c->res < 0)
+        {
+            if (user->closing)
+                return release_uring_user(server, user);
+            LOG_ERROR("failed to send data to client %d: %s", user->id, strerror(-c->res));
+            return handle_client_termination(server, user);
+        }
+
+        outbound_queue_consume(&user->outbound, c->res);
+        if (!user->closing)
+        {
+            handle_outbound_drained(server, user);
+            if (start_uring_send(server, user) != 0)
+            {
+                LOG_ERROR("failed to submit send for client %d", user->id);
+                return handle_client_termination(server, user);
+            }
+        }
+        return release_uring_user(server, user);
+    case URING_OP_CANCEL:
+        break;
+    case URING_OP_POLL:
+        // The listener is polled without a context, and accepts again once a connection is queued
+        if (c->ctx == NULL)
+        {
+            if (server->accept_paused && uring_engine_prep_accept(server->uring, server->listener) != 0)
+            {
+                LOG_ERROR("failed to re-arm accept on listener socket");
+                return -1;
+            }
+            server->accept_paused = false;
+            if (!c->more && uring_engine_prep_poll(server->uring, server->listener, NULL) != 0)
+            {
+                LOG_ERROR("failed to re-arm poll on listener socket");
+                return -1;
+            }
+            break;
+        }
+
+        handle_wakeup(server);
+        if (!c->more && uring_engine_prep_poll(server->uring, server->wakeup.fd, server) != 0)
+        {
+            LOG_ERROR("failed to re-arm poll on wakeup fd");
+            return -1;
+        }
+        break;
+    }
+
+    return 0;
+}
+
+/**
+ * Runs the server on the io_uring engine. Each iteration submits every operation prepared by the previous one (new
+ * recvs, replies and the sends of a whole room fan-out) and waits for completions in a single system call.
+ *
+ * @param server    Pointer to the server state
+ */
+void run_uring_loop(struct server *server)
+{
+    if (uring_engine_prep_accept(server->uring, server->listener) != 0)
+    {
+        LOG_ERROR("failed to submit accept on listener socket");
+        exit(EXIT_FAILURE);
+    }
+
+    if (uring_engine_prep_poll(server->uring, server->wakeup.fd, server) != 0)
+    {
+        LOG_ERROR("failed to submit poll on wakeup fd");
+        exit(EXIT_FAILURE);
+    }
+
+    struct uring_completion completions[MAX_EVENTS];
+    while (1)
+    {
+        // Don't block if some clients still have unparsed data left from the previous iteration
+        unsigned wait_nr = server->ready_users != NULL ? 0 : 1;
+        if (uring_engine_submit_and_wait(server->uring, wait_nr) == -1)
+        {
+            LOG_ERROR("failed to wait for completions");
+            exit(EXIT_FAILURE);
+        }
+
+        int n;
+        while ((n = uring_engine_reap(server->uring, completions, MAX_EVENTS)) > 0)
+            for (int i = 0; i < n; i++)
+                if (handle_uring_completion(server, &completions[i]) != 0)
+                {
+                    LOG_ERROR("failed to handle io_uring completion");
+                    exit(EXIT_FAILURE);
+                }
+
+        // Give clients which ran out of read budget another turn, taking the whole list first as in run_event_loop()
+        struct user *ready = server->ready_users;
+        server->ready_users = NULL;
+        struct user *user;
+        while ((user = user_list_pop(&ready, offsetof(struct user, ready))) != NULL)
+        {
+            int status = handle_client_backlog(server, user);
+            if (status == -1)
+                LOG_ERROR("failed to handle data from client %d", user->id);
+            if (status != 0 && handle_client_termination(server, user) != 0)
+                exit(EXIT_FAILURE);
+        }
+
+        // The messages accepted during this iteration reach the WAL before any of them is submitted to be sent
+        if (commit_wal(server) != 0)
+        {
+            LOG_ERROR("failed to commit the WAL");
+            exit(EXIT_FAILURE);
+        }
+
+        finish_migrations(server);
+    }
+}
+
+/**
+ * Handles a client whose socket is readable, closing the connection if the client hung up or sent something invalid.
+ *
+ * @param server    Pointer to the server state
+ * @param user      Pointer to the user data for the client
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int handle_readable_client(struct server *server, struct user *user)
+{
+    int sockfd = user->id;
+    int status = handle_client_message(server, user);
+    if (status == 1)
+        return 0;
+
+    if (status == -1)
+        LOG_ERROR("failed to handle message from client %d", sockfd);
 
-    if (listen(listener, BACKLOG_LIMIT) == -1)
+    if (handle_client_termination(server, user) != 0)
     {
-        LOG_ERROR("failed to set-up listener socket for listening: %s", strerror(errno));
+        LOG_ERROR("failed to close connection to client %d", sockfd);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Runs the server on an event loop.
+ *
+ * @param server    Pointer to the server state
+ */
+void run_event_loop(struct server *server)
+{
+    if (event_loop_add(server->loop, server->listener, EVENT_READ, NULL) != 0)
+    {
+        LOG_ERROR("failed to add listener socket to event loop");
         exit(EXIT_FAILURE);
     }
 
-    if (pollfd_array_append(pollfds, listener, POLLIN) != 0)
+    if (event_loop_add(server->loop, server->wakeup.fd, EVENT_READ, server) != 0)
     {
-        LOG_ERROR("failed to append listener socket to pollfd array");
+        LOG_ERROR("failed to add wakeup fd to event loop");
         exit(EXIT_FAILURE);
     }
 
+    struct event events[MAX_EVENTS];
     while (1)
     {
-        if (poll(pollfds->fds, pollfds->len, -1) == -1)
+        // Don't block if some clients still have unread data left from the previous iteration
+        int timeout = server->ready_users != NULL ? 0 : -1;
+
+        int n;
+        if ((n = event_loop_wait(server->loop, events, MAX_EVENTS, timeout)) == -1)
         {
-            LOG_ERROR("failed to poll open sockets: %s", strerror(errno));
+            LOG_ERROR("failed to wait for events on open sockets");
             exit(EXIT_FAILURE);
         }
 
-        for (uint32_t i = 0; i < pollfds->len; i++)
+        // Only ready fds are visited and each one carries its user, so no lookup is needed to dispatch
+        for (int i = 0; i < n; i++)
         {
-            struct pollfd pfd = pollfds->fds[i];
-            int sockfd = pfd.fd;
-            short revents = pfd.revents;
+            // The wakeup fd is registered with the reactor itself as its context
+            if (events[i].ctx == server)
+            {
+                handle_wakeup(server);
+                continue;
+            }
 
-            if (revents & POLLHUP)
+            struct user *user = events[i].ctx;
+            uint32_t revents = events[i].events;
+
+            // The listener is the only fd without a user, so its context is NULL
+            if (user == NULL)
             {
-                if (handle_client_termination(sockfd, i, pollfds, rooms, &user_table) != 0)
-                {
-                    LOG_ERROR("failed to close connection to client %d", sockfd);
+                if ((revents & EVENT_READ) && accept_clients(server) != 0)
                     exit(EXIT_FAILURE);
-                }
-                i--; // repeat same index because last element in pollfd array has taken its place
                 continue;
             }
 
-            if (revents & POLLIN)
+            if ((revents & EVENT_WRITE) && flush_user(server, user) != 0)
             {
-                if (sockfd == listener)
-                {
-                    if (handle_new_client(listener, pollfds, &user_table) != 0)
-                    {
-                        LOG_ERROR("failed to create new connection");
-                        exit(EXIT_FAILURE);
-                    }
-                }
-                else
-                {
-                    int status = handle_client_message(sockfd, &user_table, rooms);
-                    if (status == 0)
-                    {
-                        if (handle_client_termination(sockfd, i, pollfds, rooms, &user_table) != 0)
-                        {
-                            LOG_ERROR("failed to close connection to client %d", sockfd);
-                            exit(EXIT_FAILURE);
-                        }
-                        i--; // repeat same index because last element in pollfd array has taken its place
-                    }
-                    else if (status == -1)
-                    {
-                        LOG_ERROR("failed to handle message from client %d", sockfd);
-                        exit(EXIT_FAILURE);
-                    }
-                }
+                if (handle_client_termination(server, user) != 0)
+                    exit(EXIT_FAILURE);
+                continue;
+            }
+
+            // Read before handling a hang up so messages sent right before it are not lost
+            if (((revents & EVENT_READ) && !user->reads_paused) || (revents & (EVENT_HUP | EVENT_ERROR)))
+            {
+                user_list_remove(&server->ready_users, user, offsetof(struct user, ready)); // This turn replaces it
+                if (handle_readable_client(server, user) != 0)
+                    exit(EXIT_FAILURE);
+            }
+        }
+
+        // Give clients which ran out of read budget on an earlier iteration another turn. Clients which get a turn now
+        // and run out again are added back, so take the whole list first.
+        struct user *ready = server->ready_users;
+        server->ready_users = NULL;
+        struct user *user;
+        while ((user = user_list_pop(&ready, offsetof(struct user, ready))) != NULL)
+            if (handle_readable_client(server, user) != 0)
+                exit(EXIT_FAILURE);
+
+        // The messages accepted during this iteration reach the WAL before any of them is sent
+        if (commit_wal(server) != 0)
+        {
+            LOG_ERROR("failed to commit the WAL");
+            exit(EXIT_FAILURE);
+        }
+
+        // Write every message queued during this iteration, one writev() per user
+        while ((user = user_list_pop(&server->flush_users, offsetof(struct user, flush))) != NULL)
+            if (flush_user(server, user) != 0 && handle_client_termination(server, user) != 0)
+                exit(EXIT_FAILURE);
+
+        finish_migrations(server);
+    }
+}
+
+/**
+ * Runs a reactor thread on the io_uring engine or its event loop. Never returns.
+ *
+ * @param arg   Pointer to the state of the reactor
+ *
+ * @return  Nothing, the server exits on fatal errors.
+ */
+void *run_server(void *arg)
+{
+    struct server *server = arg;
+    if (server->uring != NULL)
+        run_uring_loop(server);
+    else
+        run_event_loop(server);
+
+    return NULL;
+}
+
+/**
+ * Reports the cross-thread traffic of every reactor, the open rooms, the memory their history holds, and the use of the
+ * memory pools, each time the server receives SIGUSR1, which every other thread blocks. Never returns.
+ *
+ * @param arg   Pointer to the group of reactors
+ *
+ * @return  Nothing.
+ */
+void *report_metrics(void *arg)
+{
+    struct server_group *group = arg;
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    while (1)
+    {
+        int sig;
+        if (sigwait(&signals, &sig) != 0)
+            continue;
+
+        for (int i = 0; i < group->num_servers; i++)
+        {
+            struct reactor_metrics *m = &group->servers[i].metrics;
+            fprintf(stderr,
+                    "reactor %d: migrations in %" PRIuFAST64 ", out %" PRIuFAST64 ", broadcasts posted %" PRIuFAST64
+                    ", handled %" PRIuFAST64 ", local deliveries %" PRIuFAST64 "\n",
+                    i, atomic_load(&m->migrations_in), atomic_load(&m->migrations_out),
+                    atomic_load(&m->broadcasts_posted), atomic_load(&m->broadcasts_handled),
+                    atomic_load(&m->local_deliveries));
+            struct wal *wal = group->servers[i].wal;
+            if (wal != NULL)
+                fprintf(stderr,
+                        "reactor %d WAL: %" PRIuFAST64 " messages in %" PRIuFAST64 " commits, %" PRIuFAST64
+                        " syncs, %" PRIuFAST64 " of %" PRIuFAST64 " bytes synced\n",
+                        i, atomic_load(&wal->records), atomic_load(&wal->commits), atomic_load(&wal->syncs),
+                        atomic_load(&wal->synced), atomic_load(&wal->written));
+        }
+        struct slab_stats rooms;
+        slab_pool_stats(group->room_pool, &rooms);
+        fprintf(stderr, "open rooms: %zu, room records: %zu live, %zu free, high water %zu\n",
+                atomic_load(&group->rooms.count), rooms.live, rooms.free, rooms.high_water);
+        fprintf(stderr, "history: %zu of %zu bytes\n", atomic_load(&group->history.used), group->history.limit);
+        if (group->log != NULL)
+        {
+            fprintf(stderr,
+                    "room log: %" PRIuFAST64 " messages in %" PRIuFAST64 " writes, %" PRIuFAST64 " stalls, %" PRIuFAST64
+                    " checkpoints, %" PRIuFAST64 " snapshots\n",
+                    atomic_load(&group->log->records), atomic_load(&group->log->writes),
+                    atomic_load(&group->log->stalls), atomic_load(&group->log->syncs),
+                    atomic_load(&group->snapshots));
+            fprintf(stderr,
+                    "recovery: %" PRIu64 " rooms from the snapshot, %" PRIu64 " WAL records replayed in %.1f ms, "
+                    "ready in %.1f ms\n",
+                    group->log->recovered_rooms, group->log->replayed, group->log->recovery_ms, group->ready_ms);
+        }
+
+        if (group->search != NULL)
+            fprintf(stderr,
+                    "search: %" PRIuFAST64 " messages indexed, %" PRIuFAST64 " left out, %" PRIuFAST64
+                    " room indexes dropped, %zu of %zu bytes\n",
+                    atomic_load(&group->search->indexed), atomic_load(&group->search->skipped),
+                    atomic_load(&group->search->evicted), atomic_load(&group->search->used), group->search->limit);
+
+        struct slab_stats users;
+        slab_pool_stats(group->user_pool, &users);
+        fprintf(stderr, "user records: %zu live, %zu free, high water %zu\n", users.live, users.free,
+                users.high_water);
+
+        struct buffer_pool_stats buffers;
+        buffer_pool_stats(&buffers);
+        for (int i = 0; i < BUFFER_POOL_NUM_CLASSES; i++)
+        {
+            struct buffer_class_stats *c = &buffers.classes[i];
+            fprintf(stderr, "%zu byte buffers: %zu hits, %zu misses, %zu outstanding\n", c->size, c->hits, c->misses,
+                    c->outstanding);
+        }
+        fprintf(stderr, "heap buffers: %zu allocated, %zu outstanding\n", buffers.heap.misses,
+                buffers.heap.outstanding);
+    }
+
+    return NULL;
+}
+
+/**
+ * Saves the state of the rooms in a snapshot once SNAPSHOT_WAL_BYTES were written to the WALs since the last one, or
+ * after SNAPSHOT_INTERVAL_MS if anything was, so a restart only replays a bounded tail of the WALs. Never returns.
+ *
+ * @param arg   Pointer to the group of reactors, whose messages are logged
+ *
+ * @return  Nothing.
+ */
+void *take_snapshots(void *arg)
+{
+    struct server_group *group = arg;
+    uint64_t lsns[MAX_THREADS];
+    uint64_t last[MAX_THREADS];
+    for (int i = 0; i < group->num_servers; i++)
+        last[i] = atomic_load(&group->servers[i].wal->written);
+
+    struct timespec poll = {0, SNAPSHOT_POLL_MS * 1000000L};
+    unsigned waited_ms = 0;
+    while (1)
+    {
+        nanosleep(&poll, NULL);
+        waited_ms += SNAPSHOT_POLL_MS;
+
+        uint64_t bytes = 0;
+        for (int i = 0; i < group->num_servers; i++)
+        {
+            lsns[i] = atomic_load(&group->servers[i].wal->written);
+            bytes += lsns[i] - last[i];
+        }
+        if (bytes < SNAPSHOT_WAL_BYTES && (bytes == 0 || waited_ms < SNAPSHOT_INTERVAL_MS))
+            continue;
+
+        waited_ms = 0;
+        if (room_directory_snapshot(&group->rooms, lsns) != 0)
+        {
+            LOG_ERROR("failed to take a snapshot of the rooms: the WALs are kept until the next one");
+            continue;
+        }
+        memcpy(last, lsns, group->num_servers * sizeof(uint64_t));
+        atomic_fetch_add_explicit(&group->snapshots, 1, memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+/**
+ * Initializes the state of a reactor thread: its event loop or io_uring engine, room registry, inbox and wakeup fd, its
+ * own listener socket bound to the server's port, and its WAL if messages are logged.
+ *
+ * @param server    Pointer to the state to initialize
+ * @param group     Pointer to the group the reactor belongs to
+ * @param id        Index of the reactor in the group
+ * @param res       Pointer to the address info of the server
+ * @param use_uring Whether the reactor should use the io_uring engine instead of an event loop
+ * @param backend   The event loop backend, if an event loop is used
+ * @param policy    What to do with users which fall behind on reading
+ * @param backlog   Number of connections the kernel queues on the listener until they are accepted
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int init_server(struct server *server, struct server_group *group, int id, struct addrinfo *res, bool use_uring,
+                enum event_loop_backend backend, enum slow_consumer_policy policy, int backlog)
+{
+    memset(server, 0, sizeof(*server));
+    server->id = id;
+    server->group = group;
+    server->slow_consumer_policy = policy;
+    slab_cache_init(&server->user_cache, group->user_pool);
+    if (conn_table_init(&server->users) != 0)
+    {
+        LOG_ERROR("failed to initialize user table");
+        return -1;
+    }
+
+    if (use_uring)
+    {
+        if ((server->uring = uring_engine_init(URING_ENTRIES, URING_NUM_BUFS, URING_BUF_SIZE)) == NULL)
+        {
+            LOG_ERROR("failed to initialize io_uring engine");
+            return -1;
+        }
+    }
+    else if ((server->loop = event_loop_init(backend)) == NULL)
+    {
+        LOG_ERROR("failed to initialize event loop");
+        return -1;
+    }
+
+    if (room_registry_init(&server->rooms, group->room_pool) != 0)
+    {
+        LOG_ERROR("failed to initialize room registry");
+        return -1;
+    }
+
+    if ((server->inbox = mpsc_ring_init(INBOX_CAPACITY, sizeof(struct reactor_msg))) == NULL)
+    {
+        LOG_ERROR("failed to initialize inbox");
+        return -1;
+    }
+
+    if (ring_wakeup_init(&server->wakeup) != 0)
+    {
+        LOG_ERROR("failed to create wakeup fd");
+        return -1;
+    }
+
+    // Opened before the listener, so the reactor can still turn connections away once the process is out of fds
+    if ((server->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        LOG_ERROR("failed to open the spare fd: %s", strerror(errno));
+        return -1;
+    }
+
+    if ((server->listener = create_listener_socket(res)) == -1)
+    {
+        LOG_ERROR("failed to create listener socket");
+        return -1;
+    }
+
+    if (listen(server->listener, backlog) == -1)
+    {
+        LOG_ERROR("failed to set-up listener socket for listening: %s", strerror(errno));
+        return -1;
+    }
+
+    // A connection can be gone by the time it is accepted, so accepting must not block
+    if (set_nonblocking(server->listener) != 0)
+    {
+        LOG_ERROR("failed to make listener socket non-blocking");
+        return -1;
+    }
+
+    // Every reactor writes ahead to a WAL of its own
+    if (group->log != NULL)
+    {
+        char dir[PATH_MAX];
+        if (snprintf(dir, PATH_MAX, "%s/wal/%d", group->log->dir, id) >= PATH_MAX ||
+            (server->wal = wal_open(dir, group->wal_policy)) == NULL)
+        {
+            LOG_ERROR("failed to open WAL");
+            return -1;
+        }
+
+        bool holds = group->wal_policy == WAL_SYNC_ALWAYS || group->wal_policy == WAL_SYNC_BATCH;
+        if (holds && (server->held = malloc(HELD_MESSAGES_MAX * sizeof(struct held_message))) == NULL)
+        {
+            LOG_ERROR("failed to allocate space for held messages");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Prints how to run the server.
+ *
+ * @param prog  The name the server was run with
+ */
+void print_usage(char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-e poll|epoll|io_uring] [-s disconnect|drop|pause] [-t threads] [-a] [-b backlog] [-H] "
+            "[-r messages] [-m MiB] [-d dir] [-f always|batch|interval|never] [-i ms] [-x MiB]\n",
+            prog);
+    fprintf(stderr, "  -e   I/O backend (default: epoll)\n");
+    fprintf(stderr, "  -s   what to do with clients which fall behind on reading (default: disconnect)\n");
+    fprintf(stderr, "  -t   number of reactor threads, each with its own listener (default: 1, at most %d)\n",
+            MAX_THREADS);
+    fprintf(stderr, "  -a   room affinity: hand every user to the thread owning the room they join\n");
+    fprintf(stderr, "  -b   connections queued on each listener until accepted (default: %d, capped by the kernel)\n",
+            DEFAULT_BACKLOG);
+    fprintf(stderr, "  -H   back connection records and buffers with hugepages\n");
+    fprintf(stderr, "  -r   messages from its history sent to a user joining a room, 0 for no history (default: %d)\n",
+            DEFAULT_HISTORY_REPLAY);
+    fprintf(stderr, "  -m   memory all rooms together keep history in, at most %d KiB per room (default: %d)\n",
+            HISTORY_ROOM_LIMIT / 1024, DEFAULT_HISTORY_LIMIT);
+    fprintf(stderr, "  -d   directory to log every room's messages to (default: messages are not logged)\n");
+    fprintf(stderr, "  -f   when logged messages are synced to disk, and whether they wait for it (default: batch)\n");
+    fprintf(stderr, "  -i   milliseconds between syncs with -f interval (default: %d)\n", DEFAULT_WAL_INTERVAL_MS);
+    fprintf(stderr, "  -x   memory the search indexes of all rooms together take, 0 to turn search off (default: %d)\n",
+            DEFAULT_SEARCH_LIMIT);
+}
+
+int main(int argc, char *argv[])
+{
+    struct timespec start, ready;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    enum event_loop_backend backend = EVENT_LOOP_EPOLL;
+    bool use_uring = false;
+    enum slow_consumer_policy policy = SLOW_CONSUMER_DISCONNECT;
+    int num_threads = 1;
+    bool room_affinity = false;
+    int backlog = DEFAULT_BACKLOG;
+    bool hugepages = false;
+    int history_replay = DEFAULT_HISTORY_REPLAY;
+    int history_limit = DEFAULT_HISTORY_LIMIT;
+    const char *log_dir = NULL;
+    enum wal_sync_policy wal_policy = WAL_SYNC_BATCH;
+    int wal_interval = DEFAULT_WAL_INTERVAL_MS;
+    int search_limit = DEFAULT_SEARCH_LIMIT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "e:s:t:ab:Hr:m:d:f:i:x:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'e':
+            if (strcmp(optarg, "io_uring") == 0)
+                use_uring = true;
+            else if (event_loop_parse_backend(optarg, &backend) != 0)
+            {
+                LOG_ERROR("unknown I/O backend: %s", optarg);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            if (strcmp(optarg, "disconnect") == 0)
+                policy = SLOW_CONSUMER_DISCONNECT;
+            else if (strcmp(optarg, "drop") == 0)
+                policy = SLOW_CONSUMER_DROP;
+            else if (strcmp(optarg, "pause") == 0)
+                policy = SLOW_CONSUMER_PAUSE;
+            else
+            {
+                LOG_ERROR("unknown slow consumer policy: %s", optarg);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 't':
+            num_threads = atoi(optarg);
+            if (num_threads < 1 || num_threads > MAX_THREADS)
+            {
+                LOG_ERROR("invalid number of threads: %s", optarg);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'a':
+            room_affinity = true;
+            break;
+        case 'b':
+            backlog = atoi(optarg);
+            if (backlog < 1)
+            {
+                LOG_ERROR("invalid backlog: %s", optarg);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'H':
+            hugepages = true;
+            break;
+        case 'r':
+            history_replay = atoi(optarg);
+            if (history_replay < 0)
+            {
+                LOG_ERROR("invalid number of messages to replay: %s", optarg);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'm':
+            history_limit = atoi(optarg);
+            if (history_limit < 0)
+            {
+                LOG_ERROR("invalid history memory: %s", optarg);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'd':
+            log_dir = optarg;
+            break;
+        case 'f':
+            if (wal_parse_policy(optarg, &wal_policy) != 0)
+            {
+                LOG_ERROR("unknown WAL sync policy: %s", optarg);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'i':
+            wal_interval = atoi(optarg);
+            if (wal_interval < 1)
+            {
+                LOG_ERROR("invalid WAL sync interval: %s", optarg);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'x':
+            search_limit = atoi(optarg);
+            if (search_limit < 0)
+            {
+                LOG_ERROR("invalid search index memory: %s", optarg);
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
             }
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Writing to a client which has disconnected must fail with EPIPE instead of killing the server
+    signal(SIGPIPE, SIG_IGN);
+
+    // Only the metrics thread handles SIGUSR1, every other thread inherits the mask blocking it
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    // Every buffer the reactors allocate comes from the pool, so it must be set up before any of them is
+    if (buffer_pool_init(hugepages) != 0)
+    {
+        LOG_ERROR("failed to initialize buffer pool");
+        exit(EXIT_FAILURE);
+    }
+
+    struct server_group group;
+    group.num_servers = num_threads;
+    group.room_affinity = room_affinity;
+    group.history_replay = history_replay;
+    history_budget_init(&group.history, history_replay > 0 ? HISTORY_ROOM_LIMIT : 0, (size_t)history_limit << 20);
+    group.servers = aligned_alloc(CACHE_LINE_SIZE, num_threads * sizeof(struct server));
+    group.room_pool = slab_pool_init(sizeof(struct room), hugepages);
+    group.user_pool = slab_pool_init(sizeof(struct user), hugepages);
+    atomic_init(&group.next_generation, 1);
+    group.wal_policy = wal_policy;
+    group.log = NULL;
+    atomic_init(&group.snapshots, 0);
+    if (log_dir != NULL &&
+        (group.log = room_log_init(log_dir, num_threads, history_replay > 0 ? HISTORY_ROOM_LIMIT : 0)) == NULL)
+    {
+        LOG_ERROR("failed to open room log in %s", log_dir);
+        exit(EXIT_FAILURE);
+    }
+    group.search = NULL;
+    if (search_limit > 0 && (group.search = text_search_init((size_t)search_limit << 20, group.log)) == NULL)
+    {
+        LOG_ERROR("failed to start the search indexer");
+        exit(EXIT_FAILURE);
+    }
+    if (group.servers == NULL || group.room_pool == NULL || group.user_pool == NULL ||
+        room_directory_init(&group.rooms, &group.history, group.log, group.search) != 0)
+    {
+        LOG_ERROR("failed to allocate space for %d reactors", num_threads);
+        exit(EXIT_FAILURE);
+    }
+
+    int status;
+    struct addrinfo *res;
+    if ((status = get_server_addr_info(PORT, &res)) != 0)
+    {
+        LOG_ERROR("failed to get server's address info: %s", gai_strerror(status));
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < num_threads; i++)
+        if (init_server(&group.servers[i], &group, i, res, use_uring, backend, policy, backlog) != 0)
+        {
+            LOG_ERROR("failed to initialize reactor %d", i);
+            exit(EXIT_FAILURE);
+        }
+    freeaddrinfo(res);
+    res = NULL;
+
+    // The listeners queue connections from now on, and recovery is over
+    clock_gettime(CLOCK_MONOTONIC, &ready);
+    group.ready_ms = (ready.tv_sec - start.tv_sec) * 1e3 + (ready.tv_nsec - start.tv_nsec) / 1e6;
+
+    // With WAL_SYNC_INTERVAL, a thread of its own syncs the reactors' WALs
+    static struct wal_syncer syncer;
+    if (group.log != NULL && wal_policy == WAL_SYNC_INTERVAL)
+    {
+        struct wal **wals = malloc(num_threads * sizeof(struct wal *));
+        if (wals == NULL)
+        {
+            LOG_ERROR("failed to allocate space for the WALs to sync");
+            exit(EXIT_FAILURE);
         }
+        for (int i = 0; i < num_threads; i++)
+            wals[i] = group.servers[i].wal;
+        if (wal_syncer_start(&syncer, wals, num_threads, wal_interval) != 0)
+            exit(EXIT_FAILURE);
+    }
+
+    pthread_t snapshot_thread;
+    if (group.log != NULL && (status = pthread_create(&snapshot_thread, NULL, take_snapshots, &group)) != 0)
+    {
+        LOG_ERROR("failed to start snapshot thread: %s", strerror(status));
+        exit(EXIT_FAILURE);
     }
+
+    pthread_t metrics_thread;
+    if ((status = pthread_create(&metrics_thread, NULL, report_metrics, &group)) != 0)
+    {
+        LOG_ERROR("failed to start metrics thread: %s", strerror(status));
+        exit(EXIT_FAILURE);
+    }
+
+    // The main thread runs the first reactor
+    for (int i = 1; i < num_threads; i++)
+        if ((status = pthread_create(&group.servers[i].thread, NULL, run_server, &group.servers[i])) != 0)
+        {
+            LOG_ERROR("failed to start reactor thread %d: %s", i, strerror(status));
+            exit(EXIT_FAILURE);
+        }
+    group.servers[0].thread = pthread_self();
+    run_server(&group.servers[0]);
 }
@@ -9,23 +9,25 @@
 #include "chat_message.h"
 #include "../../lib/log.h"
 
-int chat_message_serialize(struct chat_message *msg, char **buf, size_t *len)
+size_t chat_message_view_size(const struct chat_message_view *view)
+{
+    return sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(ROOM_ID) + sizeof(view->timestamp) + sizeof(NAME_LEN) +
+           view->name_len + sizeof(TEXT_LEN) + view->text_len;
+}
+
+int chat_message_view_serialize_to(const struct chat_message_view *view, char *buf, size_t size, size_t *len)
 {
     // Determine total message length
-    NAME_LEN name_len = strlen(msg->name) + 1; // +1 for null character
-    TEXT_LEN text_len = strlen(msg->text) + 1; // +1 for null character
-    TOTAL_MSG_LEN total_len = sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(msg->timestamp) + sizeof(NAME_LEN) + name_len + sizeof(TEXT_LEN) + text_len;
-    *len = total_len;
+    TOTAL_MSG_LEN total_len = chat_message_view_size(view);
 
-    // Allocate space for the buffer
-    *buf = malloc(total_len);
-    if (*buf == NULL)
+    if (total_len > size)
     {
-        LOG_ERROR("failed to allocate space for buffer");
+        LOG_ERROR("buffer too small for message: %u > %zu bytes", total_len, size);
         return -1;
     }
+    *len = total_len;
 
-    char *b = *buf; // Use b instead of *buf since we're going to be adding to it
+    char *b = buf; // Use b instead of buf since we're going to be adding to it
 
     // Write total message length
     TOTAL_MSG_LEN total_len_nbe = htonl(total_len);
@@ -37,26 +39,77 @@ int chat_message_serialize(struct chat_message *msg, char **buf, size_t *len)
     memcpy(b, &msg_type, sizeof(msg_type));
     b += sizeof(msg_type);
 
+    // Write room ID
+    ROOM_ID room_id_nbe = htonl(view->room_id);
+    memcpy(b, &room_id_nbe, sizeof(room_id_nbe));
+    b += sizeof(room_id_nbe);
+
     // Write timestamp
-    TIMESTAMP timestamp_nbe = htonl(msg->timestamp);
+    TIMESTAMP timestamp_nbe = htonl(view->timestamp);
     memcpy(b, &timestamp_nbe, sizeof(timestamp_nbe));
     b += sizeof(timestamp_nbe);
 
     // Write name length
-    memcpy(b, &name_len, sizeof(name_len)); // Don't need to convert name_len to Network Byte Order because it is one byte long
-    b += sizeof(name_len);
+    memcpy(b, &view->name_len, sizeof(view->name_len)); // Don't need to convert name_len to Network Byte Order because it is one byte long
+    b += sizeof(view->name_len);
 
     // Write name
-    memcpy(b, &msg->name, name_len);
-    b += name_len;
+    memcpy(b, view->name, view->name_len);
+    b += view->name_len;
 
     // Write text length
-    TEXT_LEN text_len_nbe = htons(text_len);
-    memcpy(b, &text_len_nbe, sizeof(text_len));
-    b += sizeof(text_len);
+    TEXT_LEN text_len_nbe = htons(view->text_len);
+    memcpy(b, &text_len_nbe, sizeof(text_len_nbe));
+    b += sizeof(text_len_nbe);
 
     // Write text
-    memcpy(b, msg->text, text_len);
+    memcpy(b, view->text, view->text_len);
+
+    return 0;
+}
+
+/**
+ * Describes a chat message struct as a view of its fields.
+ */
+static void view_message(struct chat_message *msg, struct chat_message_view *view)
+{
+    view->room_id = msg->room_id;
+    view->timestamp = msg->timestamp;
+    view->name = msg->name;
+    view->name_len = strlen(msg->name) + 1; // +1 for null character
+    view->text = msg->text;
+    view->text_len = strlen(msg->text) + 1; // +1 for null character
+}
+
+size_t chat_message_size(struct chat_message *msg)
+{
+    struct chat_message_view view;
+    view_message(msg, &view);
+    return chat_message_view_size(&view);
+}
+
+int chat_message_serialize_to(struct chat_message *msg, char *buf, size_t size, size_t *len)
+{
+    struct chat_message_view view;
+    view_message(msg, &view);
+    return chat_message_view_serialize_to(&view, buf, size, len);
+}
+
+int chat_message_serialize(struct chat_message *msg, char **buf, size_t *len)
+{
+    size_t size = chat_message_size(msg);
+    *buf = malloc(size);
+    if (*buf == NULL)
+    {
+        LOG_ERROR("failed to allocate space for buffer");
+        return -1;
+    }
+
+    if (chat_message_serialize_to(msg, *buf, size, len) != 0)
+    {
+        free(*buf);
+        return -1;
+    }
 
     return 0;
 }
@@ -66,6 +119,11 @@ void chat_message_deserialize(char *buf, struct chat_message *msg)
     // Skip over total message length and message type
     buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
 
+    // Get room ID
+    memcpy(&msg->room_id, buf, sizeof(msg->room_id));
+    msg->room_id = ntohl(msg->room_id);
+    buf += sizeof(msg->room_id);
+
     // Get timestamp
     TIMESTAMP timestamp = ntohl(*(TIMESTAMP *)buf);
     memcpy(&msg->timestamp, &timestamp, sizeof(timestamp));
@@ -87,8 +145,55 @@ void chat_message_deserialize(char *buf, struct chat_message *msg)
     memcpy(msg->text, buf, text_len);
 }
 
+int chat_message_parse(char *buf, size_t len, struct chat_message_view *view)
+{
+    char *end = buf + len;
+
+    // Skip over total message length and message type
+    buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
+
+    // Get room ID
+    if (end - buf < (ptrdiff_t)sizeof(ROOM_ID))
+        return -1;
+    memcpy(&view->room_id, buf, sizeof(view->room_id));
+    view->room_id = ntohl(view->room_id);
+    buf += sizeof(view->room_id);
+
+    // Get timestamp
+    if (end - buf < (ptrdiff_t)sizeof(TIMESTAMP))
+        return -1;
+    TIMESTAMP timestamp;
+    memcpy(&timestamp, buf, sizeof(timestamp));
+    view->timestamp = ntohl(timestamp);
+    buf += sizeof(timestamp);
+
+    // Get name
+    if (end - buf < (ptrdiff_t)sizeof(NAME_LEN))
+        return -1;
+    view->name_len = *(NAME_LEN *)buf; // Don't need to convert name_len to Host Byte Order because it is one byte long
+    buf += sizeof(NAME_LEN);
+    view->name = buf;
+    if (view->name_len > 0 && !message_string_valid(buf, end, view->name_len, NAME_SIZE_LIMIT)) // May be left out
+        return -1;
+    buf += view->name_len;
+
+    // Get text
+    if (end - buf < (ptrdiff_t)sizeof(TEXT_LEN))
+        return -1;
+    TEXT_LEN text_len;
+    memcpy(&text_len, buf, sizeof(text_len));
+    view->text_len = ntohs(text_len);
+    buf += sizeof(text_len);
+    view->text = buf;
+    if (!message_string_valid(buf, end, view->text_len, TEXT_SIZE_LIMIT))
+        return -1;
+
+    return 0;
+}
+
 void chat_message_print(struct chat_message *msg)
 {
     struct tm *sent_timestamp = localtime(&msg->timestamp);
-    printf("(%02d:%02d) %s: %s", sent_timestamp->tm_hour, sent_timestamp->tm_min, msg->name, msg->text);
+    printf("(%02d:%02d) #%u %s: %s", sent_timestamp->tm_hour, sent_timestamp->tm_min, msg->room_id, msg->name,
+           msg->text);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 
+#include "join_message.h"
 #include "name_message.h"
 
 typedef int64_t TIMESTAMP;
@@ -13,11 +14,56 @@ typedef uint16_t TEXT_LEN;
 // Represents a message sent in a chat room
 struct chat_message
 {
+    ROOM_ID room_id; // The room the message is sent to
     TIMESTAMP timestamp;
     char name[NAME_SIZE_LIMIT];
     char text[TEXT_SIZE_LIMIT];
 };
 
+// A received chat message read in place: the strings point into the buffer holding the message. Also describes a
+// message to serialize from fields held in different places.
+struct chat_message_view
+{
+    ROOM_ID room_id;
+    TIMESTAMP timestamp;
+    const char *name;
+    NAME_LEN name_len; // Length of name including its null character, 0 if the sender left the name out
+    const char *text;
+    TEXT_LEN text_len; // Length of text including its null character
+};
+
+/**
+ * Gets the number of bytes a chat message takes once serialized, so a buffer can be sized for it.
+ *
+ * @param msg   The message to measure
+ *
+ * @return  Length of the serialized message in bytes
+ */
+size_t chat_message_size(struct chat_message *msg);
+
+/**
+ * Serializes a chat message into a caller-provided buffer, without allocating anything.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - timestamp (4 bytes)
+ * - name length (1 byte)
+ * - name (max 50 bytes)
+ * - text length (2 bytes)
+ * - text (max 1000 bytes)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Pointer to the buffer which will store the serialized message
+ * @param size  Size of buf in bytes, at least chat_message_size(msg)
+ * @param len   Pointer to a size_t which will store the length of the serialized message
+ *
+ * @return  0 on success.
+ *          -1 if buf is too small.
+ */
+int chat_message_serialize_to(struct chat_message *msg, char *buf, size_t size, size_t *len);
+
 /**
  * Serializes a chat message so it can be sent to the client/server. The buffer should be freed when it is no longer
  * needed.
@@ -25,6 +71,7 @@ struct chat_message
  * Message structure:
  * - message length (4 bytes)
  * - message type (1 byte)
+ * - room ID (4 bytes)
  * - timestamp (4 bytes)
  * - name length (1 byte)
  * - name (max 50 bytes)
@@ -40,12 +87,49 @@ struct chat_message
  */
 int chat_message_serialize(struct chat_message *msg, char **buf, size_t *len);
 
+/**
+ * Gets the number of bytes the chat message described by a view takes once serialized.
+ *
+ * @param view  The message to measure
+ *
+ * @return  Length of the serialized message in bytes
+ */
+size_t chat_message_view_size(const struct chat_message_view *view);
+
+/**
+ * Serializes the chat message described by a view into a caller-provided buffer. Each field is copied once, straight
+ * from wherever the view points.
+ *
+ * @param view  The message to serialize
+ * @param buf   Pointer to the buffer which will store the serialized message
+ * @param size  Size of buf in bytes, at least chat_message_view_size(view)
+ * @param len   Pointer to a size_t which will store the length of the serialized message
+ *
+ * @return  0 on success.
+ *          -1 if buf is too small.
+ */
+int chat_message_view_serialize_to(const struct chat_message_view *view, char *buf, size_t size, size_t *len);
+
+/**
+ * Reads a received chat message in place, checking that every field lies within the message and that the strings are
+ * null-terminated and within their limits. The view stays valid as long as buf does.
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param len   Length of the message in bytes
+ * @param view  Pointer to a view which will describe the message
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int chat_message_parse(char *buf, size_t len, struct chat_message_view *view);
+
 /**
  * Deserializes a chat message received from the client/server.
  *
  * Message structure:
  * - message length (4 bytes)
  * - message type (1 byte)
+ * - room ID (4 bytes)
  * - timestamp (4 bytes)
  * - name length (1 byte)
  * - name (max 50 bytes)
@@ -58,9 +142,9 @@ int chat_message_serialize(struct chat_message *msg, char **buf, size_t *len);
 void chat_message_deserialize(char *buf, struct chat_message *msg);
 
 /**
- * Prints a message in the format: (hh:mm) [name]: [message].
+ * Prints a message in the format: (hh:mm) #[room] [name]: [message].
  *
- * Example: (09:00) Tyler: Hello, world!
+ * Example: (09:00) #5 Tyler: Hello, world!
  *
  * @param msg   The message to print
  */
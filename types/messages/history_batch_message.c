@@ -0,0 +1,127 @@
+#include <arpa/inet.h>
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "message.h"
+#include "history_batch_message.h"
+#include "../../lib/log.h"
+
+size_t history_batch_message_size(struct history_batch_message *msg)
+{
+    (void)msg; // History batch messages have a fixed length, the chat messages following them are messages of their own
+    return sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(ROOM_ID) + 2 * sizeof(MSG_SEQ) + sizeof(MSG_COUNT) +
+           sizeof(msg->more);
+}
+
+int history_batch_message_serialize_to(struct history_batch_message *msg, char *buf, size_t size, size_t *len)
+{
+    // Determine total message length
+    TOTAL_MSG_LEN total_len = history_batch_message_size(msg);
+
+    if (total_len > size)
+    {
+        LOG_ERROR("buffer too small for message: %u > %zu bytes", total_len, size);
+        return -1;
+    }
+    *len = total_len;
+
+    char *b = buf; // Use b instead of buf since we're going to be adding to it
+
+    // Write total message length
+    TOTAL_MSG_LEN total_len_nbe = htonl(total_len);
+    memcpy(b, &total_len_nbe, sizeof(total_len_nbe));
+    b += sizeof(total_len_nbe);
+
+    // Write message type
+    MSG_TYPE msg_type = HISTORY_BATCH_MESSAGE;
+    memcpy(b, &msg_type, sizeof(msg_type));
+    b += sizeof(msg_type);
+
+    // Write room ID
+    ROOM_ID room_id_nbe = htonl(msg->room_id);
+    memcpy(b, &room_id_nbe, sizeof(room_id_nbe));
+    b += sizeof(room_id_nbe);
+
+    // Write first and next sequence numbers
+    MSG_SEQ first_seq_nbe = htobe64(msg->first_seq);
+    memcpy(b, &first_seq_nbe, sizeof(first_seq_nbe));
+    b += sizeof(first_seq_nbe);
+    MSG_SEQ next_seq_nbe = htobe64(msg->next_seq);
+    memcpy(b, &next_seq_nbe, sizeof(next_seq_nbe));
+    b += sizeof(next_seq_nbe);
+
+    // Write count
+    MSG_COUNT count_nbe = htonl(msg->count);
+    memcpy(b, &count_nbe, sizeof(count_nbe));
+    b += sizeof(count_nbe);
+
+    // Write more
+    memcpy(b, &msg->more, sizeof(msg->more)); // Don't need to convert more to Network Byte Order because it is one byte long
+
+    return 0;
+}
+
+int history_batch_message_serialize(struct history_batch_message *msg, char **buf, size_t *len)
+{
+    size_t size = history_batch_message_size(msg);
+    *buf = malloc(size);
+    if (*buf == NULL)
+    {
+        LOG_ERROR("failed to allocate space for buffer");
+        return -1;
+    }
+
+    if (history_batch_message_serialize_to(msg, *buf, size, len) != 0)
+    {
+        free(*buf);
+        return -1;
+    }
+
+    return 0;
+}
+
+void history_batch_message_deserialize(char *buf, struct history_batch_message *msg)
+{
+    struct history_batch_message_view view;
+    history_batch_message_parse(buf, history_batch_message_size(msg), &view);
+    msg->room_id = view.room_id;
+    msg->first_seq = view.first_seq;
+    msg->next_seq = view.next_seq;
+    msg->count = view.count;
+    msg->more = view.more;
+}
+
+int history_batch_message_parse(char *buf, size_t len, struct history_batch_message_view *view)
+{
+    char *end = buf + len;
+
+    // Skip over total message length and message type
+    buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
+
+    if (end - buf < (ptrdiff_t)(sizeof(ROOM_ID) + 2 * sizeof(MSG_SEQ) + sizeof(MSG_COUNT) + sizeof(view->more)))
+        return -1;
+
+    // Get room ID
+    memcpy(&view->room_id, buf, sizeof(view->room_id));
+    view->room_id = ntohl(view->room_id);
+    buf += sizeof(view->room_id);
+
+    // Get first and next sequence numbers
+    memcpy(&view->first_seq, buf, sizeof(view->first_seq));
+    view->first_seq = be64toh(view->first_seq);
+    buf += sizeof(view->first_seq);
+    memcpy(&view->next_seq, buf, sizeof(view->next_seq));
+    view->next_seq = be64toh(view->next_seq);
+    buf += sizeof(view->next_seq);
+
+    // Get count
+    memcpy(&view->count, buf, sizeof(view->count));
+    view->count = ntohl(view->count);
+    buf += sizeof(view->count);
+
+    // Get more
+    memcpy(&view->more, buf, sizeof(view->more));
+
+    return 0;
+}
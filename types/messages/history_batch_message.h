@@ -0,0 +1,113 @@
+#ifndef HISTORY_BATCH_MESSAGE_H
+#define HISTORY_BATCH_MESSAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "history_message.h"
+
+// A batch of the answer to a history message, followed on the connection by count chat messages of the room, exactly as
+// they were first sent and in the order of their sequence numbers, from first_seq. An answer is made of batches up to
+// the one with more set to 0, which may have no messages.
+struct history_batch_message
+{
+    ROOM_ID room_id;
+    MSG_SEQ first_seq; // Sequence number of the batch's first message, or the room's next one if it has none
+    MSG_SEQ next_seq;  // Sequence number after the batch's last message, which a later history message can start from
+    MSG_COUNT count;   // Number of chat messages following
+    uint8_t more;      // 1 if another batch of the answer follows, 0 if this is its last
+};
+
+// A received history batch message read in place
+struct history_batch_message_view
+{
+    ROOM_ID room_id;
+    MSG_SEQ first_seq;
+    MSG_SEQ next_seq;
+    MSG_COUNT count;
+    uint8_t more;
+};
+
+/**
+ * Gets the number of bytes a history batch message takes once serialized, so a buffer can be sized for it.
+ *
+ * @param msg   The message to measure
+ *
+ * @return  Length of the serialized message in bytes
+ */
+size_t history_batch_message_size(struct history_batch_message *msg);
+
+/**
+ * Serializes a history batch message into a caller-provided buffer, without allocating anything.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - first sequence number (8 bytes)
+ * - next sequence number (8 bytes)
+ * - count (4 bytes)
+ * - more (1 byte)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Pointer to the buffer which will store the serialized message
+ * @param size  Size of buf in bytes, at least history_batch_message_size(msg)
+ * @param len   Pointer to a size_t which will store the length of the serialized message
+ *
+ * @return  0 on success.
+ *          -1 if buf is too small.
+ */
+int history_batch_message_serialize_to(struct history_batch_message *msg, char *buf, size_t size, size_t *len);
+
+/**
+ * Serializes a history batch message so it can be sent to the client. The buffer should be freed when it is no longer
+ * needed.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - first sequence number (8 bytes)
+ * - next sequence number (8 bytes)
+ * - count (4 bytes)
+ * - more (1 byte)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Double pointer to a char buffer which will store the serialized message
+ * @param len   Pointer to a size_t which will store the size of the buffer
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int history_batch_message_serialize(struct history_batch_message *msg, char **buf, size_t *len);
+
+/**
+ * Reads a received history batch message in place, checking that every field lies within the message.
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param len   Length of the message in bytes
+ * @param view  Pointer to a view which will describe the message
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int history_batch_message_parse(char *buf, size_t len, struct history_batch_message_view *view);
+
+/**
+ * Deserializes a history batch message received from the server.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - first sequence number (8 bytes)
+ * - next sequence number (8 bytes)
+ * - count (4 bytes)
+ * - more (1 byte)
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param msg   Pointer to a message which will store the deserialized message
+ */
+void history_batch_message_deserialize(char *buf, struct history_batch_message *msg);
+
+#endif
@@ -0,0 +1,110 @@
+#include <arpa/inet.h>
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "message.h"
+#include "history_message.h"
+#include "../../lib/log.h"
+
+size_t history_message_size(struct history_message *msg)
+{
+    (void)msg; // History messages have a fixed length
+    return sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(ROOM_ID) + sizeof(MSG_SEQ) + sizeof(MSG_COUNT);
+}
+
+int history_message_serialize_to(struct history_message *msg, char *buf, size_t size, size_t *len)
+{
+    // Determine total message length
+    TOTAL_MSG_LEN total_len = history_message_size(msg);
+
+    if (total_len > size)
+    {
+        LOG_ERROR("buffer too small for message: %u > %zu bytes", total_len, size);
+        return -1;
+    }
+    *len = total_len;
+
+    char *b = buf; // Use b instead of buf since we're going to be adding to it
+
+    // Write total message length
+    TOTAL_MSG_LEN total_len_nbe = htonl(total_len);
+    memcpy(b, &total_len_nbe, sizeof(total_len_nbe));
+    b += sizeof(total_len_nbe);
+
+    // Write message type
+    MSG_TYPE msg_type = HISTORY_MESSAGE;
+    memcpy(b, &msg_type, sizeof(msg_type));
+    b += sizeof(msg_type);
+
+    // Write room ID
+    ROOM_ID room_id_nbe = htonl(msg->room_id);
+    memcpy(b, &room_id_nbe, sizeof(room_id_nbe));
+    b += sizeof(room_id_nbe);
+
+    // Write first sequence number
+    MSG_SEQ from_seq_nbe = htobe64(msg->from_seq);
+    memcpy(b, &from_seq_nbe, sizeof(from_seq_nbe));
+    b += sizeof(from_seq_nbe);
+
+    // Write count
+    MSG_COUNT count_nbe = htonl(msg->count);
+    memcpy(b, &count_nbe, sizeof(count_nbe));
+
+    return 0;
+}
+
+int history_message_serialize(struct history_message *msg, char **buf, size_t *len)
+{
+    size_t size = history_message_size(msg);
+    *buf = malloc(size);
+    if (*buf == NULL)
+    {
+        LOG_ERROR("failed to allocate space for buffer");
+        return -1;
+    }
+
+    if (history_message_serialize_to(msg, *buf, size, len) != 0)
+    {
+        free(*buf);
+        return -1;
+    }
+
+    return 0;
+}
+
+void history_message_deserialize(char *buf, struct history_message *msg)
+{
+    struct history_message_view view;
+    history_message_parse(buf, history_message_size(msg), &view);
+    msg->room_id = view.room_id;
+    msg->from_seq = view.from_seq;
+    msg->count = view.count;
+}
+
+int history_message_parse(char *buf, size_t len, struct history_message_view *view)
+{
+    char *end = buf + len;
+
+    // Skip over total message length and message type
+    buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
+
+    if (end - buf < (ptrdiff_t)(sizeof(ROOM_ID) + sizeof(MSG_SEQ) + sizeof(MSG_COUNT)))
+        return -1;
+
+    // Get room ID
+    memcpy(&view->room_id, buf, sizeof(view->room_id));
+    view->room_id = ntohl(view->room_id);
+    buf += sizeof(view->room_id);
+
+    // Get first sequence number
+    memcpy(&view->from_seq, buf, sizeof(view->from_seq));
+    view->from_seq = be64toh(view->from_seq);
+    buf += sizeof(view->from_seq);
+
+    // Get count
+    memcpy(&view->count, buf, sizeof(view->count));
+    view->count = ntohl(view->count);
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+#ifndef HISTORY_MESSAGE_H
+#define HISTORY_MESSAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "join_message.h"
+
+typedef uint64_t MSG_SEQ;   // Sequence number of a chat message in its room, starting at 1
+typedef uint32_t MSG_COUNT; // Number of chat messages
+
+// Asks for the chat messages of a room from a sequence number on
+struct history_message
+{
+    ROOM_ID room_id;
+    MSG_SEQ from_seq; // Sequence number of the first message wanted
+    MSG_COUNT count;  // Most messages wanted
+};
+
+// A received history message read in place
+struct history_message_view
+{
+    ROOM_ID room_id;
+    MSG_SEQ from_seq;
+    MSG_COUNT count;
+};
+
+/**
+ * Gets the number of bytes a history message takes once serialized, so a buffer can be sized for it.
+ *
+ * @param msg   The message to measure
+ *
+ * @return  Length of the serialized message in bytes
+ */
+size_t history_message_size(struct history_message *msg);
+
+/**
+ * Serializes a history message into a caller-provided buffer, without allocating anything.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - first sequence number (8 bytes)
+ * - count (4 bytes)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Pointer to the buffer which will store the serialized message
+ * @param size  Size of buf in bytes, at least history_message_size(msg)
+ * @param len   Pointer to a size_t which will store the length of the serialized message
+ *
+ * @return  0 on success.
+ *          -1 if buf is too small.
+ */
+int history_message_serialize_to(struct history_message *msg, char *buf, size_t size, size_t *len);
+
+/**
+ * Serializes a history message so it can be sent to the server. The buffer should be freed when it is no longer
+ * needed.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - first sequence number (8 bytes)
+ * - count (4 bytes)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Double pointer to a char buffer which will store the serialized message
+ * @param len   Pointer to a size_t which will store the size of the buffer
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int history_message_serialize(struct history_message *msg, char **buf, size_t *len);
+
+/**
+ * Reads a received history message in place, checking that every field lies within the message.
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param len   Length of the message in bytes
+ * @param view  Pointer to a view which will describe the message
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int history_message_parse(char *buf, size_t len, struct history_message_view *view);
+
+/**
+ * Deserializes a history message received from the client.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - first sequence number (8 bytes)
+ * - count (4 bytes)
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param msg   Pointer to a message which will store the deserialized message
+ */
+void history_message_deserialize(char *buf, struct history_message *msg);
+
+#endif
@@ -6,21 +6,25 @@
 #include "join_message.h"
 #include "../../lib/log.h"
 
-int join_message_serialize(struct join_message *msg, char **buf, size_t *len)
+size_t join_message_size(struct join_message *msg)
+{
+    (void)msg; // Join messages have a fixed length
+    return sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(ROOM_ID);
+}
+
+int join_message_serialize_to(struct join_message *msg, char *buf, size_t size, size_t *len)
 {
     // Determine total message length
     TOTAL_MSG_LEN total_len = sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(ROOM_ID);
-    *len = total_len;
 
-    // Allocate space for the buffer
-    *buf = malloc(total_len);
-    if (*buf == NULL)
+    if (total_len > size)
     {
-        LOG_ERROR("failed to allocate space for buffer");
+        LOG_ERROR("buffer too small for message: %u > %zu bytes", total_len, size);
         return -1;
     }
+    *len = total_len;
 
-    char *b = *buf; // Use b instead of *buf since we're going to be adding to it
+    char *b = buf; // Use b instead of buf since we're going to be adding to it
 
     // Write total message length
     TOTAL_MSG_LEN total_len_nbe = htonl(total_len);
@@ -33,7 +37,27 @@ int join_message_serialize(struct join_message *msg, char **buf, size_t *len)
     b += sizeof(msg_type);
 
     // Write room ID
-    memcpy(b, &msg->room_id, sizeof(msg->room_id)); // Don't need to convert room_id to Network Byte Order because it is one byte long
+    ROOM_ID room_id_nbe = htonl(msg->room_id);
+    memcpy(b, &room_id_nbe, sizeof(room_id_nbe));
+
+    return 0;
+}
+
+int join_message_serialize(struct join_message *msg, char **buf, size_t *len)
+{
+    size_t size = join_message_size(msg);
+    *buf = malloc(size);
+    if (*buf == NULL)
+    {
+        LOG_ERROR("failed to allocate space for buffer");
+        return -1;
+    }
+
+    if (join_message_serialize_to(msg, *buf, size, len) != 0)
+    {
+        free(*buf);
+        return -1;
+    }
 
     return 0;
 }
@@ -44,5 +68,22 @@ void join_message_deserialize(char *buf, struct join_message *msg)
     buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
 
     // Get room ID
-    memcpy(&msg->room_id, buf, sizeof(msg->room_id)); // Don't need to convert room_id to Host Byte Order because it is one byte long
+    memcpy(&msg->room_id, buf, sizeof(msg->room_id));
+    msg->room_id = ntohl(msg->room_id);
+}
+
+int join_message_parse(char *buf, size_t len, struct join_message_view *view)
+{
+    char *end = buf + len;
+
+    // Skip over total message length and message type
+    buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
+
+    // Get room ID
+    if (end - buf < (ptrdiff_t)sizeof(ROOM_ID))
+        return -1;
+    memcpy(&view->room_id, buf, sizeof(view->room_id));
+    view->room_id = ntohl(view->room_id);
+
+    return 0;
 }
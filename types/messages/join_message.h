@@ -4,13 +4,46 @@
 #include <stddef.h>
 #include <stdint.h>
 
-typedef uint8_t ROOM_ID;
+typedef uint32_t ROOM_ID;
 
 struct join_message
 {
     ROOM_ID room_id;
 };
 
+// A received join message read in place
+struct join_message_view
+{
+    ROOM_ID room_id;
+};
+
+/**
+ * Gets the number of bytes a join message takes once serialized, so a buffer can be sized for it.
+ *
+ * @param msg   The message to measure
+ *
+ * @return  Length of the serialized message in bytes
+ */
+size_t join_message_size(struct join_message *msg);
+
+/**
+ * Serializes a join message into a caller-provided buffer, without allocating anything.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Pointer to the buffer which will store the serialized message
+ * @param size  Size of buf in bytes, at least join_message_size(msg)
+ * @param len   Pointer to a size_t which will store the length of the serialized message
+ *
+ * @return  0 on success.
+ *          -1 if buf is too small.
+ */
+int join_message_serialize_to(struct join_message *msg, char *buf, size_t size, size_t *len);
+
 /**
  * Serializes a join message so it can be sent to the client/server. The buffer should be freed when it is no longer
  * needed.
@@ -18,7 +51,7 @@ struct join_message
  * Message structure:
  * - message length (4 bytes)
  * - message type (1 byte)
- * - room ID (1 byte)
+ * - room ID (4 bytes)
  *
  * @param msg   The message to serialize
  * @param buf   Double pointer to a char buffer which will store the serialized message
@@ -29,13 +62,26 @@ struct join_message
  */
 int join_message_serialize(struct join_message *msg, char **buf, size_t *len);
 
+/**
+ * Reads a received join message in place, checking that every field lies within the message. The view stays valid
+ * as long as buf does.
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param len   Length of the message in bytes
+ * @param view  Pointer to a view which will describe the message
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int join_message_parse(char *buf, size_t len, struct join_message_view *view);
+
 /**
  * Deserializes a join message received from the client/server.
  *
  * Message structure:
  * - message length (4 bytes)
  * - message type (1 byte)
- * - room ID (1 byte)
+ * - room ID (4 bytes)
  *
  * @param buf   Pointer to a char buffer which contains the message
  * @param msg   Pointer to a message which will store the deserialized message
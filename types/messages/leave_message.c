@@ -0,0 +1,89 @@
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "message.h"
+#include "leave_message.h"
+#include "../../lib/log.h"
+
+size_t leave_message_size(struct leave_message *msg)
+{
+    (void)msg; // Leave messages have a fixed length
+    return sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(ROOM_ID);
+}
+
+int leave_message_serialize_to(struct leave_message *msg, char *buf, size_t size, size_t *len)
+{
+    // Determine total message length
+    TOTAL_MSG_LEN total_len = sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(ROOM_ID);
+
+    if (total_len > size)
+    {
+        LOG_ERROR("buffer too small for message: %u > %zu bytes", total_len, size);
+        return -1;
+    }
+    *len = total_len;
+
+    char *b = buf; // Use b instead of buf since we're going to be adding to it
+
+    // Write total message length
+    TOTAL_MSG_LEN total_len_nbe = htonl(total_len);
+    memcpy(b, &total_len_nbe, sizeof(total_len_nbe));
+    b += sizeof(total_len_nbe);
+
+    // Write message type
+    MSG_TYPE msg_type = LEAVE_MESSAGE;
+    memcpy(b, &msg_type, sizeof(msg_type));
+    b += sizeof(msg_type);
+
+    // Write room ID
+    ROOM_ID room_id_nbe = htonl(msg->room_id);
+    memcpy(b, &room_id_nbe, sizeof(room_id_nbe));
+
+    return 0;
+}
+
+int leave_message_serialize(struct leave_message *msg, char **buf, size_t *len)
+{
+    size_t size = leave_message_size(msg);
+    *buf = malloc(size);
+    if (*buf == NULL)
+    {
+        LOG_ERROR("failed to allocate space for buffer");
+        return -1;
+    }
+
+    if (leave_message_serialize_to(msg, *buf, size, len) != 0)
+    {
+        free(*buf);
+        return -1;
+    }
+
+    return 0;
+}
+
+void leave_message_deserialize(char *buf, struct leave_message *msg)
+{
+    // Skip over total message length and message type
+    buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
+
+    // Get room ID
+    memcpy(&msg->room_id, buf, sizeof(msg->room_id));
+    msg->room_id = ntohl(msg->room_id);
+}
+
+int leave_message_parse(char *buf, size_t len, struct leave_message_view *view)
+{
+    char *end = buf + len;
+
+    // Skip over total message length and message type
+    buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
+
+    // Get room ID
+    if (end - buf < (ptrdiff_t)sizeof(ROOM_ID))
+        return -1;
+    memcpy(&view->room_id, buf, sizeof(view->room_id));
+    view->room_id = ntohl(view->room_id);
+
+    return 0;
+}
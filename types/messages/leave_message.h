@@ -0,0 +1,91 @@
+#ifndef LEAVE_MESSAGE_H
+#define LEAVE_MESSAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "join_message.h"
+
+struct leave_message
+{
+    ROOM_ID room_id;
+};
+
+// A received leave message read in place
+struct leave_message_view
+{
+    ROOM_ID room_id;
+};
+
+/**
+ * Gets the number of bytes a leave message takes once serialized, so a buffer can be sized for it.
+ *
+ * @param msg   The message to measure
+ *
+ * @return  Length of the serialized message in bytes
+ */
+size_t leave_message_size(struct leave_message *msg);
+
+/**
+ * Serializes a leave message into a caller-provided buffer, without allocating anything.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Pointer to the buffer which will store the serialized message
+ * @param size  Size of buf in bytes, at least leave_message_size(msg)
+ * @param len   Pointer to a size_t which will store the length of the serialized message
+ *
+ * @return  0 on success.
+ *          -1 if buf is too small.
+ */
+int leave_message_serialize_to(struct leave_message *msg, char *buf, size_t size, size_t *len);
+
+/**
+ * Serializes a leave message so it can be sent to the client/server. The buffer should be freed when it is no longer
+ * needed.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Double pointer to a char buffer which will store the serialized message
+ * @param len   Pointer to a size_t which will store the size of the buffer
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int leave_message_serialize(struct leave_message *msg, char **buf, size_t *len);
+
+/**
+ * Reads a received leave message in place, checking that every field lies within the message. The view stays valid
+ * as long as buf does.
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param len   Length of the message in bytes
+ * @param view  Pointer to a view which will describe the message
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int leave_message_parse(char *buf, size_t len, struct leave_message_view *view);
+
+/**
+ * Deserializes a leave message received from the client/server.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param msg   Pointer to a message which will store the deserialized message
+ */
+void leave_message_deserialize(char *buf, struct leave_message *msg);
+
+#endif
@@ -14,7 +14,21 @@ enum MessageType get_message_type(char *buf)
         return JOIN_MESSAGE;
     case REPLY_MESSAGE:
         return REPLY_MESSAGE;
+    case LEAVE_MESSAGE:
+        return LEAVE_MESSAGE;
+    case HISTORY_MESSAGE:
+        return HISTORY_MESSAGE;
+    case HISTORY_BATCH_MESSAGE:
+        return HISTORY_BATCH_MESSAGE;
+    case SEARCH_MESSAGE:
+        return SEARCH_MESSAGE;
+    case SEARCH_RESULT_MESSAGE:
+        return SEARCH_RESULT_MESSAGE;
     default:
         return INVALID_MESSAGE;
     }
-}
\ No newline at end of file
+}
+bool message_string_valid(const char *str, const char *end, size_t len, size_t limit)
+{
+    return len >= 1 && len <= limit && (size_t)(end - str) >= len && str[len - 1] == '\0';
+}
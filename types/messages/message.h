@@ -1,11 +1,16 @@
 #ifndef MESSAGE_H
 #define MESSAGE_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef uint32_t TOTAL_MSG_LEN;
 typedef uint8_t MSG_TYPE;
 
+#define MSG_HEADER_SIZE (sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE)) // Size of the fields every message starts with
+#define MSG_SIZE_LIMIT 2048                                         // Upper bound on the total length of any message
+
 enum MessageType
 {
     CHAT_MESSAGE,
@@ -13,6 +18,11 @@ enum MessageType
     INVALID_MESSAGE,
     JOIN_MESSAGE,
     REPLY_MESSAGE,
+    LEAVE_MESSAGE,
+    HISTORY_MESSAGE,
+    HISTORY_BATCH_MESSAGE,
+    SEARCH_MESSAGE,
+    SEARCH_RESULT_MESSAGE,
 };
 
 /**
@@ -26,4 +36,18 @@ enum MessageType
  */
 enum MessageType get_message_type(char *buf);
 
+/**
+ * Checks that a string field of a received message lies within the message, fits in limit bytes and ends with a null
+ * character, so it can be read in place.
+ *
+ * @param str   Pointer to the start of the field
+ * @param end   Pointer past the end of the message
+ * @param len   Length of the field according to the message, including the null character
+ * @param limit Maximum length of the field, including the null character
+ *
+ * @return  true if the field is valid.
+ *          false if not.
+ */
+bool message_string_valid(const char *str, const char *end, size_t len, size_t limit);
+
 #endif
@@ -6,22 +6,26 @@
 #include "name_message.h"
 #include "../../lib/log.h"
 
-int name_message_serialize(struct name_message *msg, char **buf, size_t *len)
+size_t name_message_size(struct name_message *msg)
+{
+    NAME_LEN name_len = strlen(msg->name) + 1; // +1 for null character
+    return sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(NAME_LEN) + name_len;
+}
+
+int name_message_serialize_to(struct name_message *msg, char *buf, size_t size, size_t *len)
 {
     // Determine total message length
     NAME_LEN name_len = strlen(msg->name) + 1; // +1 for null character
     TOTAL_MSG_LEN total_len = sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(NAME_LEN) + name_len;
-    *len = total_len;
 
-    // Allocate space for the buffer
-    *buf = malloc(total_len);
-    if (*buf == NULL)
+    if (total_len > size)
     {
-        LOG_ERROR("failed to allocate space for buffer");
+        LOG_ERROR("buffer too small for message: %u > %zu bytes", total_len, size);
         return -1;
     }
+    *len = total_len;
 
-    char *b = *buf; // Use b instead of *buf since we're going to be adding to it
+    char *b = buf; // Use b instead of buf since we're going to be adding to it
 
     // Write total message length
     TOTAL_MSG_LEN total_len_nbe = htonl(total_len);
@@ -43,6 +47,25 @@ int name_message_serialize(struct name_message *msg, char **buf, size_t *len)
     return 0;
 }
 
+int name_message_serialize(struct name_message *msg, char **buf, size_t *len)
+{
+    size_t size = name_message_size(msg);
+    *buf = malloc(size);
+    if (*buf == NULL)
+    {
+        LOG_ERROR("failed to allocate space for buffer");
+        return -1;
+    }
+
+    if (name_message_serialize_to(msg, *buf, size, len) != 0)
+    {
+        free(*buf);
+        return -1;
+    }
+
+    return 0;
+}
+
 void name_message_deserialize(char *buf, struct name_message *msg)
 {
     // Skip over total message length and message type
@@ -55,3 +78,22 @@ void name_message_deserialize(char *buf, struct name_message *msg)
     // Get name
     memcpy(msg->name, buf, name_len);
 }
+
+int name_message_parse(char *buf, size_t len, struct name_message_view *view)
+{
+    char *end = buf + len;
+
+    // Skip over total message length and message type
+    buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
+
+    // Get name
+    if (end - buf < (ptrdiff_t)sizeof(NAME_LEN))
+        return -1;
+    view->name_len = *(NAME_LEN *)buf; // Don't need to convert name_len to Host Byte Order because it is one byte long
+    buf += sizeof(NAME_LEN);
+    view->name = buf;
+    if (!message_string_valid(buf, end, view->name_len, NAME_SIZE_LIMIT))
+        return -1;
+
+    return 0;
+}
@@ -13,6 +13,41 @@ struct name_message
     char name[NAME_SIZE_LIMIT];
 };
 
+// A received name message read in place: the name points into the buffer holding the message
+struct name_message_view
+{
+    const char *name;
+    NAME_LEN name_len; // Length of name including its null character
+};
+
+/**
+ * Gets the number of bytes a name message takes once serialized, so a buffer can be sized for it.
+ *
+ * @param msg   The message to measure
+ *
+ * @return  Length of the serialized message in bytes
+ */
+size_t name_message_size(struct name_message *msg);
+
+/**
+ * Serializes a name message into a caller-provided buffer, without allocating anything.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - name length (1 byte)
+ * - name (max 50 bytes)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Pointer to the buffer which will store the serialized message
+ * @param size  Size of buf in bytes, at least name_message_size(msg)
+ * @param len   Pointer to a size_t which will store the length of the serialized message
+ *
+ * @return  0 on success.
+ *          -1 if buf is too small.
+ */
+int name_message_serialize_to(struct name_message *msg, char *buf, size_t size, size_t *len);
+
 /**
  * Serializes a name message so it can be sent to the client/server. The buffer should be freed when it is no longer
  * needed.
@@ -32,6 +67,19 @@ struct name_message
  */
 int name_message_serialize(struct name_message *msg, char **buf, size_t *len);
 
+/**
+ * Reads a received name message in place, checking that every field lies within the message and that the name is null-terminated and within its limit. The view stays valid
+ * as long as buf does.
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param len   Length of the message in bytes
+ * @param view  Pointer to a view which will describe the message
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int name_message_parse(char *buf, size_t len, struct name_message_view *view);
+
 /**
  * Deserializes a name message received from the client/server.
  *
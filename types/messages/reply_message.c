@@ -6,22 +6,26 @@
 #include "reply_message.h"
 #include "../../lib/log.h"
 
-int reply_message_serialize(struct reply_message *msg, char **buf, size_t *len)
+size_t reply_message_size(struct reply_message *msg)
+{
+    REPLY_LEN reply_len = strlen(msg->reply) + 1; // +1 for null character
+    return sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(REPLY_LEN) + reply_len;
+}
+
+int reply_message_serialize_to(struct reply_message *msg, char *buf, size_t size, size_t *len)
 {
     // Determine total message length
     REPLY_LEN reply_len = strlen(msg->reply) + 1; // +1 for null character
     TOTAL_MSG_LEN total_len = sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(REPLY_LEN) + reply_len;
-    *len = total_len;
 
-    // Allocate space for the buffer
-    *buf = malloc(total_len);
-    if (*buf == NULL)
+    if (total_len > size)
     {
-        LOG_ERROR("failed to allocate space for buffer");
+        LOG_ERROR("buffer too small for message: %u > %zu bytes", total_len, size);
         return -1;
     }
+    *len = total_len;
 
-    char *b = *buf; // Use b instead of *buf since we're going to be adding to it
+    char *b = buf; // Use b instead of buf since we're going to be adding to it
 
     // Write total message length
     TOTAL_MSG_LEN total_len_nbe = htonl(total_len);
@@ -43,6 +47,25 @@ int reply_message_serialize(struct reply_message *msg, char **buf, size_t *len)
     return 0;
 }
 
+int reply_message_serialize(struct reply_message *msg, char **buf, size_t *len)
+{
+    size_t size = reply_message_size(msg);
+    *buf = malloc(size);
+    if (*buf == NULL)
+    {
+        LOG_ERROR("failed to allocate space for buffer");
+        return -1;
+    }
+
+    if (reply_message_serialize_to(msg, *buf, size, len) != 0)
+    {
+        free(*buf);
+        return -1;
+    }
+
+    return 0;
+}
+
 void reply_message_deserialize(char *buf, struct reply_message *msg)
 {
     // Skip over total message length and message type
@@ -55,3 +78,22 @@ void reply_message_deserialize(char *buf, struct reply_message *msg)
     // Get reply
     memcpy(msg->reply, buf, reply_len);
 }
+
+int reply_message_parse(char *buf, size_t len, struct reply_message_view *view)
+{
+    char *end = buf + len;
+
+    // Skip over total message length and message type
+    buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
+
+    // Get reply
+    if (end - buf < (ptrdiff_t)sizeof(REPLY_LEN))
+        return -1;
+    view->reply_len = *(REPLY_LEN *)buf; // Don't need to convert reply_len to Host Byte Order because it is one byte long
+    buf += sizeof(REPLY_LEN);
+    view->reply = buf;
+    if (!message_string_valid(buf, end, view->reply_len, REPLY_SIZE_LIMIT))
+        return -1;
+
+    return 0;
+}
@@ -13,6 +13,41 @@ struct reply_message
     char reply[REPLY_SIZE_LIMIT];
 };
 
+// A received reply message read in place: the reply points into the buffer holding the message
+struct reply_message_view
+{
+    const char *reply;
+    REPLY_LEN reply_len; // Length of reply including its null character
+};
+
+/**
+ * Gets the number of bytes a reply message takes once serialized, so a buffer can be sized for it.
+ *
+ * @param msg   The message to measure
+ *
+ * @return  Length of the serialized message in bytes
+ */
+size_t reply_message_size(struct reply_message *msg);
+
+/**
+ * Serializes a reply message into a caller-provided buffer, without allocating anything.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - reply length (1 byte)
+ * - reply (max 100 bytes)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Pointer to the buffer which will store the serialized message
+ * @param size  Size of buf in bytes, at least reply_message_size(msg)
+ * @param len   Pointer to a size_t which will store the length of the serialized message
+ *
+ * @return  0 on success.
+ *          -1 if buf is too small.
+ */
+int reply_message_serialize_to(struct reply_message *msg, char *buf, size_t size, size_t *len);
+
 /**
  * Serializes a reply message so it can be sent to the client. The buffer should be freed when it is no longer needed.
  *
@@ -31,6 +66,19 @@ struct reply_message
  */
 int reply_message_serialize(struct reply_message *msg, char **buf, size_t *len);
 
+/**
+ * Reads a received reply message in place, checking that every field lies within the message and that the reply is null-terminated and within its limit. The view stays valid
+ * as long as buf does.
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param len   Length of the message in bytes
+ * @param view  Pointer to a view which will describe the message
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int reply_message_parse(char *buf, size_t len, struct reply_message_view *view);
+
 /**
  * Deserializes a reply message received from the client/server.
  *
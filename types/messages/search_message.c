@@ -0,0 +1,136 @@
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "message.h"
+#include "search_message.h"
+#include "../../lib/log.h"
+
+size_t search_message_size(struct search_message *msg)
+{
+    TEXT_LEN query_len = strlen(msg->query) + 1; // +1 for null character
+    return sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(ROOM_ID) + sizeof(MSG_COUNT) + sizeof(TEXT_LEN) +
+           query_len;
+}
+
+int search_message_serialize_to(struct search_message *msg, char *buf, size_t size, size_t *len)
+{
+    // Determine total message length
+    TEXT_LEN query_len = strlen(msg->query) + 1; // +1 for null character
+    TOTAL_MSG_LEN total_len = search_message_size(msg);
+
+    if (total_len > size)
+    {
+        LOG_ERROR("buffer too small for message: %u > %zu bytes", total_len, size);
+        return -1;
+    }
+    *len = total_len;
+
+    char *b = buf; // Use b instead of buf since we're going to be adding to it
+
+    // Write total message length
+    TOTAL_MSG_LEN total_len_nbe = htonl(total_len);
+    memcpy(b, &total_len_nbe, sizeof(total_len_nbe));
+    b += sizeof(total_len_nbe);
+
+    // Write message type
+    MSG_TYPE msg_type = SEARCH_MESSAGE;
+    memcpy(b, &msg_type, sizeof(msg_type));
+    b += sizeof(msg_type);
+
+    // Write room ID
+    ROOM_ID room_id_nbe = htonl(msg->room_id);
+    memcpy(b, &room_id_nbe, sizeof(room_id_nbe));
+    b += sizeof(room_id_nbe);
+
+    // Write count
+    MSG_COUNT count_nbe = htonl(msg->count);
+    memcpy(b, &count_nbe, sizeof(count_nbe));
+    b += sizeof(count_nbe);
+
+    // Write query length
+    TEXT_LEN query_len_nbe = htons(query_len);
+    memcpy(b, &query_len_nbe, sizeof(query_len_nbe));
+    b += sizeof(query_len_nbe);
+
+    // Write query
+    memcpy(b, msg->query, query_len);
+
+    return 0;
+}
+
+int search_message_serialize(struct search_message *msg, char **buf, size_t *len)
+{
+    size_t size = search_message_size(msg);
+    *buf = malloc(size);
+    if (*buf == NULL)
+    {
+        LOG_ERROR("failed to allocate space for buffer");
+        return -1;
+    }
+
+    if (search_message_serialize_to(msg, *buf, size, len) != 0)
+    {
+        free(*buf);
+        return -1;
+    }
+
+    return 0;
+}
+
+void search_message_deserialize(char *buf, struct search_message *msg)
+{
+    // Skip over total message length and message type
+    buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
+
+    // Get room ID
+    memcpy(&msg->room_id, buf, sizeof(msg->room_id));
+    msg->room_id = ntohl(msg->room_id);
+    buf += sizeof(msg->room_id);
+
+    // Get count
+    memcpy(&msg->count, buf, sizeof(msg->count));
+    msg->count = ntohl(msg->count);
+    buf += sizeof(msg->count);
+
+    // Get query length
+    TEXT_LEN query_len;
+    memcpy(&query_len, buf, sizeof(query_len));
+    query_len = ntohs(query_len);
+    buf += sizeof(query_len);
+
+    // Get query
+    memcpy(msg->query, buf, query_len);
+}
+
+int search_message_parse(char *buf, size_t len, struct search_message_view *view)
+{
+    char *end = buf + len;
+
+    // Skip over total message length and message type
+    buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
+
+    if (end - buf < (ptrdiff_t)(sizeof(ROOM_ID) + sizeof(MSG_COUNT) + sizeof(TEXT_LEN)))
+        return -1;
+
+    // Get room ID
+    memcpy(&view->room_id, buf, sizeof(view->room_id));
+    view->room_id = ntohl(view->room_id);
+    buf += sizeof(view->room_id);
+
+    // Get count
+    memcpy(&view->count, buf, sizeof(view->count));
+    view->count = ntohl(view->count);
+    buf += sizeof(view->count);
+
+    // Get query
+    TEXT_LEN query_len;
+    memcpy(&query_len, buf, sizeof(query_len));
+    view->query_len = ntohs(query_len);
+    buf += sizeof(query_len);
+    view->query = buf;
+    if (!message_string_valid(buf, end, view->query_len, QUERY_SIZE_LIMIT))
+        return -1;
+
+    return 0;
+}
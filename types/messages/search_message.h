@@ -0,0 +1,110 @@
+#ifndef SEARCH_MESSAGE_H
+#define SEARCH_MESSAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chat_message.h"
+#include "history_message.h"
+
+#define QUERY_SIZE_LIMIT 200
+
+// Asks for the newest chat messages of a room matching a query: messages holding every word of the query, and the
+// words of each phrase in double quotes one after the other
+struct search_message
+{
+    ROOM_ID room_id;
+    MSG_COUNT count; // Most messages wanted
+    char query[QUERY_SIZE_LIMIT];
+};
+
+// A received search message read in place: the query points into the buffer holding the message
+struct search_message_view
+{
+    ROOM_ID room_id;
+    MSG_COUNT count;
+    const char *query;
+    TEXT_LEN query_len; // Length of query including its null character
+};
+
+/**
+ * Gets the number of bytes a search message takes once serialized, so a buffer can be sized for it.
+ *
+ * @param msg   The message to measure
+ *
+ * @return  Length of the serialized message in bytes
+ */
+size_t search_message_size(struct search_message *msg);
+
+/**
+ * Serializes a search message into a caller-provided buffer, without allocating anything.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - count (4 bytes)
+ * - query length (2 bytes)
+ * - query (max 200 bytes)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Pointer to the buffer which will store the serialized message
+ * @param size  Size of buf in bytes, at least search_message_size(msg)
+ * @param len   Pointer to a size_t which will store the length of the serialized message
+ *
+ * @return  0 on success.
+ *          -1 if buf is too small.
+ */
+int search_message_serialize_to(struct search_message *msg, char *buf, size_t size, size_t *len);
+
+/**
+ * Serializes a search message so it can be sent to the server. The buffer should be freed when it is no longer
+ * needed.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - count (4 bytes)
+ * - query length (2 bytes)
+ * - query (max 200 bytes)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Double pointer to a char buffer which will store the serialized message
+ * @param len   Pointer to a size_t which will store the size of the buffer
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int search_message_serialize(struct search_message *msg, char **buf, size_t *len);
+
+/**
+ * Reads a received search message in place, checking that every field lies within the message and that the query is
+ * a null-terminated string within QUERY_SIZE_LIMIT.
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param len   Length of the message in bytes
+ * @param view  Pointer to a view which will describe the message
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int search_message_parse(char *buf, size_t len, struct search_message_view *view);
+
+/**
+ * Deserializes a search message received from the client.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - count (4 bytes)
+ * - query length (2 bytes)
+ * - query (max 200 bytes)
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param msg   Pointer to a message which will store the deserialized message
+ */
+void search_message_deserialize(char *buf, struct search_message *msg);
+
+#endif
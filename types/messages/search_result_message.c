@@ -0,0 +1,141 @@
+#include <arpa/inet.h>
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "message.h"
+#include "search_result_message.h"
+#include "../../lib/log.h"
+
+size_t search_result_message_size(struct search_result_message *msg)
+{
+    return sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE) + sizeof(ROOM_ID) + sizeof(msg->more) + sizeof(MSG_COUNT) +
+           msg->count * sizeof(MSG_SEQ);
+}
+
+int search_result_message_serialize_to(struct search_result_message *msg, char *buf, size_t size, size_t *len)
+{
+    if (msg->count > SEARCH_RESULTS_LIMIT)
+    {
+        LOG_ERROR("too many search results: %u > %d", msg->count, SEARCH_RESULTS_LIMIT);
+        return -1;
+    }
+
+    // Determine total message length
+    TOTAL_MSG_LEN total_len = search_result_message_size(msg);
+
+    if (total_len > size)
+    {
+        LOG_ERROR("buffer too small for message: %u > %zu bytes", total_len, size);
+        return -1;
+    }
+    *len = total_len;
+
+    char *b = buf; // Use b instead of buf since we're going to be adding to it
+
+    // Write total message length
+    TOTAL_MSG_LEN total_len_nbe = htonl(total_len);
+    memcpy(b, &total_len_nbe, sizeof(total_len_nbe));
+    b += sizeof(total_len_nbe);
+
+    // Write message type
+    MSG_TYPE msg_type = SEARCH_RESULT_MESSAGE;
+    memcpy(b, &msg_type, sizeof(msg_type));
+    b += sizeof(msg_type);
+
+    // Write room ID
+    ROOM_ID room_id_nbe = htonl(msg->room_id);
+    memcpy(b, &room_id_nbe, sizeof(room_id_nbe));
+    b += sizeof(room_id_nbe);
+
+    // Write more
+    memcpy(b, &msg->more, sizeof(msg->more)); // Don't need to convert more to Network Byte Order because it is one byte long
+    b += sizeof(msg->more);
+
+    // Write count
+    MSG_COUNT count_nbe = htonl(msg->count);
+    memcpy(b, &count_nbe, sizeof(count_nbe));
+    b += sizeof(count_nbe);
+
+    // Write sequence numbers
+    for (MSG_COUNT i = 0; i < msg->count; i++)
+    {
+        MSG_SEQ seq_nbe = htobe64(msg->seqs[i]);
+        memcpy(b, &seq_nbe, sizeof(seq_nbe));
+        b += sizeof(seq_nbe);
+    }
+
+    return 0;
+}
+
+int search_result_message_serialize(struct search_result_message *msg, char **buf, size_t *len)
+{
+    size_t size = search_result_message_size(msg);
+    *buf = malloc(size);
+    if (*buf == NULL)
+    {
+        LOG_ERROR("failed to allocate space for buffer");
+        return -1;
+    }
+
+    if (search_result_message_serialize_to(msg, *buf, size, len) != 0)
+    {
+        free(*buf);
+        return -1;
+    }
+
+    return 0;
+}
+
+void search_result_message_deserialize(char *buf, struct search_result_message *msg)
+{
+    TOTAL_MSG_LEN total_len;
+    memcpy(&total_len, buf, sizeof(total_len));
+
+    struct search_result_message_view view;
+    if (search_result_message_parse(buf, ntohl(total_len), &view) != 0)
+    {
+        msg->count = 0;
+        return;
+    }
+    msg->room_id = view.room_id;
+    msg->more = view.more;
+    msg->count = view.count;
+    for (MSG_COUNT i = 0; i < view.count; i++)
+    {
+        memcpy(&msg->seqs[i], view.seqs + i * sizeof(MSG_SEQ), sizeof(MSG_SEQ));
+        msg->seqs[i] = be64toh(msg->seqs[i]);
+    }
+}
+
+int search_result_message_parse(char *buf, size_t len, struct search_result_message_view *view)
+{
+    char *end = buf + len;
+
+    // Skip over total message length and message type
+    buf += sizeof(TOTAL_MSG_LEN) + sizeof(MSG_TYPE);
+
+    if (end - buf < (ptrdiff_t)(sizeof(ROOM_ID) + sizeof(view->more) + sizeof(MSG_COUNT)))
+        return -1;
+
+    // Get room ID
+    memcpy(&view->room_id, buf, sizeof(view->room_id));
+    view->room_id = ntohl(view->room_id);
+    buf += sizeof(view->room_id);
+
+    // Get more
+    memcpy(&view->more, buf, sizeof(view->more));
+    buf += sizeof(view->more);
+
+    // Get count
+    memcpy(&view->count, buf, sizeof(view->count));
+    view->count = ntohl(view->count);
+    buf += sizeof(view->count);
+
+    // Get sequence numbers
+    if (view->count > SEARCH_RESULTS_LIMIT || (size_t)(end - buf) < view->count * sizeof(MSG_SEQ))
+        return -1;
+    view->seqs = buf;
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+#ifndef SEARCH_RESULT_MESSAGE_H
+#define SEARCH_RESULT_MESSAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "history_message.h"
+
+#define SEARCH_RESULTS_LIMIT 100 // Most messages a search result names
+
+// The answer to a search message: the sequence numbers of the newest messages of the room matching the query, newest
+// first, which history messages can fetch while the room keeps them
+struct search_result_message
+{
+    ROOM_ID room_id;
+    uint8_t more;    // 1 if older messages match, or may match, as well, 0 if these are all
+    MSG_COUNT count; // Number of messages found
+    MSG_SEQ seqs[SEARCH_RESULTS_LIMIT];
+};
+
+// A received search result message read in place: the sequence numbers point into the buffer holding the message
+struct search_result_message_view
+{
+    ROOM_ID room_id;
+    uint8_t more;
+    MSG_COUNT count;
+    const char *seqs; // count sequence numbers of 8 bytes each, in Network Byte Order
+};
+
+/**
+ * Gets the number of bytes a search result message takes once serialized, so a buffer can be sized for it.
+ *
+ * @param msg   The message to measure
+ *
+ * @return  Length of the serialized message in bytes
+ */
+size_t search_result_message_size(struct search_result_message *msg);
+
+/**
+ * Serializes a search result message into a caller-provided buffer, without allocating anything.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - more (1 byte)
+ * - count (4 bytes)
+ * - sequence numbers (8 bytes each, max 100)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Pointer to the buffer which will store the serialized message
+ * @param size  Size of buf in bytes, at least search_result_message_size(msg)
+ * @param len   Pointer to a size_t which will store the length of the serialized message
+ *
+ * @return  0 on success.
+ *          -1 if buf is too small.
+ */
+int search_result_message_serialize_to(struct search_result_message *msg, char *buf, size_t size, size_t *len);
+
+/**
+ * Serializes a search result message so it can be sent to the client. The buffer should be freed when it is no longer
+ * needed.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - more (1 byte)
+ * - count (4 bytes)
+ * - sequence numbers (8 bytes each, max 100)
+ *
+ * @param msg   The message to serialize
+ * @param buf   Double pointer to a char buffer which will store the serialized message
+ * @param len   Pointer to a size_t which will store the size of the buffer
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int search_result_message_serialize(struct search_result_message *msg, char **buf, size_t *len);
+
+/**
+ * Reads a received search result message in place, checking that every field lies within the message.
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param len   Length of the message in bytes
+ * @param view  Pointer to a view which will describe the message
+ *
+ * @return  0 on success.
+ *          -1 if the message is malformed.
+ */
+int search_result_message_parse(char *buf, size_t len, struct search_result_message_view *view);
+
+/**
+ * Deserializes a search result message received from the server.
+ *
+ * Message structure:
+ * - message length (4 bytes)
+ * - message type (1 byte)
+ * - room ID (4 bytes)
+ * - more (1 byte)
+ * - count (4 bytes)
+ * - sequence numbers (8 bytes each, max 100)
+ *
+ * @param buf   Pointer to a char buffer which contains the message
+ * @param msg   Pointer to a message which will store the deserialized message
+ */
+void search_result_message_deserialize(char *buf, struct search_result_message *msg);
+
+#endif
@@ -1,45 +1,146 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "room.h"
+#include "../data_structures/buffer_pool.h"
 #include "../lib/log.h"
 
+/**
+ * Moves the elements of an array to one at least twice as large from the buffer pool, using all of the size class it
+ * lands in, and releases the old array.
+ *
+ * @param array     Pointer to the array, NULL if it has never been allocated
+ * @param len       Number of elements in the array
+ * @param cap       Pointer to the number of elements the array has space for, updated on success
+ * @param elem_size Size of an element in bytes
+ * @param min_cap   Number of elements the first array holds
+ *
+ * @return  Pointer to the new array on success.
+ *          NULL on error (the old array is left as it was).
+ */
+static void *grow(void *array, uint32_t len, uint32_t *cap, size_t elem_size, uint32_t min_cap)
+{
+    size_t size = buffer_pool_size((*cap == 0 ? min_cap : 2 * (size_t)*cap) * elem_size);
+    void *grown = buffer_pool_alloc(size);
+    if (grown == NULL)
+        return NULL;
+
+    if (len > 0)
+        memcpy(grown, array, len * elem_size);
+    if (array != NULL)
+        buffer_pool_release(array, *cap * elem_size);
+    *cap = size / elem_size;
+
+    return grown;
+}
+
+void room_init(struct room *room, ROOM_ID id)
+{
+    room->id = id;
+    room->members = NULL;
+    room->num_users = 0;
+    room->cap = 0;
+    room->entry = NULL;
+}
+
+void room_free(struct room *room)
+{
+    if (room->members != NULL)
+        buffer_pool_release(room->members, room->cap * sizeof(struct room_member));
+    room->members = NULL;
+    room->cap = 0;
+}
+
 int room_add_user(struct room *room, struct user *user)
 {
-    if (room->num_users == MAX_USERS_PER_ROOM)
+    if (room->num_users == room->cap)
     {
-        LOG_ERROR("room %d is full", room->id);
-        return -1;
+        struct room_member *members = grow(room->members, room->num_users, &room->cap, sizeof(struct room_member),
+                                           ROOM_MIN_CAPACITY);
+        if (members == NULL)
+        {
+            LOG_ERROR("failed to allocate space for the members of room %u", room->id);
+            return -1;
+        }
+        room->members = members;
     }
 
-    room->users[room->num_users] = user->id;
+    if (user->num_subs == user->subs_cap)
+    {
+        struct subscription *subs = grow(user->subs, user->num_subs, &user->subs_cap, sizeof(struct subscription), 1);
+        if (subs == NULL)
+        {
+            LOG_ERROR("failed to allocate space for the subscriptions of user %d", user->id);
+            return -1;
+        }
+        user->subs = subs;
+    }
+
+    room->members[room->num_users] = (struct room_member){user->handle, user->num_subs, 0};
+    user->subs[user->num_subs] = (struct subscription){room, room->num_users};
     room->num_users++;
-    user->room = room->id;
+    user->num_subs++;
 
-    LOG_INFO("added user %d to room %d", user->id, room->id);
+    LOG_INFO("added user %d to room %u", user->id, room->id);
 
     return 0;
 }
 
-int room_remove_user(struct room *room, struct user *user)
+/**
+ * Removes a member from a room by moving the room's last member into its place. Members at the end of the room whose
+ * handle is stale are dropped along the way, so the place is taken by a live member or the room shrinks past it.
+ *
+ * @param room      Pointer to the room
+ * @param member    Index of the member in the room
+ * @param users     Pointer to the table of connections holding the room's users
+ */
+static void remove_member(struct room *room, uint32_t member, const struct conn_table *users)
 {
-    if (room->id != user->room)
+    while (--room->num_users > member)
     {
-        LOG_ERROR("user %d is not in room %d", user->id, room->id);
-        return -1;
+        struct room_member *moved = &room->members[room->num_users];
+        struct user *moved_user = conn_table_get(users, moved->handle);
+        if (moved_user == NULL)
+        {
+            LOG_ERROR("dropped stale handle of user %d from room %u", conn_handle_fd(moved->handle), room->id);
+            continue;
+        }
+        moved_user->subs[moved->subscription].member = member;
+        room->members[member] = *moved;
+        return;
     }
+}
+
+void room_remove_user(struct user *user, struct subscription *sub, const struct conn_table *users)
+{
+    struct room *room = sub->room;
+    uint32_t index = sub - user->subs;
+
+    // Move the room's last member into the user's place
+    remove_member(room, sub->member, users);
 
-    int i;
-    for (i = 0; i < room->num_users; i++)
+    // Move the user's last subscription into the room's place
+    uint32_t last = user->num_subs - 1;
+    if (index != last)
     {
-        if (room->users[i] == user->id)
-            break;
+        struct subscription *moved = &user->subs[last];
+        moved->room->members[moved->member].subscription = index;
+        user->subs[index] = *moved;
     }
+    user->num_subs--;
 
-    room->users[i] = room->users[room->num_users - 1];
-    room->num_users--;
-    user->room = INVALID_ROOM;
+    if (user->num_subs == 0)
+    {
+        buffer_pool_release(user->subs, user->subs_cap * sizeof(struct subscription));
+        user->subs = NULL;
+        user->subs_cap = 0;
+    }
 
-    LOG_INFO("removed user %d from room %d", user->id, room->id);
+    LOG_INFO("removed user %d from room %u", user->id, room->id);
+}
 
-    return 0;
+void room_drop_stale_member(struct room *room, uint32_t member, const struct conn_table *users)
+{
+    LOG_ERROR("dropped stale handle of user %d from room %u", conn_handle_fd(room->members[member].handle), room->id);
+    remove_member(room, member, users);
 }
@@ -1,24 +1,58 @@
 #ifndef ROOM_H
 #define ROOM_H
 
+#include <stdint.h>
+
 #include "messages/join_message.h"
 #include "user.h"
+#include "../data_structures/conn_table.h"
 
 #define INVALID_ROOM 0
-#define MAX_USERS_PER_ROOM 25
+#define ROOM_MIN_CAPACITY 8 // Number of members the first members array of a room holds
+
+struct room_entry;
+
+// A user in a room
+struct room_member
+{
+    CONN_HANDLE handle;    // Handle of the user's connection
+    uint32_t subscription; // Index of the room in the user's subscriptions
+    uint64_t fence;        // Stamp of the first message not replayed to the user on joining, 0 if none was
+};
 
+// A room's users on one reactor. Its members are kept in a dense array, so a fan-out walks contiguous memory. Each
+// member points at the room's entry in the user's subscriptions and back, so removing a user moves the last member
+// into their place instead of searching. The array doubles when it is full, with no limit on the number of users.
 struct room
 {
     ROOM_ID id;
-    int users[MAX_USERS_PER_ROOM]; // Stores user ids
-    uint8_t num_users;
+    struct room_member *members;
+    uint32_t num_users;
+    uint32_t cap;             // Number of members the members array has space for
+    struct room_entry *entry; // The room's entry in the room directory (see data_structures/room_directory.h)
 };
 
 /**
- * Adds a user to the room. Returns an error if the room is full.
+ * Initializes an empty room. The members array is allocated when the first user is added.
+ *
+ * @param room  Pointer to the room
+ * @param id    Id of the room
+ */
+void room_init(struct room *room, ROOM_ID id);
+
+/**
+ * Frees the members array of a room.
+ *
+ * @param room  Pointer to the room
+ */
+void room_free(struct room *room);
+
+/**
+ * Adds a user to the room and the room to the user's subscriptions, growing either array if it is full. The user must
+ * not be in the room already.
  *
  * @param room      Pointer to the room
- * @param user_id   Id of the user
+ * @param user      Pointer to the user
  *
  * @return  0 on success.
  *          -1 on error.
@@ -26,14 +60,26 @@ struct room
 int room_add_user(struct room *room, struct user *user);
 
 /**
- * Removes a user from the room. Returns an error if the user is not in the room.
+ * Removes a user from a room and the room from the user's subscriptions in O(1). The last member of the room and the
+ * user's last subscription take the freed places. Members with a stale handle met on the way are dropped (see
+ * room_drop_stale_member()).
  *
- * @param room      Pointer to the room
- * @param user_id   Id of the user
+ * @param user      Pointer to the user
+ * @param sub       Pointer to the user's subscription to the room
+ * @param users     Pointer to the table of connections holding the room's users
+ */
+void room_remove_user(struct user *user, struct subscription *sub, const struct conn_table *users);
+
+/**
+ * Drops a member whose handle is stale from a room, in O(1). The last member of the room takes the freed place.
  *
- * @return  0 on success.
- *          -1 on error.
+ * A stale handle names a connection which closed, or whose fd was reused, without leaving the room. It has no user to
+ * update, so wherever one is found, in a fan-out or while removing a user, it is dropped rather than treated as an error.
+ *
+ * @param room      Pointer to the room
+ * @param member    Index of the member in the room
+ * @param users     Pointer to the table of connections holding the room's users
  */
-int room_remove_user(struct room *room, struct user *user);
+void room_drop_stale_member(struct room *room, uint32_t member, const struct conn_table *users);
 
 #endif
@@ -0,0 +1,44 @@
+#include <string.h>
+
+#include "room.h"
+#include "user.h"
+
+void user_init(struct user *user, CONN_HANDLE handle)
+{
+    user->id = conn_handle_fd(handle);
+    user->handle = handle;
+    user->subs = NULL;
+    user->num_subs = 0;
+    user->subs_cap = 0;
+    strcpy(user->name, "anonymous");
+    frame_parser_init(&user->parser);
+    outbound_queue_init(&user->outbound);
+    memset(&user->ready, 0, sizeof(user->ready));
+    memset(&user->flush, 0, sizeof(user->flush));
+    user->events = 0;
+    user->reads_paused = false;
+    user->dropping = false;
+    user->shut_down = false;
+    user->send_in_flight = false;
+    user->inflight_ops = 0;
+    user->recv_armed = false;
+    user->recv_cancelled = false;
+    user->recv_backlog = NULL;
+    user->backlog_len = 0;
+    user->backlog_cap = 0;
+    user->closing = false;
+    user->hung_up = false;
+    user->migrating = false;
+    user->migrate_room = INVALID_ROOM;
+    memset(&user->migrate, 0, sizeof(user->migrate));
+    user->waiting = false;
+}
+
+struct subscription *user_find_subscription(struct user *user, ROOM_ID room_id)
+{
+    for (uint32_t i = 0; i < user->num_subs; i++)
+        if (user->subs[i].room->id == room_id)
+            return &user->subs[i];
+
+    return NULL;
+}
@@ -1,19 +1,98 @@
 #ifndef USER_H
 #define USER_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "messages/join_message.h"
 #include "messages/name_message.h"
-#include "../lib/uthash.h"
+#include "../data_structures/conn_table.h"
+#include "../data_structures/outbound_queue.h"
+#include "../utils/frame_parser.h"
+
+#define USER_SEND_IOV_MAX 64 // Maximum number of queued messages submitted in one io_uring send
+#define USER_MAX_SUBSCRIPTIONS 256 // Maximum number of rooms a user can be in at once
+
+struct room;
+
+// A room a user is in. Together with the room's member entry for the user, it links the user and the room both ways,
+// so either side can be removed from the other in O(1).
+struct subscription
+{
+    struct room *room; // The room, on the user's reactor
+    uint32_t member;   // Index of the user in the room's members array
+};
+
+// Links a user into an intrusive list of users (see data_structures/user_list.h)
+struct user_link
+{
+    struct user *prev;
+    struct user *next;
+    bool linked; // Whether the user is in the list
+};
 
 // Represents a user
 struct user
 {
-    int id;
-    ROOM_ID room;
+    int id;             // Socket fd of the client
+    CONN_HANDLE handle; // Identifies the connection, which id stops doing once the fd is closed and reused
+    struct subscription *subs; // The rooms the user is in, in no particular order, NULL if none
+    uint32_t num_subs;         // Number of rooms the user is in
+    uint32_t subs_cap;         // Number of subscriptions subs has space for
     char name[NAME_SIZE_LIMIT];
-    UT_hash_handle hh; // Makes the structure hashable with uthash
+
+    struct frame_parser parser;     // Reassembles the messages received from the user
+    struct outbound_queue outbound; // Messages waiting to be written to the user
+
+    struct user_link ready; // Links users with unread data left after their read budget ran out
+    struct user_link flush; // Links users with messages queued during the current event loop iteration
+
+    uint32_t events;       // Events the event loop is watching the socket for
+    bool reads_paused;     // Whether reading is paused until the outbound queue drains
+    bool dropping;         // Whether new messages are dropped until the outbound queue drains
+    bool shut_down;        // Whether the socket has been shut down for falling behind and is waiting to be closed
+
+    // io_uring engine state
+    bool send_in_flight;                      // Whether a send of the front of the outbound queue is submitted
+    struct msghdr send_msg;                   // Describes the messages being sent while send_in_flight
+    struct iovec send_iov[USER_SEND_IOV_MAX]; // Messages being sent while send_in_flight
+    uint32_t inflight_ops;                    // Operations submitted for the user which have not finished
+    bool recv_armed;                          // Whether a multishot recv is submitted for the user
+    bool recv_cancelled;                      // Whether the multishot recv has been asked to stop
+    char *recv_backlog;                       // Received bytes not yet handed to the frame parser
+    size_t backlog_len;                       // Number of bytes in recv_backlog
+    size_t backlog_cap;                       // Size of recv_backlog in bytes
+    bool closing;                             // Whether the connection is being torn down
+    bool hung_up;                             // Whether the client hung up with messages left to handle
+
+    // Room affinity state
+    bool migrating;           // Whether the user is being handed to the reactor thread owning the room they are joining
+    ROOM_ID migrate_room;     // Room the user joins once handed over
+    struct user_link migrate; // Links users ready to be handed over at the end of the event loop iteration
+
+    bool waiting; // Whether the user's messages wait for the room log to look up a room they join or read a history
 };
 
+/**
+ * Initializes the user data of a newly accepted client: anonymous, in no room, with nothing received or queued.
+ *
+ * @param user      Pointer to the user
+ * @param handle    The handle of the connection, which holds the client's socket fd
+ */
+void user_init(struct user *user, CONN_HANDLE handle);
+
+/**
+ * Finds a user's subscription to a room by scanning their subscriptions, which are few and stored contiguously.
+ *
+ * @param user      Pointer to the user
+ * @param room_id   Id of the room
+ *
+ * @return  Pointer to the subscription.
+ *          NULL if the user is not in the room.
+ */
+struct subscription *user_find_subscription(struct user *user, ROOM_ID room_id);
+
 #endif
@@ -0,0 +1,34 @@
+#include <pthread.h>
+
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82F63B78 // Castagnoli polynomial, bit reversed
+
+static uint32_t table[256];
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Fills the table of the checksums of every byte value.
+ */
+static void init_table(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+        table[i] = crc;
+    }
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+    pthread_once(&table_once, init_table);
+
+    const unsigned char *p = data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+        crc = (crc >> 8) ^ table[(crc ^ p[i]) & 0xFF];
+
+    return ~crc;
+}
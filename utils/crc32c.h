@@ -0,0 +1,18 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Computes the CRC-32C (Castagnoli) checksum of a buffer, or extends the checksum of the bytes before it.
+ *
+ * @param crc   Checksum of the preceding bytes, 0 to start a new one
+ * @param data  Pointer to the bytes
+ * @param len   Number of bytes
+ *
+ * @return  The checksum of the preceding bytes followed by data.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+#endif
@@ -0,0 +1,350 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include "event_loop.h"
+#include "../lib/log.h"
+
+#define INITIAL_NUM_SLOTS 64
+
+/**
+ * Converts EVENT_* flags to poll() event flags.
+ */
+static short to_poll_events(uint32_t events)
+{
+    short poll_events = 0;
+    if (events & EVENT_READ)
+        poll_events |= POLLIN;
+    if (events & EVENT_WRITE)
+        poll_events |= POLLOUT;
+    return poll_events;
+}
+
+/**
+ * Converts poll() revents flags to EVENT_* flags.
+ */
+static uint32_t from_poll_events(short revents)
+{
+    uint32_t events = 0;
+    if (revents & POLLIN)
+        events |= EVENT_READ;
+    if (revents & POLLOUT)
+        events |= EVENT_WRITE;
+    if (revents & POLLHUP)
+        events |= EVENT_HUP;
+    if (revents & (POLLERR | POLLNVAL))
+        events |= EVENT_ERROR;
+    return events;
+}
+
+#ifdef __linux__
+/**
+ * Converts EVENT_* flags to epoll event flags.
+ */
+static uint32_t to_epoll_events(uint32_t events)
+{
+    uint32_t epoll_events = 0;
+    if (events & EVENT_READ)
+        epoll_events |= EPOLLIN;
+    if (events & EVENT_WRITE)
+        epoll_events |= EPOLLOUT;
+    if (events & EVENT_EDGE)
+        epoll_events |= EPOLLET;
+    return epoll_events;
+}
+
+/**
+ * Converts epoll event flags to EVENT_* flags.
+ */
+static uint32_t from_epoll_events(uint32_t epoll_events)
+{
+    uint32_t events = 0;
+    if (epoll_events & EPOLLIN)
+        events |= EVENT_READ;
+    if (epoll_events & EPOLLOUT)
+        events |= EVENT_WRITE;
+    if (epoll_events & EPOLLHUP)
+        events |= EVENT_HUP;
+    if (epoll_events & EPOLLERR)
+        events |= EVENT_ERROR;
+    return events;
+}
+#endif
+
+/**
+ * Makes sure the poll backend has a slot for fd, growing the slot array if needed.
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int ensure_slot(struct event_loop *loop, int fd)
+{
+    if ((uint32_t)fd < loop->num_slots)
+        return 0;
+
+    uint32_t new_num_slots = loop->num_slots;
+    while ((uint32_t)fd >= new_num_slots)
+        new_num_slots *= 2;
+
+    struct poll_slot *slots = reallocarray(loop->slots, new_num_slots, sizeof(struct poll_slot));
+    if (slots == NULL)
+    {
+        LOG_ERROR("failed to allocate space for %d poll slots", new_num_slots);
+        return -1;
+    }
+
+    for (uint32_t i = loop->num_slots; i < new_num_slots; i++)
+    {
+        slots[i].index = -1;
+        slots[i].ctx = NULL;
+    }
+    loop->slots = slots;
+    loop->num_slots = new_num_slots;
+
+    return 0;
+}
+
+struct event_loop *event_loop_init(enum event_loop_backend backend)
+{
+    struct event_loop *loop = calloc(1, sizeof(struct event_loop));
+    if (loop == NULL)
+    {
+        LOG_ERROR("failed to allocate space for event loop");
+        return NULL;
+    }
+    loop->backend = backend;
+    loop->epfd = -1;
+
+    if (backend == EVENT_LOOP_EPOLL)
+    {
+#ifdef __linux__
+        if ((loop->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+        {
+            LOG_ERROR("failed to create epoll instance: %s", strerror(errno));
+            free(loop);
+            return NULL;
+        }
+        return loop;
+#else
+        LOG_ERROR("epoll is not supported on this platform");
+        free(loop);
+        return NULL;
+#endif
+    }
+
+    if ((loop->pollfds = pollfd_array_init()) == NULL)
+    {
+        LOG_ERROR("failed to initialize pollfd array");
+        free(loop);
+        return NULL;
+    }
+
+    loop->num_slots = INITIAL_NUM_SLOTS;
+    if ((loop->slots = malloc(INITIAL_NUM_SLOTS * sizeof(struct poll_slot))) == NULL)
+    {
+        LOG_ERROR("failed to allocate space for %d poll slots", INITIAL_NUM_SLOTS);
+        free(loop->pollfds->fds);
+        free(loop->pollfds);
+        free(loop);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < loop->num_slots; i++)
+    {
+        loop->slots[i].index = -1;
+        loop->slots[i].ctx = NULL;
+    }
+
+    return loop;
+}
+
+void event_loop_free(struct event_loop *loop)
+{
+    if (loop->epfd != -1)
+        close(loop->epfd);
+
+    if (loop->pollfds != NULL)
+    {
+        free(loop->pollfds->fds);
+        free(loop->pollfds);
+    }
+    free(loop->slots);
+    free(loop);
+}
+
+int event_loop_add(struct event_loop *loop, int fd, uint32_t events, void *ctx)
+{
+#ifdef __linux__
+    if (loop->backend == EVENT_LOOP_EPOLL)
+    {
+        struct epoll_event ev;
+        ev.events = to_epoll_events(events);
+        ev.data.ptr = ctx;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        {
+            LOG_ERROR("failed to add fd %d to epoll instance: %s", fd, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+#endif
+
+    if (ensure_slot(loop, fd) != 0)
+        return -1;
+
+    if (loop->slots[fd].index != -1)
+    {
+        LOG_ERROR("fd %d already in event loop", fd);
+        return -1;
+    }
+
+    if (pollfd_array_append(loop->pollfds, fd, to_poll_events(events)) != 0)
+    {
+        LOG_ERROR("failed to add fd %d to pollfd array", fd);
+        return -1;
+    }
+    loop->slots[fd].index = loop->pollfds->len - 1;
+    loop->slots[fd].ctx = ctx;
+
+    return 0;
+}
+
+int event_loop_modify(struct event_loop *loop, int fd, uint32_t events, void *ctx)
+{
+#ifdef __linux__
+    if (loop->backend == EVENT_LOOP_EPOLL)
+    {
+        struct epoll_event ev;
+        ev.events = to_epoll_events(events);
+        ev.data.ptr = ctx;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev) == -1)
+        {
+            LOG_ERROR("failed to modify fd %d in epoll instance: %s", fd, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+#endif
+
+    if ((uint32_t)fd >= loop->num_slots || loop->slots[fd].index == -1)
+    {
+        LOG_ERROR("fd %d not in event loop", fd);
+        return -1;
+    }
+
+    loop->pollfds->fds[loop->slots[fd].index].events = to_poll_events(events);
+    loop->slots[fd].ctx = ctx;
+
+    return 0;
+}
+
+int event_loop_delete(struct event_loop *loop, int fd)
+{
+#ifdef __linux__
+    if (loop->backend == EVENT_LOOP_EPOLL)
+    {
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL) == -1)
+        {
+            LOG_ERROR("failed to delete fd %d from epoll instance: %s", fd, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+#endif
+
+    if ((uint32_t)fd >= loop->num_slots || loop->slots[fd].index == -1)
+    {
+        LOG_ERROR("fd %d not in event loop", fd);
+        return -1;
+    }
+
+    uint32_t i = loop->slots[fd].index;
+    if (pollfd_array_delete(loop->pollfds, i) != 0)
+    {
+        LOG_ERROR("failed to delete fd %d from pollfd array", fd);
+        return -1;
+    }
+
+    // The last pollfd has been moved into the deleted one's place
+    if (i < loop->pollfds->len)
+        loop->slots[loop->pollfds->fds[i].fd].index = i;
+    loop->slots[fd].index = -1;
+    loop->slots[fd].ctx = NULL;
+
+    return 0;
+}
+
+int event_loop_wait(struct event_loop *loop, struct event *events, int max_events, int timeout)
+{
+#ifdef __linux__
+    if (loop->backend == EVENT_LOOP_EPOLL)
+    {
+        struct epoll_event ready[max_events];
+        int n = epoll_wait(loop->epfd, ready, max_events, timeout);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                return 0;
+            LOG_ERROR("failed to wait on epoll instance: %s", strerror(errno));
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            events[i].ctx = ready[i].data.ptr;
+            events[i].events = from_epoll_events(ready[i].events);
+            events[i].fd = -1; // Only the context pointer is stored by epoll
+        }
+
+        return n;
+    }
+#endif
+
+    struct pollfd_array *pollfds = loop->pollfds;
+    if (poll(pollfds->fds, pollfds->len, timeout) == -1)
+    {
+        if (errno == EINTR)
+            return 0;
+        LOG_ERROR("failed to poll fds: %s", strerror(errno));
+        return -1;
+    }
+
+    // Resume scanning where the last wait stopped so fds at the end of the array are not starved
+    int n = 0;
+    uint32_t len = pollfds->len;
+    uint32_t start = loop->next_scan < len ? loop->next_scan : 0;
+    for (uint32_t j = 0; j < len && n < max_events; j++)
+    {
+        uint32_t i = (start + j) % len;
+        struct pollfd pfd = pollfds->fds[i];
+        if (pfd.revents == 0)
+            continue;
+
+        events[n].fd = pfd.fd;
+        events[n].events = from_poll_events(pfd.revents);
+        events[n].ctx = loop->slots[pfd.fd].ctx;
+        n++;
+        loop->next_scan = i + 1;
+    }
+
+    return n;
+}
+
+int event_loop_parse_backend(const char *name, enum event_loop_backend *backend)
+{
+    if (strcmp(name, "poll") == 0)
+        *backend = EVENT_LOOP_POLL;
+#ifdef __linux__
+    else if (strcmp(name, "epoll") == 0)
+        *backend = EVENT_LOOP_EPOLL;
+#endif
+    else
+        return -1;
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+
+#include "../data_structures/pollfd_array.h"
+
+// Events that can be waited for (passed to event_loop_add()/event_loop_modify()) and reported (in struct event)
+#define EVENT_READ 0x1  // fd is readable
+#define EVENT_WRITE 0x2 // fd is writable
+#define EVENT_HUP 0x4   // peer hung up (reported only)
+#define EVENT_ERROR 0x8 // error condition on fd (reported only)
+#define EVENT_EDGE 0x10 // report readiness changes only, not readiness itself (epoll backend only, ignored by poll)
+
+// The mechanism used by an event loop to wait for events
+enum event_loop_backend
+{
+    EVENT_LOOP_POLL,  // poll(): every wait scans all registered fds, works everywhere
+    EVENT_LOOP_EPOLL, // epoll: every wait only touches ready fds, Linux only
+};
+
+// A ready fd reported by event_loop_wait()
+struct event
+{
+    int fd;
+    uint32_t events; // Combination of EVENT_* flags
+    void *ctx;       // Context pointer the fd was registered with
+};
+
+// Per-fd bookkeeping for the poll backend
+struct poll_slot
+{
+    int32_t index; // Index of the fd in pollfds, -1 if the fd is not registered
+    void *ctx;
+};
+
+// Waits for events on a set of fds and hands back the context pointer each ready fd was registered with
+struct event_loop
+{
+    enum event_loop_backend backend;
+
+    // epoll backend
+    int epfd;
+
+    // poll backend
+    struct pollfd_array *pollfds;
+    struct poll_slot *slots; // Indexed by fd
+    uint32_t num_slots;      // Number of elements in slots
+    uint32_t next_scan;      // Index in pollfds to resume scanning from when more fds were ready than could be reported
+};
+
+/**
+ * Initializes an event loop which uses the given backend to wait for events.
+ *
+ * The returned struct should be freed with event_loop_free() when no longer needed.
+ *
+ * @param backend   The mechanism used to wait for events
+ *
+ * @return  Pointer to the event loop on success.
+ *          NULL if initialization fails.
+ */
+struct event_loop *event_loop_init(enum event_loop_backend backend);
+
+/**
+ * Frees an event loop. The fds registered with it are not closed.
+ *
+ * @param loop  Pointer to the event loop
+ */
+void event_loop_free(struct event_loop *loop);
+
+/**
+ * Starts watching fd for the given events. ctx is handed back with every event reported for fd.
+ *
+ * @param loop      Pointer to the event loop
+ * @param fd        The file descriptor to watch
+ * @param events    Combination of EVENT_READ, EVENT_WRITE and EVENT_EDGE
+ * @param ctx       Context pointer for the fd
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int event_loop_add(struct event_loop *loop, int fd, uint32_t events, void *ctx);
+
+/**
+ * Changes the events watched for on fd, which must have been added to the loop.
+ *
+ * @param loop      Pointer to the event loop
+ * @param fd        The file descriptor
+ * @param events    Combination of EVENT_READ, EVENT_WRITE and EVENT_EDGE
+ * @param ctx       Context pointer for the fd
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int event_loop_modify(struct event_loop *loop, int fd, uint32_t events, void *ctx);
+
+/**
+ * Stops watching fd. Must be called before fd is closed.
+ *
+ * @param loop  Pointer to the event loop
+ * @param fd    The file descriptor
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int event_loop_delete(struct event_loop *loop, int fd);
+
+/**
+ * Waits until at least one watched fd is ready, then stores up to max_events ready fds in events.
+ *
+ * @param loop          Pointer to the event loop
+ * @param events        Pointer to an array which will store the ready fds
+ * @param max_events    Number of elements in events
+ * @param timeout       Maximum time to wait in milliseconds, -1 to wait forever
+ *
+ * @return  Number of ready fds stored in events (0 on timeout or when interrupted by a signal).
+ *          -1 on error.
+ */
+int event_loop_wait(struct event_loop *loop, struct event *events, int max_events, int timeout);
+
+/**
+ * Parses the name of an event loop backend ("poll" or "epoll").
+ *
+ * @param name      The name of the backend
+ * @param backend   Pointer to a backend which will store the result
+ *
+ * @return  0 on success.
+ *          -1 if the name is not a known backend.
+ */
+int event_loop_parse_backend(const char *name, enum event_loop_backend *backend);
+
+#endif
@@ -0,0 +1,177 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "frame_parser.h"
+#include "net_utils.h"
+#include "../data_structures/buffer_pool.h"
+#include "../lib/log.h"
+
+/**
+ * Finds the message at the start of len bytes of data.
+ *
+ * @return  FRAME_COMPLETE with the length of the message stored in frame_len if data holds all of it,
+ *          FRAME_INCOMPLETE if it does not,
+ *          FRAME_ERROR if the message length is invalid.
+ */
+static enum frame_status find_frame(const char *data, size_t len, size_t *frame_len)
+{
+    if (len < sizeof(TOTAL_MSG_LEN))
+        return FRAME_INCOMPLETE;
+
+    TOTAL_MSG_LEN total_len;
+    memcpy(&total_len, data, sizeof(total_len));
+    total_len = ntohl(total_len);
+    if (total_len < MSG_HEADER_SIZE || total_len > MSG_SIZE_LIMIT)
+    {
+        LOG_ERROR("invalid message length %u", total_len);
+        return FRAME_ERROR;
+    }
+
+    if (len < total_len)
+        return FRAME_INCOMPLETE;
+
+    *frame_len = total_len;
+    return FRAME_COMPLETE;
+}
+
+/**
+ * Hands out the next message in the parser's buffer, if it holds a whole one.
+ */
+static enum frame_status next_frame(struct frame_parser *parser, char **frame, size_t *len)
+{
+    enum frame_status status = find_frame(parser->buf + parser->head, parser->tail - parser->head, len);
+    if (status != FRAME_COMPLETE)
+        return status;
+
+    *frame = parser->buf + parser->head;
+    parser->head += *len;
+
+    return FRAME_COMPLETE;
+}
+
+/**
+ * Makes room at the end of the parser's buffer by moving the partially received message left in it to the front, and
+ * allocates the buffer on first use. The buffer holds at least one message of any length, so there is always room
+ * afterwards.
+ *
+ * @return  Pointer to the free space, whose size is stored in space, on success.
+ *          NULL on error.
+ */
+static char *make_space(struct frame_parser *parser, size_t *space)
+{
+    if (parser->buf == NULL && (parser->buf = buffer_pool_alloc(FRAME_PARSER_BUF_SIZE)) == NULL)
+    {
+        LOG_ERROR("failed to allocate space for receive buffer");
+        return NULL;
+    }
+
+    if (parser->head > 0)
+    {
+        memmove(parser->buf, parser->buf + parser->head, parser->tail - parser->head);
+        parser->tail -= parser->head;
+        parser->head = 0;
+    }
+
+    *space = FRAME_PARSER_BUF_SIZE - parser->tail;
+    return parser->buf + parser->tail;
+}
+
+void frame_parser_init(struct frame_parser *parser)
+{
+    parser->buf = NULL;
+    parser->head = 0;
+    parser->tail = 0;
+}
+
+void frame_parser_free(struct frame_parser *parser)
+{
+    buffer_pool_release(parser->buf, FRAME_PARSER_BUF_SIZE);
+    frame_parser_init(parser);
+}
+
+enum frame_status frame_parser_recv(struct frame_parser *parser, int sockfd, char **frame, size_t *len)
+{
+    while (1)
+    {
+        if (parser->buf != NULL)
+        {
+            enum frame_status status = next_frame(parser, frame, len);
+            if (status != FRAME_INCOMPLETE)
+                return status;
+        }
+
+        size_t space;
+        char *dst = make_space(parser, &space);
+        if (dst == NULL)
+            return FRAME_ERROR;
+
+        ssize_t recvd = recv(sockfd, dst, space, RECV_FLAGS);
+        if (recvd == 0)
+        {
+            LOG_INFO("connection to socket %d terminated", sockfd);
+            return FRAME_CLOSED;
+        }
+        else if (recvd == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return FRAME_INCOMPLETE;
+            if (errno == EINTR)
+                continue;
+            if (errno == ECONNRESET) // Abrupt close
+            {
+                LOG_INFO("connection to socket %d terminated", sockfd);
+                return FRAME_CLOSED;
+            }
+            LOG_ERROR("failed to receive data from socket %d: %s", sockfd, strerror(errno));
+            return FRAME_ERROR;
+        }
+
+        parser->tail += recvd;
+    }
+}
+
+enum frame_status frame_parser_feed(struct frame_parser *parser, char *data, size_t data_len, size_t *consumed,
+                                    char **frame, size_t *len)
+{
+    *consumed = 0;
+
+    // Nothing is buffered, so a whole message at the start of data can be used where it is
+    if (parser->head == parser->tail)
+    {
+        enum frame_status status = find_frame(data, data_len, len);
+        if (status == FRAME_COMPLETE)
+        {
+            *frame = data;
+            *consumed = *len;
+        }
+        if (status != FRAME_INCOMPLETE)
+            return status;
+    }
+
+    while (1)
+    {
+        if (parser->buf != NULL)
+        {
+            enum frame_status status = next_frame(parser, frame, len);
+            if (status != FRAME_INCOMPLETE)
+                return status;
+        }
+
+        if (*consumed == data_len)
+            return FRAME_INCOMPLETE;
+
+        size_t space;
+        char *dst = make_space(parser, &space);
+        if (dst == NULL)
+            return FRAME_ERROR;
+
+        size_t n = data_len - *consumed < space ? data_len - *consumed : space;
+        memcpy(dst, data + *consumed, n);
+        *consumed += n;
+        parser->tail += n;
+    }
+}
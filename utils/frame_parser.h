@@ -0,0 +1,79 @@
+#ifndef FRAME_PARSER_H
+#define FRAME_PARSER_H
+
+#include <stddef.h>
+
+#include "../types/messages/message.h"
+
+#define FRAME_PARSER_BUF_SIZE (4 * MSG_SIZE_LIMIT) // Size of a frame parser's receive buffer
+
+// Result of handing bytes to a frame parser
+enum frame_status
+{
+    FRAME_COMPLETE,   // A whole message has been received
+    FRAME_INCOMPLETE, // More bytes are needed (for a socket, none are available right now)
+    FRAME_CLOSED,     // The peer closed the connection
+    FRAME_ERROR,      // The message is malformed or receiving failed
+};
+
+// Incrementally reassembles length-prefixed messages from a byte stream. Bytes are received into a buffer reused for
+// the life of the connection, as many as fit at a time, and every complete message in it is handed out in place. A
+// partially received message is kept at the front of the buffer between calls, so a connection can be read whenever it
+// has data without ever blocking on a slow sender.
+struct frame_parser
+{
+    char *buf;   // Received bytes, allocated from the buffer pool on first use
+    size_t head; // Offset of the first byte not handed out yet
+    size_t tail; // Offset past the last received byte
+};
+
+/**
+ * Initializes a frame parser to expect the start of a message.
+ *
+ * @param parser    Pointer to the frame parser
+ */
+void frame_parser_init(struct frame_parser *parser);
+
+/**
+ * Frees the receive buffer of a frame parser, along with any partially received message in it.
+ *
+ * @param parser    Pointer to the frame parser
+ */
+void frame_parser_free(struct frame_parser *parser);
+
+/**
+ * Gets the next message from a non-blocking socket. Messages already in the parser's buffer are handed out first, and
+ * only once none is left is the socket read, with a single recv() filling as much of the buffer as possible.
+ *
+ * On FRAME_COMPLETE, *frame points into the parser's buffer and stays valid until the next call.
+ *
+ * @param parser    Pointer to the frame parser for the socket
+ * @param sockfd    The non-blocking socket to receive on
+ * @param frame     Double pointer to a char buffer which will store the message
+ * @param len       Pointer to a size_t which will store the length of the message
+ *
+ * @return  The status of the message being received.
+ */
+enum frame_status frame_parser_recv(struct frame_parser *parser, int sockfd, char **frame, size_t *len);
+
+/**
+ * Gets the next message from already received bytes. Messages already in the parser's buffer are handed out first.
+ * Then, if nothing is buffered and data starts with a whole message, that message is handed out without copying it.
+ * Otherwise as much of data as fits is copied into the buffer.
+ *
+ * On FRAME_COMPLETE, *frame points into the parser's buffer or into data and stays valid until the next call (or
+ * until data is freed).
+ *
+ * @param parser    Pointer to the frame parser
+ * @param data      Pointer to the received bytes
+ * @param data_len  Number of received bytes
+ * @param consumed  Pointer to a size_t which will store the number of bytes consumed from data
+ * @param frame     Double pointer to a char buffer which will store the message
+ * @param len       Pointer to a size_t which will store the length of the message
+ *
+ * @return  FRAME_COMPLETE, FRAME_INCOMPLETE (all of data was consumed) or FRAME_ERROR.
+ */
+enum frame_status frame_parser_feed(struct frame_parser *parser, char *data, size_t data_len, size_t *consumed,
+                                    char **frame, size_t *len);
+
+#endif
@@ -0,0 +1,460 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+#include "log_segment.h"
+#include "../lib/log.h"
+
+#define SEGMENT_SUFFIX ".log"
+#define INDEX_SUFFIX ".idx"
+
+/**
+ * Builds the path of a file of a segment.
+ *
+ * @param path      Pointer to a buffer of PATH_MAX bytes which will store the path
+ * @param dir       Path of the directory holding the segment
+ * @param first_seq Sequence number of the segment's first record
+ * @param suffix    SEGMENT_SUFFIX or INDEX_SUFFIX
+ *
+ * @return  0 on success.
+ *          -1 if the path is too long.
+ */
+static int segment_path(char *path, const char *dir, uint64_t first_seq, const char *suffix)
+{
+    if (snprintf(path, PATH_MAX, "%s/%020" PRIu64 "%s", dir, first_seq, suffix) >= PATH_MAX)
+    {
+        LOG_ERROR("path of segment %" PRIu64 " in %s too long", first_seq, dir);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Computes the checksum of a record.
+ *
+ * @param seq   Sequence number of the record
+ * @param len   Length of the record's data in bytes
+ * @param data  Pointer to the record's data
+ *
+ * @return  The checksum.
+ */
+static uint32_t record_crc(uint64_t seq, uint32_t len, const char *data)
+{
+    struct log_record_header header = {seq, len, 0};
+    return crc32c(crc32c(0, &header, offsetof(struct log_record_header, crc)), data, len);
+}
+
+/**
+ * Checks whether a complete record follows the previous one at an offset of a mapped segment.
+ *
+ * @param map       Pointer to the mapped segment
+ * @param offset    Offset of the record
+ * @param prev_seq  Sequence number of the previous record, 0 if there is none
+ *
+ * @return  true if a complete record with a higher sequence number is there.
+ *          false otherwise.
+ */
+static bool valid_record(const char *map, size_t offset, uint64_t prev_seq)
+{
+    if (offset + sizeof(struct log_record_header) > LOG_SEGMENT_SIZE)
+        return false;
+
+    const struct log_record_header *header = (const struct log_record_header *)(map + offset);
+    if (header->seq <= prev_seq || offset + log_record_size(header->len) > LOG_SEGMENT_SIZE)
+        return false;
+
+    return header->crc == record_crc(header->seq, header->len, (const char *)(header + 1));
+}
+
+/**
+ * Compares sequence numbers for qsort().
+ */
+static int compare_seqs(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+size_t log_record_size(size_t len)
+{
+    return (sizeof(struct log_record_header) + len + LOG_RECORD_ALIGN - 1) & ~(size_t)(LOG_RECORD_ALIGN - 1);
+}
+
+int log_segment_list(const char *dir, uint64_t **seqs, size_t *n)
+{
+    return log_segment_list_files(dir, SEGMENT_SUFFIX, seqs, n);
+}
+
+int log_segment_list_files(const char *dir, const char *suffix, uint64_t **seqs, size_t *n)
+{
+    *seqs = NULL;
+    *n = 0;
+
+    DIR *d = opendir(dir);
+    if (d == NULL)
+    {
+        if (errno == ENOENT)
+            return 0;
+        LOG_ERROR("failed to open %s: %s", dir, strerror(errno));
+        return -1;
+    }
+
+    size_t cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL)
+    {
+        uint64_t seq;
+        char found[8];
+        if (sscanf(ent->d_name, "%" SCNu64 "%7s", &seq, found) != 2 || strcmp(found, suffix) != 0)
+            continue;
+
+        if (*n == cap)
+        {
+            cap = cap == 0 ? 16 : 2 * cap;
+            uint64_t *grown = realloc(*seqs, cap * sizeof(uint64_t));
+            if (grown == NULL)
+            {
+                LOG_ERROR("failed to allocate space for the segments of %s", dir);
+                free(*seqs);
+                *seqs = NULL;
+                *n = 0;
+                closedir(d);
+                return -1;
+            }
+            *seqs = grown;
+        }
+        (*seqs)[(*n)++] = seq;
+    }
+    closedir(d);
+
+    qsort(*seqs, *n, sizeof(uint64_t), compare_seqs);
+
+    return 0;
+}
+
+int log_segment_open(struct log_segment *seg, const char *dir, uint64_t first_seq)
+{
+    char path[PATH_MAX];
+    if (segment_path(path, dir, first_seq, SEGMENT_SUFFIX) != 0)
+        return -1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        LOG_ERROR("failed to open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    seg->map = mmap(NULL, LOG_SEGMENT_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg->map == MAP_FAILED)
+    {
+        LOG_ERROR("failed to map %s: %s", path, strerror(errno));
+        return -1;
+    }
+    seg->first_seq = first_seq;
+
+    // A missing or empty index is fine: the segment is walked from its start
+    seg->index = NULL;
+    seg->index_len = 0;
+    seg->index_size = 0;
+    struct stat st;
+    if (segment_path(path, dir, first_seq, INDEX_SUFFIX) == 0 && (fd = open(path, O_RDONLY)) != -1)
+    {
+        if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(struct log_index_entry))
+        {
+            void *index = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (index != MAP_FAILED)
+            {
+                seg->index = index;
+                seg->index_size = st.st_size;
+                seg->index_len = st.st_size / sizeof(struct log_index_entry);
+            }
+        }
+        close(fd);
+    }
+
+    // Walk from the last index entry which points at a complete record
+    size_t offset = 0;
+    uint64_t prev_seq = 0;
+    while (seg->index_len > 0)
+    {
+        struct log_index_entry *last = &seg->index[seg->index_len - 1];
+        if (last->offset < LOG_SEGMENT_SIZE && last->offset % LOG_RECORD_ALIGN == 0 &&
+            valid_record(seg->map, last->offset, 0) &&
+            ((const struct log_record_header *)(seg->map + last->offset))->seq == last->seq)
+        {
+            offset = last->offset;
+            break;
+        }
+        seg->index_len--;
+    }
+    while (valid_record(seg->map, offset, prev_seq))
+    {
+        const struct log_record_header *header = (const struct log_record_header *)(seg->map + offset);
+        prev_seq = header->seq;
+        offset += log_record_size(header->len);
+    }
+    seg->end = offset;
+    seg->last_seq = prev_seq;
+
+    return 0;
+}
+
+void log_segment_close(struct log_segment *seg)
+{
+    munmap(seg->map, LOG_SEGMENT_SIZE);
+    if (seg->index != NULL)
+        munmap(seg->index, seg->index_size);
+    seg->map = NULL;
+    seg->index = NULL;
+}
+
+size_t log_segment_find(const struct log_segment *seg, uint64_t seq)
+{
+    // Find the last index entry at or before seq
+    size_t lo = 0;
+    size_t hi = seg->index_len;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (seg->index[mid].seq <= seq)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    size_t offset = lo == 0 ? 0 : seg->index[lo - 1].offset;
+
+    while (offset < seg->end)
+    {
+        const struct log_record_header *header = (const struct log_record_header *)(seg->map + offset);
+        if (header->seq >= seq)
+            break;
+        offset += log_record_size(header->len);
+    }
+
+    return offset;
+}
+
+const struct log_record_header *log_segment_record(const struct log_segment *seg, size_t offset)
+{
+    if (offset >= seg->end)
+        return NULL;
+
+    return (const struct log_record_header *)(seg->map + offset);
+}
+
+int log_segment_create(struct log_segment_writer *writer, const char *dir, uint64_t first_seq)
+{
+    char path[PATH_MAX];
+    char index_path[PATH_MAX];
+    if (segment_path(path, dir, first_seq, SEGMENT_SUFFIX) != 0 ||
+        segment_path(index_path, dir, first_seq, INDEX_SUFFIX) != 0)
+        return -1;
+
+    // The file has its full size from the start, so readers can map all of it, but takes up no blocks until written
+    if ((writer->fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644)) == -1 ||
+        ftruncate(writer->fd, LOG_SEGMENT_SIZE) == -1)
+    {
+        LOG_ERROR("failed to create %s: %s", path, strerror(errno));
+        if (writer->fd != -1)
+            close(writer->fd);
+        writer->fd = -1;
+        writer->index_fd = -1;
+        return -1;
+    }
+
+    if ((writer->index_fd = open(index_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644)) == -1)
+    {
+        LOG_ERROR("failed to create %s: %s", index_path, strerror(errno));
+        close(writer->fd);
+        writer->fd = -1;
+        return -1;
+    }
+
+    writer->first_seq = first_seq;
+    writer->last_seq = 0;
+    writer->end = 0;
+    writer->indexed = 0;
+
+    return 0;
+}
+
+int log_segment_resume(struct log_segment_writer *writer, const char *dir, uint64_t first_seq)
+{
+    writer->fd = -1;
+    writer->index_fd = -1;
+    struct log_segment seg;
+    if (log_segment_open(&seg, dir, first_seq) != 0)
+        return -1;
+    writer->first_seq = first_seq;
+    writer->last_seq = seg.last_seq;
+    writer->end = seg.end;
+    writer->indexed = seg.index_len > 0 ? seg.index[seg.index_len - 1].offset : 0;
+    size_t index_len = seg.index_len;
+    log_segment_close(&seg);
+
+    char path[PATH_MAX];
+    char index_path[PATH_MAX];
+    if (segment_path(path, dir, first_seq, SEGMENT_SUFFIX) != 0 ||
+        segment_path(index_path, dir, first_seq, INDEX_SUFFIX) != 0)
+        return -1;
+
+    // Zero whatever follows the last complete record, so no stale bytes are taken for records after new ones
+    if ((writer->fd = open(path, O_WRONLY | O_CLOEXEC)) == -1 || ftruncate(writer->fd, writer->end) == -1 ||
+        ftruncate(writer->fd, LOG_SEGMENT_SIZE) == -1)
+    {
+        LOG_ERROR("failed to open %s: %s", path, strerror(errno));
+        if (writer->fd != -1)
+            close(writer->fd);
+        writer->fd = -1;
+        return -1;
+    }
+
+    if ((writer->index_fd = open(index_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) == -1 ||
+        ftruncate(writer->index_fd, index_len * sizeof(struct log_index_entry)) == -1)
+    {
+        LOG_ERROR("failed to open %s: %s", index_path, strerror(errno));
+        if (writer->index_fd != -1)
+            close(writer->index_fd);
+        close(writer->fd);
+        writer->fd = -1;
+        writer->index_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Writes the whole of a gather list at an offset of a file, resuming after short writes.
+ *
+ * @param fd        The file
+ * @param iov       Pointer to the gather list, which is modified
+ * @param iovcnt    Number of elements in iov
+ * @param offset    Offset to write at
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int pwritev_all(int fd, struct iovec *iov, int iovcnt, off_t offset)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t n = pwritev(fd, iov, iovcnt, offset);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        offset += n;
+
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    return 0;
+}
+
+ssize_t log_segment_append(struct log_segment_writer *writer, const struct log_entry *entries, size_t n)
+{
+    static const char padding[LOG_RECORD_ALIGN];
+    struct log_record_header headers[LOG_APPEND_MAX];
+    struct iovec iov[3 * LOG_APPEND_MAX];
+    struct log_index_entry index[LOG_APPEND_MAX];
+
+    size_t appended = 0;
+    while (appended < n)
+    {
+        size_t start = writer->end;
+        size_t indexed = writer->indexed;
+        int iovcnt = 0;
+        size_t index_len = 0;
+        size_t batch = 0;
+        for (; batch < LOG_APPEND_MAX && appended + batch < n; batch++)
+        {
+            const struct log_entry *entry = &entries[appended + batch];
+            size_t size = log_record_size(entry->len);
+            if (writer->end + size > LOG_SEGMENT_SIZE)
+                break;
+
+            if (writer->end == 0 || writer->end - writer->indexed >= LOG_INDEX_INTERVAL)
+            {
+                index[index_len++] = (struct log_index_entry){entry->seq, writer->end};
+                writer->indexed = writer->end;
+            }
+
+            headers[batch] = (struct log_record_header){entry->seq, entry->len, 0};
+            headers[batch].crc = record_crc(entry->seq, entry->len, entry->data);
+            iov[iovcnt++] = (struct iovec){&headers[batch], sizeof(struct log_record_header)};
+            iov[iovcnt++] = (struct iovec){(void *)entry->data, entry->len};
+            if (size > sizeof(struct log_record_header) + entry->len)
+                iov[iovcnt++] = (struct iovec){(void *)padding, size - sizeof(struct log_record_header) - entry->len};
+            writer->end += size;
+        }
+        if (batch == 0)
+            break;
+
+        if (pwritev_all(writer->fd, iov, iovcnt, start) != 0)
+        {
+            LOG_ERROR("failed to append to segment %" PRIu64 ": %s", writer->first_seq, strerror(errno));
+            writer->end = start;
+            writer->indexed = indexed;
+            return -1;
+        }
+        writer->last_seq = entries[appended + batch - 1].seq;
+        appended += batch;
+
+        // The index is written after the records it points at, so it never points past a record written in full. A
+        // missing entry only makes finding the records after it slower.
+        if (index_len > 0 &&
+            write(writer->index_fd, index, index_len * sizeof(struct log_index_entry)) !=
+                (ssize_t)(index_len * sizeof(struct log_index_entry)))
+            LOG_WARN("failed to append to the index of segment %" PRIu64 ": %s", writer->first_seq, strerror(errno));
+    }
+
+    return appended;
+}
+
+int log_segment_sync(struct log_segment_writer *writer)
+{
+    if (fdatasync(writer->fd) == -1 || fdatasync(writer->index_fd) == -1)
+    {
+        LOG_ERROR("failed to sync segment %" PRIu64 ": %s", writer->first_seq, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+void log_segment_writer_close(struct log_segment_writer *writer)
+{
+    if (writer->fd != -1)
+        close(writer->fd);
+    if (writer->index_fd != -1)
+        close(writer->index_fd);
+    writer->fd = -1;
+    writer->index_fd = -1;
+}
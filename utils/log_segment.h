@@ -0,0 +1,202 @@
+#ifndef LOG_SEGMENT_H
+#define LOG_SEGMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define LOG_SEGMENT_SIZE (4 * 1024 * 1024) // Size of every segment file, which is sparse until written
+#define LOG_INDEX_INTERVAL 4096            // Most bytes of records between two entries of a segment's index
+#define LOG_RECORD_ALIGN 8                 // Records start at multiples of this many bytes
+#define LOG_APPEND_MAX 128                 // Most records written by one pwritev()
+
+// Header of a record in a segment, followed by the record's data and padding up to LOG_RECORD_ALIGN. Segments are
+// written in host byte order: they are read back by the host which wrote them.
+struct log_record_header
+{
+    uint64_t seq; // Sequence number of the record, 0 where no record has been written
+    uint32_t len; // Length of the data in bytes
+    uint32_t crc; // CRC-32C of seq, len and the data, which tells a complete record from a torn one
+};
+
+// An entry of the sparse index of a segment, stored in a file next to it
+struct log_index_entry
+{
+    uint64_t seq;    // Sequence number of a record
+    uint64_t offset; // Offset of the record in the segment
+};
+
+// A record to append to a segment
+struct log_entry
+{
+    uint64_t seq;
+    const char *data;
+    size_t len;
+};
+
+// A segment mapped for reading. Any number of readers may map a segment while it is appended to, each seeing the
+// records complete when it was mapped.
+struct log_segment
+{
+    char *map;                     // The segment, LOG_SEGMENT_SIZE bytes
+    uint64_t first_seq;            // Sequence number of the segment's first record, which names its files
+    uint64_t last_seq;             // Sequence number of the segment's last complete record, 0 if it has none
+    size_t end;                    // Offset just past the last complete record
+    struct log_index_entry *index; // The segment's index, NULL if it has no entries
+    size_t index_len;              // Number of valid entries in index
+    size_t index_size;             // Size of the index mapping in bytes
+};
+
+// A segment being appended to
+struct log_segment_writer
+{
+    int fd;             // The segment file
+    int index_fd;       // The segment's index file
+    uint64_t first_seq; // Sequence number of the segment's first record, which names its files
+    uint64_t last_seq;  // Sequence number of the last record written, 0 if none has been
+    size_t end;         // Offset just past the last record written
+    size_t indexed;     // Offset of the last record put in the index
+};
+
+/**
+ * Gets the number of bytes a record takes up in a segment, header and padding included.
+ *
+ * @param len   Length of the record's data in bytes
+ *
+ * @return  Size of the record in bytes.
+ */
+size_t log_record_size(size_t len);
+
+/**
+ * Lists the segments in a directory, by the sequence numbers of their first records.
+ *
+ * @param dir   Path of the directory
+ * @param seqs  Double pointer which will store an array of the sequence numbers in ascending order, which the caller
+ *              frees with free(), NULL if there are no segments
+ * @param n     Pointer which will store the number of segments
+ *
+ * @return  0 on success (including when the directory does not exist).
+ *          -1 on error.
+ */
+int log_segment_list(const char *dir, uint64_t **seqs, size_t *n);
+
+/**
+ * Lists the files in a directory named by a number, zero-padded to 20 digits, and a suffix, by their numbers.
+ *
+ * @param dir       Path of the directory
+ * @param suffix    The suffix, including its dot, at most 7 characters
+ * @param seqs      Double pointer which will store an array of the numbers in ascending order, which the caller frees
+ *                  with free(), NULL if there are no such files
+ * @param n         Pointer which will store the number of files
+ *
+ * @return  0 on success (including when the directory does not exist).
+ *          -1 on error.
+ */
+int log_segment_list_files(const char *dir, const char *suffix, uint64_t **seqs, size_t *n);
+
+/**
+ * Maps a segment and its index for reading, and finds its last complete record. Index entries pointing past it (left
+ * by a crash) are ignored.
+ *
+ * The segment should be closed with log_segment_close() when no longer needed.
+ *
+ * @param seg       Pointer to the segment
+ * @param dir       Path of the directory holding the segment
+ * @param first_seq Sequence number of the segment's first record
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int log_segment_open(struct log_segment *seg, const char *dir, uint64_t first_seq);
+
+/**
+ * Unmaps a segment opened with log_segment_open().
+ *
+ * @param seg   Pointer to the segment
+ */
+void log_segment_close(struct log_segment *seg);
+
+/**
+ * Finds the first record of a segment with a sequence number of at least seq. The index narrows the search down to
+ * LOG_INDEX_INTERVAL bytes with a binary search, which are then walked.
+ *
+ * @param seg   Pointer to the segment
+ * @param seq   Sequence number to look for
+ *
+ * @return  Offset of the record, seg->end if there is none.
+ */
+size_t log_segment_find(const struct log_segment *seg, uint64_t seq);
+
+/**
+ * Gets the record at an offset of a segment. The record's data follows the header, and the next record starts
+ * log_record_size(header->len) bytes after it.
+ *
+ * @param seg       Pointer to the segment
+ * @param offset    Offset of a record, or seg->end
+ *
+ * @return  Pointer to the record's header.
+ *          NULL if offset is seg->end.
+ */
+const struct log_record_header *log_segment_record(const struct log_segment *seg, size_t offset);
+
+/**
+ * Creates an empty segment and its index in a directory, and opens them for appending.
+ *
+ * The writer should be closed with log_segment_writer_close() when no longer needed.
+ *
+ * @param writer    Pointer to the writer
+ * @param dir       Path of the directory, which must exist
+ * @param first_seq Sequence number of the first record which will be appended
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int log_segment_create(struct log_segment_writer *writer, const char *dir, uint64_t first_seq);
+
+/**
+ * Opens an existing segment for appending after its last complete record. A torn record and index entries past the
+ * last complete record are overwritten.
+ *
+ * The writer should be closed with log_segment_writer_close() when no longer needed.
+ *
+ * @param writer    Pointer to the writer
+ * @param dir       Path of the directory holding the segment
+ * @param first_seq Sequence number of the segment's first record
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int log_segment_resume(struct log_segment_writer *writer, const char *dir, uint64_t first_seq);
+
+/**
+ * Appends as many records as the segment has room for, in order, with one pwritev() per LOG_APPEND_MAX records, and
+ * then the index entries they need with one write().
+ *
+ * @param writer    Pointer to the writer
+ * @param entries   Pointer to the records, in ascending order of sequence numbers above writer->last_seq
+ * @param n         Number of records
+ *
+ * @return  Number of records appended, fewer than n once the segment is full.
+ *          -1 on error.
+ */
+ssize_t log_segment_append(struct log_segment_writer *writer, const struct log_entry *entries, size_t n);
+
+/**
+ * Syncs the records appended to a segment, and its index, to the disk.
+ *
+ * @param writer    Pointer to the writer
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int log_segment_sync(struct log_segment_writer *writer);
+
+/**
+ * Closes the files of a segment writer.
+ *
+ * @param writer    Pointer to the writer
+ */
+void log_segment_writer_close(struct log_segment_writer *writer);
+
+#endif
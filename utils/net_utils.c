@@ -1,5 +1,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,8 +18,21 @@ ssize_t sendall(int sockfd, char *buf, size_t len)
     while (total_sent < len)
     {
         sent = send(sockfd, buf + total_sent, len - total_sent, SEND_FLAGS);
-        if (sent == -1)
+        if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
         {
+            // Non-blocking socket with a full send buffer: wait until it drains
+            struct pollfd pfd = {.fd = sockfd, .events = POLLOUT};
+            if (poll(&pfd, 1, -1) == -1 && errno != EINTR)
+            {
+                LOG_ERROR("failed to wait for socket %d to become writable: %s", sockfd, strerror(errno));
+                return -1;
+            }
+            continue;
+        }
+        else if (sent == -1)
+        {
+            if (errno == EINTR)
+                continue;
             LOG_ERROR("failed to send data to socket %d: %s", sockfd, strerror(errno));
             return -1;
         }
@@ -28,49 +43,21 @@ ssize_t sendall(int sockfd, char *buf, size_t len)
     return total_sent;
 }
 
-ssize_t recvall(int sockfd, char **buf)
+/**
+ * Receives exactly len bytes on sockfd into buf, handling partial receives.
+ *
+ * @return  len on success.
+ *          0 when the peer closes the connection.
+ *          -1 on error.
+ */
+static ssize_t recv_exact(int sockfd, char *buf, size_t len)
 {
-    // Get total message length with first receive
-    char *msg = malloc(sizeof(TOTAL_MSG_LEN));
-    if (msg == NULL)
-    {
-        LOG_ERROR("failed to allocate space for buffer");
-        return -1;
-    }
-
-    ssize_t recvd = recv(sockfd, msg, sizeof(TOTAL_MSG_LEN), RECV_FLAGS);
-    if (recvd <= 0)
-    {
-        free(msg);
-        if (recvd == 0 || (recvd == -1 && errno == ECONNRESET)) // 0 = graceful close, -1 with ECONNRESET = abrupt close
-        {
-            LOG_INFO("connection to socket %d terminated", sockfd);
-            return 0;
-        }
-        else
-        {
-            LOG_ERROR("failed to receive data from socket %d: %s", sockfd, strerror(errno));
-            return -1;
-        }
-    }
-
-    TOTAL_MSG_LEN total_len = ntohl(*((TOTAL_MSG_LEN *)msg));
-
-    // Get rest of message with remaining receives
-    msg = realloc(msg, total_len);
-    if (msg == NULL)
-    {
-        LOG_ERROR("failed to reallocate space for buffer");
-        return -1;
-    }
-
-    size_t total_recvd = recvd;
-    while (total_recvd < total_len)
+    size_t total_recvd = 0;
+    while (total_recvd < len)
     {
-        recvd = recv(sockfd, msg + total_recvd, total_len - total_recvd, RECV_FLAGS);
+        ssize_t recvd = recv(sockfd, buf + total_recvd, len - total_recvd, RECV_FLAGS);
         if (recvd <= 0)
         {
-            free(msg);
             if (recvd == 0 || (recvd == -1 && errno == ECONNRESET)) // 0 = graceful close, -1 with ECONNRESET = abrupt close
             {
                 LOG_INFO("connection to socket %d terminated", sockfd);
@@ -85,7 +72,41 @@ ssize_t recvall(int sockfd, char **buf)
         total_recvd += recvd;
     }
 
-    *buf = msg;
-
     return total_recvd;
 }
+
+ssize_t recvall(int sockfd, char *buf, size_t size)
+{
+    // Get total message length with first receive
+    ssize_t recvd = recv_exact(sockfd, buf, sizeof(TOTAL_MSG_LEN));
+    if (recvd <= 0)
+        return recvd;
+
+    TOTAL_MSG_LEN total_len;
+    memcpy(&total_len, buf, sizeof(total_len));
+    total_len = ntohl(total_len);
+    if (total_len < MSG_HEADER_SIZE || total_len > size)
+    {
+        LOG_ERROR("invalid message length %u on socket %d", total_len, sockfd);
+        return -1;
+    }
+
+    // Get rest of message with remaining receives
+    recvd = recv_exact(sockfd, buf + sizeof(TOTAL_MSG_LEN), total_len - sizeof(TOTAL_MSG_LEN));
+    if (recvd <= 0)
+        return recvd;
+
+    return total_len;
+}
+
+int set_nonblocking(int sockfd)
+{
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    if (flags == -1 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+        LOG_ERROR("failed to make socket %d non-blocking: %s", sockfd, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
@@ -9,7 +9,8 @@
 #define RECV_FLAGS 0
 
 /**
- * Sends a message stored in buf on the socket sockfd, handling partial sends so the entire messsage is delivered.
+ * Sends a message stored in buf on the socket sockfd, handling partial sends so the entire messsage is delivered. If
+ * the socket is non-blocking and its send buffer is full, waits for it to drain.
  *
  * @param sockfd    The socket to send the mesage on
  * @param buf       Pointer to a buffer containing the message
@@ -21,17 +22,27 @@
 ssize_t sendall(int sockfd, char *buf, size_t len);
 
 /**
- * Receives a message on sockfd, handling partial receives so the entire message is obtained. Since messages have
- * variable lengths, *buf will be dynamically allocated based on the incoming message's size and should be freed when
- * no longer needed.
+ * Receives a message on sockfd into buf, handling partial receives so the entire message is obtained.
  *
  * @param sockfd    The socket to receive the message on
- * @param buf       Double pointer to a char buffer which will store the message
+ * @param buf       Pointer to a char buffer which will store the message
+ * @param size      Size of buf in bytes, a longer message is an error (MSG_SIZE_LIMIT holds any valid message)
  *
  * @return  Number of bytes received on success.
  *          0 when the peer closes the connection.
  *          -1 on error.
  */
-ssize_t recvall(int sockfd, char **buf);
+ssize_t recvall(int sockfd, char *buf, size_t size);
+
+/**
+ * Puts a socket in non-blocking mode, so receives and sends return immediately instead of waiting for data or buffer
+ * space.
+ *
+ * @param sockfd    The socket
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int set_nonblocking(int sockfd);
 
 #endif
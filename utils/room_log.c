@@ -0,0 +1,1419 @@
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "room_log.h"
+#include "../types/room.h"
+#include "../types/messages/message.h"
+#include "../lib/log.h"
+
+/**
+ * Creates a directory unless it exists.
+ *
+ * @param path  Path of the directory
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int make_dir(const char *path)
+{
+    if (mkdir(path, 0755) == -1 && errno != EEXIST)
+    {
+        LOG_ERROR("failed to create %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Gets the time on CLOCK_MONOTONIC.
+ *
+ * @return  The time in milliseconds.
+ */
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Stops checkpoints after a failed write: a message missing from its room's log is then never released from its WAL.
+ *
+ * @param log   Pointer to the log
+ */
+static void stop_checkpoints(struct room_log *log)
+{
+    if (!log->failed)
+        LOG_ERROR("room log write failed: no more checkpoints, the WALs keep every message from now on");
+    log->failed = true;
+}
+
+/**
+ * Syncs the messages written to the segment of a room's file since it was last synced.
+ *
+ * @param log   Pointer to the log
+ * @param file  Pointer to the file, which is open
+ */
+static void sync_file(struct room_log *log, struct room_log_file *file)
+{
+    if (!file->dirty)
+        return;
+
+    if (log_segment_sync(&file->seg) != 0)
+        stop_checkpoints(log);
+    file->dirty = false;
+}
+
+/**
+ * Frees the writer's file of a room, which is not open. The room's newest segment tells where its log ends when the
+ * writer writes to it again.
+ *
+ * @param log   Pointer to the log
+ * @param file  Pointer to the file
+ */
+static void forget_file(struct room_log *log, struct room_log_file *file)
+{
+    room_map_remove(&log->files, file->id);
+    free(file);
+}
+
+/**
+ * Syncs and closes the segment of a room's file, takes it off the list of open files and frees the file.
+ *
+ * @param log   Pointer to the log
+ * @param file  Pointer to the file, which is open
+ */
+static void close_file(struct room_log *log, struct room_log_file *file)
+{
+    sync_file(log, file);
+    log_segment_writer_close(&file->seg);
+    file->open = false;
+
+    if (file->prev != NULL)
+        file->prev->next = file->next;
+    else
+        log->open_head = file->next;
+    if (file->next != NULL)
+        file->next->prev = file->prev;
+    else
+        log->open_tail = file->prev;
+    log->num_open--;
+    forget_file(log, file);
+}
+
+/**
+ * Moves a room's file to the front of the list of open files, adding it if it was not on the list.
+ *
+ * @param log   Pointer to the log
+ * @param file  Pointer to the file
+ * @param added Whether the file has just been opened and is not on the list yet
+ */
+static void touch_file(struct room_log *log, struct room_log_file *file, bool added)
+{
+    if (!added)
+    {
+        if (log->open_head == file)
+            return;
+        file->prev->next = file->next;
+        if (file->next != NULL)
+            file->next->prev = file->prev;
+        else
+            log->open_tail = file->prev;
+    }
+    else
+        log->num_open++;
+
+    file->prev = NULL;
+    file->next = log->open_head;
+    if (log->open_head != NULL)
+        log->open_head->prev = file;
+    log->open_head = file;
+    if (log->open_tail == NULL)
+        log->open_tail = file;
+}
+
+/**
+ * Opens the newest segment of a room for appending, or creates the room's first segment. The file written to least
+ * recently is closed if too many are open.
+ *
+ * @param log       Pointer to the log
+ * @param file      Pointer to the room's file, which is not open
+ * @param first_seq Sequence number of the next message of the room
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int open_file(struct room_log *log, struct room_log_file *file, uint64_t first_seq)
+{
+    char dir[PATH_MAX];
+    if (room_log_room_dir(log, file->id, dir) != 0 || make_dir(dir) != 0)
+        return -1;
+
+    uint64_t *seqs;
+    size_t n;
+    if (log_segment_list(dir, &seqs, &n) != 0)
+        return -1;
+
+    int status = n == 0 ? log_segment_create(&file->seg, dir, first_seq)
+                        : log_segment_resume(&file->seg, dir, seqs[n - 1]);
+    free(seqs);
+    if (status != 0)
+    {
+        LOG_ERROR("failed to open the log of room %u", file->id);
+        return -1;
+    }
+
+    if (file->seg.last_seq > file->last_seq)
+        file->last_seq = file->seg.last_seq;
+    file->open = true;
+    touch_file(log, file, true);
+    if (log->num_open > ROOM_LOG_MAX_OPEN)
+        close_file(log, log->open_tail);
+
+    return 0;
+}
+
+/**
+ * Finds the writer's file of a room, creating it if the writer has not written to the room yet.
+ *
+ * @param log   Pointer to the log
+ * @param room  Id of the room
+ *
+ * @return  Pointer to the file on success.
+ *          NULL on error.
+ */
+static struct room_log_file *find_file(struct room_log *log, ROOM_ID room)
+{
+    struct room_log_file *file = room_map_find(&log->files, room);
+    if (file != NULL)
+        return file;
+
+    if ((file = calloc(1, sizeof(struct room_log_file))) == NULL)
+    {
+        LOG_ERROR("failed to allocate space for the log of room %u", room);
+        return NULL;
+    }
+    file->id = room;
+    if (room_map_insert(&log->files, room, file) != 0)
+    {
+        LOG_ERROR("failed to add the log of room %u", room);
+        free(file);
+        return NULL;
+    }
+
+    return file;
+}
+
+/**
+ * Appends messages of one room to its log, starting a new segment whenever one is full.
+ *
+ * @param log       Pointer to the log
+ * @param room      Id of the room
+ * @param entries   Pointer to the messages, in ascending order of sequence numbers, which may be overwritten
+ * @param n         Number of messages
+ * @param replayed  Whether the messages are replayed from a WAL, and may be in the log already
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int write_room(struct room_log *log, ROOM_ID room, struct log_entry *entries, size_t n, bool replayed)
+{
+    struct room_log_file *file = find_file(log, room);
+    if (file == NULL)
+        return -1;
+
+    if (!file->open && open_file(log, file, entries[0].seq) != 0)
+    {
+        forget_file(log, file);
+        return -1;
+    }
+    touch_file(log, file, false);
+
+    // A number already in the log means its room was numbered without looking at the log: such messages are dropped
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (entries[i].seq <= file->last_seq)
+        {
+            if (!replayed)
+                LOG_WARN("dropped message %" PRIu64 " of room %u: already in its log", entries[i].seq, room);
+            continue;
+        }
+        entries[len++] = entries[i];
+        file->last_seq = entries[i].seq;
+    }
+
+    struct log_entry *next = entries;
+    while (len > 0)
+    {
+        ssize_t appended = log_segment_append(&file->seg, next, len);
+        if (appended == -1)
+        {
+            LOG_ERROR("failed to write %zu messages to the log of room %u", len, room);
+            return -1;
+        }
+        next += appended;
+        len -= appended;
+        file->dirty = true;
+        atomic_fetch_add_explicit(&log->records, appended, memory_order_relaxed);
+
+        if (len > 0)
+        {
+            char dir[PATH_MAX];
+            sync_file(log, file);
+            log_segment_writer_close(&file->seg);
+            if (room_log_room_dir(log, room, dir) != 0 || log_segment_create(&file->seg, dir, next->seq) != 0)
+            {
+                LOG_ERROR("failed to start a new segment in the log of room %u", room);
+                close_file(log, file);
+                return -1;
+            }
+        }
+    }
+    atomic_fetch_add_explicit(&log->writes, 1, memory_order_relaxed);
+
+    return 0;
+}
+
+/**
+ * Finds the sequence number after the last message in the log of a room on disk, which the newest segment holds.
+ *
+ * @param log   Pointer to the log
+ * @param room  Id of the room
+ *
+ * @return  The sequence number, 1 for a room with no messages.
+ */
+static uint64_t disk_next_seq(struct room_log *log, ROOM_ID room)
+{
+    uint64_t next_seq = 1;
+    char dir[PATH_MAX];
+    uint64_t *seqs;
+    size_t n;
+    if (room_log_room_dir(log, room, dir) != 0 || log_segment_list(dir, &seqs, &n) != 0)
+    {
+        LOG_ERROR("failed to find the last message in the log of room %u", room);
+        return next_seq;
+    }
+    if (n > 0)
+    {
+        struct log_segment seg;
+        next_seq = seqs[n - 1];
+        if (log_segment_open(&seg, dir, seqs[n - 1]) == 0)
+        {
+            if (seg.last_seq >= next_seq)
+                next_seq = seg.last_seq + 1;
+            log_segment_close(&seg);
+        }
+    }
+    free(seqs);
+
+    return next_seq;
+}
+
+/**
+ * Answers a lookup with the number after the last message in its room's log, which the writer's file of the room knows
+ * if its segment is open, and wakes up whoever waits for the answer.
+ *
+ * @param log       Pointer to the log
+ * @param lookup    Pointer to the lookup
+ */
+static void answer_lookup(struct room_log *log, struct room_log_lookup *lookup)
+{
+    struct room_log_file *file = room_map_find(&log->files, lookup->room);
+    uint64_t next_seq = file != NULL ? file->last_seq + 1 : disk_next_seq(log, lookup->room);
+
+    // The lookup may be freed as soon as it is answered, unlike the wakeup
+    struct ring_wakeup *wakeup = lookup->wakeup;
+    pthread_mutex_lock(&log->closed_lock);
+    lookup->forgotten = log->forgotten;
+    pthread_mutex_unlock(&log->closed_lock);
+    atomic_store(&lookup->next_seq, next_seq);
+    if (wakeup != NULL && ring_wakeup_signal(wakeup) != 0)
+        LOG_ERROR("failed to signal that room %u was looked up", lookup->room);
+}
+
+/**
+ * Copies the messages of a segment asked for by a read into its buffer, allocating the buffer for the first one.
+ *
+ * @param seg   Pointer to the segment
+ * @param read  Pointer to the read, whose count, first_seq and next_seq are updated
+ *
+ * @return  1 if the read is complete, with next_seq set.
+ *          0 if it goes on in the next segment.
+ *          -1 on error.
+ */
+static int read_segment(const struct log_segment *seg, struct room_log_read *read)
+{
+    size_t offset = log_segment_find(seg, read->next_seq);
+    const struct log_record_header *header;
+    while ((header = log_segment_record(seg, offset)) != NULL)
+    {
+        if (header->seq >= read->end_seq)
+        {
+            read->next_seq = read->end_seq;
+            return 1;
+        }
+
+        if (read->buf == NULL)
+        {
+            size_t len = header->len > read->max_len ? header->len : read->max_len;
+            if ((read->buf = shared_buffer_alloc(read->reserve + len)) == NULL)
+                return -1;
+            read->buf->len = read->reserve;
+            read->first_seq = header->seq;
+        }
+        else if (read->count == read->max_count || read->buf->len - read->reserve + header->len > read->max_len)
+        {
+            read->next_seq = header->seq;
+            return 1;
+        }
+
+        memcpy(read->buf->data + read->buf->len, (const char *)(header + 1), header->len);
+        read->buf->len += header->len;
+        if (read->seqs != NULL)
+            read->seqs[read->count] = header->seq;
+        read->count++;
+        read->next_seq = header->seq + 1;
+        offset += log_record_size(header->len);
+    }
+
+    return 0;
+}
+
+/**
+ * Answers a read with a run of its room's messages, found in the segment which may hold the first one with the
+ * segment's sparse index and copied out of the mapped segments, and wakes up whoever waits for the answer. Every
+ * message queued before the read is written, so the segments are complete.
+ *
+ * @param log   Pointer to the log
+ * @param read  Pointer to the read
+ */
+static void answer_read(struct room_log *log, struct room_log_read *read)
+{
+    read->buf = NULL;
+    read->count = 0;
+    read->next_seq = read->from_seq;
+
+    char dir[PATH_MAX];
+    uint64_t *seqs = NULL;
+    size_t n = 0;
+    int status = 0;
+    if (read->max_count > 0 && read->from_seq < read->end_seq &&
+        (room_log_room_dir(log, read->room, dir) != 0 || log_segment_list(dir, &seqs, &n) != 0))
+        status = -1;
+
+    // Start from the newest segment whose first message is not past the one wanted, or the oldest if there is none
+    size_t i = n;
+    while (i > 1 && seqs[i - 1] > read->from_seq)
+        i--;
+    for (i = i > 0 ? i - 1 : 0; status == 0 && i < n && seqs[i] < read->end_seq; i++)
+    {
+        struct log_segment seg;
+        if (log_segment_open(&seg, dir, seqs[i]) != 0)
+        {
+            status = -1;
+            break;
+        }
+        status = read_segment(&seg, read);
+        log_segment_close(&seg);
+    }
+    free(seqs);
+
+    if (status == -1)
+        LOG_ERROR("failed to read messages %" PRIu64 " on from the log of room %u", read->next_seq, read->room);
+    if (status != 1)
+        read->next_seq = read->end_seq;
+    if (read->count == 0)
+        read->first_seq = read->next_seq;
+
+    // The read may be freed as soon as it is answered, unlike the wakeup
+    struct ring_wakeup *wakeup = read->wakeup;
+    ROOM_ID room = read->room;
+    atomic_store(&read->done, true);
+    if (wakeup != NULL && ring_wakeup_signal(wakeup) != 0)
+        LOG_ERROR("failed to signal that the log of room %u was read", room);
+}
+
+/**
+ * Orders messages by room, then by sequence number, for qsort().
+ */
+static int compare_msgs(const void *a, const void *b)
+{
+    const struct room_log_msg *x = a;
+    const struct room_log_msg *y = b;
+
+    if (x->room != y->room)
+        return (x->room > y->room) - (x->room < y->room);
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/**
+ * Notes that a room closed, so the next checkpoint forgets its state if the room is still closed with the same number.
+ *
+ * @param log       Pointer to the log
+ * @param room      Id of the room
+ * @param next_seq  Sequence number the room's next message would have got
+ */
+static void note_closing(struct room_log *log, ROOM_ID room, uint64_t next_seq)
+{
+    if (log->num_closing == log->closing_cap)
+    {
+        size_t cap = log->closing_cap == 0 ? 64 : 2 * log->closing_cap;
+        struct room_log_closing *closing = realloc(log->closing, cap * sizeof(struct room_log_closing));
+        if (closing == NULL)
+        {
+            LOG_ERROR("failed to allocate space to note that room %u closed", room);
+            return;
+        }
+        log->closing = closing;
+        log->closing_cap = cap;
+    }
+    log->closing[log->num_closing++] = (struct room_log_closing){room, next_seq};
+}
+
+/**
+ * Writes a batch of messages taken from the queue, one run per room, and releases them. Each WAL's messages come off
+ * the queue in the WAL's order, so once the batch is written, so is every message of each WAL up to its last one.
+ * A room's close comes after its messages, and sorts after them as it carries the room's next number. Lookups and
+ * reads are answered last, once every message queued before them is written.
+ *
+ * @param log   Pointer to the log
+ * @param msgs  Pointer to the messages
+ * @param n     Number of messages
+ */
+static void write_batch(struct room_log *log, struct room_log_msg *msgs, size_t n)
+{
+    qsort(msgs, n, sizeof(struct room_log_msg), compare_msgs);
+
+    struct log_entry entries[ROOM_LOG_BATCH];
+    for (size_t start = 0, end; start < n; start = end)
+    {
+        size_t len = 0;
+        for (end = start; end < n && msgs[end].room == msgs[start].room; end++)
+        {
+            if (msgs[end].buf != NULL)
+                entries[len++] = (struct log_entry){msgs[end].seq, msgs[end].buf->data, msgs[end].buf->len};
+            else if (msgs[end].lookup == NULL && msgs[end].read == NULL)
+                note_closing(log, msgs[end].room, msgs[end].seq);
+        }
+        if (len > 0 && write_room(log, msgs[start].room, entries, len, false) != 0)
+            stop_checkpoints(log);
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (msgs[i].source >= 0 && msgs[i].source < log->num_sources && msgs[i].lsn > log->written[msgs[i].source])
+            log->written[msgs[i].source] = msgs[i].lsn;
+        if (msgs[i].buf != NULL)
+            shared_buffer_unref(msgs[i].buf);
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (msgs[i].lookup != NULL)
+            answer_lookup(log, msgs[i].lookup);
+        if (msgs[i].read != NULL)
+            answer_read(log, msgs[i].read);
+    }
+
+    if (!log->unsynced)
+        log->checkpoint_ms = now_ms() + ROOM_LOG_CHECKPOINT_MS;
+    log->unsynced = true;
+}
+
+/**
+ * Frees what the log keeps of a room.
+ *
+ * @param state Pointer to the room's state
+ */
+static void free_room(struct room_log_room *state)
+{
+    free(state->history);
+    free(state);
+}
+
+/**
+ * Forgets the state of the rooms seen closing which are still closed with no history and the number they closed with:
+ * every message they had is synced in their logs, which tell their next number from now on.
+ *
+ * @param log   Pointer to the log
+ */
+static void forget_closed_rooms(struct room_log *log)
+{
+    bool forgot = false;
+    pthread_mutex_lock(&log->closed_lock);
+    for (size_t i = 0; i < log->num_closing; i++)
+    {
+        ROOM_ID room = log->closing[i].room;
+        struct room_log_room *state = room_map_find(&log->closed, room);
+        if (state != NULL && state->count == 0 && state->next_seq == log->closing[i].next_seq)
+        {
+            free_room(room_map_remove(&log->closed, room));
+            forgot = true;
+        }
+    }
+    if (forgot)
+        log->forgotten++;
+    pthread_mutex_unlock(&log->closed_lock);
+    log->num_closing = 0;
+}
+
+/**
+ * Syncs every segment written to since the last checkpoint and publishes the LSNs of the WALs up to which every
+ * message is now synced. The state of the rooms which closed before is forgotten, unless a write failed.
+ *
+ * @param log   Pointer to the log
+ */
+static void checkpoint(struct room_log *log)
+{
+    for (struct room_log_file *file = log->open_head; file != NULL; file = file->next)
+        sync_file(log, file);
+    log->unsynced = false;
+
+    if (log->failed)
+    {
+        log->num_closing = 0;
+        return;
+    }
+    for (int i = 0; i < log->num_sources; i++)
+        atomic_store(&log->checkpoints[i], log->written[i]);
+    atomic_fetch_add_explicit(&log->syncs, 1, memory_order_relaxed);
+    forget_closed_rooms(log);
+}
+
+/**
+ * Runs the writer thread: writes the messages in the queue, then sleeps until more are pushed or a checkpoint is due.
+ *
+ * @param arg   Pointer to the log
+ *
+ * @return  Nothing.
+ */
+static void *run_writer(void *arg)
+{
+    struct room_log *log = arg;
+    struct room_log_msg batch[ROOM_LOG_BATCH];
+
+    while (1)
+    {
+        ring_wakeup_clear(&log->wakeup);
+
+        // A checkpoint falls due between batches too, or a queue which never empties would hold it off
+        size_t n;
+        while ((n = mpsc_ring_pop_batch(log->queue, batch, ROOM_LOG_BATCH)) > 0)
+        {
+            write_batch(log, batch, n);
+            if (now_ms() >= log->checkpoint_ms)
+                checkpoint(log);
+        }
+
+        int timeout = -1;
+        if (log->unsynced)
+        {
+            uint64_t now = now_ms();
+            if (now >= log->checkpoint_ms)
+                checkpoint(log);
+            else
+                timeout = (int)(log->checkpoint_ms - now);
+        }
+
+        if (atomic_load(&log->stopping))
+            break;
+
+        struct pollfd pfd = {.fd = log->wakeup.fd, .events = POLLIN};
+        if (poll(&pfd, 1, timeout) == -1 && errno != EINTR)
+            LOG_ERROR("failed to wait for messages to log: %s", strerror(errno));
+    }
+
+    if (log->unsynced)
+        checkpoint(log);
+
+    return NULL;
+}
+
+/**
+ * Gets the length of a frame from the length it starts with.
+ *
+ * @param frame Pointer to the frame
+ *
+ * @return  Length of the frame in bytes.
+ */
+static size_t frame_len(const char *frame)
+{
+    TOTAL_MSG_LEN len;
+    memcpy(&len, frame, sizeof(len));
+    return ntohl(len);
+}
+
+/**
+ * Keeps the state of a room which is not open, in place of what was kept of it. The caller holds closed_lock, unless
+ * no other thread uses the log yet.
+ *
+ * @param log   Pointer to the log
+ * @param room  Id of the room
+ * @param state Pointer to the room's state, which belongs to the log afterwards
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int keep_room(struct room_log *log, ROOM_ID room, struct room_log_room *state)
+{
+    struct room_log_room *old = room_map_find(&log->closed, room);
+    if (old != NULL)
+    {
+        room_map_remove(&log->closed, room);
+        free_room(old);
+    }
+
+    if (room_map_insert(&log->closed, room, state) != 0)
+    {
+        LOG_ERROR("failed to remember the state of room %u", room);
+        free_room(state);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Checks that a history read back from a snapshot is made of count whole frames.
+ *
+ * @param history   Pointer to the frames
+ * @param len       Length of the frames in bytes
+ * @param count     Number of frames
+ *
+ * @return  true if the history is valid.
+ */
+static bool history_valid(const char *history, size_t len, size_t count)
+{
+    size_t offset = 0;
+    for (; count > 0 && len - offset >= MSG_HEADER_SIZE; count--)
+    {
+        size_t frame = frame_len(history + offset);
+        if (frame < MSG_HEADER_SIZE || frame > len - offset)
+            return false;
+        offset += frame;
+    }
+
+    return count == 0 && offset == len;
+}
+
+/**
+ * Finds where the newest frames of a history which fit in a number of bytes start.
+ *
+ * @param history   Pointer to the frames, which are valid
+ * @param len       Length of the frames in bytes
+ * @param count     Pointer to the number of frames, which will store the number of frames kept
+ * @param limit     Most bytes kept
+ *
+ * @return  Offset of the first frame kept, len if none is.
+ */
+static size_t trim_history(const char *history, size_t len, size_t *count, size_t limit)
+{
+    size_t offset = 0;
+    for (; len - offset > limit; (*count)--)
+        offset += frame_len(history + offset);
+
+    return offset;
+}
+
+/**
+ * Restores the state of a room saved in a snapshot, keeping the newest frames of its history which fit in the log's
+ * history limit. A room closed while the snapshot was taken may be in it twice, and its newest state wins.
+ *
+ * @param log   Pointer to the log
+ * @param room  Pointer to the room in the snapshot
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int restore_room(struct room_log *log, const struct snapshot_room *room)
+{
+    struct room_log_room *old = room_map_find(&log->closed, room->id);
+    if (old != NULL && old->next_seq >= room->next_seq)
+        return 0;
+
+    const char *history = (const char *)(room + 1);
+    size_t count = room->count;
+    size_t offset = room->len;
+    if (!history_valid(history, room->len, count))
+        LOG_WARN("dropped the history of room %u: damaged in the snapshot", room->id);
+    else
+        offset = trim_history(history, room->len, &count, log->history_limit);
+
+    struct room_log_room *state = calloc(1, sizeof(struct room_log_room));
+    if (state == NULL || (offset < room->len && (state->history = malloc(room->len - offset)) == NULL))
+    {
+        LOG_ERROR("failed to allocate space for the state of room %u", room->id);
+        free(state);
+        return -1;
+    }
+    state->next_seq = room->next_seq;
+    if (offset < room->len)
+    {
+        memcpy(state->history, history + offset, room->len - offset);
+        state->len = room->len - offset;
+        state->count = count;
+    }
+
+    return keep_room(log, room->id, state);
+}
+
+/**
+ * Maps the segments of a WAL holding records from an LSN on, and adds those records to what recovery replays.
+ *
+ * @param recovery  Pointer to what recovery reads back
+ * @param dir       Path of the directory holding the segments
+ * @param from      LSN of the first record to replay
+ * @param next_lsn  Pointer which will store the LSN the WAL carries on from when it is opened again
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int read_wal(struct room_log_recovery *recovery, const char *dir, uint64_t from, uint64_t *next_lsn)
+{
+    uint64_t *lsns;
+    size_t n;
+    if (wal_list_segments(dir, &lsns, &n) != 0)
+        return -1;
+    *next_lsn = n > 0 ? lsns[n - 1] + WAL_SEGMENT_SIZE : 0;
+
+    int status = 0;
+    for (size_t i = 0; i < n && status == 0; i++)
+    {
+        // A segment's records end where the next segment's start
+        if (i + 1 < n && lsns[i + 1] <= from)
+            continue;
+
+        if (recovery->num_segments == recovery->segments_cap)
+        {
+            size_t cap = recovery->segments_cap == 0 ? 16 : 2 * recovery->segments_cap;
+            struct wal_segment *segments = realloc(recovery->segments, cap * sizeof(struct wal_segment));
+            if (segments == NULL)
+            {
+                LOG_ERROR("failed to allocate space for the segments of %s", dir);
+                status = -1;
+                break;
+            }
+            recovery->segments = segments;
+            recovery->segments_cap = cap;
+        }
+        struct wal_segment *seg = &recovery->segments[recovery->num_segments];
+        if (wal_segment_open(seg, dir, lsns[i]) != 0)
+        {
+            status = -1;
+            break;
+        }
+        recovery->num_segments++;
+
+        const struct wal_record_header *header;
+        for (size_t offset = from > seg->lsn ? from - seg->lsn : 0; (header = wal_segment_record(seg, offset)) != NULL;
+             offset += wal_record_size(header->len))
+        {
+            if (recovery->num_records == recovery->records_cap)
+            {
+                size_t cap = recovery->records_cap == 0 ? 4096 : 2 * recovery->records_cap;
+                struct room_log_replayed *records = realloc(recovery->records, cap * sizeof(struct room_log_replayed));
+                if (records == NULL)
+                {
+                    LOG_ERROR("failed to allocate space for the records of %s", dir);
+                    status = -1;
+                    break;
+                }
+                recovery->records = records;
+                recovery->records_cap = cap;
+            }
+            recovery->records[recovery->num_records++] =
+                (struct room_log_replayed){header->room, header->seq, (const char *)(header + 1), header->len};
+        }
+    }
+    free(lsns);
+
+    return status;
+}
+
+/**
+ * Orders replayed records by room, then by sequence number, for qsort().
+ */
+static int compare_replayed(const void *a, const void *b)
+{
+    const struct room_log_replayed *x = a;
+    const struct room_log_replayed *y = b;
+
+    if (x->room != y->room)
+        return (x->room > y->room) - (x->room < y->room);
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/**
+ * Replays the records of one room read back from the WALs: those past the room's state move its numbering on, and the
+ * newest frames which fit in the history limit make up its history: the records past the state, the state's history,
+ * then the records before it, for as long as they follow on. Any records missing from the room's log are written to it.
+ *
+ * @param log       Pointer to the log
+ * @param records   Pointer to the records, in ascending order of sequence numbers
+ * @param n         Number of records
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int replay_room(struct room_log *log, const struct room_log_replayed *records, size_t n)
+{
+    ROOM_ID room = records[0].room;
+    struct room_log_room *state = room_map_find(&log->closed, room);
+    if (state == NULL)
+    {
+        if ((state = calloc(1, sizeof(struct room_log_room))) == NULL)
+        {
+            LOG_ERROR("failed to allocate space for the state of room %u", room);
+            return -1;
+        }
+        state->next_seq = disk_next_seq(log, room);
+        if (keep_room(log, room, state) != 0)
+            return -1;
+    }
+
+    // Records [older, newer) are in the state's history already
+    uint64_t first_seq = state->next_seq - state->count;
+    size_t older = 0;
+    while (older < n && records[older].seq < first_seq)
+        older++;
+    size_t newer = older;
+    while (newer < n && records[newer].seq < state->next_seq)
+        newer++;
+
+    size_t keep_new = n;
+    size_t bytes = 0;
+    while (keep_new > newer && bytes + records[keep_new - 1].len <= log->history_limit)
+        bytes += records[--keep_new].len;
+    size_t count = 0;
+    size_t offset = state->len;
+    size_t keep_old = older;
+    if (keep_new == newer)
+    {
+        count = state->count;
+        offset = trim_history(state->history, state->len, &count, log->history_limit - bytes);
+        bytes += state->len - offset;
+        for (uint64_t seq = first_seq; offset == 0 && keep_old > 0 && records[keep_old - 1].seq + 1 == seq &&
+                                       bytes + records[keep_old - 1].len <= log->history_limit;
+             seq--)
+            bytes += records[--keep_old].len;
+    }
+
+    if (keep_new < n || keep_old < older)
+    {
+        char *history = malloc(bytes);
+        if (history == NULL)
+        {
+            LOG_ERROR("failed to allocate space for the history of room %u", room);
+            return -1;
+        }
+        size_t len = 0;
+        for (size_t i = keep_old; i < older; i++, len += records[i - 1].len)
+            memcpy(history + len, records[i].data, records[i].len);
+        if (state->len > offset)
+            memcpy(history + len, state->history + offset, state->len - offset);
+        len += state->len - offset;
+        for (size_t i = keep_new; i < n; i++, len += records[i - 1].len)
+            memcpy(history + len, records[i].data, records[i].len);
+        free(state->history);
+        state->history = history;
+        state->len = len;
+        state->count = (older - keep_old) + count + (n - keep_new);
+    }
+    if (newer < n)
+        state->next_seq = records[n - 1].seq + 1;
+
+    struct log_entry entries[ROOM_LOG_BATCH];
+    for (size_t start = 0; start < n; start += ROOM_LOG_BATCH)
+    {
+        size_t count = n - start < ROOM_LOG_BATCH ? n - start : ROOM_LOG_BATCH;
+        for (size_t i = 0; i < count; i++)
+            entries[i] = (struct log_entry){records[start + i].seq, records[start + i].data, records[start + i].len};
+        if (write_room(log, room, entries, count, true) != 0)
+        {
+            stop_checkpoints(log);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Lists the WALs in the log's directory, by the indexes of the reactors they belong to.
+ *
+ * @param log       Pointer to the log
+ * @param sources   Double pointer which will store an array of the indexes, which the caller frees with free()
+ * @param n         Pointer which will store the number of WALs
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int list_wals(const struct room_log *log, int **sources, size_t *n)
+{
+    *sources = NULL;
+    *n = 0;
+
+    char path[PATH_MAX];
+    if (snprintf(path, PATH_MAX, "%s/wal", log->dir) >= PATH_MAX)
+    {
+        LOG_ERROR("path of the WALs in %s too long", log->dir);
+        return -1;
+    }
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        if (errno == ENOENT)
+            return 0;
+        LOG_ERROR("failed to open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    size_t cap = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        size_t len = strlen(entry->d_name);
+        if (len == 0 || len > 9 || strspn(entry->d_name, "0123456789") != len)
+            continue;
+
+        if (*n == cap)
+        {
+            cap = cap == 0 ? 16 : 2 * cap;
+            int *grown = realloc(*sources, cap * sizeof(int));
+            if (grown == NULL)
+            {
+                LOG_ERROR("failed to allocate space for the WALs in %s", path);
+                free(*sources);
+                closedir(dir);
+                return -1;
+            }
+            *sources = grown;
+        }
+        (*sources)[(*n)++] = atoi(entry->d_name);
+    }
+    closedir(dir);
+
+    return 0;
+}
+
+/**
+ * Builds the path of the directory holding the WAL of a reactor.
+ *
+ * @param log       Pointer to the log
+ * @param source    Index of the reactor
+ * @param path      Pointer to a buffer of PATH_MAX bytes which will store the path
+ *
+ * @return  0 on success.
+ *          -1 if the path is too long.
+ */
+static int wal_dir(const struct room_log *log, int source, char *path)
+{
+    if (snprintf(path, PATH_MAX, "%s/wal/%d", log->dir, source) >= PATH_MAX)
+    {
+        LOG_ERROR("path of WAL %d in %s too long", source, log->dir);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Recovers the rooms' state from the newest snapshot and the tails of the WALs past it, writes the messages the WALs
+ * hold and the rooms' logs miss, syncs them, and saves the state in a new snapshot. The WALs of reactors beyond
+ * num_sources, which no reactor will release, are then deleted. Runs before the writer thread starts.
+ *
+ * @param log   Pointer to the log
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int recover(struct room_log *log)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    char path[PATH_MAX];
+    struct snapshot snap;
+    if (room_log_snapshot_dir(log, path) != 0 || snapshot_open(&snap, path) != 0)
+        return -1;
+
+    int status = -1;
+    struct room_log_recovery recovery = {0};
+    int *sources = NULL;
+    size_t num_sources = 0;
+    for (size_t offset = snap.rooms, i = 0; i < snap.num_rooms; i++)
+    {
+        const struct snapshot_room *room = snapshot_room(&snap, offset);
+        if (room == NULL)
+        {
+            LOG_ERROR("snapshot %" PRIu64 " ends before its %" PRIu64 " rooms", snap.number, snap.num_rooms);
+            goto done;
+        }
+        if (restore_room(log, room) != 0)
+            goto done;
+        offset += snapshot_room_size(room->len);
+    }
+    log->recovered_rooms = snap.num_rooms;
+
+    // The tail of each WAL starts where the snapshot says, or at its start if the snapshot predates it
+    if (list_wals(log, &sources, &num_sources) != 0)
+        goto done;
+    for (size_t i = 0; i < num_sources; i++)
+    {
+        uint64_t from = snap.map != NULL && (uint32_t)sources[i] < snap.num_sources ? snap.lsns[sources[i]] : 0;
+        uint64_t next_lsn;
+        if (wal_dir(log, sources[i], path) != 0 || read_wal(&recovery, path, from, &next_lsn) != 0)
+            goto done;
+        if (sources[i] < log->num_sources)
+            log->written[sources[i]] = next_lsn;
+    }
+
+    // Each room's records are replayed in order, whichever WALs they come from
+    qsort(recovery.records, recovery.num_records, sizeof(struct room_log_replayed), compare_replayed);
+    for (size_t start = 0, end; start < recovery.num_records; start = end)
+    {
+        for (end = start + 1; end < recovery.num_records && recovery.records[end].room == recovery.records[start].room;
+             end++)
+            ;
+        if (replay_room(log, &recovery.records[start], end - start) != 0)
+            goto done;
+    }
+    log->replayed = recovery.num_records;
+
+    // Every message of the old WALs is now synced in the rooms' logs, and the new WALs start past them. The rooms left
+    // with no history are forgotten by the checkpoint, as their logs tell their next number from then on.
+    for (size_t i = 0; i < log->closed.cap; i++)
+    {
+        struct room_log_room *state = log->closed.slots[i].value;
+        if (log->closed.slots[i].id != INVALID_ROOM && state->count == 0)
+            note_closing(log, log->closed.slots[i].id, state->next_seq);
+    }
+    checkpoint(log);
+    if (log->failed)
+    {
+        LOG_ERROR("failed to write the messages recovered from the WALs: the WALs are kept");
+        status = 0;
+        goto done;
+    }
+
+    struct snapshot_writer writer;
+    if (room_log_snapshot_dir(log, path) != 0 ||
+        snapshot_writer_begin(&writer, path, log->num_sources, log->written) != 0)
+        goto done;
+    if (room_log_snapshot_rooms(log, &writer) != 0)
+    {
+        snapshot_writer_abort(&writer);
+        goto done;
+    }
+    if (snapshot_writer_commit(&writer) != 0)
+        goto done;
+    room_log_snapshot_taken(log, log->written);
+
+    for (size_t i = 0; i < num_sources; i++)
+        if (sources[i] >= log->num_sources && wal_dir(log, sources[i], path) == 0)
+            wal_remove(path);
+    status = 0;
+
+done:
+    for (size_t i = 0; i < recovery.num_segments; i++)
+        wal_segment_close(&recovery.segments[i]);
+    free(recovery.segments);
+    free(recovery.records);
+    free(sources);
+    snapshot_close(&snap);
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    log->recovery_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    return status;
+}
+
+/**
+ * Closes the files of a log and frees the state it keeps of the rooms.
+ *
+ * @param log   Pointer to the log
+ */
+static void free_rooms(struct room_log *log)
+{
+    free(log->closing);
+
+    for (size_t i = 0; i < log->files.cap; i++)
+        if (log->files.slots[i].id != INVALID_ROOM)
+        {
+            struct room_log_file *file = log->files.slots[i].value;
+            if (file->open)
+                log_segment_writer_close(&file->seg);
+            free(file);
+        }
+    room_map_free(&log->files);
+
+    for (size_t i = 0; i < log->closed.cap; i++)
+        if (log->closed.slots[i].id != INVALID_ROOM)
+            free_room(log->closed.slots[i].value);
+    room_map_free(&log->closed);
+}
+
+/**
+ * Pushes a message to the writer's queue, waiting for room in the queue if it is full, and wakes the writer up.
+ *
+ * @param log   Pointer to the log
+ * @param msg   Pointer to the message
+ */
+static void push_msg(struct room_log *log, const struct room_log_msg *msg)
+{
+    if (mpsc_ring_push(log->queue, msg) != 0)
+    {
+        atomic_fetch_add_explicit(&log->stalls, 1, memory_order_relaxed);
+        do
+        {
+            ring_wakeup_signal(&log->wakeup);
+            sched_yield();
+        } while (mpsc_ring_push(log->queue, msg) != 0);
+    }
+
+    if (ring_wakeup_signal(&log->wakeup) != 0)
+        LOG_ERROR("failed to wake up the room log writer");
+}
+
+struct room_log *room_log_init(const char *dir, int num_sources, size_t history_limit)
+{
+    struct room_log *log = calloc(1, sizeof(struct room_log));
+    if (log == NULL)
+    {
+        LOG_ERROR("failed to allocate space for the room log");
+        return NULL;
+    }
+
+    log->num_sources = num_sources;
+    log->history_limit = history_limit;
+    log->written = calloc(num_sources, sizeof(uint64_t));
+    log->checkpoints = calloc(num_sources, sizeof(atomic_uint_fast64_t));
+    log->snapshots = calloc(num_sources, sizeof(atomic_uint_fast64_t));
+    if (log->written == NULL || log->checkpoints == NULL || log->snapshots == NULL)
+    {
+        LOG_ERROR("failed to allocate space for the room log checkpoints");
+        goto free_log;
+    }
+    for (int i = 0; i < num_sources; i++)
+    {
+        atomic_init(&log->checkpoints[i], 0);
+        atomic_init(&log->snapshots[i], 0);
+    }
+
+    if ((log->dir = strdup(dir)) == NULL || make_dir(dir) != 0)
+        goto free_log;
+
+    if ((log->queue = mpsc_ring_init(ROOM_LOG_QUEUE_CAPACITY, sizeof(struct room_log_msg))) == NULL)
+    {
+        LOG_ERROR("failed to initialize the room log queue");
+        goto free_log;
+    }
+
+    if (ring_wakeup_init(&log->wakeup) != 0)
+    {
+        LOG_ERROR("failed to create the room log wakeup fd");
+        goto free_queue;
+    }
+
+    if (room_map_init(&log->closed) != 0 || room_map_init(&log->files) != 0)
+    {
+        LOG_ERROR("failed to initialize the room log maps");
+        room_map_free(&log->closed);
+        goto free_wakeup;
+    }
+    pthread_mutex_init(&log->closed_lock, NULL);
+    atomic_init(&log->stopping, false);
+
+    if (recover(log) != 0)
+    {
+        LOG_ERROR("failed to recover the rooms from %s", dir);
+        goto free_rooms;
+    }
+
+    int status = pthread_create(&log->thread, NULL, run_writer, log);
+    if (status != 0)
+    {
+        LOG_ERROR("failed to start the room log writer: %s", strerror(status));
+        goto free_rooms;
+    }
+
+    return log;
+
+free_rooms:
+    pthread_mutex_destroy(&log->closed_lock);
+    free_rooms(log);
+free_wakeup:
+    ring_wakeup_free(&log->wakeup);
+free_queue:
+    mpsc_ring_free(log->queue);
+free_log:
+    free(log->snapshots);
+    free(log->checkpoints);
+    free(log->written);
+    free(log->dir);
+    free(log);
+    return NULL;
+}
+
+void room_log_free(struct room_log *log)
+{
+    atomic_store(&log->stopping, true);
+    ring_wakeup_signal(&log->wakeup);
+    pthread_join(log->thread, NULL);
+
+    free_rooms(log);
+    pthread_mutex_destroy(&log->closed_lock);
+    ring_wakeup_free(&log->wakeup);
+    mpsc_ring_free(log->queue);
+    free(log->snapshots);
+    free(log->checkpoints);
+    free(log->written);
+    free(log->dir);
+    free(log);
+}
+
+void room_log_append(struct room_log *log, ROOM_ID room, uint64_t seq, struct shared_buffer *buf, int source,
+                     uint64_t lsn)
+{
+    struct room_log_msg msg = {room, seq, shared_buffer_ref(buf), source, lsn, NULL, NULL};
+    push_msg(log, &msg);
+}
+
+int room_log_open_room(struct room_log *log, ROOM_ID room, struct history_ring *history,
+                       const struct room_log_lookup *lookup)
+{
+    pthread_mutex_lock(&log->closed_lock);
+    struct room_log_room *state = room_map_find(&log->closed, room);
+    if (state != NULL)
+        room_map_remove(&log->closed, room);
+    bool answered = lookup != NULL && atomic_load(&lookup->next_seq) != 0 && lookup->forgotten == log->forgotten;
+    pthread_mutex_unlock(&log->closed_lock);
+
+    // Not open since its last message was synced, nor recovered: the room's log on disk is complete. A room forgotten
+    // after the lookup was answered may have had messages past it.
+    if (state == NULL)
+    {
+        if (!answered)
+            return 1;
+        history->next_seq = atomic_load(&lookup->next_seq);
+        return 0;
+    }
+
+    // The frames are numbered as the newest ones before the room's next number, which they are unless some were lost
+    history->next_seq = state->next_seq > state->count ? state->next_seq - state->count : 1;
+    for (size_t offset = 0; offset < state->len; offset += frame_len(state->history + offset))
+        history_ring_append(history, state->history + offset, frame_len(state->history + offset));
+    history->next_seq = state->next_seq;
+    free_room(state);
+
+    return 0;
+}
+
+void room_log_lookup(struct room_log *log, struct room_log_lookup *lookup)
+{
+    atomic_store(&lookup->next_seq, 0);
+    struct room_log_msg msg = {lookup->room, 0, NULL, -1, 0, lookup, NULL};
+    push_msg(log, &msg);
+}
+
+void room_log_read(struct room_log *log, struct room_log_read *read)
+{
+    atomic_store(&read->done, false);
+    struct room_log_msg msg = {read->room, 0, NULL, -1, 0, NULL, read};
+    push_msg(log, &msg);
+}
+
+void room_log_close_room(struct room_log *log, ROOM_ID room, uint64_t next_seq)
+{
+    struct room_log_room *state = calloc(1, sizeof(struct room_log_room));
+    if (state == NULL)
+    {
+        LOG_ERROR("failed to remember the next sequence number of room %u", room);
+        return;
+    }
+    state->next_seq = next_seq;
+
+    pthread_mutex_lock(&log->closed_lock);
+    int status = keep_room(log, room, state);
+    pthread_mutex_unlock(&log->closed_lock);
+
+    // The writer forgets the state once it has synced the messages queued before
+    struct room_log_msg msg = {room, next_seq, NULL, -1, 0, NULL, NULL};
+    if (status == 0)
+        push_msg(log, &msg);
+}
+
+uint64_t room_log_checkpoint(struct room_log *log, int source)
+{
+    return atomic_load(&log->checkpoints[source]);
+}
+
+uint64_t room_log_replay_lsn(struct room_log *log, int source)
+{
+    uint64_t checkpoint = atomic_load(&log->checkpoints[source]);
+    uint64_t snapshot = atomic_load(&log->snapshots[source]);
+    return checkpoint < snapshot ? checkpoint : snapshot;
+}
+
+int room_log_snapshot_rooms(struct room_log *log, struct snapshot_writer *writer)
+{
+    int status = 0;
+    pthread_mutex_lock(&log->closed_lock);
+    for (size_t i = 0; i < log->closed.cap && status == 0; i++)
+    {
+        if (log->closed.slots[i].id == INVALID_ROOM)
+            continue;
+
+        struct room_log_room *state = log->closed.slots[i].value;
+        char *history =
+            snapshot_writer_add_room(writer, log->closed.slots[i].id, state->next_seq, state->count, state->len);
+        if (history == NULL)
+            status = -1;
+        else if (state->len > 0)
+            memcpy(history, state->history, state->len);
+    }
+    pthread_mutex_unlock(&log->closed_lock);
+
+    return status;
+}
+
+void room_log_snapshot_taken(struct room_log *log, const uint64_t *lsns)
+{
+    for (int i = 0; i < log->num_sources; i++)
+        atomic_store(&log->snapshots[i], lsns[i]);
+}
+
+int room_log_snapshot_dir(const struct room_log *log, char *path)
+{
+    if (snprintf(path, PATH_MAX, "%s/snapshot", log->dir) >= PATH_MAX)
+    {
+        LOG_ERROR("path of the snapshots in %s too long", log->dir);
+        return -1;
+    }
+
+    return 0;
+}
+
+int room_log_room_dir(const struct room_log *log, ROOM_ID room, char *path)
+{
+    if (snprintf(path, PATH_MAX, "%s/%u", log->dir, room) >= PATH_MAX)
+    {
+        LOG_ERROR("path of the log of room %u too long", room);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,334 @@
+#ifndef ROOM_LOG_H
+#define ROOM_LOG_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "log_segment.h"
+#include "snapshot.h"
+#include "wal.h"
+#include "../data_structures/history_ring.h"
+#include "../data_structures/mpsc_ring.h"
+#include "../data_structures/ring_wakeup.h"
+#include "../data_structures/room_map.h"
+#include "../data_structures/shared_buffer.h"
+#include "../types/messages/join_message.h"
+
+#define ROOM_LOG_QUEUE_CAPACITY 65536 // Most messages waiting for the writer thread
+#define ROOM_LOG_BATCH 256            // Most messages the writer thread takes from its queue at a time
+#define ROOM_LOG_MAX_OPEN 128         // Most rooms whose current segment the writer thread keeps open
+#define ROOM_LOG_CHECKPOINT_MS 1000   // Most milliseconds messages written stay unsynced
+
+// A lookup of the number after the last message in a room's log on disk, which the writer thread answers so that
+// opening a room the log keeps nothing of does not read the disk
+struct room_log_lookup
+{
+    ROOM_ID room;
+    struct ring_wakeup *wakeup;    // Signalled once the lookup is answered, NULL for none
+    atomic_uint_fast64_t next_seq; // The number, 0 until the lookup is answered
+    uint64_t forgotten;            // Number of times the log had forgotten closed rooms when the lookup was answered
+};
+
+// A read of a run of a room's messages from its log on disk, which the writer thread answers so that reading them
+// never blocks the thread asking
+struct room_log_read
+{
+    ROOM_ID room;
+    uint64_t from_seq;          // Sequence number of the first message wanted
+    uint64_t end_seq;           // Sequence number past the last message wanted
+    size_t max_count;           // Most messages read
+    size_t max_len;             // Most bytes of messages read, unless the first message alone is longer
+    size_t reserve;             // Bytes left free at the start of buf, for whoever asked to fill in
+    uint64_t *seqs;             // Array of max_count entries which will store the number of each message read, or NULL
+    struct ring_wakeup *wakeup; // Signalled once the read is answered, NULL for none
+    atomic_bool done;           // Set once the read is answered, after which the fields below are valid
+    struct shared_buffer *buf;  // The messages read, back to back after reserve bytes, NULL if none was
+    uint64_t first_seq;         // Sequence number of the first message read, next_seq if none was
+    uint64_t next_seq;          // Where a further read starts: past the last message read, end_seq if the log has no
+                                // more messages before it
+    size_t count;               // Number of messages read
+};
+
+// A message waiting to be written to the log of its room, or else a lookup, a read or, with neither, a room closing
+struct room_log_msg
+{
+    ROOM_ID room;
+    uint64_t seq;                   // Sequence number of the message in its room
+    struct shared_buffer *buf;      // The serialized message, whose reference belongs to the log, NULL if there is none
+    int source;                     // Index of the WAL the message was written to
+    uint64_t lsn;                   // LSN just past the message's record in that WAL, 0 if it is in none
+    struct room_log_lookup *lookup; // Lookup to answer instead, NULL otherwise
+    struct room_log_read *read;     // Read to answer instead, NULL otherwise
+};
+
+// What the writer thread knows about the log of one room
+struct room_log_file
+{
+    ROOM_ID id;
+    bool open;                     // Whether seg is open
+    bool dirty;                    // Whether seg has messages which are not synced
+    struct log_segment_writer seg; // The room's newest segment
+    uint64_t last_seq;             // Sequence number of the last message written, 0 if none has been
+    struct room_log_file *prev;    // Neighbours in the list of open files, most recently written first
+    struct room_log_file *next;
+};
+
+// A room the writer saw close, whose state the log can forget once its messages are synced
+struct room_log_closing
+{
+    ROOM_ID room;
+    uint64_t next_seq; // Sequence number the room's next message would have got
+};
+
+// What the log keeps of a room which is not open, for when it is opened again
+struct room_log_room
+{
+    uint64_t next_seq; // Sequence number the room's next message gets
+    char *history;     // Frames of the room's newest messages back to back, NULL if it has none
+    size_t len;        // Length of the history in bytes
+    size_t count;      // Number of frames in the history
+};
+
+// A message read back from a WAL by recovery, pointing into the mapped segment
+struct room_log_replayed
+{
+    ROOM_ID room;
+    uint64_t seq;
+    const char *data;
+    size_t len;
+};
+
+// What recovery reads back from the WALs
+struct room_log_recovery
+{
+    struct wal_segment *segments; // Segments mapped, which the records point into
+    size_t num_segments;
+    size_t segments_cap;
+    struct room_log_replayed *records; // Records past the snapshot, in the order they were read
+    size_t num_records;
+    size_t records_cap;
+};
+
+// An append-only log of every room's chat messages on disk. Each room has a directory of fixed size segment files
+// (see log_segment.h), named by the sequence number of their first message, which are read through mmap: the writer
+// reads a run of messages on request, finding the first one with the sparse index of its segment.
+//
+// Reactors hand messages to a background writer thread through a lock-free queue, so writing never delays a fan-out.
+// The writer takes messages from the queue in batches and appends those of the same room with one pwritev().
+//
+// The sequence numbers of a room carry on where its log ends, both when the room is opened again and when the server
+// restarts, so the numbers in a room's log only ever grow. A closed room's next number is kept in memory until the
+// checkpoint which syncs its last message, after which its log on disk tells it: the writer looks it up on request.
+// Only the rooms recovered with a history are kept until they are opened again.
+//
+// Messages reach the disk first through the write-ahead logs (WALs) of the reactors (see wal.h). At most every
+// ROOM_LOG_CHECKPOINT_MS, the writer syncs the segments it wrote to and takes a checkpoint: it publishes, for each WAL,
+// the LSN up to which every message is synced in the rooms' logs.
+//
+// The state of every room, its next sequence number and its history, is saved now and then in a snapshot (see
+// snapshot.h), along with the LSN in each WAL from which the WAL must be replayed on top of it. Opening the log
+// recovers from a restart: it maps the newest snapshot, replays the records of the WALs past its LSNs, writing those
+// missing from the rooms' logs, and takes a checkpoint, after which it keeps the state of the rooms with a history.
+// Only the WALs' tails are read, so recovery takes time in proportion to the snapshot and to what was logged since,
+// not to the size of the logs. A snapshot holds the rooms the log keeps the state of, not those it forgot: their
+// numbering is found in their logs.
+// A WAL's segments are deleted once both the rooms' logs and the snapshot are past them.
+struct room_log
+{
+    char *dir; // Directory holding a directory per room, the snapshots in "snapshot" and the WALs in "wal"
+    int num_sources;
+    size_t history_limit; // Most bytes of history a room keeps through a restart
+
+    struct mpsc_ring *queue;   // Messages waiting for the writer
+    struct ring_wakeup wakeup; // Signalled when messages are pushed to the queue
+    pthread_t thread;
+    atomic_bool stopping; // Set to make the writer exit once the queue is empty
+
+    pthread_mutex_t closed_lock; // Protects closed and forgotten
+    struct room_map closed;      // room_log_room of the rooms closed and not yet synced, or recovered, by id
+    uint64_t forgotten;          // Number of times the writer forgot closed rooms, which makes older lookups stale
+
+    // Only touched by the writer thread
+    struct room_map files;           // The writer's room_log_file of the rooms whose segment is open, by id
+    struct room_log_file *open_head; // Open files, most recently written first
+    struct room_log_file *open_tail;
+    size_t num_open;
+    uint64_t *written;      // LSN in each WAL up to which every message is written
+    bool unsynced;          // Whether messages were written since the last checkpoint
+    uint64_t checkpoint_ms; // When the next checkpoint is due, on CLOCK_MONOTONIC
+    bool failed;            // Whether a write failed, which stops checkpoints so the WALs keep every message
+
+    struct room_log_closing *closing; // Rooms seen closing since the last checkpoint, whose state may be forgotten
+    size_t num_closing;
+    size_t closing_cap;
+
+    atomic_uint_fast64_t *checkpoints; // LSN in each WAL up to which every message is synced
+    atomic_uint_fast64_t *snapshots;   // LSN in each WAL from which the newest snapshot replays it, 0 before the first
+    atomic_uint_fast64_t records;      // Messages written
+    atomic_uint_fast64_t writes;       // Runs of messages of one room written together
+    atomic_uint_fast64_t stalls;       // Messages which waited for room in the queue
+    atomic_uint_fast64_t syncs;        // Checkpoints taken
+
+    // What recovery did when the log was opened
+    uint64_t recovered_rooms; // Rooms restored from the snapshot
+    uint64_t replayed;        // WAL records read past the snapshot
+    double recovery_ms;       // Milliseconds it took
+};
+
+/**
+ * Opens the log kept in a directory, creating the directory if needed, recovers the rooms' state from the newest
+ * snapshot and the WALs left by the previous run, and starts the writer thread. Recovery ends with a new snapshot, and
+ * the new WALs, opened afterwards, must start past the old ones, as wal_open() does.
+ *
+ * The returned struct should be freed with room_log_free() when no longer needed.
+ *
+ * @param dir           Path of the directory
+ * @param num_sources   Number of WALs the messages come from
+ * @param history_limit Most bytes of history a room keeps through a restart, 0 to keep none
+ *
+ * @return  Pointer to the log on success.
+ *          NULL on error, or if the snapshot is damaged.
+ */
+struct room_log *room_log_init(const char *dir, int num_sources, size_t history_limit);
+
+/**
+ * Writes every message waiting in the queue, takes a last checkpoint, stops the writer thread and frees the log.
+ *
+ * @param log   Pointer to the log
+ */
+void room_log_free(struct room_log *log);
+
+/**
+ * Queues a message to be written to the log of its room, waiting for room in the queue if it is full. Messages of a
+ * room must be queued in the order of their sequence numbers. Safe to call from any thread.
+ *
+ * @param log       Pointer to the log
+ * @param room      Id of the room
+ * @param seq       Sequence number of the message in the room
+ * @param buf       Pointer to a shared buffer containing the message, which the log takes a reference to
+ * @param source    Index of the WAL the message was written to, whose messages must be queued in the WAL's order
+ * @param lsn       LSN just past the message's record in that WAL, 0 if it is in none
+ */
+void room_log_append(struct room_log *log, ROOM_ID room, uint64_t seq, struct shared_buffer *buf, int source,
+                     uint64_t lsn);
+
+/**
+ * Restores the state of a room being opened into its empty history: the number after the last one the room had when
+ * it was last closed or recovered, along with the history it had then if it was recovered, or, if the log keeps
+ * nothing of the room, the number a lookup found after the last message in its log on disk. Never reads the disk.
+ * Safe to call from any thread.
+ *
+ * @param log       Pointer to the log
+ * @param room      Id of the room
+ * @param history   Pointer to the room's history, which is empty
+ * @param lookup    Pointer to an answered lookup of the room, NULL if there is none
+ *
+ * @return  0 on success.
+ *          1 if the log keeps nothing of the room and the lookup is missing, or stale since closed rooms were forgotten
+ *          after it was answered: the history is untouched, and the call should be made again once the room has been
+ *          looked up with room_log_lookup().
+ */
+int room_log_open_room(struct room_log *log, ROOM_ID room, struct history_ring *history,
+                       const struct room_log_lookup *lookup);
+
+/**
+ * Has the writer thread look up the number after the last message in a room's log on disk, once it has written the
+ * messages queued before. Waits for room in the queue if it is full. Safe to call from any thread.
+ *
+ * @param log       Pointer to the log
+ * @param lookup    Pointer to the lookup, whose room and wakeup are set, which must stay valid until it is answered
+ */
+void room_log_lookup(struct room_log *log, struct room_log_lookup *lookup);
+
+/**
+ * Has the writer thread read a run of a room's messages from its log on disk, once it has written the messages queued
+ * before. Waits for room in the queue if it is full. Safe to call from any thread.
+ *
+ * @param log   Pointer to the log
+ * @param read  Pointer to the read, whose room, range, limits, reserve, seqs and wakeup are set, which must stay valid
+ *              until it is answered
+ */
+void room_log_read(struct room_log *log, struct room_log_read *read);
+
+/**
+ * Remembers the sequence number the next message of a room being closed would have got, for when it is opened again,
+ * until the room's messages are synced in its log. The room's history is not kept. Messages of the room must all have
+ * been queued beforehand. Safe to call from any thread.
+ *
+ * @param log       Pointer to the log
+ * @param room      Id of the room
+ * @param next_seq  The sequence number
+ */
+void room_log_close_room(struct room_log *log, ROOM_ID room, uint64_t next_seq);
+
+/**
+ * Gets the LSN of a WAL up to which the last checkpoint found every message synced in the rooms' logs. Safe to call
+ * from any thread.
+ *
+ * @param log       Pointer to the log
+ * @param source    Index of the WAL
+ *
+ * @return  The LSN, 0 before the first checkpoint.
+ */
+uint64_t room_log_checkpoint(struct room_log *log, int source);
+
+/**
+ * Gets the LSN of a WAL from which recovery would replay it: the records before it are synced in the rooms' logs and
+ * covered by the newest snapshot, so the segments holding only such records can be deleted. Safe to call from any
+ * thread.
+ *
+ * @param log       Pointer to the log
+ * @param source    Index of the WAL
+ *
+ * @return  The LSN.
+ */
+uint64_t room_log_replay_lsn(struct room_log *log, int source);
+
+/**
+ * Adds the rooms the log keeps the state of to a snapshot being written: those closed since before the last
+ * checkpoint, and those recovered with a history which were not opened since. A room the log forgot is left out, as
+ * its log on disk tells its next number. Safe to call from any thread.
+ *
+ * @param log       Pointer to the log
+ * @param writer    Pointer to the snapshot's writer
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int room_log_snapshot_rooms(struct room_log *log, struct snapshot_writer *writer);
+
+/**
+ * Records that a snapshot was committed, so the WALs are only needed from its LSNs on. Safe to call from any thread.
+ *
+ * @param log   Pointer to the log
+ * @param lsns  Pointer to the LSN in each WAL from which the snapshot replays it
+ */
+void room_log_snapshot_taken(struct room_log *log, const uint64_t *lsns);
+
+/**
+ * Builds the path of the directory holding the snapshots.
+ *
+ * @param log   Pointer to the log
+ * @param path  Pointer to a buffer of PATH_MAX bytes which will store the path
+ *
+ * @return  0 on success.
+ *          -1 if the path is too long.
+ */
+int room_log_snapshot_dir(const struct room_log *log, char *path);
+
+/**
+ * Builds the path of the directory holding the segments of a room.
+ *
+ * @param log   Pointer to the log
+ * @param room  Id of the room
+ * @param path  Pointer to a buffer of PATH_MAX bytes which will store the path
+ *
+ * @return  0 on success.
+ *          -1 if the path is too long.
+ */
+int room_log_room_dir(const struct room_log *log, ROOM_ID room, char *path);
+
+#endif
@@ -0,0 +1,329 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+#include "log_segment.h"
+#include "snapshot.h"
+#include "../lib/log.h"
+
+#define SNAPSHOT_SUFFIX ".snap"
+#define SNAPSHOT_TEMP_SUFFIX ".tmp"
+
+/**
+ * Builds the path of a snapshot file.
+ *
+ * @param path      Pointer to a buffer of PATH_MAX bytes which will store the path
+ * @param dir       Path of the directory holding the snapshots
+ * @param number    Number of the snapshot
+ * @param suffix    Suffix of the file, including its dot
+ *
+ * @return  0 on success.
+ *          -1 if the path is too long.
+ */
+static int snapshot_path(char *path, const char *dir, uint64_t number, const char *suffix)
+{
+    if (snprintf(path, PATH_MAX, "%s/%020" PRIu64 "%s", dir, number, suffix) >= PATH_MAX)
+    {
+        LOG_ERROR("path of snapshot %" PRIu64 " in %s too long", number, dir);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Writes the bytes a writer has collected to its file, adding those past the header to the checksum.
+ *
+ * @param writer    Pointer to the writer
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int flush(struct snapshot_writer *writer)
+{
+    if (writer->len == 0)
+        return 0;
+
+    // The header is the first thing in the buffer the first time it is written out
+    size_t skip = writer->size == writer->len ? sizeof(struct snapshot_header) : 0;
+    writer->crc = crc32c(writer->crc, writer->buf + skip, writer->len - skip);
+
+    for (const char *data = writer->buf; writer->len > 0;)
+    {
+        ssize_t n = write(writer->fd, data, writer->len);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("failed to write snapshot %" PRIu64 " in %s: %s", writer->number, writer->dir,
+                      strerror(errno));
+            return -1;
+        }
+        data += n;
+        writer->len -= n;
+    }
+
+    return 0;
+}
+
+/**
+ * Makes sure a writer's buffer has room for len more bytes, writing out what it holds or growing it as needed.
+ *
+ * @param writer    Pointer to the writer
+ * @param len       Number of bytes
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int reserve(struct snapshot_writer *writer, size_t len)
+{
+    if (writer->cap - writer->len >= len)
+        return 0;
+    if (flush(writer) != 0)
+        return -1;
+    if (writer->cap >= len)
+        return 0;
+
+    char *buf = realloc(writer->buf, len);
+    if (buf == NULL)
+    {
+        LOG_ERROR("failed to allocate space for snapshot %" PRIu64, writer->number);
+        return -1;
+    }
+    writer->buf = buf;
+    writer->cap = len;
+
+    return 0;
+}
+
+/**
+ * Syncs a directory, so the files created, renamed or deleted in it stay so after a crash.
+ *
+ * @param dir   Path of the directory
+ */
+static void sync_dir(const char *dir)
+{
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1 || fsync(fd) == -1)
+        LOG_WARN("failed to sync %s: %s", dir, strerror(errno));
+    if (fd != -1)
+        close(fd);
+}
+
+size_t snapshot_room_size(size_t len)
+{
+    return (sizeof(struct snapshot_room) + len + SNAPSHOT_ALIGN - 1) & ~(size_t)(SNAPSHOT_ALIGN - 1);
+}
+
+int snapshot_writer_begin(struct snapshot_writer *writer, const char *dir, uint32_t num_sources, const uint64_t *lsns)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = -1;
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+    {
+        LOG_ERROR("failed to create %s: %s", dir, strerror(errno));
+        return -1;
+    }
+
+    uint64_t *numbers;
+    size_t n;
+    if ((writer->dir = strdup(dir)) == NULL || log_segment_list_files(dir, SNAPSHOT_SUFFIX, &numbers, &n) != 0)
+        goto abort;
+    writer->number = n > 0 ? numbers[n - 1] + 1 : 1;
+    free(numbers);
+
+    // A temporary file left by a crash is overwritten
+    char path[PATH_MAX];
+    if (snapshot_path(path, dir, writer->number, SNAPSHOT_TEMP_SUFFIX) != 0)
+        goto abort;
+    if ((writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+    {
+        LOG_ERROR("failed to create %s: %s", path, strerror(errno));
+        goto abort;
+    }
+
+    // The header is written last, once the rest is known, over the zeroes it starts as
+    size_t len = sizeof(struct snapshot_header) + num_sources * sizeof(uint64_t);
+    if (reserve(writer, len > SNAPSHOT_BUFFER_SIZE ? len : SNAPSHOT_BUFFER_SIZE) != 0)
+        goto abort;
+    memset(writer->buf, 0, sizeof(struct snapshot_header));
+    memcpy(writer->buf + sizeof(struct snapshot_header), lsns, num_sources * sizeof(uint64_t));
+    writer->len = len;
+    writer->size = len;
+    writer->header.magic = SNAPSHOT_MAGIC;
+    writer->header.num_sources = num_sources;
+
+    return 0;
+
+abort:
+    snapshot_writer_abort(writer);
+    return -1;
+}
+
+char *snapshot_writer_add_room(struct snapshot_writer *writer, ROOM_ID id, uint64_t next_seq, uint32_t count,
+                               size_t len)
+{
+    size_t size = snapshot_room_size(len);
+    if (reserve(writer, size) != 0)
+        return NULL;
+
+    struct snapshot_room room = {id, count, next_seq, len};
+    char *dst = writer->buf + writer->len;
+    memcpy(dst, &room, sizeof(room));
+    memset(dst + sizeof(room) + len, 0, size - sizeof(room) - len);
+    writer->len += size;
+    writer->size += size;
+    writer->num_rooms++;
+
+    return dst + sizeof(room);
+}
+
+int snapshot_writer_commit(struct snapshot_writer *writer)
+{
+    char path[PATH_MAX];
+    char temp[PATH_MAX];
+    if (flush(writer) != 0 || snapshot_path(path, writer->dir, writer->number, SNAPSHOT_SUFFIX) != 0 ||
+        snapshot_path(temp, writer->dir, writer->number, SNAPSHOT_TEMP_SUFFIX) != 0)
+        goto abort;
+
+    writer->header.crc = writer->crc;
+    writer->header.num_rooms = writer->num_rooms;
+    writer->header.size = writer->size;
+    if (pwrite(writer->fd, &writer->header, sizeof(writer->header), 0) != sizeof(writer->header) ||
+        fdatasync(writer->fd) == -1)
+    {
+        LOG_ERROR("failed to write snapshot %" PRIu64 " in %s: %s", writer->number, writer->dir, strerror(errno));
+        goto abort;
+    }
+
+    if (rename(temp, path) == -1)
+    {
+        LOG_ERROR("failed to rename %s to %s: %s", temp, path, strerror(errno));
+        goto abort;
+    }
+    sync_dir(writer->dir);
+
+    // Only the newest snapshot is read back
+    uint64_t *numbers;
+    size_t n;
+    if (log_segment_list_files(writer->dir, SNAPSHOT_SUFFIX, &numbers, &n) == 0)
+    {
+        for (size_t i = 0; i < n && numbers[i] < writer->number; i++)
+            if (snapshot_path(path, writer->dir, numbers[i], SNAPSHOT_SUFFIX) == 0 && unlink(path) == -1)
+                LOG_WARN("failed to delete %s: %s", path, strerror(errno));
+        free(numbers);
+    }
+
+    close(writer->fd);
+    free(writer->buf);
+    free(writer->dir);
+
+    return 0;
+
+abort:
+    snapshot_writer_abort(writer);
+    return -1;
+}
+
+void snapshot_writer_abort(struct snapshot_writer *writer)
+{
+    char temp[PATH_MAX];
+    if (writer->fd != -1)
+    {
+        close(writer->fd);
+        if (snapshot_path(temp, writer->dir, writer->number, SNAPSHOT_TEMP_SUFFIX) == 0)
+            unlink(temp);
+    }
+    free(writer->buf);
+    free(writer->dir);
+    writer->fd = -1;
+    writer->buf = NULL;
+    writer->dir = NULL;
+}
+
+int snapshot_open(struct snapshot *snap, const char *dir)
+{
+    memset(snap, 0, sizeof(*snap));
+
+    uint64_t *numbers;
+    size_t n;
+    if (log_segment_list_files(dir, SNAPSHOT_SUFFIX, &numbers, &n) != 0)
+        return -1;
+    if (n == 0)
+        return 0;
+    snap->number = numbers[n - 1];
+    free(numbers);
+
+    char path[PATH_MAX];
+    if (snapshot_path(path, dir, snap->number, SNAPSHOT_SUFFIX) != 0)
+        return -1;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        LOG_ERROR("failed to open %s: %s", path, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+    snap->size = st.st_size;
+    if (snap->size < sizeof(struct snapshot_header))
+    {
+        LOG_ERROR("snapshot %s is damaged: too short", path);
+        close(fd);
+        return -1;
+    }
+    if ((snap->map = mmap(NULL, snap->size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        LOG_ERROR("failed to map %s: %s", path, strerror(errno));
+        snap->map = NULL;
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    madvise(snap->map, snap->size, MADV_SEQUENTIAL);
+
+    const struct snapshot_header *header = (const struct snapshot_header *)snap->map;
+    snap->rooms = sizeof(struct snapshot_header) + (size_t)header->num_sources * sizeof(uint64_t);
+    if (header->magic != SNAPSHOT_MAGIC || header->size != snap->size || snap->rooms > snap->size ||
+        crc32c(0, snap->map + sizeof(struct snapshot_header), snap->size - sizeof(struct snapshot_header)) !=
+            header->crc)
+    {
+        LOG_ERROR("snapshot %s is damaged", path);
+        snapshot_close(snap);
+        return -1;
+    }
+    snap->num_sources = header->num_sources;
+    snap->lsns = (const uint64_t *)(snap->map + sizeof(struct snapshot_header));
+    snap->num_rooms = header->num_rooms;
+
+    return 0;
+}
+
+void snapshot_close(struct snapshot *snap)
+{
+    if (snap->map != NULL)
+        munmap(snap->map, snap->size);
+    snap->map = NULL;
+}
+
+const struct snapshot_room *snapshot_room(const struct snapshot *snap, size_t offset)
+{
+    if (offset + sizeof(struct snapshot_room) > snap->size)
+        return NULL;
+
+    const struct snapshot_room *room = (const struct snapshot_room *)(snap->map + offset);
+    if (room->len > snap->size - offset - sizeof(struct snapshot_room))
+        return NULL;
+
+    return room;
+}
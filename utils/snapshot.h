@@ -0,0 +1,152 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../types/messages/join_message.h"
+
+#define SNAPSHOT_MAGIC 0x31504e5354414843ULL // "CHATSNP1" read as a little-endian number
+#define SNAPSHOT_ALIGN 8                     // Rooms start at multiples of this many bytes of the file
+#define SNAPSHOT_BUFFER_SIZE (1024 * 1024)   // Bytes a writer collects before writing them out
+
+// Header of a snapshot file. It is followed by num_sources LSNs, one per WAL, then by num_rooms rooms. Snapshots are
+// written in host byte order: they are read back by the host which wrote them.
+struct snapshot_header
+{
+    uint64_t magic;       // SNAPSHOT_MAGIC
+    uint32_t num_sources; // Number of WALs
+    uint32_t crc;         // CRC-32C of everything after the header
+    uint64_t num_rooms;   // Number of rooms
+    uint64_t size;        // Size of the file in bytes
+};
+
+// A room in a snapshot, followed by its history: the frames of its newest messages back to back, exactly as they were
+// sent, and padding up to SNAPSHOT_ALIGN
+struct snapshot_room
+{
+    ROOM_ID id;
+    uint32_t count;    // Number of frames in the history
+    uint64_t next_seq; // Sequence number the room's next message gets
+    uint64_t len;      // Length of the history in bytes
+};
+
+// A snapshot being written. It goes to a temporary file, which only replaces the previous snapshot once it is complete
+// and synced, so a crash while writing leaves the previous one in place.
+struct snapshot_writer
+{
+    char *dir;          // Directory holding the snapshots
+    uint64_t number;    // Number of the snapshot, which names its file, one more than the newest one's
+    int fd;             // The temporary file
+    char *buf;          // Bytes not written to the file yet
+    size_t len;         // Length of the bytes in buf
+    size_t cap;         // Size of buf
+    uint64_t size;      // Bytes written to the file, or to buf, so far
+    uint32_t crc;       // CRC-32C of the bytes after the header written to the file so far
+    uint64_t num_rooms; // Rooms added so far
+    struct snapshot_header header;
+};
+
+// A snapshot mapped for reading
+struct snapshot
+{
+    char *map;            // The file, NULL if there is no snapshot
+    size_t size;          // Size of the file in bytes
+    uint64_t number;      // Number of the snapshot, which names its file
+    uint32_t num_sources; // Number of WALs
+    const uint64_t *lsns; // LSN in each WAL from which it must be replayed on top of the snapshot
+    uint64_t num_rooms;   // Number of rooms
+    size_t rooms;         // Offset of the first room
+};
+
+/**
+ * Starts writing a snapshot to a directory, creating the directory if needed.
+ *
+ * The snapshot should be finished with snapshot_writer_commit() or snapshot_writer_abort().
+ *
+ * @param writer        Pointer to the writer
+ * @param dir           Path of the directory
+ * @param num_sources   Number of WALs
+ * @param lsns          Pointer to the LSN in each WAL from which it must be replayed on top of the snapshot
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int snapshot_writer_begin(struct snapshot_writer *writer, const char *dir, uint32_t num_sources, const uint64_t *lsns);
+
+/**
+ * Adds a room to a snapshot, leaving space for its history, which the caller copies to the returned pointer before
+ * adding anything else.
+ *
+ * @param writer    Pointer to the writer
+ * @param id        Id of the room
+ * @param next_seq  Sequence number the room's next message gets
+ * @param count     Number of frames in the room's history
+ * @param len       Length of the history in bytes
+ *
+ * @return  Pointer to len bytes the history must be copied to on success (which may not be used if len is 0).
+ *          NULL on error.
+ */
+char *snapshot_writer_add_room(struct snapshot_writer *writer, ROOM_ID id, uint64_t next_seq, uint32_t count,
+                               size_t len);
+
+/**
+ * Finishes a snapshot: writes and syncs it, puts it in place of the previous snapshot, which is deleted, and frees the
+ * writer's resources.
+ *
+ * @param writer    Pointer to the writer
+ *
+ * @return  0 on success.
+ *          -1 on error, in which case the snapshot is aborted.
+ */
+int snapshot_writer_commit(struct snapshot_writer *writer);
+
+/**
+ * Drops a snapshot being written and frees the writer's resources.
+ *
+ * @param writer    Pointer to the writer
+ */
+void snapshot_writer_abort(struct snapshot_writer *writer);
+
+/**
+ * Maps the newest snapshot in a directory for reading and checks that it is intact.
+ *
+ * The snapshot should be closed with snapshot_close() when no longer needed.
+ *
+ * @param snap  Pointer to the snapshot, whose map is NULL if the directory holds none
+ * @param dir   Path of the directory
+ *
+ * @return  0 on success (including when there is no snapshot).
+ *          -1 on error or if the snapshot is damaged.
+ */
+int snapshot_open(struct snapshot *snap, const char *dir);
+
+/**
+ * Unmaps a snapshot opened with snapshot_open().
+ *
+ * @param snap  Pointer to the snapshot
+ */
+void snapshot_close(struct snapshot *snap);
+
+/**
+ * Gets the room at an offset of a snapshot. Its history follows it, and the next room starts
+ * snapshot_room_size(room->len) bytes after it.
+ *
+ * @param snap      Pointer to the snapshot
+ * @param offset    Offset of a room, or snap->size
+ *
+ * @return  Pointer to the room.
+ *          NULL if offset is snap->size.
+ */
+const struct snapshot_room *snapshot_room(const struct snapshot *snap, size_t offset);
+
+/**
+ * Gets the number of bytes a room takes up in a snapshot, history and padding included.
+ *
+ * @param len   Length of the room's history in bytes
+ *
+ * @return  Size of the room in bytes.
+ */
+size_t snapshot_room_size(size_t len);
+
+#endif
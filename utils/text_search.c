@@ -0,0 +1,423 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "text_search.h"
+#include "../types/room.h"
+#include "../types/messages/chat_message.h"
+#include "../lib/log.h"
+
+/**
+ * Takes a room out of the list of rooms by when they were last indexed.
+ *
+ * @param search    Pointer to the search
+ * @param room      Pointer to the room, which is in the list
+ */
+static void unlink_room(struct text_search *search, struct text_search_room *room)
+{
+    if (room->newer != NULL)
+        room->newer->older = room->older;
+    else
+        search->newest = room->older;
+    if (room->older != NULL)
+        room->older->newer = room->newer;
+    else
+        search->oldest = room->newer;
+}
+
+/**
+ * Puts a room at the newest end of the list of rooms by when they were last indexed.
+ *
+ * @param search    Pointer to the search
+ * @param room      Pointer to the room, which is not in the list
+ */
+static void link_newest(struct text_search *search, struct text_search_room *room)
+{
+    room->newer = NULL;
+    room->older = search->newest;
+    if (search->newest != NULL)
+        search->newest->newer = room;
+    else
+        search->oldest = room;
+    search->newest = room;
+}
+
+/**
+ * Finds the index of a room, creating it if the room has none yet. Only called by the indexer thread, the only one
+ * which adds rooms, so the lookup needs no lock.
+ *
+ * @param search    Pointer to the search
+ * @param id        Id of the room
+ *
+ * @return  Pointer to the room's index on success.
+ *          NULL on error.
+ */
+static struct text_search_room *get_room(struct text_search *search, ROOM_ID id)
+{
+    struct text_search_room *room = room_map_find(&search->rooms, id);
+    if (room != NULL)
+        return room;
+
+    if ((room = malloc(sizeof(struct text_search_room))) == NULL)
+    {
+        LOG_ERROR("failed to allocate space for the index of room %u", id);
+        return NULL;
+    }
+    room->id = id;
+    pthread_mutex_init(&room->lock, NULL);
+    text_index_init(&room->index);
+
+    pthread_mutex_lock(&search->rooms_lock);
+    int status = room_map_insert(&search->rooms, id, room);
+    pthread_mutex_unlock(&search->rooms_lock);
+    if (status != 0)
+    {
+        LOG_ERROR("failed to add the index of room %u", id);
+        pthread_mutex_destroy(&room->lock);
+        free(room);
+        return NULL;
+    }
+    atomic_fetch_add(&search->used, sizeof(struct text_search_room));
+    link_newest(search, room);
+
+    return room;
+}
+
+/**
+ * Drops the index of a room. Only called by the indexer thread. A search which found the room before it left the map
+ * holds its lock, which is taken once more before the room is freed, so the room outlives every search of it.
+ *
+ * @param search    Pointer to the search
+ * @param room      Pointer to the room
+ */
+static void drop_room(struct text_search *search, struct text_search_room *room)
+{
+    pthread_mutex_lock(&search->rooms_lock);
+    room_map_remove(&search->rooms, room->id);
+    pthread_mutex_lock(&room->lock);
+    pthread_mutex_unlock(&room->lock);
+    pthread_mutex_unlock(&search->rooms_lock);
+
+    unlink_room(search, room);
+    atomic_fetch_sub(&search->used, room->index.bytes + sizeof(struct text_search_room));
+    text_index_free(&room->index);
+    pthread_mutex_destroy(&room->lock);
+    free(room);
+}
+
+/**
+ * Adds a message to the index of its room. If the indexes hold all the memory they may, those of the rooms which went
+ * longest without a message are dropped first, and the message is left out if its room's index is the only one left.
+ *
+ * @param search    Pointer to the search
+ * @param id        Id of the room
+ * @param seq       Sequence number of the message in the room
+ * @param data      Pointer to the serialized chat message
+ * @param len       Length of the message in bytes
+ */
+static void index_message(struct text_search *search, ROOM_ID id, uint64_t seq, char *data, size_t len)
+{
+    struct chat_message_view chat;
+    struct text_search_room *room;
+    if (chat_message_parse(data, len, &chat) != 0 || (room = get_room(search, id)) == NULL)
+    {
+        atomic_fetch_add_explicit(&search->skipped, 1, memory_order_relaxed);
+        return;
+    }
+
+    // The message was read back from the log when the room opened, and queued as well
+    if (seq <= room->index.last_seq)
+        return;
+
+    while (atomic_load(&search->used) >= search->limit && search->oldest != room)
+    {
+        drop_room(search, search->oldest);
+        atomic_fetch_add_explicit(&search->evicted, 1, memory_order_relaxed);
+    }
+    if (atomic_load(&search->used) >= search->limit)
+    {
+        atomic_fetch_add_explicit(&search->skipped, 1, memory_order_relaxed);
+        return;
+    }
+    unlink_room(search, room);
+    link_newest(search, room);
+
+    pthread_mutex_lock(&room->lock);
+    size_t before = room->index.bytes;
+    text_index_add(&room->index, seq, chat.text, chat.text_len - 1); // -1 to leave out the null character
+
+    size_t after = room->index.bytes;
+    pthread_mutex_unlock(&room->lock);
+
+    if (after >= before)
+        atomic_fetch_add(&search->used, after - before);
+    else
+        atomic_fetch_sub(&search->used, before - after);
+    atomic_fetch_add_explicit(&search->indexed, 1, memory_order_relaxed);
+}
+
+/**
+ * Waits for the log to answer the indexer, which may have answered already.
+ *
+ * @param search    Pointer to the search
+ */
+static void wait_for_log(struct text_search *search)
+{
+    struct pollfd pfd = {search->wakeup.fd, POLLIN, 0};
+    if (poll(&pfd, 1, -1) == -1)
+        LOG_ERROR("failed to wait for the room log: %s", strerror(errno));
+    ring_wakeup_clear(&search->wakeup);
+}
+
+/**
+ * Gets the length of a frame from the length it starts with.
+ *
+ * @param frame Pointer to the frame
+ *
+ * @return  Length of the frame in bytes.
+ */
+static size_t frame_len(const char *frame)
+{
+    TOTAL_MSG_LEN len;
+    memcpy(&len, frame, sizeof(len));
+    return ntohl(len);
+}
+
+/**
+ * Starts the index of a room which opened over from the newest TEXT_SEARCH_BACKFILL messages of its log, read
+ * TEXT_SEARCH_READ_COUNT at a time. The log writes the messages queued before it answers, so the messages of the room
+ * not found in the log are queued for the indexer after the open, and those found twice are indexed once.
+ *
+ * @param search    Pointer to the search
+ * @param id        Id of the room
+ */
+static void open_room(struct text_search *search, ROOM_ID id)
+{
+    struct text_search_room *room = room_map_find(&search->rooms, id);
+    if (room != NULL)
+        drop_room(search, room);
+    if (get_room(search, id) == NULL || search->log == NULL)
+        return;
+
+    struct room_log_lookup lookup = {.room = id, .wakeup = &search->wakeup};
+    room_log_lookup(search->log, &lookup);
+    while (atomic_load(&lookup.next_seq) == 0)
+        wait_for_log(search);
+    uint64_t end_seq = atomic_load(&lookup.next_seq);
+
+    uint64_t seqs[TEXT_SEARCH_READ_COUNT];
+    struct room_log_read read = {
+        .room = id,
+        .from_seq = end_seq > TEXT_SEARCH_BACKFILL ? end_seq - TEXT_SEARCH_BACKFILL : 1,
+        .end_seq = end_seq,
+        .max_count = TEXT_SEARCH_READ_COUNT,
+        .max_len = TEXT_SEARCH_READ_BYTES,
+        .reserve = 0,
+        .seqs = seqs,
+        .wakeup = &search->wakeup,
+    };
+    while (read.from_seq < end_seq)
+    {
+        room_log_read(search->log, &read);
+        while (!atomic_load(&read.done))
+            wait_for_log(search);
+
+        size_t offset = 0;
+        for (size_t i = 0; i < read.count; i++)
+        {
+            size_t len = frame_len(read.buf->data + offset);
+            index_message(search, id, seqs[i], read.buf->data + offset, len);
+            offset += len;
+        }
+        if (read.buf != NULL)
+            shared_buffer_unref(read.buf);
+        read.from_seq = read.next_seq;
+    }
+}
+
+/**
+ * Body of the indexer thread: takes messages from the queue in batches and adds them to the indexes of their rooms, or
+ * starts over or drops the indexes of the rooms which opened or closed, sleeping for TEXT_SEARCH_POLL_MS whenever the
+ * queue is empty.
+ *
+ * @param arg   Pointer to the search
+ *
+ * @return  Nothing.
+ */
+static void *run_indexer(void *arg)
+{
+    struct text_search *search = arg;
+    struct text_search_msg batch[TEXT_SEARCH_BATCH];
+
+    struct timespec pause = {0, TEXT_SEARCH_POLL_MS * 1000000L};
+    while (1)
+    {
+        size_t n;
+        while ((n = mpsc_ring_pop_batch(search->queue, batch, TEXT_SEARCH_BATCH)) > 0)
+            for (size_t i = 0; i < n; i++)
+            {
+                struct text_search_msg *msg = &batch[i];
+                if (msg->type == TEXT_SEARCH_OPEN)
+                    open_room(search, msg->room);
+                else if (msg->type == TEXT_SEARCH_CLOSE)
+                {
+                    struct text_search_room *room = room_map_find(&search->rooms, msg->room);
+                    if (room != NULL)
+                        drop_room(search, room);
+                }
+                else
+                {
+                    index_message(search, msg->room, msg->seq, msg->buf->data, msg->buf->len);
+                    shared_buffer_unref(msg->buf);
+                }
+            }
+
+        if (atomic_load(&search->stopping))
+            break;
+
+        nanosleep(&pause, NULL);
+    }
+
+    return NULL;
+}
+
+/**
+ * Frees the index of every room of a search.
+ *
+ * @param search    Pointer to the search
+ */
+static void free_rooms(struct text_search *search)
+{
+    for (size_t i = 0; i < search->rooms.cap; i++)
+        if (search->rooms.slots[i].id != INVALID_ROOM)
+        {
+            struct text_search_room *room = search->rooms.slots[i].value;
+            text_index_free(&room->index);
+            pthread_mutex_destroy(&room->lock);
+            free(room);
+        }
+    room_map_free(&search->rooms);
+}
+
+struct text_search *text_search_init(size_t limit, struct room_log *log)
+{
+    struct text_search *search = calloc(1, sizeof(struct text_search));
+    if (search == NULL)
+    {
+        LOG_ERROR("failed to allocate space for the search");
+        return NULL;
+    }
+    search->limit = limit;
+    search->log = log;
+
+    if (ring_wakeup_init(&search->wakeup) != 0)
+    {
+        LOG_ERROR("failed to initialize the search's wakeup");
+        goto free_search;
+    }
+
+    if ((search->queue = mpsc_ring_init(TEXT_SEARCH_QUEUE_CAPACITY, sizeof(struct text_search_msg))) == NULL)
+    {
+        LOG_ERROR("failed to initialize the search queue");
+        goto free_wakeup;
+    }
+
+    if (room_map_init(&search->rooms) != 0)
+    {
+        LOG_ERROR("failed to initialize the search's room map");
+        goto free_queue;
+    }
+    pthread_mutex_init(&search->rooms_lock, NULL);
+    atomic_init(&search->stopping, false);
+    atomic_init(&search->used, 0);
+    atomic_init(&search->indexed, 0);
+    atomic_init(&search->skipped, 0);
+    atomic_init(&search->evicted, 0);
+
+    int status = pthread_create(&search->thread, NULL, run_indexer, search);
+    if (status != 0)
+    {
+        LOG_ERROR("failed to start the indexer: %s", strerror(status));
+        goto free_rooms;
+    }
+
+    return search;
+
+free_rooms:
+    pthread_mutex_destroy(&search->rooms_lock);
+    free_rooms(search);
+free_queue:
+    mpsc_ring_free(search->queue);
+free_wakeup:
+    ring_wakeup_free(&search->wakeup);
+free_search:
+    free(search);
+    return NULL;
+}
+
+void text_search_free(struct text_search *search)
+{
+    atomic_store(&search->stopping, true);
+    pthread_join(search->thread, NULL);
+
+    free_rooms(search);
+    pthread_mutex_destroy(&search->rooms_lock);
+    mpsc_ring_free(search->queue);
+    ring_wakeup_free(&search->wakeup);
+    free(search);
+}
+
+void text_search_append(struct text_search *search, ROOM_ID room, uint64_t seq, struct shared_buffer *buf)
+{
+    struct text_search_msg msg = {TEXT_SEARCH_CHAT, room, seq, shared_buffer_ref(buf)};
+    if (mpsc_ring_push(search->queue, &msg) != 0)
+    {
+        shared_buffer_unref(buf);
+        atomic_fetch_add_explicit(&search->skipped, 1, memory_order_relaxed);
+    }
+}
+
+void text_search_open_room(struct text_search *search, ROOM_ID room)
+{
+    struct text_search_msg msg = {TEXT_SEARCH_OPEN, room, 0, NULL};
+    while (mpsc_ring_push(search->queue, &msg) != 0)
+        sched_yield();
+}
+
+void text_search_close_room(struct text_search *search, ROOM_ID room)
+{
+    struct text_search_msg msg = {TEXT_SEARCH_CLOSE, room, 0, NULL};
+    while (mpsc_ring_push(search->queue, &msg) != 0)
+        sched_yield();
+}
+
+int text_search_query(struct text_search *search, ROOM_ID room, const char *query, size_t len, uint64_t *seqs,
+                      size_t max, size_t *count, bool *more)
+{
+    // The room's lock is taken before the room can leave the map, which keeps it from being freed (see drop_room())
+    pthread_mutex_lock(&search->rooms_lock);
+    struct text_search_room *r = room_map_find(&search->rooms, room);
+    if (r == NULL)
+    {
+        // The room's index was dropped for lack of memory, or the indexer has not started it yet
+        pthread_mutex_unlock(&search->rooms_lock);
+        struct text_index empty;
+        text_index_init(&empty);
+        int status = text_index_search(&empty, query, len, seqs, max, TEXT_INDEX_BUDGET, count, more);
+        *more = status == 0;
+        return status;
+    }
+    pthread_mutex_lock(&r->lock);
+    pthread_mutex_unlock(&search->rooms_lock);
+
+    int status = text_index_search(&r->index, query, len, seqs, max, TEXT_INDEX_BUDGET, count, more);
+    if (r->index.first_seq > 1)
+        *more = true;
+    pthread_mutex_unlock(&r->lock);
+
+    return status;
+}
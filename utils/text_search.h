@@ -0,0 +1,156 @@
+#ifndef TEXT_SEARCH_H
+#define TEXT_SEARCH_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "room_log.h"
+#include "../data_structures/mpsc_ring.h"
+#include "../data_structures/ring_wakeup.h"
+#include "../data_structures/room_map.h"
+#include "../data_structures/shared_buffer.h"
+#include "../data_structures/text_index.h"
+#include "../types/messages/join_message.h"
+
+#define TEXT_SEARCH_QUEUE_CAPACITY 65536 // Most messages waiting for the indexer thread
+#define TEXT_SEARCH_BATCH 256            // Most messages the indexer thread takes from its queue at a time
+#define TEXT_SEARCH_POLL_MS 10           // Milliseconds the indexer thread sleeps once its queue is empty
+#define TEXT_SEARCH_BACKFILL 16384       // Most of a room's newest messages indexed from its log when it opens
+#define TEXT_SEARCH_READ_COUNT 1024      // Most messages the indexer reads from a room's log at a time
+#define TEXT_SEARCH_READ_BYTES 262144    // Most bytes of messages the indexer reads from a room's log at a time
+
+enum text_search_msg_type
+{
+    TEXT_SEARCH_CHAT,
+    TEXT_SEARCH_OPEN,
+    TEXT_SEARCH_CLOSE,
+};
+
+// A message waiting to be indexed, or a room's open or close
+struct text_search_msg
+{
+    enum text_search_msg_type type;
+    ROOM_ID room;
+    uint64_t seq;              // Sequence number of the message in its room
+    struct shared_buffer *buf; // The serialized chat message, whose reference belongs to the search, NULL otherwise
+};
+
+// The index of one room
+struct text_search_room
+{
+    ROOM_ID id;
+    pthread_mutex_t lock; // Protects index, which the indexer adds to and any thread searches
+    struct text_index index;
+    struct text_search_room *newer; // Next room in the list of rooms by when they were last indexed, toward the newest
+    struct text_search_room *older; // Previous room in that list, toward the oldest
+};
+
+// Full-text search over the chat messages of every room (see text_index.h).
+//
+// Reactors hand messages to a background indexer thread through a lock-free queue, so indexing never delays a
+// fan-out. Nothing waits on a search finding a message the moment it is sent, so the indexer is not woken up for each
+// one: it drains the queue every TEXT_SEARCH_POLL_MS, and handing it a message costs a reactor a single push. A
+// message which finds the queue full is left out of the index rather than made to wait.
+//
+// A room's index is freed once the room closes: the close goes through the queue after the room's messages, so the
+// indexer drops the index once it has taken them. When a room opens, the indexer starts its index over from the newest
+// TEXT_SEARCH_BACKFILL messages of its log on disk, if there is one, so the messages sent before a restart are found
+// too. The writer of the log answers the indexer's reads, and never waits on the indexer. Once the indexes hold as
+// much memory as they may, the indexes of the rooms which went longest without a message are dropped to make room for
+// newer messages, which are only left out once their own room's index holds all the memory.
+struct text_search
+{
+    size_t limit;              // Most bytes all indexes together may hold
+    struct room_log *log;      // Log the indexes of rooms which open are filled from, NULL for none
+    struct ring_wakeup wakeup; // Signalled once the log answers the indexer
+    struct mpsc_ring *queue;   // Messages waiting for the indexer
+    pthread_t thread;
+    atomic_bool stopping; // Set to make the indexer exit once the queue is empty
+
+    pthread_mutex_t rooms_lock;      // Protects rooms, which the indexer changes and any thread looks up
+    struct room_map rooms;           // text_search_room of every room indexed, by id
+    struct text_search_room *newest; // Room indexed last, which only the indexer uses
+    struct text_search_room *oldest; // Room which went longest without being indexed, which only the indexer uses
+
+    atomic_size_t used;           // Bytes held by all indexes
+    atomic_uint_fast64_t indexed; // Messages indexed
+    atomic_uint_fast64_t skipped; // Messages left out of the index
+    atomic_uint_fast64_t evicted; // Indexes of open rooms dropped to make room for newer messages
+};
+
+/**
+ * Starts the indexer thread of an empty full-text search.
+ *
+ * The returned struct should be freed with text_search_free() when no longer needed.
+ *
+ * @param limit Most bytes of memory all rooms' indexes together may hold
+ * @param log   Pointer to the log rooms' messages are read back from when they open, which must outlive the search,
+ *              NULL for none
+ *
+ * @return  Pointer to the search on success.
+ *          NULL on error.
+ */
+struct text_search *text_search_init(size_t limit, struct room_log *log);
+
+/**
+ * Indexes every message waiting in the queue, stops the indexer thread and frees the search with every index.
+ *
+ * @param search    Pointer to the search
+ */
+void text_search_free(struct text_search *search);
+
+/**
+ * Queues a chat message to be indexed, unless the queue is full. Messages of a room must be queued in the order of
+ * their sequence numbers. Safe to call from any thread.
+ *
+ * @param search    Pointer to the search
+ * @param room      Id of the room
+ * @param seq       Sequence number of the message in the room
+ * @param buf       Pointer to a shared buffer containing the chat message, which the search takes a reference to
+ */
+void text_search_append(struct text_search *search, ROOM_ID room, uint64_t seq, struct shared_buffer *buf);
+
+/**
+ * Starts the index of a room which opened over, filling it from the newest messages of the room's log if the search
+ * has one, once the indexer has taken the messages queued before. Messages of the room must be queued after it opens.
+ * Waits for room in the queue if it is full. Safe to call from any thread.
+ *
+ * @param search    Pointer to the search
+ * @param room      Id of the room
+ */
+void text_search_open_room(struct text_search *search, ROOM_ID room);
+
+/**
+ * Frees the index of a room which closed, once the indexer has taken the room's messages queued before. Waits for
+ * room in the queue if it is full. Safe to call from any thread.
+ *
+ * @param search    Pointer to the search
+ * @param room      Id of the room
+ */
+void text_search_close_room(struct text_search *search, ROOM_ID room);
+
+/**
+ * Searches the index of a room for the messages matching a query, newest first (see text_index_search()). Messages
+ * still waiting for the indexer are not found, and neither are those older than the oldest one indexed, which the
+ * search tells may match. The search reads at most TEXT_INDEX_BUDGET postings, so it holds the
+ * room's index, and the thread calling it, for a bounded time. Safe to call from any thread.
+ *
+ * @param search    Pointer to the search
+ * @param room      Id of the room
+ * @param query     Pointer to the query
+ * @param len       Length of the query in bytes
+ * @param seqs      Pointer to an array which will store the sequence numbers of the messages found
+ * @param max       Most messages found
+ * @param count     Pointer to a size_t which will store the number of messages found
+ * @param more      Pointer to a bool which will store whether older messages match, or may match, as well
+ *
+ * @return  0 on success.
+ *          -1 if the query has no word or too many.
+ */
+int text_search_query(struct text_search *search, ROOM_ID room, const char *query, size_t len, uint64_t *seqs,
+                      size_t max, size_t *count, bool *more);
+
+#endif
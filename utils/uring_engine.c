@@ -0,0 +1,405 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring_engine.h"
+#include "../lib/log.h"
+
+#define BUF_GROUP_ID 0
+#define CQ_ENTRIES_PER_SQ_ENTRY 4 // Multishot operations produce many completions per submission
+
+// The operation type is stored in the low bits of user_data, the context pointer in the rest
+#define OP_MASK 0x7ULL
+
+#define load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int ring_fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+static uint64_t encode_user_data(enum uring_op op, void *ctx)
+{
+    return (uint64_t)(uintptr_t)ctx | (uint64_t)op;
+}
+
+/**
+ * Publishes prepared SQEs to the kernel.
+ *
+ * @return  Number of published SQEs the kernel has not consumed yet.
+ */
+static unsigned flush_sq(struct uring_engine *engine)
+{
+    store_release(engine->sq_tail, engine->sq_local_tail);
+    return engine->sq_local_tail - load_acquire(engine->sq_head);
+}
+
+/**
+ * Gets the next free SQE, submitting already prepared ones if the submission queue is full.
+ *
+ * @return  Pointer to a zeroed SQE.
+ *          NULL on error.
+ */
+static struct io_uring_sqe *get_sqe(struct uring_engine *engine)
+{
+    if (engine->sq_local_tail - load_acquire(engine->sq_head) >= engine->sq_entries)
+    {
+        unsigned to_submit = flush_sq(engine);
+        if (io_uring_enter(engine->ring_fd, to_submit, 0, 0) == -1)
+        {
+            LOG_ERROR("failed to submit full submission queue: %s", strerror(errno));
+            return NULL;
+        }
+        if (engine->sq_local_tail - load_acquire(engine->sq_head) >= engine->sq_entries)
+        {
+            LOG_ERROR("submission queue still full after submitting");
+            return NULL;
+        }
+    }
+
+    unsigned index = engine->sq_local_tail & engine->sq_mask;
+    struct io_uring_sqe *sqe = &engine->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    engine->sq_array[index] = index;
+    engine->sq_local_tail++;
+
+    return sqe;
+}
+
+/**
+ * Maps the rings shared with the kernel.
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int map_rings(struct uring_engine *engine, struct io_uring_params *p)
+{
+    engine->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    engine->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if (p->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (engine->cq_ring_size > engine->sq_ring_size)
+            engine->sq_ring_size = engine->cq_ring_size;
+        engine->cq_ring_size = 0;
+    }
+
+    engine->sq_ring_ptr = mmap(NULL, engine->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               engine->ring_fd, IORING_OFF_SQ_RING);
+    if (engine->sq_ring_ptr == MAP_FAILED)
+    {
+        LOG_ERROR("failed to map submission queue ring: %s", strerror(errno));
+        return -1;
+    }
+
+    if (engine->cq_ring_size == 0)
+        engine->cq_ring_ptr = engine->sq_ring_ptr;
+    else
+    {
+        engine->cq_ring_ptr = mmap(NULL, engine->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                   engine->ring_fd, IORING_OFF_CQ_RING);
+        if (engine->cq_ring_ptr == MAP_FAILED)
+        {
+            LOG_ERROR("failed to map completion queue ring: %s", strerror(errno));
+            munmap(engine->sq_ring_ptr, engine->sq_ring_size);
+            return -1;
+        }
+    }
+
+    engine->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    engine->sqes = mmap(NULL, engine->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, engine->ring_fd,
+                        IORING_OFF_SQES);
+    if (engine->sqes == MAP_FAILED)
+    {
+        LOG_ERROR("failed to map submission queue entries: %s", strerror(errno));
+        if (engine->cq_ring_size != 0)
+            munmap(engine->cq_ring_ptr, engine->cq_ring_size);
+        munmap(engine->sq_ring_ptr, engine->sq_ring_size);
+        return -1;
+    }
+
+    char *sq = engine->sq_ring_ptr;
+    engine->sq_head = (unsigned *)(sq + p->sq_off.head);
+    engine->sq_tail = (unsigned *)(sq + p->sq_off.tail);
+    engine->sq_mask = *(unsigned *)(sq + p->sq_off.ring_mask);
+    engine->sq_array = (unsigned *)(sq + p->sq_off.array);
+    engine->sq_entries = p->sq_entries;
+    engine->sq_local_tail = *engine->sq_tail;
+
+    char *cq = engine->cq_ring_ptr;
+    engine->cq_head = (unsigned *)(cq + p->cq_off.head);
+    engine->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+    engine->cq_mask = *(unsigned *)(cq + p->cq_off.ring_mask);
+    engine->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+
+    return 0;
+}
+
+/**
+ * Allocates the provided buffers and registers the ring they are handed to the kernel through.
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int register_buf_ring(struct uring_engine *engine, uint32_t num_bufs, uint32_t buf_size)
+{
+    engine->buf_ring_size = num_bufs * sizeof(struct io_uring_buf);
+    engine->buf_ring = mmap(NULL, engine->buf_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (engine->buf_ring == MAP_FAILED)
+    {
+        LOG_ERROR("failed to allocate provided buffer ring: %s", strerror(errno));
+        return -1;
+    }
+
+    if ((engine->bufs = malloc((size_t)num_bufs * buf_size)) == NULL)
+    {
+        LOG_ERROR("failed to allocate space for %d provided buffers", num_bufs);
+        munmap(engine->buf_ring, engine->buf_ring_size);
+        return -1;
+    }
+    engine->num_bufs = num_bufs;
+    engine->buf_size = buf_size;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)engine->buf_ring;
+    reg.ring_entries = num_bufs;
+    reg.bgid = BUF_GROUP_ID;
+    if (io_uring_register(engine->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    {
+        LOG_ERROR("failed to register provided buffer ring: %s", strerror(errno));
+        free(engine->bufs);
+        munmap(engine->buf_ring, engine->buf_ring_size);
+        return -1;
+    }
+
+    engine->buf_tail = 0;
+    for (uint32_t i = 0; i < num_bufs; i++)
+        uring_engine_return_buffer(engine, i);
+
+    return 0;
+}
+
+struct uring_engine *uring_engine_init(unsigned entries, uint32_t num_bufs, uint32_t buf_size)
+{
+    struct uring_engine *engine = calloc(1, sizeof(struct uring_engine));
+    if (engine == NULL)
+    {
+        LOG_ERROR("failed to allocate space for io_uring engine");
+        return NULL;
+    }
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    p.cq_entries = entries * CQ_ENTRIES_PER_SQ_ENTRY;
+    if ((engine->ring_fd = io_uring_setup(entries, &p)) == -1)
+    {
+        LOG_ERROR("failed to set up io_uring instance: %s", strerror(errno));
+        free(engine);
+        return NULL;
+    }
+
+    if (!(p.features & IORING_FEAT_NODROP))
+    {
+        LOG_ERROR("kernel io_uring does not guarantee completions are not dropped");
+        close(engine->ring_fd);
+        free(engine);
+        return NULL;
+    }
+
+    if (map_rings(engine, &p) != 0)
+    {
+        close(engine->ring_fd);
+        free(engine);
+        return NULL;
+    }
+
+    if (register_buf_ring(engine, num_bufs, buf_size) != 0)
+    {
+        engine->buf_ring = NULL;
+        uring_engine_free(engine);
+        return NULL;
+    }
+
+    return engine;
+}
+
+void uring_engine_free(struct uring_engine *engine)
+{
+    close(engine->ring_fd);
+    munmap(engine->sqes, engine->sqes_size);
+    if (engine->cq_ring_ptr != engine->sq_ring_ptr)
+        munmap(engine->cq_ring_ptr, engine->cq_ring_size);
+    munmap(engine->sq_ring_ptr, engine->sq_ring_size);
+    if (engine->buf_ring != NULL)
+    {
+        munmap(engine->buf_ring, engine->buf_ring_size);
+        free(engine->bufs);
+    }
+    free(engine);
+}
+
+int uring_engine_prep_accept(struct uring_engine *engine, int listener)
+{
+    struct io_uring_sqe *sqe = get_sqe(engine);
+    if (sqe == NULL)
+        return -1;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listener;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = encode_user_data(URING_OP_ACCEPT, NULL);
+
+    return 0;
+}
+
+int uring_engine_prep_recv(struct uring_engine *engine, int fd, void *ctx)
+{
+    struct io_uring_sqe *sqe = get_sqe(engine);
+    if (sqe == NULL)
+        return -1;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP_ID;
+    sqe->user_data = encode_user_data(URING_OP_RECV, ctx);
+
+    return 0;
+}
+
+int uring_engine_prep_send(struct uring_engine *engine, int fd, const char *buf, size_t len, void *ctx)
+{
+    struct io_uring_sqe *sqe = get_sqe(engine);
+    if (sqe == NULL)
+        return -1;
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL; // MSG_WAITALL makes the kernel retry short sends
+    sqe->user_data = encode_user_data(URING_OP_SEND, ctx);
+
+    return 0;
+}
+
+int uring_engine_prep_sendmsg(struct uring_engine *engine, int fd, const struct msghdr *msg, void *ctx)
+{
+    struct io_uring_sqe *sqe = get_sqe(engine);
+    if (sqe == NULL)
+        return -1;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    sqe->user_data = encode_user_data(URING_OP_SEND, ctx);
+
+    return 0;
+}
+
+int uring_engine_prep_poll(struct uring_engine *engine, int fd, void *ctx)
+{
+    struct io_uring_sqe *sqe = get_sqe(engine);
+    if (sqe == NULL)
+        return -1;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = encode_user_data(URING_OP_POLL, ctx);
+
+    return 0;
+}
+
+int uring_engine_prep_cancel_recv(struct uring_engine *engine, void *ctx)
+{
+    struct io_uring_sqe *sqe = get_sqe(engine);
+    if (sqe == NULL)
+        return -1;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = encode_user_data(URING_OP_RECV, ctx);
+    sqe->user_data = encode_user_data(URING_OP_CANCEL, ctx);
+
+    return 0;
+}
+
+int uring_engine_submit_and_wait(struct uring_engine *engine, unsigned wait_nr)
+{
+    unsigned to_submit = flush_sq(engine);
+
+    int submitted = io_uring_enter(engine->ring_fd, to_submit, wait_nr, IORING_ENTER_GETEVENTS);
+    if (submitted == -1)
+    {
+        if (errno == EINTR)
+            return 0; // SQEs that were not consumed are submitted by the next call
+        LOG_ERROR("failed to submit to io_uring instance: %s", strerror(errno));
+        return -1;
+    }
+
+    return submitted;
+}
+
+int uring_engine_reap(struct uring_engine *engine, struct uring_completion *completions, int max)
+{
+    unsigned head = *engine->cq_head;
+    unsigned tail = load_acquire(engine->cq_tail);
+
+    int n = 0;
+    while (head != tail && n < max)
+    {
+        struct io_uring_cqe *cqe = &engine->cqes[head & engine->cq_mask];
+        struct uring_completion *c = &completions[n++];
+
+        c->op = (enum uring_op)(cqe->user_data & OP_MASK);
+        c->ctx = (void *)(uintptr_t)(cqe->user_data & ~OP_MASK);
+        c->res = cqe->res;
+        c->more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+        c->buf = NULL;
+        c->buf_id = 0;
+        if (cqe->flags & IORING_CQE_F_BUFFER)
+        {
+            c->buf_id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            c->buf = engine->bufs + (size_t)c->buf_id * engine->buf_size;
+        }
+
+        head++;
+    }
+    store_release(engine->cq_head, head);
+
+    return n;
+}
+
+void uring_engine_return_buffer(struct uring_engine *engine, uint16_t buf_id)
+{
+    struct io_uring_buf *buf = &engine->buf_ring->bufs[engine->buf_tail & (engine->num_bufs - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(engine->bufs + (size_t)buf_id * engine->buf_size);
+    buf->len = engine->buf_size;
+    buf->bid = buf_id;
+    engine->buf_tail++;
+    store_release(&engine->buf_ring->tail, engine->buf_tail);
+}
@@ -0,0 +1,197 @@
+#ifndef URING_ENGINE_H
+#define URING_ENGINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+
+// The kinds of operations the engine submits
+enum uring_op
+{
+    URING_OP_ACCEPT, // Multishot accept on a listener socket
+    URING_OP_RECV,   // Multishot recv into buffers picked from the engine's provided buffer ring
+    URING_OP_SEND,   // Single send (or gather send) of caller-owned buffers
+    URING_OP_CANCEL, // Cancellation of a multishot recv
+    URING_OP_POLL,   // Multishot poll for readability, used for fds which are not sockets
+};
+
+// A finished (or, for multishot operations, progressed) operation reported by uring_engine_reap()
+struct uring_completion
+{
+    enum uring_op op;
+    void *ctx;       // Context pointer the operation was submitted with
+    int32_t res;     // Result of the operation (accepted fd, bytes received/sent or -errno)
+    bool more;       // For multishot operations, true if the operation is still armed and will complete again
+    char *buf;       // For URING_OP_RECV, the provided buffer holding the res received bytes, NULL if none was used
+    uint16_t buf_id; // Id of buf, which must be handed back with uring_engine_return_buffer() once consumed
+};
+
+// An io_uring instance driven through the raw kernel interface, plus a ring of provided receive buffers
+struct uring_engine
+{
+    int ring_fd;
+
+    // Submission queue
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_local_tail; // Tail including SQEs that have been prepared but not yet published to the kernel
+    unsigned sq_entries;
+
+    // Completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // Provided buffer ring used by multishot recv
+    struct io_uring_buf_ring *buf_ring;
+    char *bufs;
+    uint32_t num_bufs;
+    uint32_t buf_size;
+    uint16_t buf_tail; // Tail including buffers that have been returned but not yet published to the kernel
+
+    // Mappings to release on free
+    void *sq_ring_ptr;
+    size_t sq_ring_size;
+    void *cq_ring_ptr;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    size_t buf_ring_size;
+};
+
+/**
+ * Initializes an io_uring instance with room for entries submissions and registers a ring of num_bufs provided
+ * buffers, each buf_size bytes long, for multishot receives.
+ *
+ * The returned struct should be freed with uring_engine_free() when no longer needed.
+ *
+ * @param entries   Number of submission queue entries, must be a power of 2
+ * @param num_bufs  Number of provided receive buffers, must be a power of 2
+ * @param buf_size  Size of each provided receive buffer in bytes
+ *
+ * @return  Pointer to the engine on success.
+ *          NULL if the kernel does not support the features needed or initialization fails.
+ */
+struct uring_engine *uring_engine_init(unsigned entries, uint32_t num_bufs, uint32_t buf_size);
+
+/**
+ * Tears down the io_uring instance and frees the engine. Outstanding operations are cancelled by the kernel.
+ *
+ * @param engine    Pointer to the engine
+ */
+void uring_engine_free(struct uring_engine *engine);
+
+/**
+ * Prepares a multishot accept on listener. Every accepted connection completes with the new socket fd as its result.
+ *
+ * @param engine    Pointer to the engine
+ * @param listener  The listening socket
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int uring_engine_prep_accept(struct uring_engine *engine, int listener);
+
+/**
+ * Prepares a multishot recv on fd. Each chunk of received data completes with a provided buffer holding it.
+ *
+ * @param engine    Pointer to the engine
+ * @param fd        The socket to receive on
+ * @param ctx       Context pointer reported with each completion, must be aligned to 8 bytes
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int uring_engine_prep_recv(struct uring_engine *engine, int fd, void *ctx);
+
+/**
+ * Prepares a send of len bytes of buf on fd. The operation only completes once every byte has been sent or an error
+ * occurs. buf must stay valid until the operation completes.
+ *
+ * @param engine    Pointer to the engine
+ * @param fd        The socket to send on
+ * @param buf       Pointer to the data to send
+ * @param len       Number of bytes to send
+ * @param ctx       Context pointer reported with the completion, must be aligned to 8 bytes
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int uring_engine_prep_send(struct uring_engine *engine, int fd, const char *buf, size_t len, void *ctx);
+
+/**
+ * Prepares a gather send on fd of the buffers described by msg. The operation only completes once every byte has been
+ * sent or an error occurs. msg and the buffers it points to must stay valid until the operation completes.
+ *
+ * @param engine    Pointer to the engine
+ * @param fd        The socket to send on
+ * @param msg       Pointer to a message header describing the buffers to send
+ * @param ctx       Context pointer reported with the completion, must be aligned to 8 bytes
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int uring_engine_prep_sendmsg(struct uring_engine *engine, int fd, const struct msghdr *msg, void *ctx);
+
+/**
+ * Prepares a multishot poll for readability of fd. Every time fd becomes readable the operation completes, and the
+ * caller is expected to read from fd itself.
+ *
+ * @param engine    Pointer to the engine
+ * @param fd        The fd to watch
+ * @param ctx       Context pointer reported with each completion, must be aligned to 8 bytes
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int uring_engine_prep_poll(struct uring_engine *engine, int fd, void *ctx);
+
+/**
+ * Prepares the cancellation of the multishot recv submitted with ctx. The recv then completes with -ECANCELED (unless
+ * it has already finished).
+ *
+ * @param engine    Pointer to the engine
+ * @param ctx       Context pointer the recv was submitted with
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int uring_engine_prep_cancel_recv(struct uring_engine *engine, void *ctx);
+
+/**
+ * Submits every prepared operation and waits until at least wait_nr operations have completed, all in one system call.
+ *
+ * @param engine    Pointer to the engine
+ * @param wait_nr   Number of completions to wait for
+ *
+ * @return  Number of operations submitted on success.
+ *          -1 on error.
+ */
+int uring_engine_submit_and_wait(struct uring_engine *engine, unsigned wait_nr);
+
+/**
+ * Removes up to max completions from the completion queue and stores them in completions. Does not block.
+ *
+ * @param engine        Pointer to the engine
+ * @param completions   Pointer to an array which will store the completions
+ * @param max           Number of elements in completions
+ *
+ * @return  Number of completions stored.
+ */
+int uring_engine_reap(struct uring_engine *engine, struct uring_completion *completions, int max);
+
+/**
+ * Hands a provided buffer reported by a URING_OP_RECV completion back to the kernel so it can be filled again.
+ *
+ * @param engine    Pointer to the engine
+ * @param buf_id    Id of the buffer
+ */
+void uring_engine_return_buffer(struct uring_engine *engine, uint16_t buf_id);
+
+#endif
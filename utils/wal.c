@@ -0,0 +1,541 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+#include "log_segment.h"
+#include "wal.h"
+#include "../lib/log.h"
+
+#define WAL_SUFFIX ".wal"
+#define WAL_BUFFER_MIN_SIZE (64 * 1024) // Size of the first buffer the records of a commit are collected in
+
+/**
+ * Creates a directory and any missing parents.
+ *
+ * @param path  Path of the directory
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int make_dirs(const char *path)
+{
+    char partial[PATH_MAX];
+    if (snprintf(partial, PATH_MAX, "%s", path) >= PATH_MAX)
+    {
+        LOG_ERROR("path %s too long", path);
+        return -1;
+    }
+
+    for (char *slash = strchr(partial + 1, '/');; slash = strchr(slash + 1, '/'))
+    {
+        if (slash != NULL)
+            *slash = '\0';
+        if (mkdir(partial, 0755) == -1 && errno != EEXIST)
+        {
+            LOG_ERROR("failed to create %s: %s", partial, strerror(errno));
+            return -1;
+        }
+        if (slash == NULL)
+            return 0;
+        *slash = '/';
+    }
+}
+
+/**
+ * Builds the path of a segment of a WAL.
+ *
+ * @param path  Pointer to a buffer of PATH_MAX bytes which will store the path
+ * @param wal   Pointer to the WAL
+ * @param lsn   LSN of the segment's first record
+ *
+ * @return  0 on success.
+ *          -1 if the path is too long.
+ */
+static int segment_path(char *path, const struct wal *wal, uint64_t lsn)
+{
+    if (snprintf(path, PATH_MAX, "%s/%020" PRIu64 WAL_SUFFIX, wal->dir, lsn) >= PATH_MAX)
+    {
+        LOG_ERROR("path of WAL segment %" PRIu64 " in %s too long", lsn, wal->dir);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Writes a whole buffer to a file at an offset, retrying partial writes.
+ *
+ * @param fd        The file
+ * @param data      Pointer to the bytes
+ * @param len       Number of bytes
+ * @param offset    Offset to write at
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int pwrite_all(int fd, const char *data, size_t len, off_t offset)
+{
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, data, len, offset);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+        offset += n;
+    }
+
+    return 0;
+}
+
+/**
+ * Creates a segment, allocated in full, and makes it the WAL's current one. The segment and its directory entry are
+ * synced, so later syncs only have records to write.
+ *
+ * @param wal   Pointer to the WAL
+ * @param lsn   LSN of the segment's first record
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int create_segment(struct wal *wal, uint64_t lsn)
+{
+    char path[PATH_MAX];
+    if (segment_path(path, wal, lsn) != 0)
+        return -1;
+
+    if (wal->num_segments == wal->segments_cap)
+    {
+        size_t cap = wal->segments_cap == 0 ? 16 : 2 * wal->segments_cap;
+        uint64_t *segments = realloc(wal->segments, cap * sizeof(uint64_t));
+        if (segments == NULL)
+        {
+            LOG_ERROR("failed to allocate space for the segments of %s", wal->dir);
+            return -1;
+        }
+        wal->segments = segments;
+        wal->segments_cap = cap;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        LOG_ERROR("failed to create %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    int status = posix_fallocate(fd, 0, WAL_SEGMENT_SIZE);
+    if (status != 0 || fsync(fd) == -1)
+    {
+        LOG_ERROR("failed to allocate %s: %s", path, strerror(status != 0 ? status : errno));
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    int dir_fd = open(wal->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1 || fsync(dir_fd) == -1)
+        LOG_WARN("failed to sync %s: %s", wal->dir, strerror(errno));
+    if (dir_fd != -1)
+        close(dir_fd);
+
+    wal->fd = fd;
+    wal->used = 0;
+    wal->segments[wal->num_segments++] = lsn;
+
+    return 0;
+}
+
+/**
+ * Closes the current segment of a WAL, syncing it first unless the WAL is never synced, and starts a new one.
+ *
+ * @param wal   Pointer to the WAL
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+static int next_segment(struct wal *wal)
+{
+    pthread_mutex_lock(&wal->lock);
+    uint64_t written = atomic_load(&wal->written);
+    int status = 0;
+    if (wal->policy != WAL_SYNC_NEVER && written != atomic_load(&wal->synced))
+    {
+        if (fdatasync(wal->fd) == -1)
+        {
+            LOG_ERROR("failed to sync the WAL in %s: %s", wal->dir, strerror(errno));
+            status = -1;
+        }
+        else
+        {
+            atomic_store(&wal->synced, written);
+            atomic_fetch_add_explicit(&wal->syncs, 1, memory_order_relaxed);
+        }
+    }
+    if (status == 0)
+    {
+        close(wal->fd);
+        wal->fd = -1;
+        status = create_segment(wal, written);
+    }
+    pthread_mutex_unlock(&wal->lock);
+
+    return status;
+}
+
+/**
+ * Computes the checksum of a record.
+ *
+ * @param header    Pointer to the record's header
+ * @param data      Pointer to the record's data
+ *
+ * @return  The checksum.
+ */
+static uint32_t record_crc(const struct wal_record_header *header, const char *data)
+{
+    return crc32c(crc32c(0, header, offsetof(struct wal_record_header, crc)), data, header->len);
+}
+
+int wal_parse_policy(const char *name, enum wal_sync_policy *policy)
+{
+    if (strcmp(name, "always") == 0)
+        *policy = WAL_SYNC_ALWAYS;
+    else if (strcmp(name, "batch") == 0)
+        *policy = WAL_SYNC_BATCH;
+    else if (strcmp(name, "interval") == 0)
+        *policy = WAL_SYNC_INTERVAL;
+    else if (strcmp(name, "never") == 0)
+        *policy = WAL_SYNC_NEVER;
+    else
+        return -1;
+
+    return 0;
+}
+
+size_t wal_record_size(size_t len)
+{
+    return (sizeof(struct wal_record_header) + len + WAL_RECORD_ALIGN - 1) & ~(size_t)(WAL_RECORD_ALIGN - 1);
+}
+
+struct wal *wal_open(const char *dir, enum wal_sync_policy policy)
+{
+    struct wal *wal = calloc(1, sizeof(struct wal));
+    if (wal == NULL)
+    {
+        LOG_ERROR("failed to allocate space for the WAL in %s", dir);
+        return NULL;
+    }
+    wal->policy = policy;
+    wal->fd = -1;
+
+    if ((wal->dir = strdup(dir)) == NULL || make_dirs(dir) != 0)
+        goto free_wal;
+
+    // Segments of an earlier run are kept until their records are safe elsewhere, and new LSNs follow theirs
+    size_t n;
+    if (log_segment_list_files(dir, WAL_SUFFIX, &wal->segments, &n) != 0)
+        goto free_wal;
+    wal->num_segments = n;
+    wal->segments_cap = n;
+    wal->lsn = n > 0 ? wal->segments[n - 1] + WAL_SEGMENT_SIZE : 0;
+
+    if (create_segment(wal, wal->lsn) != 0)
+        goto free_wal;
+
+    pthread_mutex_init(&wal->lock, NULL);
+    atomic_init(&wal->written, wal->lsn);
+    atomic_init(&wal->synced, wal->lsn);
+    atomic_init(&wal->records, 0);
+    atomic_init(&wal->commits, 0);
+    atomic_init(&wal->syncs, 0);
+
+    return wal;
+
+free_wal:
+    free(wal->segments);
+    free(wal->dir);
+    free(wal);
+    return NULL;
+}
+
+void wal_close(struct wal *wal)
+{
+    if (wal->fd != -1)
+        close(wal->fd);
+    pthread_mutex_destroy(&wal->lock);
+    free(wal->buf);
+    free(wal->segments);
+    free(wal->dir);
+    free(wal);
+}
+
+uint64_t wal_append(struct wal *wal, ROOM_ID room, uint64_t seq, const char *data, size_t len)
+{
+    size_t size = wal_record_size(len);
+    if (size > WAL_SEGMENT_SIZE)
+    {
+        LOG_ERROR("message of %zu bytes too large for the WAL", len);
+        return 0;
+    }
+
+    if (wal->len + size > wal->cap)
+    {
+        size_t cap = wal->cap == 0 ? WAL_BUFFER_MIN_SIZE : wal->cap;
+        while (cap < wal->len + size)
+            cap *= 2;
+        char *buf = realloc(wal->buf, cap);
+        if (buf == NULL)
+        {
+            LOG_ERROR("failed to allocate space for the WAL in %s", wal->dir);
+            return 0;
+        }
+        wal->buf = buf;
+        wal->cap = cap;
+    }
+
+    struct wal_record_header header = {seq, room, (uint32_t)len, 0, 0};
+    header.crc = record_crc(&header, data);
+
+    char *record = wal->buf + wal->len;
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), data, len);
+    memset(record + sizeof(header) + len, 0, size - sizeof(header) - len);
+    wal->len += size;
+    wal->count++;
+    wal->lsn += size;
+
+    return wal->lsn;
+}
+
+bool wal_pending(const struct wal *wal)
+{
+    return wal->len > 0;
+}
+
+int wal_commit(struct wal *wal)
+{
+    if (wal->len == 0)
+        return 0;
+
+    for (size_t offset = 0; offset < wal->len;)
+    {
+        // Records never span segments: take the ones which fit in what is left of the current segment
+        size_t end = offset;
+        while (end < wal->len)
+        {
+            const struct wal_record_header *header = (const struct wal_record_header *)(wal->buf + end);
+            size_t size = wal_record_size(header->len);
+            if (wal->used + (end - offset) + size > WAL_SEGMENT_SIZE)
+                break;
+            end += size;
+        }
+        if (end == offset)
+        {
+            if (next_segment(wal) != 0)
+                return -1;
+            continue;
+        }
+
+        if (pwrite_all(wal->fd, wal->buf + offset, end - offset, wal->used) != 0)
+        {
+            LOG_ERROR("failed to write to the WAL in %s: %s", wal->dir, strerror(errno));
+            return -1;
+        }
+        wal->used += end - offset;
+        atomic_fetch_add(&wal->written, end - offset);
+        offset = end;
+    }
+    atomic_fetch_add_explicit(&wal->records, wal->count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&wal->commits, 1, memory_order_relaxed);
+    wal->len = 0;
+    wal->count = 0;
+
+    if (wal->policy == WAL_SYNC_ALWAYS || wal->policy == WAL_SYNC_BATCH)
+        return wal_sync(wal);
+
+    return 0;
+}
+
+int wal_sync(struct wal *wal)
+{
+    int status = 0;
+    pthread_mutex_lock(&wal->lock);
+    uint64_t written = atomic_load(&wal->written);
+    if (written != atomic_load(&wal->synced))
+    {
+        if (fdatasync(wal->fd) == -1)
+        {
+            LOG_ERROR("failed to sync the WAL in %s: %s", wal->dir, strerror(errno));
+            status = -1;
+        }
+        else
+        {
+            atomic_store(&wal->synced, written);
+            atomic_fetch_add_explicit(&wal->syncs, 1, memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&wal->lock);
+
+    return status;
+}
+
+void wal_release(struct wal *wal, uint64_t lsn)
+{
+    // A segment's records end where the next segment's start
+    size_t released = 0;
+    while (released + 1 < wal->num_segments && wal->segments[released + 1] <= lsn)
+    {
+        char path[PATH_MAX];
+        if (segment_path(path, wal, wal->segments[released]) == 0 && unlink(path) == -1)
+            LOG_WARN("failed to delete %s: %s", path, strerror(errno));
+        released++;
+    }
+
+    if (released > 0)
+    {
+        wal->num_segments -= released;
+        memmove(wal->segments, wal->segments + released, wal->num_segments * sizeof(uint64_t));
+    }
+}
+
+int wal_list_segments(const char *dir, uint64_t **lsns, size_t *n)
+{
+    return log_segment_list_files(dir, WAL_SUFFIX, lsns, n);
+}
+
+int wal_segment_open(struct wal_segment *seg, const char *dir, uint64_t lsn)
+{
+    char path[PATH_MAX];
+    if (snprintf(path, PATH_MAX, "%s/%020" PRIu64 WAL_SUFFIX, dir, lsn) >= PATH_MAX)
+    {
+        LOG_ERROR("path of WAL segment %" PRIu64 " in %s too long", lsn, dir);
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        LOG_ERROR("failed to open %s: %s", path, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+
+    seg->lsn = lsn;
+    seg->size = st.st_size;
+    seg->end = 0;
+    seg->map = NULL;
+    if (seg->size > 0 && (seg->map = mmap(NULL, seg->size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        LOG_ERROR("failed to map %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    // Records are written in order, so the first one which is missing or torn ends the segment
+    if (seg->map != NULL)
+        madvise(seg->map, seg->size, MADV_SEQUENTIAL);
+    while (seg->end + sizeof(struct wal_record_header) <= seg->size)
+    {
+        const struct wal_record_header *header = (const struct wal_record_header *)(seg->map + seg->end);
+        if (header->seq == 0 || wal_record_size(header->len) > seg->size - seg->end ||
+            record_crc(header, (const char *)(header + 1)) != header->crc)
+            break;
+        seg->end += wal_record_size(header->len);
+    }
+
+    return 0;
+}
+
+void wal_segment_close(struct wal_segment *seg)
+{
+    if (seg->map != NULL)
+        munmap(seg->map, seg->size);
+    seg->map = NULL;
+}
+
+const struct wal_record_header *wal_segment_record(const struct wal_segment *seg, size_t offset)
+{
+    if (offset >= seg->end)
+        return NULL;
+
+    return (const struct wal_record_header *)(seg->map + offset);
+}
+
+void wal_remove(const char *dir)
+{
+    uint64_t *lsns;
+    size_t n;
+    if (wal_list_segments(dir, &lsns, &n) != 0)
+        return;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        char path[PATH_MAX];
+        if (snprintf(path, PATH_MAX, "%s/%020" PRIu64 WAL_SUFFIX, dir, lsns[i]) < PATH_MAX && unlink(path) == -1)
+            LOG_WARN("failed to delete %s: %s", path, strerror(errno));
+    }
+    free(lsns);
+    if (rmdir(dir) == -1 && errno != ENOENT)
+        LOG_WARN("failed to delete %s: %s", dir, strerror(errno));
+}
+
+/**
+ * Runs a syncing thread: syncs its WALs every interval until it is stopped.
+ *
+ * @param arg   Pointer to the syncer
+ *
+ * @return  Nothing.
+ */
+static void *run_syncer(void *arg)
+{
+    struct wal_syncer *syncer = arg;
+    struct timespec interval = {syncer->interval_ms / 1000, (long)(syncer->interval_ms % 1000) * 1000000};
+
+    while (!atomic_load(&syncer->stopping))
+    {
+        nanosleep(&interval, NULL);
+        for (size_t i = 0; i < syncer->num_wals; i++)
+            wal_sync(syncer->wals[i]);
+    }
+
+    return NULL;
+}
+
+int wal_syncer_start(struct wal_syncer *syncer, struct wal **wals, size_t num_wals, unsigned interval_ms)
+{
+    syncer->wals = wals;
+    syncer->num_wals = num_wals;
+    syncer->interval_ms = interval_ms;
+    atomic_init(&syncer->stopping, false);
+
+    int status = pthread_create(&syncer->thread, NULL, run_syncer, syncer);
+    if (status != 0)
+    {
+        LOG_ERROR("failed to start the WAL syncer: %s", strerror(status));
+        return -1;
+    }
+
+    return 0;
+}
+
+void wal_syncer_stop(struct wal_syncer *syncer)
+{
+    atomic_store(&syncer->stopping, true);
+    pthread_join(syncer->thread, NULL);
+}
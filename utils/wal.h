@@ -0,0 +1,259 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../types/messages/join_message.h"
+
+#define WAL_SEGMENT_SIZE (16 * 1024 * 1024) // Size every segment file is allocated with when it is created
+#define WAL_RECORD_ALIGN 8                  // Records start at multiples of this many bytes of their segment
+
+// When the messages written to a WAL are synced to the disk, and whether their delivery waits for it
+enum wal_sync_policy
+{
+    WAL_SYNC_ALWAYS,   // Each message is written and synced on its own, and delivered once it is
+    WAL_SYNC_BATCH,    // The messages of an event loop iteration are written and synced together, then delivered
+    WAL_SYNC_INTERVAL, // Messages are written every iteration and delivered at once, and a thread syncs them regularly
+    WAL_SYNC_NEVER,    // Messages are written every iteration and delivered at once, and the kernel syncs them later
+};
+
+// Header of a record in a WAL segment, followed by the record's data and padding up to WAL_RECORD_ALIGN. Segments are
+// written in host byte order: they are read back by the host which wrote them.
+struct wal_record_header
+{
+    uint64_t seq;      // Sequence number of the message in its room, 0 where no record has been written
+    ROOM_ID room;      // Id of the message's room
+    uint32_t len;      // Length of the data in bytes
+    uint32_t crc;      // CRC-32C of the header before it and the data, which tells a complete record from a torn one
+    uint32_t reserved; // Zero
+};
+
+// A write-ahead log of the chat messages accepted by one reactor, in the order it accepted them. Messages appended to
+// it are collected in memory and written together by the next commit, with one write() and at most one fdatasync(),
+// so the cost of reaching the disk is shared by every message accepted in an event loop iteration (group commit).
+//
+// The log is a series of segment files of WAL_SEGMENT_SIZE bytes, allocated up front so syncing a write does not have
+// to update the file's size. Records are addressed by log sequence numbers (LSNs), which count the bytes of records
+// ever appended: a segment is named by the LSN of its first record, and holds the records up to the next one.
+//
+// Only the reactor owning the log touches it, apart from wal_sync(), which a syncing thread may call at any time.
+struct wal
+{
+    char *dir; // Directory holding the segments
+    enum wal_sync_policy policy;
+
+    pthread_mutex_t lock; // Held while syncing, and by the owner while it switches to a new segment
+    int fd;               // The current segment
+    size_t used;          // Bytes of records written to the current segment
+
+    uint64_t *segments; // LSNs of the first records of the segments kept, oldest first, the current one last
+    size_t num_segments;
+    size_t segments_cap;
+
+    char *buf;    // Records appended since the last commit
+    size_t len;   // Length of the records in buf
+    size_t cap;   // Size of buf
+    size_t count; // Number of records in buf
+    uint64_t lsn; // LSN just past the last record appended
+
+    atomic_uint_fast64_t written; // LSN just past the last record written to the current segment
+    atomic_uint_fast64_t synced;  // LSN just past the last record synced to the disk
+
+    atomic_uint_fast64_t records; // Records written
+    atomic_uint_fast64_t commits; // Commits which wrote records
+    atomic_uint_fast64_t syncs;   // fdatasync() calls
+};
+
+// A segment of a WAL mapped for reading, as recovery does after a restart
+struct wal_segment
+{
+    char *map;    // The segment
+    size_t size;  // Size of the mapping in bytes
+    uint64_t lsn; // LSN of the segment's first record, which names it
+    size_t end;   // Offset just past the last complete record
+};
+
+// A thread syncing a set of WALs at a fixed interval, for WAL_SYNC_INTERVAL
+struct wal_syncer
+{
+    struct wal **wals;
+    size_t num_wals;
+    unsigned interval_ms;
+    atomic_bool stopping;
+    pthread_t thread;
+};
+
+/**
+ * Parses the name of a WAL sync policy ("always", "batch", "interval" or "never").
+ *
+ * @param name      The name of the policy
+ * @param policy    Pointer to a policy which will store the result
+ *
+ * @return  0 on success.
+ *          -1 if the name is not a known policy.
+ */
+int wal_parse_policy(const char *name, enum wal_sync_policy *policy);
+
+/**
+ * Gets the number of bytes a record takes up in a WAL segment, header and padding included.
+ *
+ * @param len   Length of the record's data in bytes
+ *
+ * @return  Size of the record in bytes.
+ */
+size_t wal_record_size(size_t len);
+
+/**
+ * Opens a WAL in a directory, creating the directory if needed, and starts a new segment. Segments left in it by an
+ * earlier run are kept, and new records get LSNs past theirs.
+ *
+ * The returned struct should be freed with wal_close() when no longer needed.
+ *
+ * @param dir       Path of the directory
+ * @param policy    When the records written are synced
+ *
+ * @return  Pointer to the WAL on success.
+ *          NULL on error.
+ */
+struct wal *wal_open(const char *dir, enum wal_sync_policy policy);
+
+/**
+ * Closes a WAL and frees it. Records appended since the last commit are lost.
+ *
+ * @param wal   Pointer to the WAL
+ */
+void wal_close(struct wal *wal);
+
+/**
+ * Appends a message to the records the next commit writes.
+ *
+ * @param wal   Pointer to the WAL
+ * @param room  Id of the message's room
+ * @param seq   Sequence number of the message in its room
+ * @param data  Pointer to the serialized message
+ * @param len   Length of the message in bytes
+ *
+ * @return  LSN just past the record on success.
+ *          0 on error.
+ */
+uint64_t wal_append(struct wal *wal, ROOM_ID room, uint64_t seq, const char *data, size_t len);
+
+/**
+ * Checks whether records were appended to a WAL since its last commit.
+ *
+ * @param wal   Pointer to the WAL
+ *
+ * @return  true if the next commit has records to write.
+ */
+bool wal_pending(const struct wal *wal);
+
+/**
+ * Writes the records appended since the last commit, with one write() per segment they go to, and syncs them with one
+ * fdatasync() if the WAL's policy is WAL_SYNC_ALWAYS or WAL_SYNC_BATCH.
+ *
+ * @param wal   Pointer to the WAL
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int wal_commit(struct wal *wal);
+
+/**
+ * Syncs the records written to a WAL's current segment, unless they are synced already. Safe to call from any thread.
+ *
+ * @param wal   Pointer to the WAL
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int wal_sync(struct wal *wal);
+
+/**
+ * Deletes the segments of a WAL whose records all end at or before an LSN, once those records are safe elsewhere.
+ * The current segment is always kept.
+ *
+ * @param wal   Pointer to the WAL
+ * @param lsn   The LSN
+ */
+void wal_release(struct wal *wal, uint64_t lsn);
+
+/**
+ * Lists the segments of a WAL, by the LSNs of their first records.
+ *
+ * @param dir   Path of the directory holding the segments
+ * @param lsns  Double pointer which will store an array of the LSNs in ascending order, which the caller frees with
+ *              free(), NULL if there are no segments
+ * @param n     Pointer which will store the number of segments
+ *
+ * @return  0 on success (including when the directory does not exist).
+ *          -1 on error.
+ */
+int wal_list_segments(const char *dir, uint64_t **lsns, size_t *n);
+
+/**
+ * Maps a segment of a WAL for reading and finds its last complete record, checking the checksum of every record.
+ *
+ * The segment should be closed with wal_segment_close() when no longer needed.
+ *
+ * @param seg   Pointer to the segment
+ * @param dir   Path of the directory holding the segment
+ * @param lsn   LSN of the segment's first record
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int wal_segment_open(struct wal_segment *seg, const char *dir, uint64_t lsn);
+
+/**
+ * Unmaps a segment opened with wal_segment_open().
+ *
+ * @param seg   Pointer to the segment
+ */
+void wal_segment_close(struct wal_segment *seg);
+
+/**
+ * Gets the record at an offset of a mapped segment. The record's data follows the header, and the next record starts
+ * wal_record_size(header->len) bytes after it.
+ *
+ * @param seg       Pointer to the segment
+ * @param offset    Offset of a record, or seg->end
+ *
+ * @return  Pointer to the record's header.
+ *          NULL if offset is seg->end.
+ */
+const struct wal_record_header *wal_segment_record(const struct wal_segment *seg, size_t offset);
+
+/**
+ * Deletes every segment of a WAL and its directory, once all its records are safe elsewhere.
+ *
+ * @param dir   Path of the directory holding the segments
+ */
+void wal_remove(const char *dir);
+
+/**
+ * Starts a thread syncing WALs every interval_ms milliseconds.
+ *
+ * The thread should be stopped with wal_syncer_stop() when no longer needed.
+ *
+ * @param syncer        Pointer to the syncer
+ * @param wals          Pointer to the WALs, which must outlive the thread
+ * @param num_wals      Number of WALs
+ * @param interval_ms   Milliseconds between syncs
+ *
+ * @return  0 on success.
+ *          -1 on error.
+ */
+int wal_syncer_start(struct wal_syncer *syncer, struct wal **wals, size_t num_wals, unsigned interval_ms);
+
+/**
+ * Stops a syncing thread after a last sync of its WALs.
+ *
+ * @param syncer    Pointer to the syncer
+ */
+void wal_syncer_stop(struct wal_syncer *syncer);
+
+#endif